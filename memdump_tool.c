@@ -0,0 +1,259 @@
+#include <stdio.h>    // 표준 입출력 함수를 사용하기 위해 포함.
+#include <string.h>   // 문자열 처리 함수를 사용하기 위해 포함.
+#include <stdlib.h>   // 표준 라이브러리 함수를 사용하기 위해 포함.
+#include <stdbool.h>  // boolean형을 쓰기 위해서 부른다.
+#include <stdint.h>   // 덤프 파일처럼 크기가 고정된 정수형이 필요할 때 쓴다.
+#include <fcntl.h>    // open 함수를 쓰기 위해 포함.
+#include <unistd.h>   // close 를 쓰기 위해 포함.
+#include <sys/mman.h> // 덤프 파일을 mmap 으로 읽기 위해 포함.
+#include <sys/stat.h> // 파일 크기를 알아내기 위해 포함.
+
+// risc_v_compiler --dump 로 만든 .dump 파일을 읽는다.
+// 사용법:
+//   memdump_tool info FILE                  머리, 페이지 수, 저장한 주소 수
+//   memdump_tool regs FILE                  레지스터와 pc
+//   memdump_tool read FILE ADDR [COUNT]     ADDR 부터 COUNT 개 주소의 값 (저장하지 않은 주소는 0)
+//   memdump_tool text FILE                  저장한 주소마다 "주소 값" 한 줄
+//   memdump_tool raw FILE ADDR COUNT OUT    ADDR 부터 COUNT 개 값을 OUT 에 4바이트(리틀 엔디언)씩 쓴다.
+// 메모리는 주소마다 int 하나이다. (주소 1 차이 = 값 하나)
+
+#define REGISTER_COUNT 32
+
+// 덤프 파일 머리 (risc_v_compiler 의 MemoryDumpHeader 와 같다)
+typedef struct
+{
+    char magic[4];        // "RVMD"
+    uint32_t version;     // 1
+    uint32_t pageWords;   // 페이지 하나의 주소 수
+    uint32_t pageCount;
+    int32_t pc;
+    uint32_t reserved;
+    int64_t steps;
+    int32_t registers[REGISTER_COUNT];
+} MemoryDumpHeader;
+
+// mmap 으로 연 덤프 파일
+typedef struct
+{
+    const MemoryDumpHeader *header;
+    const uint32_t *addresses; // 페이지마다 첫 주소 (주소 순서)
+    const unsigned char *pages;
+    size_t pageSize;           // 페이지 하나의 바이트 수 (값 + 표시 비트)
+} MemoryDump;
+
+bool openDump(const char *name, MemoryDump *dump)
+{
+    struct stat info;
+    int fd = open(name, O_RDONLY);
+    if (fd < 0 || fstat(fd, &info) != 0)
+    {
+        printf("we can't open the file %s\n", name);
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        return false;
+    }
+
+    size_t size = (size_t)info.st_size;
+    const unsigned char *data = (size >= sizeof(MemoryDumpHeader))
+                                    ? mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0)
+                                    : MAP_FAILED;
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        printf("%s is not a memory dump\n", name);
+        return false;
+    }
+
+    dump->header = (const MemoryDumpHeader *)data;
+    if (memcmp(dump->header->magic, "RVMD", 4) != 0 || dump->header->version != 1 || dump->header->pageWords == 0 ||
+        dump->header->pageWords % 64 != 0)
+    {
+        printf("%s is not a memory dump\n", name);
+        return false;
+    }
+
+    uint32_t pageCount = dump->header->pageCount;
+    size_t indexWords = pageCount + (pageCount & 1);
+    dump->pageSize = dump->header->pageWords * sizeof(int32_t) + dump->header->pageWords / 8;
+    dump->addresses = (const uint32_t *)(data + sizeof(MemoryDumpHeader));
+    dump->pages = data + sizeof(MemoryDumpHeader) + indexWords * sizeof(uint32_t);
+    if ((size_t)(dump->pages - data) + pageCount * dump->pageSize > size)
+    {
+        printf("%s is truncated\n", name);
+        return false;
+    }
+    return true;
+}
+
+// 주소가 들어있는 페이지 번호. 없으면 -1 (페이지 목록을 이진 탐색한다)
+long findPage(const MemoryDump *dump, uint32_t address)
+{
+    uint32_t base = address - address % dump->header->pageWords;
+    long low = 0;
+    long high = (long)dump->header->pageCount - 1;
+    while (low <= high)
+    {
+        long middle = (low + high) / 2;
+        if (dump->addresses[middle] == base)
+        {
+            return middle;
+        }
+        if (dump->addresses[middle] < base)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle - 1;
+        }
+    }
+    return -1;
+}
+
+const int32_t *pageValues(const MemoryDump *dump, long page)
+{
+    return (const int32_t *)(dump->pages + page * dump->pageSize);
+}
+
+const uint64_t *pageTouched(const MemoryDump *dump, long page)
+{
+    return (const uint64_t *)(dump->pages + page * dump->pageSize + dump->header->pageWords * sizeof(int32_t));
+}
+
+// ADDR 부터 count 개 값을 out 에 넣는다. 페이지 단위로 복사한다.
+void readRange(const MemoryDump *dump, uint32_t address, long long count, int32_t *out)
+{
+    uint32_t pageWords = dump->header->pageWords;
+    long long done = 0;
+    while (done < count)
+    {
+        uint32_t current = address + (uint32_t)done;
+        uint32_t offset = current % pageWords;
+        long long length = pageWords - offset;
+        if (length > count - done)
+        {
+            length = count - done;
+        }
+
+        long page = findPage(dump, current);
+        if (page < 0)
+        {
+            memset(out + done, 0, length * sizeof(int32_t));
+        }
+        else
+        {
+            memcpy(out + done, pageValues(dump, page) + offset, length * sizeof(int32_t));
+        }
+        done += length;
+    }
+}
+
+void printUsage(const char *program)
+{
+    printf("usage: %s info FILE\n", program);
+    printf("       %s regs FILE\n", program);
+    printf("       %s read FILE ADDR [COUNT]\n", program);
+    printf("       %s text FILE\n", program);
+    printf("       %s raw FILE ADDR COUNT OUT\n", program);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3)
+    {
+        printUsage(argv[0]);
+        return 2;
+    }
+
+    const char *command = argv[1];
+    MemoryDump dump;
+    if (!openDump(argv[2], &dump))
+    {
+        return 2;
+    }
+    const MemoryDumpHeader *header = dump.header;
+
+    if (strcmp(command, "info") == 0 && argc == 3)
+    {
+        long long stored = 0;
+        for (long page = 0; page < (long)header->pageCount; page++)
+        {
+            const uint64_t *touched = pageTouched(&dump, page);
+            for (uint32_t k = 0; k < header->pageWords / 64; k++)
+            {
+                stored += __builtin_popcountll(touched[k]);
+            }
+        }
+        printf("pc: %d\nsteps: %lld\npages: %u (%u words each)\nstored words: %lld\n", header->pc,
+               (long long)header->steps, header->pageCount, header->pageWords, stored);
+    }
+    else if (strcmp(command, "regs") == 0 && argc == 3)
+    {
+        printf("pc: %d\n", header->pc);
+        for (int r = 0; r < REGISTER_COUNT; r++)
+        {
+            printf("x%d: %d\n", r, header->registers[r]);
+        }
+    }
+    else if (strcmp(command, "read") == 0 && (argc == 4 || argc == 5))
+    {
+        uint32_t address = (uint32_t)strtoll(argv[3], NULL, 0);
+        long long count = (argc == 5) ? strtoll(argv[4], NULL, 0) : 1;
+        for (long long i = 0; i < count; i++)
+        {
+            int32_t value;
+            readRange(&dump, address + (uint32_t)i, 1, &value);
+            printf("%d %d\n", (int32_t)(address + (uint32_t)i), value);
+        }
+    }
+    else if (strcmp(command, "text") == 0 && argc == 3)
+    {
+        for (long page = 0; page < (long)header->pageCount; page++)
+        {
+            const int32_t *values = pageValues(&dump, page);
+            const uint64_t *touched = pageTouched(&dump, page);
+            for (uint32_t k = 0; k < header->pageWords; k++)
+            {
+                if (touched[k / 64] & (1ULL << (k % 64)))
+                {
+                    printf("%d %d\n", (int32_t)(dump.addresses[page] + k), values[k]);
+                }
+            }
+        }
+    }
+    else if (strcmp(command, "raw") == 0 && argc == 6)
+    {
+        uint32_t address = (uint32_t)strtoll(argv[3], NULL, 0);
+        long long count = strtoll(argv[4], NULL, 0);
+        FILE *out = fopen(argv[5], "wb");
+        if (out == NULL || count < 0)
+        {
+            printf("we can't open the file %s\n", argv[5]);
+            return 2;
+        }
+
+        // 페이지 하나씩 모아서 쓴다.
+        int32_t *buffer = malloc(header->pageWords * sizeof(int32_t));
+        for (long long done = 0; done < count;)
+        {
+            long long length = header->pageWords - (address + (uint32_t)done) % header->pageWords;
+            if (length > count - done)
+            {
+                length = count - done;
+            }
+            readRange(&dump, address + (uint32_t)done, length, buffer);
+            fwrite(buffer, sizeof(int32_t), (size_t)length, out);
+            done += length;
+        }
+        free(buffer);
+        fclose(out);
+    }
+    else
+    {
+        printUsage(argv[0]);
+        return 2;
+    }
+    return 0;
+}
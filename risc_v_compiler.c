@@ -4,45 +4,385 @@
 #include <stdlib.h>  // 표준 라이브러리 함수를 사용하기 위해 포함.
 #include <ctype.h>   // 주로 문자가 특정 유형인지 검사하거나 문자의 대소문자를 변환하는 함수들을 포함한다.
 #include <stdbool.h> // boolean형을 쓰기 위해서 부른다.
+#include <stdint.h>  // 체크포인트 파일처럼 크기가 고정된 정수형이 필요할 때 쓴다.
+#include <signal.h>  // SIGTERM을 받으면 체크포인트를 남기고 끝내기 위해 포함.
+#include <fcntl.h>   // open 함수를 쓰기 위해 포함.
+#include <unistd.h>  // close, fsync, ftruncate 등을 쓰기 위해 포함.
+#include <sys/mman.h> // 체크포인트 파일을 mmap으로 읽기 위해 포함.
+#include <sys/stat.h> // 파일 크기를 알아내기 위해 포함.
+#include <limits.h>   // LLONG_MAX 를 쓰기 위해 포함.
+#include <stdarg.h>   // 에러 메시지를 printf 형식으로 만들기 위해 포함.
+#include <pthread.h>  // 큰 파일을 여러 스레드로 나눠서 처리하기 위해 포함. (컴파일할 때 -pthread 필요)
+#include <errno.h>      // 데몬에서 accept 가 시그널로 끊겼는지 보기 위해 포함.
+#include <time.h>       // 데몬에서 요청마다 걸린 시간을 재기 위해 포함.
+#include <sys/socket.h> // 데몬 모드의 유닉스 도메인 소켓을 쓰기 위해 포함.
+#include <sys/un.h>
+#include <sys/wait.h>   // 데몬에서 죽은 워커를 다시 띄우기 위해 포함.
+#include <dirent.h>     // 데몬에서 임시 디렉터리에 생긴 결과 파일을 찾기 위해 포함.
+#include <sched.h>      // 메모리 trace 링이 가득 찼을 때 쓰기 스레드에 양보하기 위해 포함.
+#include <sys/resource.h> // --timing 에서 최대 RSS 를 알아내기 위해 포함.
+#include <sys/uio.h>      // ecall 의 read/write 를 게스트 메모리 페이지에 바로 하기 위해 포함. (readv, writev)
+#include <sys/syscall.h>  // openat2 를 부르기 위해 포함.
+#include <linux/openat2.h> // ecall 의 open 을 --io-dir 안으로 가두기 위해 포함. (RESOLVE_BENEATH)
+#include <sys/inotify.h>   // --watch 에서 파일이 저장되는 것을 알아내기 위해 포함.
+#include <poll.h>          // --watch 에서 저장이 끝날 때까지 잠깐 기다리기 위해 포함.
 
 #define MAX_LINE_LENGTH 1024
 #define REGISTER_COUNT 32
 #define INSTRUCTION_MAX_LINE 10000 // 최대 라인 길이
+#define TRACE_FLUSH_SIZE (64 * 1024 * 1024) // trace 버퍼가 이 크기를 넘으면 파일로 내보낸다.
+#define MAX_THREADS 64                      // 한 번에 쓰는 최대 스레드 수
+#define CHECK_CHUNK_MIN_BYTES (256 * 1024)  // 에러 체크 스레드 하나가 맡는 최소 크기
+#define ENCODE_CHUNK_MIN_LINES 16384        // 인코딩 스레드 하나가 맡는 최소 줄 수
+#define BINARY_LINE_LENGTH 33               // .o 파일 한 줄의 길이 (32비트 + 줄바꿈)
+#define ARENA_BLOCK_SIZE (1024 * 1024)      // 아레나 블록 하나의 기본 크기
+#define ARENA_KEEP_SIZE (64 * 1024 * 1024)  // 파일이 끝난 뒤에도 다음 파일을 위해 남겨두는 아레나 크기
+#define TRACE_CHUNK_SIZE (1024 * 1024)      // trace 조각 하나의 크기
+#define MAX_HARTS 64                        // 동시에 돌릴 수 있는 최대 하트 수
+#define MAX_DAEMON_WORKERS 256              // 데몬이 띄울 수 있는 최대 워커 수
+#define PIPELINE_QUEUE_SIZE 4               // 파이프라인 단계 사이 큐에 들어갈 수 있는 최대 개수
+#define MTRACE_RING_SIZE 65536              // 메모리 trace 링 버퍼의 레코드 수 (2의 거듭제곱)
+#define DISASSEMBLE_CHUNK_MIN_WORDS 65536   // 디스어셈블 스레드 하나가 맡는 최소 명령어 수
+#define DISASSEMBLE_WINDOW (1024 * 1024)    // 디스어셈블 스레드 하나가 한 번에 글자로 만드는 명령어 수
+#define DISASSEMBLE_MAX_LINE 64             // 디스어셈블한 명령어 한 줄(레이블 줄 포함)의 최대 길이
+#define MEMORY_PAGE_WORDS 1024              // 메모리 페이지 하나에 들어가는 주소 수
+#define MEMORY_DIRECTORY_SIZE 4096          // 메모리 디렉터리 하나가 가리키는 페이지 수
+#define MEMORY_ROOT_SIZE 1024               // 맨 위 메모리 표 크기 (1024 * 4096 * 1024 = 2^32 주소)
+#define RESERVATION_SLOTS 256               // lr.w/sc.w 가 보는 저장 횟수 칸 수 (주소를 이 수로 나눈 나머지로 고른다)
+#define LOCKSTEP_LANES 8                    // lockstep 으로 같이 실행하는 인스턴스 수 (int 8개 = AVX2 레지스터 하나)
+#define LANE_TRACE_BUFFER (64 * 1024)       // lockstep 인스턴스 하나의 trace 버퍼 크기
+#define DATA_SEGMENT_BASE 0                 // .data 가 시작하는 메모리 주소 (lw label(x0) 처럼 12비트 즉시값에 들어가도록 0에 둔다)
+#define MAX_HOST_LOADS 16                   // --load 로 줄 수 있는 최대 파일 수
+#define GUEST_FILE_COUNT 64                 // 게스트가 동시에 열 수 있는 파일 수 (0, 1, 2 포함)
+#define GUEST_FILE_BUFFER (64 * 1024)       // 작은 ecall read/write 를 모으는 파일마다의 버퍼 크기
 
+//
+// 아레나 구간!! 시작!!
+//
+// 파일 하나를 처리하는 동안 쓰는 메모리(소스, 명령어, 레이블, trace 조각)는 모두 아레나에서 받는다.
+// 하나씩 free 하지 않고, 파일이 끝나면 arenaReset 한 번으로 전부 돌려준다.
+typedef struct ArenaBlock
+{
+    struct ArenaBlock *next;
+    size_t capacity; // data 크기
+    size_t used;     // data 에서 지금까지 나눠준 크기
+    char data[];
+} ArenaBlock;
+
+typedef struct
+{
+    ArenaBlock *first;   // 첫 번째 블록
+    ArenaBlock *current; // 지금 나눠주고 있는 블록
+    size_t used;         // 이번 파일에서 나눠준 크기
+} Arena;
+
+Arena fileArena; // 파일 하나 동안 쓰는 아레나
+
+// 아레나에서 size 바이트를 받는다. (8바이트 단위로 맞춘다)
+void *arenaAlloc(Arena *arena, size_t size)
+{
+    size = (size + 7) & ~(size_t)7;
+
+    // 지금 블록에 자리가 없으면 뒤에 남아있는 블록(전에 쓰다가 비운 블록)을 본다.
+    for (ArenaBlock *block = arena->current; block != NULL; block = block->next)
+    {
+        if (block->used + size <= block->capacity)
+        {
+            void *memory = block->data + block->used;
+            block->used += size;
+            arena->current = block;
+            arena->used += size;
+            return memory;
+        }
+    }
+
+    // 남은 블록이 없으면 새 블록을 만들어서 지금 블록 뒤에 붙인다.
+    size_t capacity = (size > ARENA_BLOCK_SIZE) ? size : ARENA_BLOCK_SIZE;
+    ArenaBlock *block = (ArenaBlock *)malloc(sizeof(ArenaBlock) + capacity);
+    if (block == NULL)
+    {
+        printf("Memory allocation failed.\n");
+        exit(1);
+    }
+    block->capacity = capacity;
+    block->used = size;
+    if (arena->current == NULL)
+    {
+        block->next = arena->first;
+        arena->first = block;
+    }
+    else
+    {
+        block->next = arena->current->next;
+        arena->current->next = block;
+    }
+    arena->current = block;
+    arena->used += size;
+    return block->data;
+}
+
+// 아레나 안의 배열을 newSize 로 늘린다. 예전 배열은 arenaReset 때 같이 돌려준다.
+void *arenaGrow(Arena *arena, void *old, size_t oldSize, size_t newSize)
+{
+    void *memory = arenaAlloc(arena, newSize);
+    if (old != NULL)
+    {
+        memcpy(memory, old, oldSize);
+    }
+    return memory;
+}
+
+// 아레나를 비운다. 블록은 다음 파일에서 다시 쓰도록 ARENA_KEEP_SIZE 까지만 남기고 나머지는 free 한다.
+void arenaReset(Arena *arena)
+{
+    size_t kept = 0;
+    ArenaBlock *previous = NULL;
+    ArenaBlock *block = arena->first;
+
+    while (block != NULL)
+    {
+        ArenaBlock *next = block->next;
+        if (kept + block->capacity > ARENA_KEEP_SIZE)
+        {
+            if (previous == NULL)
+            {
+                arena->first = next;
+            }
+            else
+            {
+                previous->next = next;
+            }
+            free(block);
+        }
+        else
+        {
+            block->used = 0;
+            kept += block->capacity;
+            previous = block;
+        }
+        block = next;
+    }
+    arena->current = arena->first;
+    arena->used = 0;
+}
+
+// 지금 처리하는 소스 파일. 아레나에 통째로 읽어두고 모든 패스가 같이 본다.
+char *source = NULL;
+size_t sourceSize = 0;
+
+// 파이프라인 모드에서 읽기 스레드가 미리 읽어둔 소스 파일 (buffer 가 NULL 이면 파일이 없다)
+typedef struct
+{
+    const char *filename;
+    char *buffer;
+    size_t size;
+} ReadItem;
+
+ReadItem *prefetchedSource = NULL; // 지금 계산하는 파일의 미리 읽어둔 소스 (파이프라인 모드가 아니면 NULL)
+
+// 레이블이 어디서 보이는지 (.globl/.extern, 링크 구간 참고)
+typedef enum
+{
+    LABEL_LOCAL,  // 이 파일 안에서만
+    LABEL_GLOBAL, // .globl 로 다른 파일에도 보인다
+    LABEL_EXTERN  // .extern 으로 다른 파일에 있다고 한 레이블 (오브젝트를 만들 때만 주소 0 으로 둔다)
+} LabelBinding;
+
+// 레이블은 이름을 복사하지 않고 소스 안의 위치만 저장한다. (이름은 대소문자를 구분하지 않는다)
 typedef struct
 {
-    char label[256];
+    int nameOffset;        // 소스 안에서 레이블 이름이 시작하는 위치
+    int nameLength;        // 레이블 이름 길이
     int address;
-    int trace_address;
+    unsigned char binding; // LabelBinding
+    bool inData;           // 데이터 주소인지 (.data 뒤의 레이블)
 } Label;
 
 Label *labels;         // 라벨 배열
 int labelCount = 0;    // 라벨 개수
 int labelCapacity = 0; // 라벨 배열 용량
-int pc = 1000;
+int *labelTable = NULL; // 레이블 이름 해시표 (labels 위치 + 1, 0이면 빈칸)
+int labelTableSize = 0; // 해시표 크기 (2의 거듭제곱)
 
+// 데이터 구간에 들어갈 값 한 덩어리. firstPass 가 .word/.space/.incbin 과 --load 마다 하나씩 만들고,
+// 실행하기 전에 loadDataImage 가 게스트 메모리에 복사한다. (주소 하나에 값 하나)
 typedef struct
 {
-    char line[MAX_LINE_LENGTH]; // 한줄당 크기
-    int address;                // PC 값
-} Instruction;
+    int address;        // 시작 주소
+    int count;          // 주소 수
+    const int *values;  // 값 (NULL 이면 0으로 채운다)
+    int sourceOffset;   // .word 줄의 위치 (레이블 값은 loadInstructions 에서 채운다. .word 가 아니면 -1)
+    int sourceLength;
+    void *mapping;      // mmap 한 파일 (없으면 NULL)
+    size_t mappingSize;
+} DataBlock;
+
+DataBlock *dataBlocks = NULL; // 데이터 덩어리 배열 (주소 순서가 아니라 소스에 나온 순서)
+int dataBlockCount = 0;
+int dataBlockCapacity = 0;
+int dataAlignLog2 = 0;        // 파일에 나온 가장 큰 .align (링크할 때 데이터 구간을 이만큼 맞춘다)
+
+// .globl/.extern 줄. firstPass 가 모아두고 레이블을 다 저장한 뒤에 bindSymbols 가 레이블에 표시한다.
+typedef struct
+{
+    int sourceOffset;
+    int sourceLength;
+    int lineNumber;
+} SymbolDirective;
 
-// 레지스터 에러를 확인하는 전역변수
-bool register_error = false;
+SymbolDirective *symbolDirectives = NULL;
+int symbolDirectiveCount = 0;
+int symbolDirectiveCapacity = 0;
+
+// 하트(hart)마다 따로 가져야 하는 실행 상태(pc, 레지스터, trace, step 수)는 _Thread_local 로 둔다.
+// 하트 하나가 스레드 하나에서 돌기 때문에 실행 코드는 하트가 하나일 때와 똑같이 전역 변수를 쓰면 된다.
+_Thread_local int pc = 1000;
+
+// 명령어 하나. 원본 줄은 소스 안의 위치만 들고, 실행과 인코딩에 필요한 값은 미리 해석해 둔다.
+typedef struct
+{
+    int sourceOffset;    // 소스 안에서 명령어가 시작하는 위치 (명령어 이름부터)
+    int sourceLength;    // 명령어 길이 (앞뒤 공백은 뺀다)
+    int address;         // PC 값
+    short infoIndex;     // instructionTable 안의 위치
+    unsigned char rd;    // 레지스터 번호
+    unsigned char rs1;
+    unsigned char rs2;
+    bool hasLabel;       // 분기/점프 대상이 레이블인지
+    int imm;             // 즉시값 (분기/점프는 숫자로 쓴 offset)
+    int target;          // 분기/점프할 레이블 주소 (레이블이 아니면 -1)
+} Instruction;
 
 Instruction *instructions = NULL; // 명령어 배열
 int instructionCount = 0;         // 명령어 개수
-int instructionCapacity = 0;      // 명령어 배열 용량
 
-// 트레이스 값을 저장하는 곳
-char *trace = NULL;
-int traceSize = 0;
+// 트레이스 값을 저장하는 곳. 한 줄에 pc 하나씩 "%d\n" 형태로 아레나에서 받은 조각들에 쌓는다.
+typedef struct TraceChunk
+{
+    struct TraceChunk *next;
+    int length; // 조각에 쓴 글자 수
+    char data[TRACE_CHUNK_SIZE];
+} TraceChunk;
+
+_Thread_local TraceChunk *traceHead = NULL; // 첫 번째 조각
+_Thread_local TraceChunk *traceTail = NULL; // 지금 쓰고 있는 조각 (파일로 내보낸 뒤에는 NULL)
+_Thread_local long long traceLength = 0;    // 조각들에 쌓여있는 글자 수
+pthread_mutex_t traceChunkLock = PTHREAD_MUTEX_INITIALIZER; // 여러 하트가 아레나에서 trace 조각을 받을 때 쓰는 잠금
+
+// 트레이스 파일 포인터. 체크포인트를 쓸 때 trace 버퍼를 중간에 파일로 내보내기 위해 전역으로 둔다.
+_Thread_local FILE *traceOutputFile = NULL;
+_Thread_local long long traceFileOffset = 0; // 지금까지 .trace 파일에 쓴 바이트 수
+_Thread_local long long traceEntries = 0;    // 지금까지 trace에 들어간 pc 개수
+_Thread_local const char *traceWritePath = NULL; // 파이프라인 모드에서 쓰기 스레드로 넘길 .trace 이름
+_Thread_local bool traceWriteStarted = false;    // 파이프라인 모드에서 .trace 를 한 번이라도 넘겼는지
+
+// 실행한 명령어 개수
+_Thread_local long long stepCount = 0;
+
+// lr.w 로 잡아둔 예약. sc.w 는 예약한 뒤로 그 주소의 칸에 아무도 저장하지 않았을 때만 성공한다.
+_Thread_local bool reservationValid = false;
+_Thread_local int reservationAddress = 0;
+_Thread_local unsigned int reservationGeneration = 0;
+
+// 멀티 하트 옵션. hartCount 개의 하트가 같은 메모리를 쓰면서 각자 스레드에서 돈다.
+int hartCount = 1;
+char *hartEntryOption = NULL; // --hart-entry 로 받은 "label,label,..." (하트마다 시작 레이블)
+
+// lockstep 옵션. inputsPath 가 있으면 입력 파일의 줄마다 시작 레지스터가 다른 인스턴스를 만들어서 같이 실행한다.
+char *inputsPath = NULL;
+bool digestOnly = false; // true 면 인스턴스마다 .trace 대신 trace 해시만 파일명.digest 에 남긴다.
+
+// ILP 분석 옵션. dataflowEnabled 면 블록마다의 정적 분석과 실행 흐름의 dataflow 한계를 파일명.ilp 에 쓴다.
+bool dataflowEnabled = false;
+
+// 실행 통계 옵션. statsEnabled 면 상세 모드에서 실행한 명령어를 세서 파일명.stats 와 파일명.stats.json 에 쓴다.
+// 세는 동안에는 명령어마다(instructions 와 같은 위치) 실행 횟수와 분기한 횟수를 둔다. (세지 않을 때는 NULL)
+bool statsEnabled = false;
+long long *executedCounts = NULL;
+long long *takenCounts = NULL;
+
+// 프로파일 옵션. profileEnabled 면 상세 모드에서 함수별 명령어 수를 세서 파일명.prof 와 파일명.folded 에 쓴다.
+bool profileEnabled = false;
+bool profileActive = false; // 지금 세고 있는지 (startProfile 부터 파일이 끝날 때까지)
+
+// 시간 여행 옵션. timeTravelInterval 이 0이 아니면 상세 모드에서 실행을 기록하고(스냅숏 + step 마다 바뀐 값),
+// 끝난 뒤 표준 입력의 명령어로 지난 step 을 오간다. 스냅숏은 timeTravelKeep 개까지만 남긴다.
+long long timeTravelInterval = 0;
+int timeTravelKeep = 64;
+bool historyActive = false; // 지금 기록하고 있는지 (startHistory 부터 travelHistory 까지)
+
+// 덤프 옵션. dumpEnabled 면 프로그램이 끝났을 때 레지스터와 저장한 메모리를 파일명.dump 에 이진 형식으로 쓴다.
+bool dumpEnabled = false;
+
+// 호스트 파일 옵션. --load FILE@ADDR 마다 FILE 을 mmap 해서 ADDR 부터 4바이트(리틀 엔디언)씩 게스트 메모리에 넣는다.
+char *hostLoads[MAX_HOST_LOADS];
+int hostLoadCount = 0;
+
+// ecall 옵션. ioDirectory 가 있으면 게스트가 그 디렉터리 안의 파일을 열 수 있다. (없으면 0, 1, 2 만 쓸 수 있다)
+char *ioDirectory = NULL;
+
+// 단계별 시간 옵션. timingEnabled 면 파일마다 단계별 시간과 메모리를 출력하고, timingJsonPath 가 있으면 JSON 줄로도 붙여 쓴다.
+bool timingEnabled = false;
+char *timingJsonPath = NULL;
+
+// 메모리 trace 옵션. memoryTraceEnabled 면 상세 모드에서 실행한 lw/sw 를 파일명.mtrace 에 남긴다.
+bool memoryTraceEnabled = false;
+bool memoryTraceActive = false; // 지금 쓰기 스레드가 돌고 있는지
+
+// 디스어셈블 옵션. disassembleMode 면 입력 파일을 .o 로 보고 파일명.dis 를 만든다.
+bool disassembleMode = false;
+bool roundTripCheck = false; // true 면 파일명.s 와 파일명.dis 를 다시 어셈블해서 .o 와 같은지 확인한다.
+bool objectBinary = false;   // true 면 .o 를 33글자 줄 대신 명령어마다 4바이트(리틀 엔디언)로 쓴다.
+
+// trace 형식 옵션. traceBinary 면 .trace 를 "%d\n" 줄 대신 머리("RVTR" + uint32 버전 1 + uint32 레코드 크기 4) 뒤에
+// pc 마다 4바이트(리틀 엔디언)로 쓴다.
+bool traceBinary = false;
+
+// 파이프라인 옵션. 파일 여러 개를 줄 때 읽기/계산/쓰기를 겹친다.
+bool pipelineEnabled = false;
+
+// 링크 옵션. linkMode 면 입력 파일들을 파일마다 재배치 오브젝트(파일명.rel)로 어셈블한 뒤 프로그램 하나로 링크한다.
+// objectMode 는 지금 파일을 .rel 로 어셈블하는 중인지 (어셈블하는 자식 프로세스에서만 true)
+bool linkMode = false;
+bool objectMode = false;
+int linkedObjectCount = 0;     // 지금 프로그램을 만든 .rel 수 (링크하지 않았으면 0)
+uint64_t linkedSourceHash = 0; // .rel 들의 소스 해시를 합친 것 (체크포인트에서 소스 해시 대신 쓴다)
+
+// 감시 옵션. watchMode 면 입력 파일 하나를 저장될 때마다 다시 어셈블하고 실행한다.
+bool watchMode = false;
+
+// 데몬 옵션. daemonPath 가 있으면 그 유닉스 소켓에서 요청을 받는다. daemonWorkers 가 0이면 CPU 개수만큼 워커를 띄운다.
+char *daemonPath = NULL;
+int daemonWorkers = 0;
+
+// 최적화 옵션. optimizeEnabled 면 인코딩과 실행 전에 명령어를 최적화한다.
+bool optimizeEnabled = false;
+bool compareDynamic = false; // true 면 최적화 전후로 실행한 명령어 수를 비교한다.
+
+// 체크포인트 옵션. checkpointInterval이 0이면 체크포인트를 쓰지 않는다.
+long long checkpointInterval = 0;
+long long maxSteps = 0;                // 0이 아니면 이 step 수까지만 실행하고 멈춘다.
+char checkpointPath[260] = "";         // 체크포인트 파일 이름 (비어있으면 파일명.ckpt)
+char *checkpointOption = NULL;         // --checkpoint-file 로 받은 이름
+char *restorePath = NULL;              // --restore 로 받은 체크포인트 파일
+bool checkpointRestored = false;       // 체크포인트에서 이어서 실행하는 중인지
+uint64_t sourceHash = 0;               // 지금 실행하는 소스 파일의 해시값
+volatile sig_atomic_t checkpointRequested = 0; // SIGTERM을 받으면 1이 된다.
+
+// 병렬 처리에 쓸 스레드 수. 0이면 CPU 개수만큼 쓴다.
+int threadCount = 0;
+
+// 샘플링 옵션. 처음 fastForwardSteps 는 기능 모드로만 실행하고, 그 뒤 sampleSteps 만큼 상세 모드로 실행한다.
+// samplePeriod 가 0이 아니면 그 주기마다 상세 구간을 반복한다.
+long long fastForwardSteps = 0;
+long long sampleSteps = 0;
+long long samplePeriod = 0;
 
 // 파일이 잘 열리는지 확인하는 함수. 만약에 syntax error가 뜰 경우 trace파일도 만들면 안되기 때문에 전역변수로 설정했다.
 int fileOpenCheck = 1;
 
-// 레지스터 배열(32개 레지스터)
-int registers[REGISTER_COUNT] = {0};
+// 레지스터 배열(32개 레지스터). 하트마다 따로 가진다.
+_Thread_local int registers[REGISTER_COUNT] = {0};
 
 // 명령어 유형 열거형
 typedef enum
@@ -52,6 +392,8 @@ typedef enum
     S_TYPE,
     SB_TYPE,
     J_TYPE,
+    A_TYPE,
+    CSR_TYPE,
     EXIT_TYPE,
     UNKNOWN_TYPE
 } InstructionType;
@@ -66,15 +408,48 @@ typedef struct
     unsigned int funct7;
 } InstructionInfo;
 
-// 메모리 구조체 (동적 할당을 위한 구조체 정의)
-typedef struct MemoryNode
+// 메모리 구조체. 주소마다 int 값 하나가 들어간다.
+// 여러 하트가 같이 쓰므로 연결 리스트 대신 3단계 페이지 표로 두고, 값은 원자적으로 읽고 쓴다.
+// (맨 위 10비트 -> 디렉터리, 가운데 12비트 -> 페이지, 아래 10비트 -> 페이지 안 위치)
+typedef struct
 {
-    int address;
-    int value;
-    struct MemoryNode *next;
-} MemoryNode;
+    int values[MEMORY_PAGE_WORDS];
+    unsigned long long touched[MEMORY_PAGE_WORDS / 64]; // 한 번이라도 저장한 주소 표시
+} MemoryPage;
+
+typedef struct
+{
+    MemoryPage *pages[MEMORY_DIRECTORY_SIZE];
+    unsigned long long shared[MEMORY_DIRECTORY_SIZE / 64]; // --time-travel 스냅숏과 같이 쓰는 페이지 표시 (고치기 전에 복사한다)
+} MemoryDirectory;
+
+// writeGenerations 는 칸마다 그 칸의 주소에 저장한 횟수의 두 배이다. 홀수인 동안은 누가 그 칸을 잠그고 쓰는 중이다.
+// sc.w 는 이 값이 lr.w 때 본 값과 같을 때만 성공하므로, 사이에 다른 하트가 A->B->A 로 써도 실패한다.
+typedef struct
+{
+    MemoryDirectory *root[MEMORY_ROOT_SIZE];
+    unsigned int writeGenerations[RESERVATION_SLOTS];
+} GuestMemory;
+
+GuestMemory sharedMemory; // 모든 하트가 같이 쓰는 메모리
+long long memoryTableBytes = 0; // 지금까지 만든 메모리 표(디렉터리, 페이지)의 바이트 수 (--timing 에서 쓴다)
 
-MemoryNode *memoryHead = NULL;
+// 지금 스레드의 load/store 가 쓰는 메모리. 보통은 sharedMemory 이고, lockstep 실행에서는 인스턴스마다 바꿔 끼운다.
+_Thread_local GuestMemory *currentMemory = &sharedMemory;
+
+// 상세 구간 하나의 통계
+typedef struct
+{
+    int index;                             // 몇 번째 구간인지
+    long long startStep;                   // 구간이 시작된 step
+    long long instructions;                // 구간에서 실행한 명령어 수
+    long long typeCounts[UNKNOWN_TYPE + 1]; // 명령어 유형별 개수
+    long long loads;                       // lw 개수
+    long long stores;                      // sw 개수
+    long long branchesTaken;               // 분기한 branch 개수
+    long long branchesNotTaken;            // 분기하지 않은 branch 개수
+    long long jumps;                       // jal, jalr 개수
+} WindowStats;
 
 InstructionInfo instructionTable[] = {
     // R-type 명령어들
@@ -98,6 +473,9 @@ InstructionInfo instructionTable[] = {
     {"lw", I_TYPE, 0x03, 0x2, 0},
     {"jalr", I_TYPE, 0x67, 0x0, 0},
 
+    // 의사 명령어. la rd, label 은 addi rd, x0, 레이블 주소 로 해석한다. (funct7 1 은 addi 와 구분하기 위한 표시)
+    {"la", I_TYPE, 0x13, 0x0, 0x01},
+
     // S-type 명령어들
     {"sw", S_TYPE, 0x23, 0x2, 0},
 
@@ -110,157 +488,213 @@ InstructionInfo instructionTable[] = {
     // J-type 명령어들
     {"jal", J_TYPE, 0x6F, 0, 0},
 
+    // A-type 명령어들 (RV32A). funct7 자리에는 funct5 << 2 를 넣는다. (aq, rl 비트는 0)
+    {"lr.w", A_TYPE, 0x2F, 0x2, 0x02 << 2},
+    {"sc.w", A_TYPE, 0x2F, 0x2, 0x03 << 2},
+    {"amoswap.w", A_TYPE, 0x2F, 0x2, 0x01 << 2},
+    {"amoadd.w", A_TYPE, 0x2F, 0x2, 0x00 << 2},
+    {"amoxor.w", A_TYPE, 0x2F, 0x2, 0x04 << 2},
+    {"amoand.w", A_TYPE, 0x2F, 0x2, 0x0C << 2},
+    {"amoor.w", A_TYPE, 0x2F, 0x2, 0x08 << 2},
+    {"amomin.w", A_TYPE, 0x2F, 0x2, 0x10 << 2},
+    {"amomax.w", A_TYPE, 0x2F, 0x2, 0x14 << 2},
+    {"amominu.w", A_TYPE, 0x2F, 0x2, 0x18 << 2},
+    {"amomaxu.w", A_TYPE, 0x2F, 0x2, 0x1C << 2},
+
+    // 카운터 CSR 읽기 (Zicsr 의 csrrs rd, csr, x0). funct7 자리에는 CSR 번호(12비트)를 넣는다.
+    {"rdcycle", CSR_TYPE, 0x73, 0x2, 0xC00},
+    {"rdtime", CSR_TYPE, 0x73, 0x2, 0xC01},
+    {"rdinstret", CSR_TYPE, 0x73, 0x2, 0xC02},
+    {"rdcycleh", CSR_TYPE, 0x73, 0x2, 0xC80},
+    {"rdtimeh", CSR_TYPE, 0x73, 0x2, 0xC81},
+    {"rdinstreth", CSR_TYPE, 0x73, 0x2, 0xC82},
+
+    // 환경 호출 (시스템 호출 구간 참고). CSR 읽기와 같은 SYSTEM opcode 이고 funct3 가 0이다.
+    {"ecall", CSR_TYPE, 0x73, 0x0, 0x000},
+
     // EXIT 명령어
     {"exit", EXIT_TYPE, 0xFF, 0xF, 0xFF},
 
     // 배열의 끝을 표시하기 위해 NULL 추가
     {NULL, UNKNOWN_TYPE, 0, 0, 0}};
 
-// 메모리에 값을 저장하는 함수
-void storeMemory(int address, int value)
+// slot 이 비어있으면 size 바이트를 새로 만들어 넣는다. 다른 하트가 먼저 넣었으면 그것을 쓴다.
+void *installMemoryTable(void **slot, size_t size)
 {
-    MemoryNode *current = memoryHead;
-    MemoryNode *prev = NULL;
-
-    // 기존 메모리 노드가 있는지 확인
-    while (current != NULL && current->address != address)
+    void *table = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+    if (table == NULL)
     {
-        prev = current;
-        current = current->next;
+        void *fresh = calloc(1, size);
+        if (fresh == NULL)
+        {
+            printf("Memory allocation failed.\n");
+            exit(1);
+        }
+        if (__atomic_compare_exchange_n(slot, &table, fresh, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        {
+            table = fresh;
+            __atomic_fetch_add(&memoryTableBytes, (long long)size, __ATOMIC_RELAXED);
+        }
+        else
+        {
+            free(fresh); // 다른 하트가 먼저 만들었다.
+        }
     }
+    return table;
+}
 
-    // 기존 메모리 노드가 있으면 값을 업데이트
-    if (current != NULL)
+// 주소가 들어있는 페이지를 찾는다. create 가 false 면 없을 때 NULL
+MemoryPage *findMemoryPage(GuestMemory *memory, int address, bool create)
+{
+    unsigned int unsignedAddress = (unsigned int)address;
+    void **directorySlot = (void **)&memory->root[unsignedAddress >> 22];
+    MemoryDirectory *directory = create ? installMemoryTable(directorySlot, sizeof(MemoryDirectory))
+                                        : __atomic_load_n(directorySlot, __ATOMIC_ACQUIRE);
+    if (directory == NULL)
     {
-        current->value = value;
+        return NULL;
     }
-    else
+
+    unsigned int pageIndex = (unsignedAddress >> 10) & (MEMORY_DIRECTORY_SIZE - 1);
+    void **pageSlot = (void **)&directory->pages[pageIndex];
+    if (!create)
     {
-        // 새 메모리 노드 생성
-        MemoryNode *newNode = (MemoryNode *)malloc(sizeof(MemoryNode));
-        newNode->address = address;
-        newNode->value = value;
-        newNode->next = NULL;
+        return __atomic_load_n(pageSlot, __ATOMIC_ACQUIRE);
+    }
 
-        // 메모리 리스트에 추가
-        if (prev == NULL)
-        {
-            memoryHead = newNode;
-        }
-        else
+    // 스냅숏이 같이 쓰는 페이지면 고치기 전에 복사해서 바꿔 끼운다. (copy-on-write. 하트가 하나일 때만 표시가 생긴다)
+    MemoryPage *page = installMemoryTable(pageSlot, sizeof(MemoryPage));
+    unsigned long long sharedBit = 1ULL << (pageIndex % 64);
+    if (directory->shared[pageIndex / 64] & sharedBit)
+    {
+        MemoryPage *copy = malloc(sizeof(MemoryPage));
+        if (copy == NULL)
         {
-            prev->next = newNode;
+            printf("Memory allocation failed.\n");
+            exit(1);
         }
+        memcpy(copy, page, sizeof(MemoryPage));
+        directory->pages[pageIndex] = copy;
+        directory->shared[pageIndex / 64] &= ~sharedBit;
+        memoryTableBytes += sizeof(MemoryPage);
+        page = copy;
     }
+    return page;
 }
-// 메모리를 초기화 한다.
-void freeMemory()
+
+// 주소의 값이 들어있는 자리를 돌려준다. (없으면 만들고, 저장한 주소로 표시한다)
+int *guestMemoryWord(GuestMemory *memory, int address)
 {
-    MemoryNode *current = memoryHead;
-    while (current != NULL)
+    MemoryPage *page = findMemoryPage(memory, address, true);
+    unsigned int index = (unsigned int)address & (MEMORY_PAGE_WORDS - 1);
+    unsigned long long bit = 1ULL << (index % 64);
+
+    if ((__atomic_load_n(&page->touched[index / 64], __ATOMIC_RELAXED) & bit) == 0)
     {
-        MemoryNode *next = current->next; // 다음 노드를 임시로 저장
-        free(current);                    // 현재 노드의 메모리 해제
-        current = next;                   // 다음 노드로 이동
+        __atomic_fetch_or(&page->touched[index / 64], bit, __ATOMIC_RELAXED);
     }
+    return &page->values[index];
+}
 
-    memoryHead = NULL; // 연결 리스트 초기화
+// 지금 스레드가 쓰는 메모리에서 주소의 자리를 돌려준다.
+int *memoryWord(int address)
+{
+    return guestMemoryWord(currentMemory, address);
 }
 
-// 메모리에서 값을 불러오는 함수
-int loadMemory(int address)
+// 주소의 저장 횟수 칸을 돌려준다.
+unsigned int *writeGeneration(GuestMemory *memory, int address)
 {
-    MemoryNode *current = memoryHead;
+    return &memory->writeGenerations[(unsigned int)address % RESERVATION_SLOTS];
+}
 
-    // 메모리 노드에서 주소를 검색
-    while (current != NULL)
+// 저장 횟수 칸을 잠근다. (짝수일 때 홀수로 바꾼다) 잠그기 전 값을 돌려준다.
+unsigned int lockWriteGeneration(unsigned int *generation)
+{
+    while (1)
     {
-        if (current->address == address)
+        unsigned int current = __atomic_load_n(generation, __ATOMIC_RELAXED);
+        if ((current & 1) == 0 &&
+            __atomic_compare_exchange_n(generation, &current, current + 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
         {
-            return current->value;
+            return current;
         }
-        current = current->next;
     }
-
-    // 저장되지 않은 메모리는 기본값 0을 반환
-    return 0;
 }
 
-// 공백을 제거하는 함수
-void trim_whitespace(char *str) {
-    char *end;
-
-    // 문자열 시작 부분의 공백 제거
-    while (isspace((unsigned char)*str)) str++;
-
-    // 문자열 끝 부분의 공백 제거
-    if (*str == 0) return; // 문자열이 비어있으면 반환
-
-    end = str + strlen(str) - 1;
-    while (end > str && isspace((unsigned char)*end)) end--;
-
-    // 공백이 제거된 문자열의 끝에 널 문자 추가
-    *(end + 1) = '\0';
+// 메모리에 값을 저장하는 함수. 같은 칸의 예약은 모두 깨진다.
+void storeMemory(int address, int value)
+{
+    int *word = memoryWord(address);
+    unsigned int *generation = writeGeneration(currentMemory, address);
+    unsigned int locked = lockWriteGeneration(generation);
+    __atomic_store_n(word, value, __ATOMIC_RELAXED);
+    __atomic_store_n(generation, locked + 2, __ATOMIC_RELEASE);
 }
 
-// 이 함수는 주어진 명령어 줄(`line`)을 분석하여 해당 명령어의 유형(`InstructionType`)을 반환하는 역할을 합니다.
-InstructionType identifyInstructionType(char *line)
+// 메모리를 초기화 한다.
+void freeMemory(GuestMemory *memory)
 {
-    char instruction[20]; // 명령어를 저장할 변수
-
-    // 새로 넣은 부분!
-    // printf("instructionType trim_whitespace\n");
-
-    // `line`의 모든 문자를 소문자로 변환
-    for (int i = 0; line[i]; i++)
+    for (int i = 0; i < MEMORY_ROOT_SIZE; i++)
     {
-        line[i] = tolower(line[i]);
+        if (memory->root[i] == NULL)
+        {
+            continue;
+        }
+        for (int j = 0; j < MEMORY_DIRECTORY_SIZE; j++)
+        {
+            free(memory->root[i]->pages[j]);
+        }
+        free(memory->root[i]);
+        memory->root[i] = NULL;
     }
+}
 
-    // `line`에서 첫 번째 단어(명령어 부분)를 추출
-    sscanf(line, "%s", instruction);
+// memory 에서 값을 불러온다.
+int loadGuestMemory(GuestMemory *memory, int address)
+{
+    MemoryPage *page = findMemoryPage(memory, address, false);
 
-    // instructionTable을 순회하며 정확히 일치하는 명령어를 찾음
-    for (int i = 0; instructionTable[i].instName != NULL; i++)
+    // 저장되지 않은 메모리는 기본값 0을 반환
+    if (page == NULL)
     {
-        if (strcmp(instruction, instructionTable[i].instName) == 0)
-        { // 정확히 일치하는지 확인 예를들어 addi같은 경우는 add가 있기 때문에 이 과정이 없으면 R-type으로 오해될 수도 있다.
-            return instructionTable[i].type;
-        }
+        return 0;
     }
-
-    return UNKNOWN_TYPE; // 일치하는 명령어가 없을 경우
+    return __atomic_load_n(&page->values[(unsigned int)address & (MEMORY_PAGE_WORDS - 1)], __ATOMIC_RELAXED);
 }
 
-// 레지스터 문자열에서 숫자만 추출하는 함수
-unsigned int extractRegisterNumber(char *reg)
+// 메모리에서 값을 불러오는 함수
+int loadMemory(int address)
 {
-    // 앞에 공백이 있는 경우 다음 문자로 넘어감
-    while (*reg == ' ' || *reg == '\t') {
-        reg++;
-    }
+    return loadGuestMemory(currentMemory, address);
+}
 
-    // 예: "x5"에서 숫자 5를 추출  , xx12같은것을 막기 위해
-    if ((reg[0] == 'x' || reg[0] == 'X') && isdigit(reg[1]))
+// 한 번이라도 저장한 주소들을 주소 순서대로 visit 에 넘긴다.
+void visitMemory(GuestMemory *memory, void (*visit)(int address, int value, void *context), void *context)
+{
+    for (int i = 0; i < MEMORY_ROOT_SIZE; i++)
     {
-        int reg_num = atoi(&reg[1]);
-
-        // 레지스터 번호가 0~31 사이인지 확인
-        if (reg_num >= 0 && reg_num <= 31)
+        if (memory->root[i] == NULL)
         {
-            return (unsigned int)reg_num;
+            continue;
         }
-        else
+        for (int j = 0; j < MEMORY_DIRECTORY_SIZE; j++)
         {
-            register_error = true;
-            return 0; // 에러 코드나 다른 처리 필요
+            MemoryPage *page = memory->root[i]->pages[j];
+            if (page == NULL)
+            {
+                continue;
+            }
+            for (int k = 0; k < MEMORY_PAGE_WORDS; k++)
+            {
+                if (page->touched[k / 64] & (1ULL << (k % 64)))
+                {
+                    unsigned int address = ((unsigned int)i << 22) | ((unsigned int)j << 10) | (unsigned int)k;
+                    visit((int)address, page->values[k], context);
+                }
+            }
         }
     }
-    else
-    {
-        register_error = true;
-        return 0; // 에러 코드나 다른 처리 필요
-    }
 }
 
 // 오버플로우인지 체크하는 함수
@@ -292,1191 +726,9254 @@ bool is_overflow(int value, InstructionType type)
     }
 }
 
-// 이진수로 바꾸는 함수
-void writeBinary(FILE *file, unsigned int value)
+//
+// 토크나이저 구간!! 시작!!
+//
+// 모든 패스(에러 체크, 레이블, 인코딩, 실행)가 같은 방식으로 줄을 읽도록 토크나이저를 하나로 모았다.
+// 원본 줄을 복사하거나 고치지 않고 (시작 위치, 길이) 만 돌려준다. 대소문자는 비교할 때 무시한다.
+// 아무 글자도 없는 줄만 빈 줄이고, 공백만 있는 줄이나 '#' 은 원래처럼 에러로 본다.
+
+// 토큰 종류
+typedef enum
 {
-    for (int i = 31; i >= 0; i--)
-    {
-        fprintf(file, "%d", (value >> i) & 1);
-    }
-    fprintf(file, "\n"); // 줄바꿈
-}
+    TOKEN_WORD,   // 명령어 이름, 레지스터, 레이블 (영문자/숫자/_/.)
+    TOKEN_NUMBER, // 숫자로 시작하는 토큰 (앞에 +, - 가 붙을 수 있다)
+    TOKEN_COMMA,  // ,
+    TOKEN_LPAREN, // (
+    TOKEN_RPAREN, // )
+    TOKEN_COLON,  // :
+    TOKEN_OTHER   // 그 밖의 글자
+} TokenKind;
+
+// 원본 줄 안의 토큰 하나 (복사하지 않음)
+typedef struct
+{
+    const char *start;
+    int length;
+    TokenKind kind;
+} Token;
 
-// 레이블의 주소를 찾는 함수
-int findLabelAddress(char *label)
+// 줄의 종류
+typedef enum
 {
-    for (int i = 0; i < labelCount; i++)
-    {
-        if (strcmp(labels[i].label, label) == 0)
-        {
-            return labels[i].address;
-        }
-    }
-    return -1; // 찾지 못한 경우
-}
+    LINE_EMPTY,       // 빈 줄
+    LINE_LABEL,       // "label:"
+    LINE_INSTRUCTION, // 명령어
+    LINE_DIRECTIVE    // ".word 1, 2" 처럼 '.' 으로 시작하는 지시어
+} LineKind;
 
-// 명령어를 실질적으로 계산하는 함수(레지스터 계산 포함)
-int executeInstruction(char *line, InstructionType type)
+// 지시어 종류
+typedef enum
+{
+    DIRECTIVE_TEXT,   // .text            이후 줄은 코드
+    DIRECTIVE_DATA,   // .data            이후 줄은 데이터
+    DIRECTIVE_WORD,   // .word v, v, ...  값 (정수나 레이블) 을 주소마다 하나씩
+    DIRECTIVE_SPACE,  // .space n         0 을 n 개
+    DIRECTIVE_ALIGN,  // .align n         다음 주소를 2^n 의 배수로
+    DIRECTIVE_INCBIN, // .incbin "file"   파일 내용을 4바이트(리틀 엔디언)씩
+    DIRECTIVE_ASCIZ,  // .asciz "text"    널 문자로 끝나는 문자열을 4바이트씩 (ecall 의 경로, 출력용)
+    DIRECTIVE_GLOBL,  // .globl a, b      다른 파일에서 쓸 수 있는 레이블 (--link)
+    DIRECTIVE_EXTERN  // .extern a, b     다른 파일에 있는 레이블 (--link)
+} Directive;
+
+// 명령어의 피연산자 형식
+typedef enum
 {
-    unsigned int rd, rs1, rs2, imm;
-    char reg1[10], reg2[10], reg3[10];
-    char instruction[200];
+    OPERANDS_NONE,             // exit
+    OPERANDS_REG,              // rdcycle rd
+    OPERANDS_REG_REG_REG,      // add rd, rs1, rs2
+    OPERANDS_REG_REG_IMM,      // addi rd, rs1, imm
+    OPERANDS_REG_OFFSET_BASE,  // lw rd, imm(rs1) / sw rs2, imm(rs1)
+    OPERANDS_REG_REG_TARGET,   // beq rs1, rs2, label
+    OPERANDS_REG_TARGET,       // jal rd, label
+    OPERANDS_REG_ADDRESS,      // lr.w rd, (rs1)
+    OPERANDS_REG_REG_ADDRESS   // sc.w rd, rs2, (rs1) / amoadd.w rd, rs2, (rs1)
+} OperandFormat;
+
+// 한 줄을 해석한 결과. 피연산자는 원본 줄을 가리키는 토큰이다.
+// offset(base) 형식은 operands 에 (레지스터, offset, base) 순서로 들어간다.
+typedef struct
+{
+    LineKind kind;
+    Token label;        // LINE_LABEL 일 때 레이블 이름
+    Directive directive; // LINE_DIRECTIVE 일 때 지시어 종류
+    int infoIndex;      // instructionTable 안의 위치
+    Token mnemonic;     // 명령어 이름
+    Token operands[3];  // 피연산자
+    int operandCount;
+    const char *end;    // 마지막 토큰이 끝나는 위치
+} ParsedLine;
+
+#define MAX_LINE_TOKENS 16
+#define MAX_DIRECTIVE_OPERANDS (MAX_LINE_TOKENS / 2) // .word a, b, ... 한 줄에 들어가는 값 개수
+
+// 단어에 들어갈 수 있는 글자인지 확인한다.
+static inline bool isWordCharacter(unsigned char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c == '.';
+}
 
-    // line에서 명령어 추출
-    sscanf(line, "%s", instruction);
+// 한 줄을 토큰으로 나눈다. 토큰 개수를 돌려주고, maxTokens 보다 많으면 maxTokens + 1 을 돌려준다.
+int lexLine(const char *line, int length, Token *tokens, int maxTokens)
+{
+    const char *p = line;
+    const char *end = line + length;
+    int count = 0;
 
-    // R-type 명령어 처리
-    if (type == R_TYPE)
+    while (p < end)
     {
-        sscanf(line, "%*s %[^,],%[^,],%s", reg1, reg2, reg3);
-        //sscanf(line, "%*s %s %s %s", reg1, reg2, reg3);
-        rd = extractRegisterNumber(reg1);
-        rs1 = extractRegisterNumber(reg2);
-        rs2 = extractRegisterNumber(reg3);
+        unsigned char c = (unsigned char)*p;
 
-        if (strcmp(instruction, "add") == 0)
+        // 공백은 건너뛴다. 널 문자가 나오면 줄이 끝난 것으로 본다.
+        if (c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\v' || c == '\f')
         {
-            registers[rd] = registers[rs1] + registers[rs2];
+            p++;
+            continue;
         }
-        else if (strcmp(instruction, "sub") == 0)
+        if (c == '\0')
         {
-            registers[rd] = registers[rs1] - registers[rs2];
+            break;
         }
-        else if (strcmp(instruction, "and") == 0)
+        if (count >= maxTokens)
         {
-            registers[rd] = registers[rs1] & registers[rs2];
+            return maxTokens + 1;
         }
-        else if (strcmp(instruction, "or") == 0)
+
+        Token *token = &tokens[count++];
+        token->start = p;
+
+        if ((c >= '0' && c <= '9') || ((c == '-' || c == '+') && p + 1 < end && p[1] >= '0' && p[1] <= '9'))
         {
-            registers[rd] = registers[rs1] | registers[rs2];
+            p++;
+            while (p < end && isWordCharacter((unsigned char)*p))
+            {
+                p++;
+            }
+            token->kind = TOKEN_NUMBER;
         }
-        else if (strcmp(instruction, "xor") == 0)
+        else if (isWordCharacter(c))
         {
-            registers[rd] = registers[rs1] ^ registers[rs2];
+            while (p < end && isWordCharacter((unsigned char)*p))
+            {
+                p++;
+            }
+            token->kind = TOKEN_WORD;
         }
-        else if (strcmp(instruction, "sll") == 0)
+        else
         {
-            registers[rd] = registers[rs1] << (registers[rs2] & 0x1F);
+            p++;
+            token->kind = (c == ',') ? TOKEN_COMMA : (c == '(') ? TOKEN_LPAREN : (c == ')') ? TOKEN_RPAREN : (c == ':') ? TOKEN_COLON : TOKEN_OTHER;
         }
-        else if (strcmp(instruction, "srl") == 0)
+        token->length = (int)(p - token->start);
+    }
+    return count;
+}
+
+// 토큰이 주어진 단어와 같은지 대소문자 없이 비교한다. (word 는 소문자)
+bool tokenEquals(Token token, const char *word)
+{
+    for (int i = 0; i < token.length; i++)
+    {
+        if (word[i] == '\0' || tolower((unsigned char)token.start[i]) != word[i])
         {
-            registers[rd] = ((unsigned int)registers[rs1]) >> (registers[rs2] & 0x1F);
+            return false;
         }
-        else if (strcmp(instruction, "sra") == 0)
+    }
+    return word[token.length] == '\0';
+}
+
+// 명령어 이름 해시표. 줄마다 instructionTable 전체를 비교하지 않도록 main 시작할 때 한 번 만든다.
+#define INSTRUCTION_HASH_SIZE 256
+int instructionHash[INSTRUCTION_HASH_SIZE];
+
+// 이름을 소문자 기준으로 해시한다. (FNV-1a)
+unsigned int hashName(const char *name, int length)
+{
+    unsigned int hash = 2166136261u;
+    for (int i = 0; i < length; i++)
+    {
+        hash ^= (unsigned char)tolower((unsigned char)name[i]);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// 명령어 이름 해시표를 만든다.
+void initInstructionLookup()
+{
+    for (int i = 0; i < INSTRUCTION_HASH_SIZE; i++)
+    {
+        instructionHash[i] = -1;
+    }
+    for (int i = 0; instructionTable[i].instName != NULL; i++)
+    {
+        unsigned int slot = hashName(instructionTable[i].instName, (int)strlen(instructionTable[i].instName)) % INSTRUCTION_HASH_SIZE;
+        while (instructionHash[slot] != -1)
         {
-            // 산술 시프트 연산: 부호 비트를 유지하며 시프트
-            int shiftAmount = registers[rs2] & 0x1F;
-            registers[rd] = registers[rs1] >> shiftAmount;
-            if (registers[rs1] < 0)
-            {
-                // 음수인 경우 상위 비트를 1로 채움 (부호 비트 유지)
-                unsigned int mask = (1 << (32 - shiftAmount)) - 1;
-                registers[rd] |= ~mask;
-            }
+            slot = (slot + 1) % INSTRUCTION_HASH_SIZE;
         }
-        pc = pc + 4;
+        instructionHash[slot] = i;
     }
-    // I-type 명령어 처리
-    else if (type == I_TYPE)
-    {
+}
 
-        if (strcmp(instruction, "lw") == 0)
+// 명령어 이름으로 instructionTable 위치를 찾는다. 없으면 -1
+int findInstructionIndex(Token name)
+{
+    unsigned int slot = hashName(name.start, name.length) % INSTRUCTION_HASH_SIZE;
+    while (instructionHash[slot] != -1)
+    {
+        if (tokenEquals(name, instructionTable[instructionHash[slot]].instName))
         {
-            sscanf(line, "%*s %[^,],%d(%[^)])", reg1, &imm, reg2);
-            //sscanf(line, "%*s %[^,], %d(%[^)])", reg1, &imm, reg2);
-            rd = extractRegisterNumber(reg1);
-            rs1 = extractRegisterNumber(reg2);
-            int address = registers[rs1] + imm;
-            registers[rd] = loadMemory(address);
+            return instructionHash[slot];
+        }
+        slot = (slot + 1) % INSTRUCTION_HASH_SIZE;
+    }
+    return -1;
+}
 
-            pc = pc + 4;
+// la 의사 명령어인지 확인한다.
+static inline bool isLoadAddress(const InstructionInfo *info)
+{
+    return info->type == I_TYPE && info->opcode == 0x13 && info->funct7 == 0x01;
+}
+
+// 명령어의 피연산자 형식을 돌려준다.
+OperandFormat operandFormat(const InstructionInfo *info)
+{
+    switch (info->type)
+    {
+    case R_TYPE:
+        return OPERANDS_REG_REG_REG;
+    case I_TYPE:
+        // la 는 jal 처럼 rd, 레이블 (또는 정수) 이다.
+        if (isLoadAddress(info))
+        {
+            return OPERANDS_REG_TARGET;
         }
-        else if (strcmp(instruction, "jalr") == 0)
+        // lw 와 jalr 은 offset(base) 형식이다.
+        return (info->opcode == 0x03 || info->opcode == 0x67) ? OPERANDS_REG_OFFSET_BASE : OPERANDS_REG_REG_IMM;
+    case S_TYPE:
+        return OPERANDS_REG_OFFSET_BASE;
+    case SB_TYPE:
+        return OPERANDS_REG_REG_TARGET;
+    case J_TYPE:
+        return OPERANDS_REG_TARGET;
+    case A_TYPE:
+        // lr.w 만 rs2 가 없다.
+        return (info->funct7 >> 2 == 0x02) ? OPERANDS_REG_ADDRESS : OPERANDS_REG_REG_ADDRESS;
+    case CSR_TYPE:
+        // ecall 은 피연산자가 없다.
+        return (info->funct3 == 0x0) ? OPERANDS_NONE : OPERANDS_REG;
+    default:
+        return OPERANDS_NONE;
+    }
+}
+
+// 레지스터 토큰("x0"~"x31")을 번호로 바꾼다. 잘못된 레지스터면 -1
+int tokenRegister(Token token)
+{
+    if (token.kind != TOKEN_WORD || token.length < 2 || token.length > 4 || (token.start[0] != 'x' && token.start[0] != 'X'))
+    {
+        return -1;
+    }
+
+    int number = 0;
+    for (int i = 1; i < token.length; i++)
+    {
+        if (token.start[i] < '0' || token.start[i] > '9')
         {
-            sscanf(line, "%*s %[^,],%d(%[^)])", reg1, &imm, reg2);
-            //sscanf(line, "%*s %[^,], %d(%[^)])", reg1, &imm, reg2);
-            rd = extractRegisterNumber(reg1);
-            rs1 = extractRegisterNumber(reg2);
-            int next_pc = pc + 4; // 다음 명령어 주소 저장
+            return -1;
+        }
+        number = number * 10 + (token.start[i] - '0');
+    }
+    return (number <= 31) ? number : -1;
+}
 
-            pc = (registers[rs1] + imm) & ~1; // 목표 주소로 점프
+// 숫자 토큰을 정수로 바꾼다. 10진수가 아니면 false
+bool tokenNumber(Token token, int *value)
+{
+    int i = 0;
+    bool negative = false;
+    long long number = 0;
 
-            if (rd != 0)
-            {
-                registers[rd] = next_pc; // 반환 주소 저장 (rd가 x0이 아닌 경우)
-            }
+    if (token.kind != TOKEN_NUMBER)
+    {
+        return false;
+    }
+    if (token.start[0] == '-' || token.start[0] == '+')
+    {
+        negative = (token.start[0] == '-');
+        i++;
+    }
+    for (; i < token.length; i++)
+    {
+        if (token.start[i] < '0' || token.start[i] > '9')
+        {
+            return false;
         }
-        else
+        if (number < 0x100000000LL)
         {
-            sscanf(line, "%*s %[^,],%[^,],%d", reg1, reg2, &imm);
-            //sscanf(line, "%*s %s %s %d", reg1, reg2, &imm);
-            rd = extractRegisterNumber(reg1);
-            rs1 = extractRegisterNumber(reg2);
-
-            if (strcmp(instruction, "addi") == 0)
-            {
-                registers[rd] = registers[rs1] + imm;
-            }
-            else if (strcmp(instruction, "andi") == 0)
-            {
-                registers[rd] = registers[rs1] & imm;
-            }
-            else if (strcmp(instruction, "ori") == 0)
-            {
-                registers[rd] = registers[rs1] | imm;
-            }
-            else if (strcmp(instruction, "xori") == 0)
-            {
-                registers[rd] = registers[rs1] ^ imm;
-            }
-            else if (strcmp(instruction, "slli") == 0)
-            {
-                registers[rd] = registers[rs1] << (imm & 0x1F);
-            }
-            else if (strcmp(instruction, "srli") == 0)
-            {
-                registers[rd] = ((unsigned int)registers[rs1]) >> (imm & 0x1F);
-            }
-            else if (strcmp(instruction, "srai") == 0)
-            {
-                // 산술 시프트 연산: 부호 비트를 유지하며 시프트
-                int shiftAmount = imm & 0x1F;
-                registers[rd] = registers[rs1] >> shiftAmount;
-                if (registers[rs1] < 0)
-                {
-                    // 음수인 경우 상위 비트를 1로 채움 (부호 비트 유지)
-                    unsigned int mask = (1 << shiftAmount) - 1;
-                    registers[rd] |= mask << (32 - shiftAmount);
-                }
-            }
-            pc = pc + 4;
+            number = number * 10 + (token.start[i] - '0');
         }
     }
-    // S-type 명령어 처리
-    else if (type == S_TYPE)
+    *value = (int)(negative ? -number : number);
+    return true;
+}
+
+// 에러 메시지를 쓴다. (message 가 NULL 이면 쓰지 않는다)
+void setParseMessage(char *message, size_t messageSize, const char *format, ...)
+{
+    if (message != NULL)
     {
-        sscanf(line, "%*s %[^,],%d(%[^)])", reg1, &imm, reg2);
-        //sscanf(line, "%*s %[^,], %d(%[^)])", reg1, &imm, reg2);
-        rs1 = extractRegisterNumber(reg2);
-        rs2 = extractRegisterNumber(reg1);
+        va_list arguments;
+        va_start(arguments, format);
+        vsnprintf(message, messageSize, format, arguments);
+        va_end(arguments);
+    }
+}
 
-        if (strcmp(instruction, "sw") == 0)
+// '.' 으로 시작하는 지시어 줄을 해석한다. (tokens 는 lexLine 으로 나눈 것, count 는 그 개수)
+// .incbin 의 파일 이름과 .asciz 의 문자열은 '/' 같은 글자마다 토큰이 나뉘므로 토큰 대신 줄의 나머지 글자를 그대로 쓴다.
+// .word 의 값은 parsed->operands 에 다 들어가지 않으므로 개수만 세고, 값은 firstPass/loadInstructions 가 다시 읽는다.
+bool parseDirective(const char *line, int length, const Token *tokens, int count, ParsedLine *parsed, char *message,
+                    size_t messageSize)
+{
+    static const char *directiveNames[] = {".text", ".data", ".word", ".space", ".align", ".incbin", ".asciz", ".globl", ".extern"};
+    int directive = -1;
+    int value;
+
+    for (int i = 0; i < (int)(sizeof(directiveNames) / sizeof(directiveNames[0])); i++)
+    {
+        if (tokenEquals(tokens[0], directiveNames[i]))
         {
-            int address = registers[rs1] + imm;
-            storeMemory(address, registers[rs2]);
+            directive = i;
         }
-
-        pc = pc + 4;
     }
-    // SB-type 명령어 처리
-    else if (type == SB_TYPE)
+    if (directive < 0)
     {
-        sscanf(line, "%*s %[^,],%[^,],%s", reg1, reg2, reg3);
-        //sscanf(line, "%*s %s %s %s", reg1, reg2, reg3);
-        rs1 = extractRegisterNumber(reg1);
-        rs2 = extractRegisterNumber(reg2);
-        int labelAddress = findLabelAddress(reg3);
+        setParseMessage(message, messageSize, "unknown directive '%.*s'", tokens[0].length, tokens[0].start);
+        return false;
+    }
+    parsed->kind = LINE_DIRECTIVE;
+    parsed->directive = (Directive)directive;
+    parsed->mnemonic = tokens[0];
 
-        // 없는 레이블로 갈 경우 에러처리 해야함.
-        if (labelAddress == -1)
+    if (parsed->directive == DIRECTIVE_INCBIN || parsed->directive == DIRECTIVE_ASCIZ)
+    {
+        // 앞뒤 공백과 따옴표를 뺀다.
+        const char *start = tokens[0].start + tokens[0].length;
+        const char *end = line + length;
+        while (start < end && isspace((unsigned char)*start))
+        {
+            start++;
+        }
+        while (end > start && isspace((unsigned char)end[-1]))
+        {
+            end--;
+        }
+        bool quoted = (end - start >= 2 && *start == '"' && end[-1] == '"');
+        if (quoted)
+        {
+            start++;
+            end--;
+        }
+        if (parsed->directive == DIRECTIVE_INCBIN ? start == end : !quoted)
         {
-            // printf("Label not found: %s\n", reg3);
+            setParseMessage(message, messageSize, (parsed->directive == DIRECTIVE_INCBIN) ? "'.incbin' expects a file name"
+                                                                                          : "'.asciz' expects a quoted string");
+            return false;
         }
+        parsed->operands[0].start = start;
+        parsed->operands[0].length = (int)(end - start);
+        parsed->operands[0].kind = TOKEN_OTHER;
+        parsed->operandCount = 1;
+        parsed->end = end;
+        return true;
+    }
 
-        // 일단 여기서 imm 값은 label이랑 얼마나 떨어져있냐가 관건이다.
-        imm = labelAddress - pc;
+    if (count > MAX_LINE_TOKENS)
+    {
+        // .word/.globl/.extern 은 값과 쉼표가 번갈아 오므로 한 줄에 MAX_DIRECTIVE_OPERANDS 개까지다.
+        if (parsed->directive == DIRECTIVE_WORD || parsed->directive == DIRECTIVE_GLOBL || parsed->directive == DIRECTIVE_EXTERN)
+        {
+            setParseMessage(message, messageSize, "'%.*s' takes at most %d operands per line; split it over several lines",
+                            tokens[0].length, tokens[0].start, MAX_DIRECTIVE_OPERANDS);
+        }
+        else
+        {
+            setParseMessage(message, messageSize, "too many tokens");
+        }
+        return false;
+    }
+    parsed->end = tokens[count - 1].start + tokens[count - 1].length;
 
-        if (strcmp(instruction, "beq") == 0)
+    switch (parsed->directive)
+    {
+    case DIRECTIVE_TEXT:
+    case DIRECTIVE_DATA:
+        if (count != 1)
         {
-            if (registers[rs1] == registers[rs2])
-            {
-                pc += imm;
-            }
-            else
-            {
-                pc = pc + 4;
-            }
+            setParseMessage(message, messageSize, "'%.*s' takes no operands", tokens[0].length, tokens[0].start);
+            return false;
         }
-        else if (strcmp(instruction, "bne") == 0)
+        break;
+    case DIRECTIVE_SPACE:
+    case DIRECTIVE_ALIGN:
+        // .align 은 2^20 주소까지만 받는다.
+        if (count != 2 || !tokenNumber(tokens[1], &value) || value < 0 ||
+            (parsed->directive == DIRECTIVE_ALIGN && value > 20))
         {
-            if (registers[rs1] != registers[rs2])
-            {
-                pc += imm;
-            }
-            else
-            {
-                pc = pc + 4;
-            }
+            setParseMessage(message, messageSize, (parsed->directive == DIRECTIVE_ALIGN) ? "'.align' expects 0 to 20"
+                                                                                          : "'.space' expects a non-negative count");
+            return false;
         }
-        else if (strcmp(instruction, "blt") == 0)
+        parsed->operands[0] = tokens[1];
+        parsed->operandCount = 1;
+        break;
+    case DIRECTIVE_GLOBL:
+    case DIRECTIVE_EXTERN:
+        // .globl a , b , ... (레이블 이름만. 한 줄에 MAX_DIRECTIVE_OPERANDS 개까지)
+        if (count < 2 || count % 2 != 0)
         {
-            if (registers[rs1] < registers[rs2])
-            {
-                pc += imm;
-            }
-            else
-            {
-                pc = pc + 4;
-            }
+            setParseMessage(message, messageSize, "'%.*s' expects labels separated by commas", tokens[0].length, tokens[0].start);
+            return false;
         }
-        else if (strcmp(instruction, "bge") == 0)
+        for (int i = 1; i < count; i++)
         {
-            if (registers[rs1] >= registers[rs2])
-            {
-                pc += imm;
-            }
-            else
+            if (tokens[i].kind != ((i % 2 == 1) ? TOKEN_WORD : TOKEN_COMMA))
             {
-                pc = pc + 4;
+                setParseMessage(message, messageSize, "invalid label '%.*s'", tokens[i].length, tokens[i].start);
+                return false;
             }
         }
-    }
-    // J-type 명령어 처리
-    else if (type == J_TYPE)
-    {
-        if (strcmp(instruction, "jal") == 0)
+        parsed->operandCount = count / 2;
+        break;
+    default:
+        // .word v , v , ... (값은 정수나 레이블. 한 줄에 MAX_DIRECTIVE_OPERANDS 개까지)
+        if (count < 2 || count % 2 != 0)
         {
-            sscanf(line, "%*s %[^,],%s", reg1, reg3);
-            //sscanf(line, "%*s %s %s", reg1, reg3);
-            rd = extractRegisterNumber(reg1);
-            int labelAddress = findLabelAddress(reg3);
-
-            // 없는 레이블로 갈 경우 에러처리 해야함.
-            if (labelAddress == -1)
+            setParseMessage(message, messageSize, "'.word' expects values separated by commas");
+            return false;
+        }
+        for (int i = 1; i < count; i++)
+        {
+            bool isValue = (i % 2 == 1);
+            if (isValue ? (tokens[i].kind == TOKEN_NUMBER ? !tokenNumber(tokens[i], &value) : tokens[i].kind != TOKEN_WORD)
+                        : tokens[i].kind != TOKEN_COMMA)
             {
-                // printf("Label not found: %s\n", reg3);
+                setParseMessage(message, messageSize, "invalid .word value '%.*s'", tokens[i].length, tokens[i].start);
+                return false;
             }
-
-            // 일단 여기서 imm 값은 label이랑 얼마나 떨어져있냐가 관건이다.
-            imm = labelAddress - pc;
-
-            registers[rd] = pc + 4; // x1 레지스터에 return 주소 저장
-            pc += imm;
         }
+        parsed->operandCount = count / 2;
+        break;
     }
-    registers[0] = 0;
-    return pc;
+    return true;
 }
 
-// trace포인터에 pc값을 저장하는 저장하는 함수 (해석 필요)
-void appendToTrace(int number)
+// 한 줄을 해석한다. 문법에 맞지 않으면 message 에 이유를 쓰고 false 를 돌려준다.
+// 원본 줄은 고치지 않으므로 여러 스레드에서 같은 버퍼를 동시에 읽어도 된다.
+bool parseLine(const char *line, int length, ParsedLine *parsed, char *message, size_t messageSize)
 {
-    char buffer[20]; // 숫자와 공백을 임시로 저장할 버퍼
+    Token tokens[MAX_LINE_TOKENS];
+    int count = lexLine(line, length, tokens, MAX_LINE_TOKENS);
 
-    snprintf(buffer, sizeof(buffer), " %d ", number); // 숫자와 공백을 버퍼에 저장
+    memset(parsed, 0, sizeof(ParsedLine));
+    parsed->infoIndex = -1;
 
-    // trace 크기를 동적으로 늘리기 위해 realloc 사용
-    int neededSize = (trace ? strlen(trace) : 0) + strlen(buffer) + 1;
-    if (neededSize > traceSize)
+    // 아무것도 없는 줄만 빈 줄이다. 공백만 있는 줄은 에러로 본다.
+    if (count == 0)
     {
-        traceSize = neededSize * 100; // 크기를 여유 있게 늘립니다.
-        char *newTrace = (char *)realloc(trace, traceSize);
-        if (newTrace == NULL)
+        if (length > 0)
         {
-            // realloc 실패 시 메모리 누수 방지를 위해 함수 종료
-            printf("Memory reallocation failed.\n");
-            return;
+            setParseMessage(message, messageSize, "line contains only whitespace");
+            return false;
         }
-        trace = newTrace;
+        parsed->kind = LINE_EMPTY;
+        return true;
     }
-    // 방금 추가한 부분!!
-    if (trace != NULL)
+
+    // 지시어 확인. (".이름:" 은 레이블이다)
+    if (tokens[0].kind == TOKEN_WORD && tokens[0].start[0] == '.' && !(count >= 2 && tokens[1].kind == TOKEN_COLON))
     {
-        // 버퍼 내용을 trace에 추가(처음과 이후의 구분 없이 strcat 사용)
-        strcat(trace, buffer);
+        return parseDirective(line, length, tokens, count, parsed, message, messageSize);
+    }
+    if (count > MAX_LINE_TOKENS)
+    {
+        setParseMessage(message, messageSize, "too many tokens");
+        return false;
     }
-}
 
-// 특정 PC 값에 해당하는 명령어를 찾는 함수
-Instruction *fetchInstruction(int pcValue)
-{
-    for (int i = 0; i < instructionCount; i++)
+    // 라벨 확인. "이름:" 뒤에는 아무것도 오면 안 된다.
+    if (count >= 2 && tokens[1].kind == TOKEN_COLON)
     {
-        if (instructions[i].address == pcValue)
+        if (tokens[0].kind != TOKEN_WORD)
+        {
+            setParseMessage(message, messageSize, "invalid label name '%.*s'", tokens[0].length, tokens[0].start);
+            return false;
+        }
+        if (count > 2)
         {
-            return &instructions[i]; // 해당 PC 값을 가진 명령어를 반환
+            setParseMessage(message, messageSize, "unexpected text after label");
+            return false;
         }
+        parsed->kind = LINE_LABEL;
+        parsed->label = tokens[0];
+        return true;
     }
-    return NULL; // 해당 PC 값에 대한 명령어를 찾지 못한 경우
-}
 
-// 명령어를 넣으면 파일을 실행한다. 명령어 한줄씩 읽으면서 값을 정한다.
-void executeProgram()
-{
-    pc = 1000; // 프로그램 시작 시 PC 초기값
+    // 명령어 이름 확인
+    parsed->kind = LINE_INSTRUCTION;
+    parsed->end = tokens[count - 1].start + tokens[count - 1].length;
+    parsed->mnemonic = tokens[0];
+    parsed->infoIndex = (tokens[0].kind == TOKEN_WORD) ? findInstructionIndex(tokens[0]) : -1;
+    if (parsed->infoIndex < 0)
+    {
+        setParseMessage(message, messageSize, "unknown instruction '%.*s'", tokens[0].length, tokens[0].start);
+        return false;
+    }
 
-    while (1)
+    // 괄호 균형 확인
+    int bracket_count = 0;
+    for (int i = 1; i < count; i++)
     {
-        // 현재 PC에 해당하는 명령어 가져오기
-        Instruction *instr = fetchInstruction(pc);
-        if (instr == NULL)
+        if (tokens[i].kind == TOKEN_LPAREN)
         {
-            break; // 더 이상 명령어가 없으면 종료
+            bracket_count++;
         }
-
-        // 현재 PC값을 트레이스에 저장
-        appendToTrace(pc);
-
-        // 명령어 유형 식별 (예: R_TYPE, I_TYPE, 등)
-        InstructionType type = identifyInstructionType(instr->line);
-
-        // 유효하지 않은 명령어인 경우, 오류 처리
-        if (type == UNKNOWN_TYPE)
+        else if (tokens[i].kind == TOKEN_RPAREN && --bracket_count < 0)
         {
-            break;
+            break; // 닫는 괄호가 여는 괄호보다 먼저 나오는 경우
         }
+    }
+    if (bracket_count != 0)
+    {
+        setParseMessage(message, messageSize, "unbalanced brackets");
+        return false;
+    }
 
-        // 현재 pc 값을 저장한다 무한루프 에러체크를 위해서
-        int nowPc = pc;
+    // 쉼표 확인 (맨 앞, 연속, 맨 끝 쉼표는 안 된다) 하면서 피연산자 묶음 수를 센다.
+    int groupCount = (count > 1) ? 1 : 0;
+    for (int i = 1; i < count; i++)
+    {
+        if (tokens[i].kind == TOKEN_COMMA)
+        {
+            if (i == 1 || i == count - 1 || tokens[i + 1].kind == TOKEN_COMMA)
+            {
+                setParseMessage(message, messageSize, "consecutive or trailing comma");
+                return false;
+            }
+            groupCount++;
+        }
+    }
 
-        // 명령어 실행 (명령어에 따라 레지스터 변경, 메모리 접근, PC 갱신 등)
-        int newPc = executeInstruction(instr->line, type);
+    // 형식에 맞춰 피연산자를 꺼낸다.
+    const InstructionInfo *info = &instructionTable[parsed->infoIndex];
+    OperandFormat format = operandFormat(info);
+    int expected = (format == OPERANDS_NONE)  ? 0
+                   : (format == OPERANDS_REG) ? 1
+                   : (format == OPERANDS_REG_OFFSET_BASE || format == OPERANDS_REG_TARGET || format == OPERANDS_REG_ADDRESS) ? 2
+                                                                                                                           : 3;
+    if (groupCount != expected)
+    {
+        setParseMessage(message, messageSize, "'%s' expects %d operands", info->instName, expected);
+        return false;
+    }
 
-        // 종료 명령어인 경우 프로그램 종료
-        if (strcmp(instr->line, "exit") == 0)
+    switch (format)
+    {
+    case OPERANDS_NONE:
+        break;
+    case OPERANDS_REG_OFFSET_BASE:
+        // reg , offset ( base )
+        // offset 자리에는 레이블도 쓸 수 있다. (lw x5, value(x0))
+        if (count != 7 || (tokens[3].kind != TOKEN_NUMBER && tokens[3].kind != TOKEN_WORD) || tokens[4].kind != TOKEN_LPAREN ||
+            tokens[6].kind != TOKEN_RPAREN)
         {
-            break;
+            setParseMessage(message, messageSize, "'%.*s' expects reg, offset(base)", tokens[0].length, tokens[0].start);
+            return false;
         }
-
-        if (newPc == nowPc)
+        parsed->operands[0] = tokens[1];
+        parsed->operands[1] = tokens[3];
+        parsed->operands[2] = tokens[5];
+        parsed->operandCount = 3;
+        break;
+    case OPERANDS_REG_ADDRESS:
+    case OPERANDS_REG_REG_ADDRESS:
+    {
+        // reg , [reg ,] (base) 또는 0(base). 원자 명령어는 offset 을 쓸 수 없다.
+        int address = (expected - 1) * 2 + 1; // 주소가 시작하는 토큰
+        int value = 0;
+        if (address < count && tokens[address].kind == TOKEN_NUMBER && tokenNumber(tokens[address], &value) && value == 0)
         {
-            break;
+            address++;
         }
-
-        // PC 갱신: 명령어 실행 후 PC 값이 업데이트되었는지 확인
-        // 일반적인 경우에는 executeInstruction 함수 내부에서 pc += 4로 설정하지만
-        // 분기나 점프의 경우 PC가 바뀔 수 있음
-        pc = newPc;
+        if (count != address + 3 || tokens[address].kind != TOKEN_LPAREN || tokens[address + 2].kind != TOKEN_RPAREN)
+        {
+            setParseMessage(message, messageSize, "'%.*s' expects (base) address", tokens[0].length, tokens[0].start);
+            return false;
+        }
+        for (int i = 0; i < expected - 1; i++)
+        {
+            parsed->operands[i] = tokens[1 + i * 2];
+        }
+        parsed->operands[expected - 1] = tokens[address + 1];
+        parsed->operandCount = expected;
+        break;
     }
-}
-
-// 라벨(레이블)의 위치를 정확히 알아야 분기문하고 trace값을 처리할 수 있다. 그래서 처음에 레이블이 있는지 한번 훑는다.
-// 첫 번째 패스: 레이블 주소 저장
-bool firstPass(const char *filename)
-{
-    FILE *inputFile = fopen(filename, "r");
-    char line[MAX_LINE_LENGTH];
-
-    // 레이블 에러가 있을 경우.
-    bool label_Error = false;
-
-    // Program counter 초기값 (가정) . 여기서는 임의로 한번 읽는것이기 때문에 pc값을 따로 뺀다.
-    pc = 1000;
-
-    // 파일 끝까지 읽음
-    while (fgets(line, sizeof(line), inputFile) != NULL)
-    {
-        // 줄 끝의 개행 문자 제거
-        line[strcspn(line, "\n")] = '\0';
-
-        // 비어있는 줄은 넘어간다.
-        if (strlen(line) == 0)
+    default:
+        // reg , reg , x   또는   reg , x
+        if (count != expected * 2)
         {
-            continue;
+            setParseMessage(message, messageSize, "'%.*s' has malformed operands", tokens[0].length, tokens[0].start);
+            return false;
         }
-        // `line`의 모든 문자를 소문자로 변환
-        for (int i = 0; line[i]; i++)
+        for (int i = 0; i < expected; i++)
         {
-            line[i] = tolower(line[i]);
+            parsed->operands[i] = tokens[1 + i * 2];
         }
-        // 라벨 확인. ":"가 오는부분으로 labelPos에 저장하고 그곳에 널문자를 넣는다. 그러면 자연스럽게 label이름만 추출이 가능하다.
-        char *labelPos = strchr(line, ':');
-        if (labelPos != NULL)
+        parsed->operandCount = expected;
+        break;
+    }
+
+    // 레지스터와 즉시값 확인
+    for (int i = 0; i < parsed->operandCount; i++)
+    {
+        Token operand = parsed->operands[i];
+        bool isRegister = !((format == OPERANDS_REG_REG_IMM && i == 2) || (format == OPERANDS_REG_OFFSET_BASE && i == 1) ||
+                            (format == OPERANDS_REG_REG_TARGET && i == 2) || (format == OPERANDS_REG_TARGET && i == 1));
+        int value;
+
+        if (isRegister)
         {
-            *labelPos = '\0'; // ':' 문자를 NULL로 대체하여 레이블 이름만 추출
-            Label newLabel;
-            strcpy(newLabel.label, line);
-            newLabel.address = pc;
-            // 기존에 같은 이름의 라벨이 있는지 확인
-            for (int i = 0; i < labelCount; i++)
+            if (tokenRegister(operand) < 0)
             {
-                if (strcmp(labels[i].label, newLabel.label) == 0)
-                {
-                    label_Error = true; // 중복 라벨 발견
-                    break;
-                }
+                setParseMessage(message, messageSize, "invalid register '%.*s'", operand.length, operand.start);
+                return false;
             }
-
-            // 라벨 배열에 추가 (중복 체크 후)
-            if (labelCount >= labelCapacity)
+        }
+        else if (format == OPERANDS_REG_REG_TARGET || format == OPERANDS_REG_TARGET)
+        {
+            // 분기 대상은 레이블이나 정수
+            if (operand.kind == TOKEN_NUMBER ? !tokenNumber(operand, &value) : operand.kind != TOKEN_WORD)
             {
-                labelCapacity += 10000;
-                labels = realloc(labels, labelCapacity * sizeof(Label));
+                setParseMessage(message, messageSize, "invalid branch target '%.*s'", operand.length, operand.start);
+                return false;
             }
-            labels[labelCount++] = newLabel; // 중복 여부와 관계없이 라벨 추가
         }
-        else
+        else if (format == OPERANDS_REG_OFFSET_BASE && operand.kind == TOKEN_WORD)
         {
-            // 명령어 한 줄이므로 PC를 증가시킴
-            pc += 4;
+            // 레이블 offset. 레이블이 있는지와 범위는 decodeLine 에서 확인한다.
+        }
+        else if (!tokenNumber(operand, &value))
+        {
+            // 변환되지 않은 문자가 남아있음 -> 정수가 아님
+            setParseMessage(message, messageSize, "immediate '%.*s' is not an integer", operand.length, operand.start);
+            return false;
         }
-    }
 
-    if (label_Error == true)
-    {
-        return true;
+        // 즉시값 범위 확인 (시프트는 0~32, 나머지는 명령어 형식의 비트 수)
+        if (!isRegister && operand.kind == TOKEN_NUMBER)
+        {
+            bool isShift = (info->opcode == 0x13 && (info->funct3 == 0x1 || info->funct3 == 0x5));
+            if (isShift ? ((unsigned int)value > 32) : is_overflow(value, info->type))
+            {
+                setParseMessage(message, messageSize, "immediate '%.*s' is out of range", operand.length, operand.start);
+                return false;
+            }
+        }
     }
 
-    rewind(inputFile); // 파일 포인터를 다시 처음으로 이동
-    fclose(inputFile); // 파일을 닫는다.
-    return false;
+    return true;
 }
 
-// 두 번쨰 패스. 실제로 명령어를 계산하고 명령어를 해석(이진수 변환)하는 부분.
-bool processFile(const char *filename)
+// 줄이 빈 줄인지, 라벨인지, 명령어인지, 지시어인지만 빠르게 알아낸다. (앞의 토큰 두 개만 본다)
+// 라벨이면 *label 에 이름을 넣는다.
+LineKind classifyLine(const char *line, int length, Token *label)
 {
-    FILE *inputFile = fopen(filename, "r");
-    char outputFilename[260];
-    pc = 1000;
-    bool isThereError = false;
-    // 파일명.o  파일을 만드는 것
-    snprintf(outputFilename, sizeof(outputFilename), "%s.o", strtok(strdup(filename), "."));
-    FILE *outputFile = fopen(outputFilename, "w");
-    fileOpenCheck = 1;
+    Token tokens[2];
+    int count = lexLine(line, length, tokens, 2);
 
-    char line[MAX_LINE_LENGTH];
+    if (count == 0)
+    {
+        return LINE_EMPTY;
+    }
+    if (count >= 2 && tokens[1].kind == TOKEN_COLON)
+    {
+        *label = tokens[0];
+        return LINE_LABEL;
+    }
+    if (tokens[0].kind == TOKEN_WORD && tokens[0].start[0] == '.')
+    {
+        return LINE_DIRECTIVE;
+    }
+    return LINE_INSTRUCTION;
+}
 
-    if (inputFile == NULL || outputFile == NULL)
+// buffer 에서 다음 줄을 꺼낸다. 줄의 시작을 돌려주고 *cursor 는 다음 줄로 옮긴다. 더 없으면 NULL
+const char *nextLine(const char **cursor, const char *end, int *length)
+{
+    const char *line = *cursor;
+    if (line >= end)
     {
-        printf("we can't open the file\n");
-        return false;
+        return NULL;
     }
 
-    //  파일 끝까지 읽는다.
-    while (fgets(line, sizeof(line), inputFile) != NULL)
+    const char *newline = memchr(line, '\n', end - line);
+    const char *lineEnd = (newline != NULL) ? newline : end;
+    *length = (int)(lineEnd - line);
+    *cursor = lineEnd + 1;
+    return line;
+}
+
+// 작업량에 맞춰 쓸 스레드 수를 정한다. (--threads 로 정할 수 있고, 기본값은 CPU 개수)
+int decideThreadCount(long long work, long long minWorkPerThread)
+{
+    int count = threadCount;
+    if (count <= 0)
+    {
+        count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (count > MAX_THREADS)
+    {
+        count = MAX_THREADS;
+    }
+    if (work / minWorkPerThread < count)
     {
-        // 줄 끝의 개행 문자 제거
-        line[strcspn(line, "\n")] = '\0';
+        count = (int)(work / minWorkPerThread);
+    }
+    return (count < 1) ? 1 : count;
+}
 
-        // 비어있는 줄은 넘어간다.
-        if (strlen(line) == 0)
-        {
-            continue;
-        }
+// 파일 전체를 아레나로 읽는다. 끝에 널 문자를 붙여서 돌려준다. (열 수 없으면 NULL)
+char *readFileToArena(const char *filename, size_t *size)
+{
+    FILE *file = fopen(filename, "rb");
+    if (file == NULL)
+    {
+        return NULL;
+    }
 
-        // 라벨 값은 그냥 넘어간다.
-        if (strchr(line, ':') != NULL)
-        {
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
 
-            continue;
-        }
+    char *buffer = arenaAlloc(&fileArena, length + 1);
+    *size = fread(buffer, 1, length, file);
+    buffer[*size] = '\0';
+    fclose(file);
+    return buffer;
+}
 
-        // 명령어의 유형을 판별 , 그리고 여기서 명령어를 모두 소문자로 만들어준다!!
-        InstructionType type = identifyInstructionType(line);
+// 소스 파일 전체를 아레나로 읽는다. 끝에 널 문자를 붙여두고, 모든 패스가 이 버퍼 하나를 같이 본다.
+// 파이프라인 모드에서는 읽기 스레드가 미리 읽어둔 버퍼를 그대로 쓴다.
+bool loadSource(const char *filename)
+{
+    if (prefetchedSource != NULL)
+    {
+        source = prefetchedSource->buffer;
+        sourceSize = prefetchedSource->size;
+        return source != NULL;
+    }
+    source = readFileToArena(filename, &sourceSize);
+    return source != NULL;
+}
 
-        // 문법에 맞지 않는 assembly 코드가 하나라도 존재하는 경우에
-        // Syntax Error을 출력하고 새로운 파일 입력을 대기함. 파일명.o ,파일명.trace파일을 생성하지 않음
-        if (type == UNKNOWN_TYPE)
+// 두 이름이 대소문자 구분 없이 같은지 확인한다.
+bool namesEqual(const char *a, int aLength, const char *b, int bLength)
+{
+    if (aLength != bLength)
+    {
+        return false;
+    }
+    for (int i = 0; i < aLength; i++)
+    {
+        if (tolower((unsigned char)a[i]) != tolower((unsigned char)b[i]))
         {
-            printf("Syntax Error!!\n");
-            fileOpenCheck = 0;
-            break;
+            return false;
         }
+    }
+    return true;
+}
 
-        // 여기서부터 파일을 한줄씩 입력받으며 이진수로 새로운 파일에 적는다.
-        for (int i = 0; instructionTable[i].instName != NULL; i++)
+// 레이블 이름으로 labels 위치를 찾는다. 없으면 -1
+int findLabelIndex(const char *name, int length)
+{
+    if (labelTableSize == 0)
+    {
+        return -1;
+    }
+
+    unsigned int slot = hashName(name, length) & (labelTableSize - 1);
+    while (labelTable[slot] != 0)
+    {
+        Label *label = &labels[labelTable[slot] - 1];
+        if (namesEqual(source + label->nameOffset, label->nameLength, name, length))
         {
-            // 첫단어를 입력받는다.
-            char instruction[20];
-            sscanf(line, "%s", instruction);
+            return labelTable[slot] - 1;
+        }
+        slot = (slot + 1) & (labelTableSize - 1);
+    }
+    return -1;
+}
 
-            // 입력받은 첫 단어를 구조체 안에서 탐색한다.
-            if (strcmp(instruction, instructionTable[i].instName) == 0)
+// 레이블을 추가한다. 배열과 해시표는 아레나에서 두 배씩 늘린다.
+// 이미 같은 이름이 있으면 해시표는 처음 것을 그대로 가리킨다.
+void addLabel(Token name, int address)
+{
+    if (labelCount >= labelCapacity)
+    {
+        int newCapacity = (labelCapacity == 0) ? 256 : labelCapacity * 2;
+        labels = arenaGrow(&fileArena, labels, labelCount * sizeof(Label), newCapacity * sizeof(Label));
+        labelCapacity = newCapacity;
+    }
+
+    // 해시표는 반 이상 차지 않도록 레이블 배열의 두 배 크기로 유지한다.
+    if (labelTableSize < labelCapacity * 2)
+    {
+        labelTableSize = labelCapacity * 2;
+        labelTable = arenaAlloc(&fileArena, labelTableSize * sizeof(int));
+        memset(labelTable, 0, labelTableSize * sizeof(int));
+        for (int i = 0; i < labelCount; i++)
+        {
+            unsigned int slot = hashName(source + labels[i].nameOffset, labels[i].nameLength) & (labelTableSize - 1);
+            while (labelTable[slot] != 0)
             {
-                unsigned int opcode = instructionTable[i].opcode;
-                unsigned int funct3 = instructionTable[i].funct3;
-                unsigned int funct7 = instructionTable[i].funct7;
-                unsigned int rd, rs1, rs2, imm;
-                char reg1[10], reg2[10], reg3[10];
+                slot = (slot + 1) & (labelTableSize - 1);
+            }
+            labelTable[slot] = i + 1;
+        }
+    }
 
-                // R-type 명령어 처리
-                if (type == R_TYPE)
-                {
-                    // R-type 형식: opcode (7 bits) | rd (5 bits) | funct3 (3 bits) | rs1 (5 bits) | rs2 (5 bits) | funct7 (7 bits)
+    labels[labelCount].nameOffset = (int)(name.start - source);
+    labels[labelCount].nameLength = name.length;
+    labels[labelCount].address = address;
+    labels[labelCount].binding = LABEL_LOCAL;
+    labels[labelCount].inData = false;
 
-                    // 12_1 최종수정
-                    sscanf(line, "%*s %[^,],%[^,],%s", reg1, reg2, reg3);
+    if (findLabelIndex(name.start, name.length) < 0)
+    {
+        unsigned int slot = hashName(name.start, name.length) & (labelTableSize - 1);
+        while (labelTable[slot] != 0)
+        {
+            slot = (slot + 1) & (labelTableSize - 1);
+        }
+        labelTable[slot] = labelCount + 1;
+    }
+    labelCount++;
+}
 
-                   
-                    rd = extractRegisterNumber(reg1);
-                    rs1 = extractRegisterNumber(reg2);
-                    rs2 = extractRegisterNumber(reg3);
-                    unsigned int instruction = (funct7 << 25) | (rs2 << 20) | (rs1 << 15) | (funct3 << 12) | (rd << 7) | opcode;
-                    writeBinary(outputFile, instruction);
-                }
-                // I-type 명령어 처리
-                else if (type == I_TYPE)
-                {
-                    // I-type 형식: imm(12bits) | rs1 (5 bits) | funct3 (3 bits) | rd (5 bits) | opcode (7 bits)
+// 레이블의 주소를 찾는 함수 (레이블 이름은 대소문자를 구분하지 않는다)
+int findLabelAddress(Token label)
+{
+    int index = findLabelIndex(label.start, label.length);
+    return (index < 0) ? -1 : labels[index].address; // 찾지 못한 경우 -1
+}
 
-                    //'lw'와 'jalr' 은 명령어 명령어 형식이 조금다르니 다르게 받는다.
-                    if (instructionTable[i].instName == "lw" || instructionTable[i].instName == "jalr")
-                    {
-                        sscanf(line, "%*s %[^,],%d(%[^)])", reg1, &imm, reg2);
-                        rd = extractRegisterNumber(reg1);
-                        rs1 = extractRegisterNumber(reg2);
-                        isThereError = is_overflow(imm, type);
-                        imm = (imm & 0xFFFFFFFF);
-
-                        unsigned int instruction = (imm << 20) | (rs1 << 15) | (funct3 << 12) | (rd << 7) | opcode;
-                        writeBinary(outputFile, instruction);
-                    }
-                    else if (instructionTable[i].instName == "srli" || instructionTable[i].instName == "slli" || instructionTable[i].instName == "srai")
-                    {
-                        sscanf(line, "%*s %[^,],%[^,],%d", reg1, reg2, &imm);
-                        //sscanf(line, "%*s %s %s %d", reg1, reg2, &imm);
+// 카운터 CSR 값. retired 는 이 명령어 앞까지 실행한 명령어 수이다.
+// 타이밍 모델이 없으므로 한 명령어를 한 cycle 로 보고, time 도 명령어마다 한 번 오르는 것으로 둔다.
+// (cycle, time, instret 가 모두 같은 값이고, ...h 는 위쪽 32비트)
+unsigned int readCounter(unsigned int csr, long long retired)
+{
+    unsigned long long value = (unsigned long long)retired;
+    return (csr & 0x80) ? (unsigned int)(value >> 32) : (unsigned int)value;
+}
 
-                        rd = extractRegisterNumber(reg1);
-                        rs1 = extractRegisterNumber(reg2);
-                        if (imm > 32)
-                        {
-                            isThereError = true;
-                        }
-                        imm = (imm & 0x1F); // sign-extension 처리
-                        unsigned int instruction = (funct7 << 25) | (imm << 20) | (rs1 << 15) | (funct3 << 12) | (rd << 7) | opcode;
-                        writeBinary(outputFile, instruction);
-                    }
-                    else
-                    {
-                        sscanf(line, "%*s %[^,],%[^,],%d", reg1, reg2, &imm);
-                        rd = extractRegisterNumber(reg1);
-                        rs1 = extractRegisterNumber(reg2);
-                        isThereError = is_overflow(imm, type);
-                        imm = (imm & 0xFFFFFFFF); // sign-extension 처리
-                        unsigned int instruction = (imm << 20) | (rs1 << 15) | (funct3 << 12) | (rd << 7) | opcode;
-                        writeBinary(outputFile, instruction);
-                    }
-                }
-                // S-type 명령어 처리
-                else if (type == S_TYPE)
-                {
-                    // S=type 형식: imm[11:5] (7 bits) | rs2 (5 bits) | rs1 (5 bits) | funct3 (3 bits) | imm[4-1:11] (5 bits) | opcode (7 bits)
-                    sscanf(line, "%*s %[^,],%d(%[^)])", reg1, &imm, reg2);
-                    rs2 = extractRegisterNumber(reg1);
-                    rs1 = extractRegisterNumber(reg2);
-                    isThereError = is_overflow(imm, type);
-                    unsigned int imm11_5 = (imm >> 5) & 0x7F;
-                    unsigned int imm4_0 = imm & 0x1F;
-                    unsigned int instruction = (imm11_5 << 25) | (rs2 << 20) | (rs1 << 15) | (funct3 << 12) | (imm4_0 << 7) | opcode;
-                    writeBinary(outputFile, instruction);
-                }
-                // SB-type 명령어 처리
-                else if (type == SB_TYPE)
-                {
+//
+// 시스템 호출 구간!! 시작!! (ecall)
+//
+// 리눅스 RISC-V 번호를 따른다. a7(x17) 에 번호, a0~a3(x10~x13) 에 인자를 넣고, 결과(에러면 -errno)는 a0 에 돌려준다.
+//   56 openat(dirfd, path, flags, mode)  1024 open(path, flags, mode)  57 close(fd)
+//   63 read(fd, buf, count)  64 write(fd, buf, count)  93/94 exit(code)  214 brk(addr)
+// 메모리는 주소마다 int 하나이므로 buf 와 path 는 주소 하나에 4바이트(리틀 엔디언)씩 채운 바이트열로 보고, count 는 바이트 수이다.
+// 페이지 안의 값 배열은 그대로 4KB 바이트열이므로, 큰 read/write 는 페이지마다 iovec 을 만들어 readv/writev 로
+// 게스트 메모리에 바로 읽고 쓴다. 작은 read/write 는 파일마다 버퍼에 모아서 시스템 호출 수를 줄인다.
+// 파일은 --io-dir 로 준 디렉터리 안에서만 열 수 있고, 0, 1, 2 는 호스트의 stdin, stdout, stderr 이다.
+// 하트와 lockstep 인스턴스는 파일 표를 같이 쓰고, 시스템 호출 하나는 잠금 안에서 한다.
+// 연 파일과 brk 는 체크포인트에 들어가지 않는다.
+
+// 게스트가 연 파일 하나
+typedef struct
+{
+    int hostFd;        // 호스트 fd (-1 이면 빈 자리)
+    char *buffer;      // 작은 read/write 를 모으는 버퍼 (처음 쓸 때 만든다)
+    int bufferStart;   // 읽기 버퍼에서 아직 주지 않은 곳
+    int bufferLength;  // 버퍼에 든 바이트 수
+    bool writing;      // 버퍼가 쓰기용인지
+} GuestFile;
+
+GuestFile guestFiles[GUEST_FILE_COUNT];
+bool guestFilesReady = false;   // 0, 1, 2 를 채웠는지
+int ioDirectoryFd = -1;         // --io-dir 디렉터리 (열지 않았으면 -1)
+int programBreak = 0;           // brk 가 돌려주는 주소 (0 이면 아직 정하지 않았다)
+int programBreakStart = 0;      // 데이터 끝 (brk 로 이보다 줄일 수 없다)
+bool guestExited = false;       // exit 시스템 호출로 끝났는지
+int guestExitCode = 0;
+bool systemCallsStubbed = false; // true 면 ecall 이 호스트와 파일 표, brk 를 건드리지 않는다. (--compare-dynamic 의 세기 실행)
+pthread_mutex_t systemCallLock = PTHREAD_MUTEX_INITIALIZER;
+
+// 게스트 메모리의 바이트 구간 [address*4, address*4 + bytes) 을 페이지마다 iovec 으로 만든다. (maxIov 개까지)
+// create 면 없는 페이지를 만들고 (read 할 때), 아니면 없는 페이지는 0 으로 채운 페이지를 가리킨다. *covered 는 만든 바이트 수
+int guestIovec(int address, long long bytes, bool create, struct iovec *iov, int maxIov, long long *covered)
+{
+    static const int zeroPage[MEMORY_PAGE_WORDS];
+    int count = 0;
+    long long done = 0;
 
-                    // SB-type 형식: imm[12|10:5] (7 bits) | rs2 (5 bits) | rs1 (5 bits) | funct3 (3 bits) | imm[4:1|11] (5 bits) | opcode (7 bits)
-                    char immStr[50];
-                    sscanf(line, "%*s %[^,],%[^,],%s", reg1, reg2, immStr);
-                    int labelAddress = 0;
+    while (done < bytes && count < maxIov)
+    {
+        int current = address + (int)(done / 4);
+        unsigned int offset = (unsigned int)current & (MEMORY_PAGE_WORDS - 1);
+        long long length = (long long)(MEMORY_PAGE_WORDS - offset) * 4;
+        if (length > bytes - done)
+        {
+            length = bytes - done;
+        }
 
-                    rs1 = extractRegisterNumber(reg1);
-                    rs2 = extractRegisterNumber(reg2);
-                    int isLabel = 0;
-                    int offset = 0;
+        MemoryPage *page = findMemoryPage(currentMemory, current, create);
+        iov[count].iov_base = (page != NULL) ? (void *)&page->values[offset] : (void *)&zeroPage[offset];
+        iov[count].iov_len = (size_t)length;
+        count++;
+        done += length;
+    }
+    *covered = done;
+    return count;
+}
 
-                    // immStr이 정수 값인지 레이블인지를 판단합니다.
-                    if (isdigit(immStr[0]) || immStr[0] == '-')
-                    {
-                        // 정수형 즉시 값인 경우
-                        offset = atoi(immStr);
-                        isThereError = is_overflow(offset, type);
-                    }
-                    else
-                    {
-                        // 레이블인 경우, 레이블의 주소를 찾아야 합니다.
-                        labelAddress = findLabelAddress(immStr);
-                        if (labelAddress == -1)
-                        {
-                            // Syntax error로 고쳐야한다!!! ()
-                            // printf("Label not found: %s\n", immStr);
-                            isThereError = true;
-                            break;
-                        }
-                        // 현재 PC와 레이블 주소의 차이를 계산해 offset으로 사용합니다.
-                        offset = (labelAddress - pc) / 2; // SB 타입에서는 offset을 명령어 주소의 차이로 계산해야 합니다.
-                        isLabel = 1;
-                    }
+// 게스트 메모리에 바이트를 넣은 주소들을 저장한 주소로 표시한다.
+void markGuestBytes(int address, long long bytes)
+{
+    for (long long word = 0; word < (bytes + 3) / 4; word++)
+    {
+        int current = address + (int)word;
+        MemoryPage *page = findMemoryPage(currentMemory, current, true);
+        unsigned int index = (unsigned int)current & (MEMORY_PAGE_WORDS - 1);
+        if ((page->touched[index / 64] & (1ULL << (index % 64))) == 0)
+        {
+            __atomic_fetch_or(&page->touched[index / 64], 1ULL << (index % 64), __ATOMIC_RELAXED);
+        }
 
-                    // Branch 명령어의 즉시 값을 비트로 분해합니다.
-                    offset = (offset << 1);
-                    unsigned int imm12 = (offset >> 12) & 0x1;
-                    unsigned int imm10_5 = (offset >> 5) & 0x3F;
-                    unsigned int imm4_1 = (offset >> 1) & 0xF;
-                    unsigned int imm11 = (offset >> 11) & 0x1;
-                    unsigned int instruction = (imm12 << 31) | (imm10_5 << 25) | (rs2 << 20) | (rs1 << 15) | (funct3 << 12) | (imm4_1 << 8) | (imm11 << 7) | opcode;
+        // read 로 채운 주소도 저장한 것이므로 예약을 깨뜨린다.
+        unsigned int *generation = writeGeneration(currentMemory, current);
+        __atomic_store_n(generation, lockWriteGeneration(generation) + 2, __ATOMIC_RELEASE);
+    }
+}
 
-                    // 이진수로 출력
-                    writeBinary(outputFile, instruction);
-                }
-                // J-type 명령어 처리
-                else if (type == J_TYPE)
-                {
-                    // J - type 형식: imm[20:10-1:11:19-12] (20 bits) | rd (5 bits) | opcode (7 bits)
-                    char immStr[50];
-                    
-                    sscanf(line, "%*s %[^,],%s", reg1, immStr);
-                    //sscanf(line, "%*s %s %s", reg1, immStr);
+// 게스트 메모리와 호스트 버퍼 사이에서 bytes 바이트를 복사한다.
+void copyGuestBytes(int address, char *host, long long bytes, bool toGuest)
+{
+    struct iovec iov[64];
+    long long done = 0;
+    while (done < bytes)
+    {
+        long long covered;
+        int count = guestIovec(address + (int)(done / 4), bytes - done, toGuest, iov, 64, &covered);
+        for (int i = 0; i < count; i++)
+        {
+            if (toGuest)
+            {
+                memcpy(iov[i].iov_base, host + done, iov[i].iov_len);
+            }
+            else
+            {
+                memcpy(host + done, iov[i].iov_base, iov[i].iov_len);
+            }
+            done += (long long)iov[i].iov_len;
+        }
+    }
+    if (toGuest)
+    {
+        markGuestBytes(address, bytes);
+    }
+}
 
-            
-                    int labelAddress = 0;
+// 0, 1, 2 를 호스트 stdin, stdout, stderr 로 채우고 brk 시작 주소를 데이터 끝 다음 페이지로 정한다.
+void initSystemCalls()
+{
+    if (guestFilesReady)
+    {
+        return;
+    }
+    for (int i = 0; i < GUEST_FILE_COUNT; i++)
+    {
+        memset(&guestFiles[i], 0, sizeof(GuestFile));
+        guestFiles[i].hostFd = (i < 3) ? i : -1;
+    }
 
-                    rd = extractRegisterNumber(reg1);
+    long long dataEnd = DATA_SEGMENT_BASE;
+    for (int b = 0; b < dataBlockCount; b++)
+    {
+        if ((long long)dataBlocks[b].address + dataBlocks[b].count > dataEnd)
+        {
+            dataEnd = (long long)dataBlocks[b].address + dataBlocks[b].count;
+        }
+    }
+    dataEnd = (dataEnd + MEMORY_PAGE_WORDS - 1) & ~(long long)(MEMORY_PAGE_WORDS - 1);
+    programBreakStart = programBreak = (dataEnd > INT_MAX) ? INT_MAX : (int)dataEnd;
+    ioDirectoryFd = (ioDirectory != NULL) ? open(ioDirectory, O_RDONLY | O_DIRECTORY | O_CLOEXEC) : -1;
+    guestFilesReady = true;
+}
 
-                
+// 쓰기 버퍼를 호스트 파일로 내보낸다.
+bool flushGuestFile(GuestFile *file)
+{
+    int written = 0;
+    if (file->writing)
+    {
+        if (file->hostFd == 1 || file->hostFd == 2)
+        {
+            fflush(stdout); // 시뮬레이터가 printf 로 출력한 것과 순서를 맞춘다.
+        }
+        while (written < file->bufferLength)
+        {
+            ssize_t result = write(file->hostFd, file->buffer + written, file->bufferLength - written);
+            if (result <= 0)
+            {
+                break;
+            }
+            written += (int)result;
+        }
+    }
+    else if (file->bufferLength > file->bufferStart)
+    {
+        // 읽기 버퍼에 남은 만큼 파일 위치를 되돌린다. (파이프처럼 되돌릴 수 없으면 버린다)
+        lseek(file->hostFd, -(off_t)(file->bufferLength - file->bufferStart), SEEK_CUR);
+    }
+    bool complete = (!file->writing || written == file->bufferLength);
+    file->bufferStart = 0;
+    file->bufferLength = 0;
+    file->writing = false;
+    return complete;
+}
 
-                    int isLabel = 0;
-                    int offset = 0;
+// 게스트 문자열(주소 하나에 4글자)을 읽는다. 너무 길면 false
+bool readGuestString(int address, char *out, int size)
+{
+    copyGuestBytes(address, out, size, false);
+    return memchr(out, '\0', size) != NULL;
+}
 
-                    // immStr이 정수 값인지 레이블인지를 판단합니다.
-                    if (isdigit(immStr[0]) || immStr[0] == '-')
-                    {
-                        // 정수형 즉시 값인 경우
-                        offset = atoi(immStr);
-                        isThereError = is_overflow(offset, type);
-                    }
-                    else
-                    {
-                        // 레이블인 경우, 레이블의 주소를 찾아야 합니다.
-                        labelAddress = findLabelAddress(immStr);
-                        if (labelAddress == -1)
-                        {
-                            // Syntax error로 고쳐야한다!!! ()
-                            // printf("Label not found: %s\n", immStr);
-                            isThereError = true;
-                            break;
-                        }
-                        // 현재 PC와 레이블 주소의 차이를 계산해 offset으로 사용합니다.
-                        offset = (labelAddress - pc) / 2; // SB 타입에서는 offset을 명령어 주소의 차이로 계산해야 합니다.
-                        isLabel = 1;
-                    }
+// --io-dir 안의 파일을 연다. 절대 경로와 ".." 은 받지 않고, 커널이 지원하면 openat2 의 RESOLVE_BENEATH 로
+// 심볼릭 링크로 디렉터리 밖으로 나가는 것도 막는다.
+int openGuestFile(int pathAddress, int flags, int mode)
+{
+    char path[256];
+    if (ioDirectoryFd < 0)
+    {
+        return -EACCES;
+    }
+    if (!readGuestString(pathAddress, path, sizeof(path)))
+    {
+        return -ENAMETOOLONG;
+    }
+    if (path[0] == '\0' || path[0] == '/' || strcmp(path, "..") == 0 || strncmp(path, "../", 3) == 0 ||
+        strstr(path, "/../") != NULL || (strlen(path) >= 3 && strcmp(path + strlen(path) - 3, "/..") == 0))
+    {
+        return -EACCES;
+    }
 
-                    offset = (offset << 1);
-                    imm = offset;
-                    unsigned int imm20 = imm & 0x1;
-                    unsigned int imm10_1 = (imm >> 1) & 0x3FF;
-                    unsigned int imm11 = (imm >> 11) & 0x1;
-                    unsigned int imm19_12 = (imm >> 12) & 0xFF;
-                    unsigned int instruction = (imm20 << 31) | (imm10_1 << 21) | (imm11 << 20) | (imm19_12 << 12) | (rd << 7) | opcode;
-                    writeBinary(outputFile, instruction);
-                }
+    int slot = 3;
+    while (slot < GUEST_FILE_COUNT && guestFiles[slot].hostFd >= 0)
+    {
+        slot++;
+    }
+    if (slot == GUEST_FILE_COUNT)
+    {
+        return -EMFILE;
+    }
 
-                // EXIT type 명령어 처리
-                else if (type == EXIT_TYPE)
-                {
-                    unsigned int instruction = 0xFFFFFFFF;
-                    writeBinary(outputFile, instruction);
-                }
-                break;
+    struct open_how how;
+    memset(&how, 0, sizeof(how));
+    how.flags = (unsigned long long)((flags & (O_ACCMODE | O_CREAT | O_TRUNC | O_APPEND | O_EXCL)) | O_CLOEXEC);
+    how.mode = (flags & O_CREAT) ? (unsigned long long)((mode != 0) ? (mode & 0777) : 0644) : 0;
+    how.resolve = RESOLVE_BENEATH | RESOLVE_NO_MAGICLINKS;
+    int fd = (int)syscall(SYS_openat2, ioDirectoryFd, path, &how, sizeof(how));
+    if (fd < 0 && errno == ENOSYS)
+    {
+        fd = openat(ioDirectoryFd, path, (int)how.flags | O_NOFOLLOW, (mode_t)how.mode);
+    }
+    if (fd < 0)
+    {
+        return -errno;
+    }
+    guestFiles[slot].hostFd = fd;
+    return slot;
+}
+
+// read. 버퍼가 비어있고 큰 요청이면 readv 로 게스트 메모리에 바로 읽고, 아니면 버퍼에서 준다.
+long long readGuestFile(GuestFile *file, int address, long long count)
+{
+    struct iovec iov[1024];
+    if (file->writing)
+    {
+        flushGuestFile(file);
+    }
+    if (file->bufferStart == file->bufferLength && count >= GUEST_FILE_BUFFER / 2)
+    {
+        long long covered;
+        int iovCount = guestIovec(address, count, true, iov, 1024, &covered);
+        ssize_t result = readv(file->hostFd, iov, iovCount);
+        if (result < 0)
+        {
+            return -errno;
+        }
+        markGuestBytes(address, result);
+        return result;
+    }
+
+    if (file->bufferStart == file->bufferLength)
+    {
+        if (file->buffer == NULL && (file->buffer = malloc(GUEST_FILE_BUFFER)) == NULL)
+        {
+            return -ENOMEM;
+        }
+        ssize_t result = read(file->hostFd, file->buffer, GUEST_FILE_BUFFER);
+        if (result < 0)
+        {
+            return -errno;
+        }
+        file->bufferStart = 0;
+        file->bufferLength = (int)result;
+    }
+
+    long long length = file->bufferLength - file->bufferStart;
+    if (length > count)
+    {
+        length = count;
+    }
+    copyGuestBytes(address, file->buffer + file->bufferStart, length, true);
+    file->bufferStart += (int)length;
+    return length;
+}
+
+// write. 큰 요청이면 버퍼를 내보낸 뒤 writev 로 게스트 메모리에서 바로 쓰고, 아니면 버퍼에 모은다.
+long long writeGuestFile(GuestFile *file, int address, long long count)
+{
+    struct iovec iov[1024];
+    if (!file->writing)
+    {
+        flushGuestFile(file);
+        file->writing = true;
+    }
+    if (count >= GUEST_FILE_BUFFER / 2)
+    {
+        if (!flushGuestFile(file))
+        {
+            return -EIO;
+        }
+        file->writing = true;
+        if (file->hostFd == 1 || file->hostFd == 2)
+        {
+            fflush(stdout);
+        }
+
+        long long done = 0;
+        while (done < count)
+        {
+            long long covered;
+            int iovCount = guestIovec(address + (int)(done / 4), count - done, false, iov, 1024, &covered);
+            ssize_t result = writev(file->hostFd, iov, iovCount);
+            if (result < 0)
+            {
+                return (done > 0) ? done : -errno;
+            }
+            done += result;
+            if (result < (ssize_t)covered)
+            {
+                break; // 짧게 쓰였으면 쓴 만큼만 돌려준다.
             }
         }
-        if (isThereError == true || register_error == true)
+        return done;
+    }
+
+    if (file->buffer == NULL && (file->buffer = malloc(GUEST_FILE_BUFFER)) == NULL)
+    {
+        return -ENOMEM;
+    }
+    if (file->bufferLength + count > GUEST_FILE_BUFFER)
+    {
+        flushGuestFile(file);
+        file->writing = true;
+    }
+    copyGuestBytes(address, file->buffer + file->bufferLength, count, false);
+    file->bufferLength += (int)count;
+    return count;
+}
+
+// 게스트 파일을 닫는다. (0, 1, 2 는 버퍼만 내보내고 호스트 fd 는 닫지 않는다)
+int closeGuestFile(int fd)
+{
+    GuestFile *file = &guestFiles[fd];
+    bool complete = flushGuestFile(file);
+    free(file->buffer);
+    file->buffer = NULL;
+    if (fd >= 3)
+    {
+        int result = close(file->hostFd);
+        file->hostFd = -1;
+        if (result != 0)
         {
-            break;
+            return -errno;
         }
-        pc = pc + 4;
     }
+    return complete ? 0 : -EIO;
+}
 
-    if (fileOpenCheck == 1 && register_error == false && isThereError == false)
+// 프로그램이 끝나면 모든 게스트 파일을 닫고, exit 로 끝났으면 종료 코드를 출력한다.
+void finishSystemCalls()
+{
+    if (guestFilesReady)
+    {
+        for (int fd = 0; fd < GUEST_FILE_COUNT; fd++)
+        {
+            if (guestFiles[fd].hostFd >= 0)
+            {
+                closeGuestFile(fd);
+            }
+        }
+        if (ioDirectoryFd >= 0)
+        {
+            close(ioDirectoryFd);
+            ioDirectoryFd = -1;
+        }
+        guestFilesReady = false;
+    }
+    if (guestExited)
     {
+        printf("exit code %d\n", guestExitCode);
+        guestExited = false;
+        guestExitCode = 0;
+    }
+}
 
-        fclose(inputFile);
-        fclose(outputFile);
+// 호스트를 건드리지 않는 ecall. write 는 다 쓴 것으로, read 는 파일 끝으로, open 은 실패로 돌려준다.
+bool stubSystemCall()
+{
+    int number = registers[17];
+    int a0 = registers[10];
+    switch (number)
+    {
+    case 93: // exit
+    case 94: // exit_group
         return true;
+    case 64: // write
+        registers[10] = (registers[12] > 0) ? registers[12] : 0;
+        break;
+    case 63: // read
+    case 57: // close
+        registers[10] = 0;
+        break;
+    case 214: // brk
+        registers[10] = (a0 >= programBreakStart) ? a0 : programBreak;
+        break;
+    case 56:   // openat
+    case 1024: // open
+        registers[10] = -EACCES;
+        break;
+    default:
+        registers[10] = -ENOSYS;
+        break;
     }
-    else
+    return false;
+}
+
+// ecall 하나를 처리한다. 프로그램을 끝내야 하면 true
+bool systemCall()
+{
+    if (systemCallsStubbed)
     {
-        fclose(inputFile);
-        fclose(outputFile);
-        remove(outputFilename);
-        return false;
+        return stubSystemCall();
+    }
+
+    int number = registers[17];
+    int a0 = registers[10];
+    int a1 = registers[11];
+    int a2 = registers[12];
+    int a3 = registers[13];
+    long long result = -ENOSYS;
+    bool stop = false;
+
+    pthread_mutex_lock(&systemCallLock);
+    initSystemCalls();
+    switch (number)
+    {
+    case 56: // openat (dirfd 는 보지 않고 --io-dir 기준으로 연다)
+        result = openGuestFile(a1, a2, a3);
+        break;
+    case 1024: // open
+        result = openGuestFile(a0, a1, a2);
+        break;
+    case 57: // close
+        result = (a0 >= 0 && a0 < GUEST_FILE_COUNT && guestFiles[a0].hostFd >= 0) ? closeGuestFile(a0) : -EBADF;
+        break;
+    case 63: // read
+    case 64: // write
+        if (a0 < 0 || a0 >= GUEST_FILE_COUNT || guestFiles[a0].hostFd < 0)
+        {
+            result = -EBADF;
+        }
+        else if (a2 < 0)
+        {
+            result = -EINVAL;
+        }
+        else if (a2 == 0)
+        {
+            result = 0;
+        }
+        else
+        {
+            result = (number == 63) ? readGuestFile(&guestFiles[a0], a1, a2) : writeGuestFile(&guestFiles[a0], a1, a2);
+        }
+        break;
+    case 93: // exit
+    case 94: // exit_group
+        guestExited = true;
+        guestExitCode = a0;
+        stop = true;
+        break;
+    case 214: // brk (주소 단위. 데이터 끝보다 줄일 수는 없다)
+        if (a0 >= programBreakStart)
+        {
+            programBreak = a0;
+        }
+        result = programBreak;
+        break;
+    default:
+        break;
+    }
+    pthread_mutex_unlock(&systemCallLock);
+
+    if (!stop)
+    {
+        registers[10] = (int)result;
+    }
+    return stop;
+}
+
+// 명령어를 실질적으로 계산하는 함수(레지스터 계산 포함)
+// 레지스터 번호와 즉시값은 loadInstructions 에서 미리 해석해 두었으므로 여기서는 계산만 한다.
+int executeInstruction(const Instruction *instr)
+{
+    const InstructionInfo *info = &instructionTable[instr->infoIndex];
+    InstructionType type = info->type;
+    unsigned int rd = instr->rd;
+    unsigned int rs1 = instr->rs1;
+    unsigned int rs2 = instr->rs2;
+    int imm = instr->imm;
+
+    // R-type 명령어 처리
+    if (type == R_TYPE)
+    {
+        switch (info->funct3)
+        {
+        case 0x0: // add, sub
+            registers[rd] = (info->funct7 == 0x20) ? registers[rs1] - registers[rs2] : registers[rs1] + registers[rs2];
+            break;
+        case 0x7: // and
+            registers[rd] = registers[rs1] & registers[rs2];
+            break;
+        case 0x6: // or
+            registers[rd] = registers[rs1] | registers[rs2];
+            break;
+        case 0x4: // xor
+            registers[rd] = registers[rs1] ^ registers[rs2];
+            break;
+        case 0x1: // sll
+            registers[rd] = registers[rs1] << (registers[rs2] & 0x1F);
+            break;
+        case 0x5: // srl, sra
+            if (info->funct7 == 0x20)
+            {
+                // 산술 시프트 연산: 부호 비트를 유지하며 시프트
+                int shiftAmount = registers[rs2] & 0x1F;
+                registers[rd] = registers[rs1] >> shiftAmount;
+                if (registers[rs1] < 0)
+                {
+                    // 음수인 경우 상위 비트를 1로 채움 (부호 비트 유지)
+                    unsigned int mask = (1 << (32 - shiftAmount)) - 1;
+                    registers[rd] |= ~mask;
+                }
+            }
+            else
+            {
+                registers[rd] = ((unsigned int)registers[rs1]) >> (registers[rs2] & 0x1F);
+            }
+            break;
+        }
+        pc = pc + 4;
+    }
+    // I-type 명령어 처리
+    else if (type == I_TYPE)
+    {
+        if (info->opcode == 0x03) // lw
+        {
+            int address = registers[rs1] + imm;
+            registers[rd] = loadMemory(address);
+
+            pc = pc + 4;
+        }
+        else if (info->opcode == 0x67) // jalr
+        {
+            int next_pc = pc + 4; // 다음 명령어 주소 저장
+
+            pc = (registers[rs1] + imm) & ~1; // 목표 주소로 점프
+
+            if (rd != 0)
+            {
+                registers[rd] = next_pc; // 반환 주소 저장 (rd가 x0이 아닌 경우)
+            }
+        }
+        else
+        {
+            switch (info->funct3)
+            {
+            case 0x0: // addi
+                registers[rd] = registers[rs1] + imm;
+                break;
+            case 0x7: // andi
+                registers[rd] = registers[rs1] & imm;
+                break;
+            case 0x6: // ori
+                registers[rd] = registers[rs1] | imm;
+                break;
+            case 0x4: // xori
+                registers[rd] = registers[rs1] ^ imm;
+                break;
+            case 0x1: // slli
+                registers[rd] = registers[rs1] << (imm & 0x1F);
+                break;
+            case 0x5: // srli, srai
+                if (info->funct7 == 0x20)
+                {
+                    // 산술 시프트 연산: 부호 비트를 유지하며 시프트
+                    int shiftAmount = imm & 0x1F;
+                    registers[rd] = registers[rs1] >> shiftAmount;
+                    if (registers[rs1] < 0)
+                    {
+                        // 음수인 경우 상위 비트를 1로 채움 (부호 비트 유지)
+                        unsigned int mask = (1 << shiftAmount) - 1;
+                        registers[rd] |= mask << (32 - shiftAmount);
+                    }
+                }
+                else
+                {
+                    registers[rd] = ((unsigned int)registers[rs1]) >> (imm & 0x1F);
+                }
+                break;
+            }
+            pc = pc + 4;
+        }
+    }
+    // S-type 명령어 처리
+    else if (type == S_TYPE)
+    {
+        // sw
+        int address = registers[rs1] + imm;
+        storeMemory(address, registers[rs2]);
+
+        pc = pc + 4;
+    }
+    // SB-type 명령어 처리
+    else if (type == SB_TYPE)
+    {
+        // 레이블이 아닌 숫자로 된 대상은 target 이 -1 이다. (없는 주소로 가면 프로그램이 끝난다)
+        // 일단 여기서 imm 값은 label이랑 얼마나 떨어져있냐가 관건이다.
+        imm = instr->target - pc;
+
+        bool taken = false;
+        switch (info->funct3)
+        {
+        case 0x0: // beq
+            taken = (registers[rs1] == registers[rs2]);
+            break;
+        case 0x1: // bne
+            taken = (registers[rs1] != registers[rs2]);
+            break;
+        case 0x4: // blt
+            taken = (registers[rs1] < registers[rs2]);
+            break;
+        case 0x5: // bge
+            taken = (registers[rs1] >= registers[rs2]);
+            break;
+        }
+        pc = taken ? pc + imm : pc + 4;
+    }
+    // J-type 명령어 처리
+    else if (type == J_TYPE)
+    {
+        // jal
+        // 일단 여기서 imm 값은 label이랑 얼마나 떨어져있냐가 관건이다.
+        imm = instr->target - pc;
+
+        registers[rd] = pc + 4; // x1 레지스터에 return 주소 저장
+        pc += imm;
+    }
+    // A-type 명령어 처리. 다른 하트와 같은 메모리를 쓰므로 호스트의 원자 연산으로 처리한다.
+    // 주소의 저장 횟수 칸을 잠그고 읽고 쓰므로 lr.w/sc.w 와 저장이 서로 끼어들지 않는다.
+    else if (type == A_TYPE)
+    {
+        int address = registers[rs1];
+        int source2 = registers[rs2]; // rd 와 rs2 가 같을 수 있으므로 먼저 읽어둔다.
+        int old = 0;
+        unsigned int *generation = writeGeneration(currentMemory, address);
+        unsigned int locked = lockWriteGeneration(generation);
+        unsigned int unlocked = locked + 2; // lr.w 와 실패한 sc.w 는 저장하지 않으므로 횟수를 그대로 둔다.
+
+        switch (info->funct7 >> 2)
+        {
+        case 0x02: // lr.w
+            old = loadMemory(address);
+            reservationValid = true;
+            reservationAddress = address;
+            reservationGeneration = locked;
+            unlocked = locked;
+            break;
+        case 0x03: // sc.w (예약한 뒤로 그 칸에 저장한 하트가 없으면 성공해서 0, 아니면 1)
+        {
+            bool success = reservationValid && reservationAddress == address && reservationGeneration == locked;
+            if (success)
+            {
+                __atomic_store_n(memoryWord(address), source2, __ATOMIC_RELAXED);
+            }
+            else
+            {
+                unlocked = locked;
+            }
+            reservationValid = false;
+            old = success ? 0 : 1;
+            break;
+        }
+        case 0x01: // amoswap.w
+            old = __atomic_exchange_n(memoryWord(address), source2, __ATOMIC_SEQ_CST);
+            break;
+        case 0x00: // amoadd.w
+            old = __atomic_fetch_add(memoryWord(address), source2, __ATOMIC_SEQ_CST);
+            break;
+        case 0x04: // amoxor.w
+            old = __atomic_fetch_xor(memoryWord(address), source2, __ATOMIC_SEQ_CST);
+            break;
+        case 0x0C: // amoand.w
+            old = __atomic_fetch_and(memoryWord(address), source2, __ATOMIC_SEQ_CST);
+            break;
+        case 0x08: // amoor.w
+            old = __atomic_fetch_or(memoryWord(address), source2, __ATOMIC_SEQ_CST);
+            break;
+        default: // amomin.w, amomax.w, amominu.w, amomaxu.w 는 비교한 뒤 바꾼다.
+        {
+            int *word = memoryWord(address);
+            int updated;
+            old = __atomic_load_n(word, __ATOMIC_SEQ_CST);
+            do
+            {
+                switch (info->funct7 >> 2)
+                {
+                case 0x10: // amomin.w
+                    updated = (source2 < old) ? source2 : old;
+                    break;
+                case 0x14: // amomax.w
+                    updated = (source2 > old) ? source2 : old;
+                    break;
+                case 0x18: // amominu.w
+                    updated = ((unsigned int)source2 < (unsigned int)old) ? source2 : old;
+                    break;
+                default: // amomaxu.w
+                    updated = ((unsigned int)source2 > (unsigned int)old) ? source2 : old;
+                    break;
+                }
+            } while (!__atomic_compare_exchange_n(word, &old, updated, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST));
+            break;
+        }
+        }
+        __atomic_store_n(generation, unlocked, __ATOMIC_RELEASE);
+        registers[rd] = old;
+        pc = pc + 4;
+    }
+    // ecall. exit 이면 pc 를 그대로 둬서 실행을 끝낸다.
+    else if (type == CSR_TYPE && info->funct3 == 0x0)
+    {
+        if (!systemCall())
+        {
+            pc = pc + 4;
+        }
+    }
+    // 카운터 CSR 읽기. 하트마다 따로 센다.
+    else if (type == CSR_TYPE)
+    {
+        registers[rd] = (int)readCounter(info->funct7, stepCount);
+        pc = pc + 4;
+    }
+    registers[0] = 0;
+    return pc;
+}
+
+//
+// 단계별 시간 구간!! 시작!! (--timing)
+//
+// 파일마다 단계별로 걸린 시간(wall, CPU), 새로 할당한 바이트 수(아레나 + 메모리 표), 단계가 끝났을 때의 최대 RSS 를 잰다.
+// trace 쓰기는 실행 도중에도 일어나므로 flushTrace 에서 따로 재고, 그 시간은 감싸고 있는 단계에서 뺀다.
+
+typedef enum
+{
+    STAGE_LOAD,
+    STAGE_CHECK,
+    STAGE_FIRST_PASS,
+    STAGE_LOAD_INSTRUCTIONS,
+    STAGE_ASSEMBLE_OBJECTS,
+    STAGE_LINK,
+    STAGE_OPTIMIZE,
+    STAGE_PROCESS,
+    STAGE_EXECUTE,
+    STAGE_TRACE_WRITE,
+    STAGE_REPORTS,
+    STAGE_COUNT
+} TimingStage;
+
+const char *const stageNames[STAGE_COUNT] = {"loadSource", "check_file_for_errors", "firstPass", "loadInstructions",
+                                              "assembleObjects", "linkObjects", "optimizeProgram", "processFile", "executeProgram", "traceWrite",
+                                              "reports"};
+
+// 단계 하나의 결과 (파일 하나 동안 더한다)
+typedef struct
+{
+    bool ran;
+    long long wallNanos;
+    long long cpuNanos;
+    long long allocatedBytes;
+    long peakRssKb;
+} StageTiming;
+
+// 단계를 시작할 때의 값
+typedef struct
+{
+    long long wallNanos;
+    long long cpuNanos;
+    long long allocatedBytes;
+    long long traceWallNanos; // 그때까지 trace 쓰기에 쓴 시간
+    long long traceCpuNanos;
+} StageClock;
+
+StageTiming stageTimings[STAGE_COUNT];
+
+long long clockNanos(clockid_t id)
+{
+    struct timespec now;
+    clock_gettime(id, &now);
+    return (long long)now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+// 파일을 처리하면서 지금까지 할당한 바이트 수
+long long allocatedBytes()
+{
+    return (long long)fileArena.used + __atomic_load_n(&memoryTableBytes, __ATOMIC_RELAXED);
+}
+
+// 프로세스의 최대 RSS (KB)
+long peakRssKb()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+void beginStage(StageClock *clock)
+{
+    if (!timingEnabled)
+    {
+        return;
+    }
+    clock->wallNanos = clockNanos(CLOCK_MONOTONIC);
+    clock->cpuNanos = clockNanos(CLOCK_PROCESS_CPUTIME_ID);
+    clock->allocatedBytes = allocatedBytes();
+    clock->traceWallNanos = stageTimings[STAGE_TRACE_WRITE].wallNanos;
+    clock->traceCpuNanos = stageTimings[STAGE_TRACE_WRITE].cpuNanos;
+}
+
+void endStage(TimingStage stage, const StageClock *clock)
+{
+    if (!timingEnabled)
+    {
+        return;
+    }
+    StageTiming *timing = &stageTimings[stage];
+    timing->ran = true;
+    timing->wallNanos += clockNanos(CLOCK_MONOTONIC) - clock->wallNanos -
+                         (stageTimings[STAGE_TRACE_WRITE].wallNanos - clock->traceWallNanos);
+    timing->cpuNanos += clockNanos(CLOCK_PROCESS_CPUTIME_ID) - clock->cpuNanos -
+                        (stageTimings[STAGE_TRACE_WRITE].cpuNanos - clock->traceCpuNanos);
+    timing->allocatedBytes += allocatedBytes() - clock->allocatedBytes;
+    timing->peakRssKb = peakRssKb();
+}
+
+// 인자 없이 bool 을 돌려주는 단계를 재면서 실행한다.
+bool runStage(TimingStage stage, bool (*run)(void))
+{
+    StageClock clock;
+    beginStage(&clock);
+    bool result = run();
+    endStage(stage, &clock);
+    return result;
+}
+
+// 파일 하나의 단계별 결과를 출력하고, --timing-json 이면 단계마다 JSON 한 줄씩 붙여 쓴다.
+void printStageTimings(const char *filename)
+{
+    if (!timingEnabled)
+    {
+        return;
+    }
+    FILE *json = (timingJsonPath != NULL) ? fopen(timingJsonPath, "a") : NULL;
+    if (timingJsonPath != NULL && json == NULL)
+    {
+        printf("we can't open the file\n");
+    }
+
+    long long totalWall = 0, totalCpu = 0, totalAllocated = 0;
+    printf("timing: %s\n", filename);
+    for (int i = 0; i < STAGE_COUNT; i++)
+    {
+        const StageTiming *timing = &stageTimings[i];
+        if (!timing->ran)
+        {
+            continue;
+        }
+        printf("  %-22s %10.3f ms wall %10.3f ms cpu %12lld bytes  peak rss %ld KB\n", stageNames[i],
+               timing->wallNanos / 1e6, timing->cpuNanos / 1e6, timing->allocatedBytes, timing->peakRssKb);
+        if (json != NULL)
+        {
+            fprintf(json, "{\"file\": \"");
+            for (const char *c = filename; *c != '\0'; c++)
+            {
+                if (*c == '"' || *c == '\\')
+                {
+                    fputc('\\', json);
+                }
+                fputc(*c, json);
+            }
+            fprintf(json, "\", \"stage\": \"%s\", \"wallMs\": %.3f, \"cpuMs\": %.3f, \"allocatedBytes\": %lld, \"peakRssKb\": %ld}\n",
+                    stageNames[i], timing->wallNanos / 1e6, timing->cpuNanos / 1e6, timing->allocatedBytes,
+                    timing->peakRssKb);
+        }
+        totalWall += timing->wallNanos;
+        totalCpu += timing->cpuNanos;
+        totalAllocated += timing->allocatedBytes;
+    }
+    printf("  %-22s %10.3f ms wall %10.3f ms cpu %12lld bytes  peak rss %ld KB\n", "total", totalWall / 1e6,
+           totalCpu / 1e6, totalAllocated, peakRssKb());
+    if (json != NULL)
+    {
+        fclose(json);
+    }
+}
+
+void flushTrace();
+void submitWrite(const char *path, char *data, size_t size, bool append, bool removeFile);
+void recordDataflow(const Instruction *instr);
+void recordStatsAccess(int address);
+void recordProfile(const Instruction *instr, int newPc);
+void recordHistory(const Instruction *instr);
+void finishHistoryStep();
+void startHistory();
+void takeSnapshot();
+
+// trace 한 칸을 out 에 쓰고 길이를 돌려준다. (16바이트를 넘지 않는다)
+// 이진 형식이면 trace 의 첫 칸(first) 앞에 머리를 붙인다.
+static inline int formatTraceEntry(char *out, int number, bool first)
+{
+    if (!traceBinary)
+    {
+        return snprintf(out, 16, "%d\n", number);
+    }
+
+    int length = 0;
+    if (first)
+    {
+        uint32_t header[2] = {1, 4};
+        memcpy(out, "RVTR", 4);
+        memcpy(out + 4, header, sizeof(header));
+        length = 12;
+    }
+    memcpy(out + length, &number, 4);
+    return length + 4;
+}
+
+// trace에 pc값을 저장하는 함수. 파일에 그대로 쓸 수 있도록 "%d\n" 형태(또는 이진 형식)로 쌓는다.
+void appendToTrace(int number)
+{
+    // 버퍼가 너무 커지면 먼저 파일로 내보낸다. (아주 긴 실행에서도 메모리를 일정하게 쓰기 위해)
+    if (traceLength >= TRACE_FLUSH_SIZE && (traceOutputFile != NULL || traceWritePath != NULL))
+    {
+        flushTrace();
+    }
+
+    // 지금 조각에 자리가 없으면 다음 조각으로 넘어간다. 파일로 내보낸 뒤에는 전에 쓰던 조각을 다시 쓰고,
+    // 모자랄 때만 아레나에서 새 조각을 받는다. (한 칸은 널 문자까지 16바이트를 넘지 않는다)
+    if (traceTail == NULL || traceTail->length + 16 > TRACE_CHUNK_SIZE)
+    {
+        TraceChunk *next = (traceTail == NULL) ? traceHead : traceTail->next;
+        if (next == NULL)
+        {
+            pthread_mutex_lock(&traceChunkLock);
+            next = arenaAlloc(&fileArena, sizeof(TraceChunk));
+            pthread_mutex_unlock(&traceChunkLock);
+            next->next = NULL;
+            if (traceTail == NULL)
+            {
+                traceHead = next;
+            }
+            else
+            {
+                traceTail->next = next;
+            }
+        }
+        next->length = 0;
+        traceTail = next;
+    }
+
+    int length = formatTraceEntry(traceTail->data + traceTail->length, number, traceEntries == 0);
+    traceTail->length += length;
+    traceLength += length;
+    traceEntries++;
+}
+
+// trace 조각들에 쌓인 내용을 .trace 파일로 내보내고 조각을 비운다.
+void flushTrace()
+{
+    // --timing 이면 trace 쓰기 단계로 따로 잰다. (하트 여러 개는 스레드마다 겹쳐서 쓰므로 실행 단계에 넣는다)
+    bool timed = timingEnabled && hartCount == 1 && (traceLength > 0 || traceWritePath != NULL);
+    long long wallStart = timed ? clockNanos(CLOCK_MONOTONIC) : 0;
+    long long cpuStart = timed ? clockNanos(CLOCK_PROCESS_CPUTIME_ID) : 0;
+
+    if (traceOutputFile != NULL && traceLength > 0)
+    {
+        for (TraceChunk *chunk = traceHead; chunk != NULL; chunk = chunk->next)
+        {
+            fwrite(chunk->data, 1, chunk->length, traceOutputFile);
+            if (chunk == traceTail)
+            {
+                break;
+            }
+        }
+        traceFileOffset += traceLength;
+    }
+    // 파이프라인 모드에서는 조각들을 한 버퍼로 모아서 쓰기 스레드에 넘긴다. (빈 trace 도 파일은 만든다)
+    else if (traceWritePath != NULL && (traceLength > 0 || !traceWriteStarted))
+    {
+        char *data = malloc((size_t)traceLength + 1);
+        size_t length = 0;
+        for (TraceChunk *chunk = traceHead; chunk != NULL && traceLength > 0; chunk = chunk->next)
+        {
+            memcpy(data + length, chunk->data, chunk->length);
+            length += chunk->length;
+            if (chunk == traceTail)
+            {
+                break;
+            }
+        }
+        submitWrite(traceWritePath, data, length, traceWriteStarted, false);
+        traceWriteStarted = true;
+        traceFileOffset += traceLength;
+    }
+    traceTail = NULL;
+    traceLength = 0;
+
+    if (timed)
+    {
+        stageTimings[STAGE_TRACE_WRITE].ran = true;
+        stageTimings[STAGE_TRACE_WRITE].wallNanos += clockNanos(CLOCK_MONOTONIC) - wallStart;
+        stageTimings[STAGE_TRACE_WRITE].cpuNanos += clockNanos(CLOCK_PROCESS_CPUTIME_ID) - cpuStart;
+        stageTimings[STAGE_TRACE_WRITE].peakRssKb = peakRssKb();
+    }
+}
+
+//
+// 메모리 trace 구간!! 시작!! (--mtrace)
+//
+// 상세 모드에서 실행한 lw/sw 를 파일명.mtrace 에 이진 레코드로 남긴다.
+// 실행 루프는 잠금 없는 링 버퍼(생산자 하나, 소비자 하나)에 레코드를 넣기만 하고, 파일에는 쓰기 스레드가 쓴다.
+// 파일 형식: 머리 "RVMT" + uint32 버전(1) + uint32 레코드 크기(24), 그 뒤로 MemoryTraceRecord 가 이어진다. (리틀 엔디언)
+
+typedef struct
+{
+    uint64_t step;       // 몇 번째로 실행한 명령어인지 (0부터)
+    int32_t pc;
+    int32_t address;
+    int32_t value;       // lw 는 읽은 값, sw 는 쓴 값
+    uint8_t kind;        // 'r' (lw) 또는 'w' (sw)
+    uint8_t reserved[3];
+} MemoryTraceRecord;
+
+MemoryTraceRecord *memoryTraceRing = NULL;
+unsigned long long memoryTraceHead = 0; // 생산자(실행 루프)만 쓴다
+unsigned long long memoryTraceTail = 0; // 소비자(쓰기 스레드)만 쓴다
+bool memoryTraceDone = false;           // 실행이 끝나서 더 들어올 레코드가 없다
+FILE *memoryTraceFile = NULL;
+pthread_t memoryTraceWriter;
+
+// 레코드 하나를 링에 넣는다. 링이 가득 차 있으면 쓰기 스레드가 비울 때까지 양보한다.
+void appendMemoryTrace(long long step, int pcValue, int address, int value, char kind)
+{
+    unsigned long long head = memoryTraceHead;
+    while (head - __atomic_load_n(&memoryTraceTail, __ATOMIC_ACQUIRE) >= MTRACE_RING_SIZE)
+    {
+        sched_yield();
+    }
+
+    MemoryTraceRecord *record = &memoryTraceRing[head & (MTRACE_RING_SIZE - 1)];
+    record->step = (uint64_t)step;
+    record->pc = pcValue;
+    record->address = address;
+    record->value = value;
+    record->kind = (uint8_t)kind;
+    __atomic_store_n(&memoryTraceHead, head + 1, __ATOMIC_RELEASE);
+}
+
+// 쓰기 스레드. 링에 쌓인 만큼을 한 번에 파일로 쓰고, 비어있으면 잠깐 쉰다.
+void *memoryTraceWriterThread(void *argument)
+{
+    (void)argument;
+    unsigned long long tail = memoryTraceTail;
+    while (1)
+    {
+        unsigned long long head = __atomic_load_n(&memoryTraceHead, __ATOMIC_ACQUIRE);
+        if (head == tail)
+        {
+            if (__atomic_load_n(&memoryTraceDone, __ATOMIC_ACQUIRE))
+            {
+                // done 을 본 뒤에 head 를 한 번 더 봐서 마지막 레코드를 놓치지 않는다.
+                if (__atomic_load_n(&memoryTraceHead, __ATOMIC_ACQUIRE) == tail)
+                {
+                    break;
+                }
+                continue;
+            }
+            struct timespec pause = {0, 100000};
+            nanosleep(&pause, NULL);
+            continue;
+        }
+
+        // 링의 끝에서 끊기지 않는 만큼씩 쓴다.
+        unsigned long long start = tail & (MTRACE_RING_SIZE - 1);
+        unsigned long long count = head - tail;
+        if (start + count > MTRACE_RING_SIZE)
+        {
+            count = MTRACE_RING_SIZE - start;
+        }
+        fwrite(&memoryTraceRing[start], sizeof(MemoryTraceRecord), (size_t)count, memoryTraceFile);
+        tail += count;
+        __atomic_store_n(&memoryTraceTail, tail, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+// 파일을 열고 머리를 쓴 뒤 쓰기 스레드를 띄운다.
+bool startMemoryTrace(const char *outputFilename)
+{
+    memoryTraceFile = fopen(outputFilename, "wb");
+    if (memoryTraceFile == NULL)
+    {
+        printf("we can't open the file\n");
+        return false;
+    }
+
+    uint32_t header[3];
+    memcpy(&header[0], "RVMT", 4);
+    header[1] = 1;
+    header[2] = sizeof(MemoryTraceRecord);
+    fwrite(header, sizeof(header), 1, memoryTraceFile);
+
+    if (memoryTraceRing == NULL)
+    {
+        memoryTraceRing = malloc(MTRACE_RING_SIZE * sizeof(MemoryTraceRecord));
+        memset(memoryTraceRing, 0, MTRACE_RING_SIZE * sizeof(MemoryTraceRecord));
+    }
+    memoryTraceHead = 0;
+    memoryTraceTail = 0;
+    memoryTraceDone = false;
+    pthread_create(&memoryTraceWriter, NULL, memoryTraceWriterThread, NULL);
+    memoryTraceActive = true;
+    return true;
+}
+
+// 남은 레코드를 다 쓸 때까지 기다리고 파일을 닫는다.
+void stopMemoryTrace()
+{
+    if (!memoryTraceActive)
+    {
+        return;
+    }
+    memoryTraceActive = false;
+    __atomic_store_n(&memoryTraceDone, true, __ATOMIC_RELEASE);
+    pthread_join(memoryTraceWriter, NULL);
+    fclose(memoryTraceFile);
+    memoryTraceFile = NULL;
+}
+
+// 특정 PC 값에 해당하는 명령어를 찾는 함수
+// 명령어는 1000부터 4씩 차례대로 들어있으므로 pc로 바로 위치를 계산한다.
+Instruction *fetchInstruction(int pcValue)
+{
+    if (pcValue < 1000 || (pcValue - 1000) % 4 != 0)
+    {
+        return NULL;
+    }
+
+    int index = (pcValue - 1000) / 4;
+    if (index >= instructionCount || instructions[index].address != pcValue)
+    {
+        return NULL; // 해당 PC 값에 대한 명령어를 찾지 못한 경우
+    }
+    return &instructions[index]; // 해당 PC 값을 가진 명령어를 반환
+}
+
+//
+// 체크포인트 구간!! 시작!!
+//
+// 체크포인트 파일은 mmap으로 바로 읽을 수 있게 고정 크기 헤더 뒤에 메모리 (주소, 값) 쌍을 이어 붙인 형식이다.
+#define CHECKPOINT_MAGIC "RVCKPT1"
+#define CHECKPOINT_VERSION 1
+
+typedef struct
+{
+    char magic[8];            // "RVCKPT1"
+    uint32_t version;         // 형식 버전
+    uint32_t registerCount;   // 레지스터 개수 (32)
+    uint64_t sourceHash;      // 같은 소스 파일에서 이어서 실행하는지 확인하기 위한 해시
+    int64_t stepCount;        // 지금까지 실행한 명령어 개수
+    int64_t traceEntries;     // 지금까지 trace에 들어간 pc 개수
+    int64_t traceFileOffset;  // .trace 파일에서 이어 쓸 위치
+    int32_t pc;               // 다음에 실행할 pc
+    int32_t instructionCount; // 명령어 개수 (소스 확인용)
+    uint64_t memoryCount;     // 뒤에 붙는 메모리 항목 개수
+    int32_t registers[REGISTER_COUNT];
+} CheckpointHeader;
+
+typedef struct
+{
+    int32_t address;
+    int32_t value;
+} CheckpointMemory;
+
+// 소스의 FNV-1a 해시를 구한다. 체크포인트가 같은 프로그램에서 나온 것인지 확인할 때 쓴다.
+uint64_t hashSource(const char *buffer, size_t size)
+{
+    uint64_t hash = 1469598103934665603ULL;
+
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= (unsigned char)buffer[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// 메모리 항목 개수를 센다. (visitMemory 에 넘기는 함수)
+void countCheckpointMemory(int address, int value, void *context)
+{
+    (void)address;
+    (void)value;
+    ((CheckpointHeader *)context)->memoryCount++;
+}
+
+// 메모리 항목 하나를 체크포인트 파일에 쓴다. (visitMemory 에 넘기는 함수)
+void writeCheckpointMemory(int address, int value, void *context)
+{
+    CheckpointMemory entry = {address, value};
+    fwrite(&entry, sizeof(entry), 1, (FILE *)context);
+}
+
+// 지금 상태(pc, 레지스터, 메모리, trace 위치, step 수)를 체크포인트 파일에 쓴다.
+// 쓰다가 죽어도 이전 체크포인트가 남도록 임시 파일에 쓴 뒤 rename 한다.
+bool writeCheckpoint(const char *path)
+{
+    char tempPath[280];
+    CheckpointHeader header;
+
+    // trace 위치가 체크포인트와 맞도록 먼저 trace 버퍼를 파일로 내보낸다.
+    flushTrace();
+    if (traceOutputFile != NULL)
+    {
+        fflush(traceOutputFile);
+        fsync(fileno(traceOutputFile));
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+    header.version = CHECKPOINT_VERSION;
+    header.registerCount = REGISTER_COUNT;
+    header.sourceHash = sourceHash;
+    header.stepCount = stepCount;
+    header.traceEntries = traceEntries;
+    header.traceFileOffset = traceFileOffset;
+    header.pc = pc;
+    header.instructionCount = instructionCount;
+    for (int i = 0; i < REGISTER_COUNT; i++)
+    {
+        header.registers[i] = registers[i];
+    }
+    visitMemory(&sharedMemory, countCheckpointMemory, &header);
+
+    snprintf(tempPath, sizeof(tempPath), "%s.tmp", path);
+    FILE *file = fopen(tempPath, "wb");
+    if (file == NULL)
+    {
+        printf("we can't write the checkpoint file\n");
+        return false;
+    }
+
+    fwrite(&header, sizeof(header), 1, file);
+    visitMemory(&sharedMemory, writeCheckpointMemory, file);
+
+    fflush(file);
+    fsync(fileno(file));
+    fclose(file);
+
+    if (rename(tempPath, path) != 0)
+    {
+        printf("we can't write the checkpoint file\n");
+        remove(tempPath);
+        return false;
+    }
+    return true;
+}
+
+// 체크포인트 파일을 mmap으로 읽어서 pc, 레지스터, 메모리, trace 위치, step 수를 되돌린다.
+bool restoreCheckpoint(const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+
+    if (fd < 0 || fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(CheckpointHeader))
+    {
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        printf("we can't open the checkpoint file\n");
+        return false;
+    }
+
+    void *mapped = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED)
+    {
+        printf("we can't open the checkpoint file\n");
+        return false;
+    }
+
+    const CheckpointHeader *header = (const CheckpointHeader *)mapped;
+    const CheckpointMemory *entries = (const CheckpointMemory *)(header + 1);
+
+    // 형식과 소스가 맞는지 확인한다.
+    if (memcmp(header->magic, CHECKPOINT_MAGIC, sizeof(header->magic)) != 0 || header->version != CHECKPOINT_VERSION ||
+        header->registerCount != REGISTER_COUNT ||
+        (uint64_t)st.st_size < sizeof(CheckpointHeader) + header->memoryCount * sizeof(CheckpointMemory))
+    {
+        printf("Checkpoint file is broken!!\n");
+        munmap(mapped, st.st_size);
+        return false;
+    }
+    if (header->sourceHash != sourceHash || header->instructionCount != instructionCount)
+    {
+        printf("Checkpoint does not match the input file!!\n");
+        munmap(mapped, st.st_size);
+        return false;
+    }
+
+    pc = header->pc;
+    stepCount = header->stepCount;
+    traceEntries = header->traceEntries;
+    traceFileOffset = header->traceFileOffset;
+    for (int i = 0; i < REGISTER_COUNT; i++)
+    {
+        registers[i] = header->registers[i];
+    }
+
+    freeMemory(&sharedMemory);
+    for (uint64_t i = 0; i < header->memoryCount; i++)
+    {
+        storeMemory(entries[i].address, entries[i].value);
+    }
+
+    munmap(mapped, st.st_size);
+    return true;
+}
+
+// SIGTERM(선점형 클러스터에서 작업이 밀려날 때)을 받으면 다음 명령어 경계에서 체크포인트를 쓰고 멈춘다.
+void handleCheckpointSignal(int signalNumber)
+{
+    (void)signalNumber;
+    checkpointRequested = 1;
+}
+
+// 기능 모드(fast-forward). trace도 통계도 남기지 않고 명령어만 빠르게 실행한다.
+// stepLimit 까지 실행했으면 false, 프로그램이 끝났으면 true를 돌려준다.
+bool runFunctional(long long stepLimit)
+{
+    while (stepCount < stepLimit && !checkpointRequested)
+    {
+        Instruction *instr = fetchInstruction(pc);
+        if (instr == NULL)
+        {
+            return true; // 더 이상 명령어가 없으면 종료
+        }
+
+        InstructionType type = instructionTable[instr->infoIndex].type;
+
+        int nowPc = pc;
+        int newPc = executeInstruction(instr);
+        stepCount++;
+
+        // 종료 명령어이거나 pc가 그대로면 끝낸다.
+        if (type == EXIT_TYPE || newPc == nowPc)
+        {
+            return true;
+        }
+        pc = newPc;
+    }
+    return false;
+}
+
+// 상세 모드. trace를 남기고, stats가 있으면 구간 통계도 같이 센다.
+// stepLimit 까지 실행했으면 false, 프로그램이 끝났으면 true를 돌려준다.
+bool runDetailed(long long stepLimit, WindowStats *stats)
+{
+    while (stepCount < stepLimit && !checkpointRequested)
+    {
+        // 현재 PC에 해당하는 명령어 가져오기
+        Instruction *instr = fetchInstruction(pc);
+        if (instr == NULL)
+        {
+            return true; // 더 이상 명령어가 없으면 종료
+        }
+
+        // 현재 PC값을 트레이스에 저장
+        appendToTrace(pc);
+
+        // --ilp 면 실행하기 전에 dataflow 스케줄에 넣는다.
+        if (dataflowEnabled)
+        {
+            recordDataflow(instr);
+        }
+
+        // 명령어 유형 식별 (예: R_TYPE, I_TYPE, 등)
+        const InstructionInfo *info = &instructionTable[instr->infoIndex];
+        InstructionType type = info->type;
+
+        // 현재 pc 값을 저장한다 무한루프 에러체크를 위해서
+        int nowPc = pc;
+
+        // --mtrace, --stats 면 lw/sw 주소를 실행하기 전에 구해둔다. (lw 의 rd 가 rs1 과 같을 수 있으므로)
+        int memoryAddress = (memoryTraceActive || executedCounts != NULL) ? registers[instr->rs1] + instr->imm : 0;
+
+        // --time-travel 이면 바뀔 값을 실행 전후로 기록한다.
+        if (historyActive)
+        {
+            recordHistory(instr);
+        }
+
+        // 명령어 실행 (명령어에 따라 레지스터 변경, 메모리 접근, PC 갱신 등)
+        int newPc = executeInstruction(instr);
+        if (historyActive)
+        {
+            finishHistoryStep();
+        }
+        if (memoryTraceActive && (info->opcode == 0x03 || type == S_TYPE))
+        {
+            bool isLoad = (info->opcode == 0x03);
+            appendMemoryTrace(stepCount, nowPc, memoryAddress, isLoad ? loadMemory(memoryAddress) : registers[instr->rs2],
+                              isLoad ? 'r' : 'w');
+        }
+        stepCount++;
+
+        // --stats 면 명령어마다 실행 횟수와 분기한 횟수를 센다.
+        if (executedCounts != NULL)
+        {
+            int index = (int)(instr - instructions);
+            executedCounts[index]++;
+            if (type == SB_TYPE && newPc != nowPc + 4)
+            {
+                takenCounts[index]++;
+            }
+            if (info->opcode == 0x03 || type == S_TYPE || type == A_TYPE)
+            {
+                recordStatsAccess(memoryAddress);
+            }
+        }
+
+        // --profile 이면 함수별로 센다.
+        if (profileActive)
+        {
+            recordProfile(instr, newPc);
+        }
+
+        // 구간 통계를 센다.
+        if (stats != NULL)
+        {
+            stats->instructions++;
+            stats->typeCounts[type]++;
+            if (type == SB_TYPE)
+            {
+                if (newPc != nowPc + 4)
+                {
+                    stats->branchesTaken++;
+                }
+                else
+                {
+                    stats->branchesNotTaken++;
+                }
+            }
+            else if (type == J_TYPE || info->opcode == 0x67) // jal, jalr
+            {
+                stats->jumps++;
+            }
+            else if (info->opcode == 0x03) // lw
+            {
+                stats->loads++;
+            }
+            else if (type == S_TYPE)
+            {
+                stats->stores++;
+            }
+        }
+
+        // 종료 명령어인 경우 프로그램 종료
+        if (type == EXIT_TYPE)
+        {
+            return true;
+        }
+
+        if (newPc == nowPc)
+        {
+            return true;
+        }
+
+        // PC 갱신: 명령어 실행 후 PC 값이 업데이트되었는지 확인
+        // 일반적인 경우에는 executeInstruction 함수 내부에서 pc += 4로 설정하지만
+        // 분기나 점프의 경우 PC가 바뀔 수 있음
+        pc = newPc;
+    }
+    return false;
+}
+
+// 지금 step에서 어떤 모드로 어디까지 실행할지 정한다.
+// fast-forward N 뒤에 M step씩 상세 구간을 두고, 주기 P가 있으면 N + kP 마다 다시 상세 구간을 둔다.
+bool findWindow(long long step, long long *windowEnd, int *windowIndex)
+{
+    if (step < fastForwardSteps)
+    {
+        *windowEnd = fastForwardSteps;
+        return false;
+    }
+
+    long long offset = step - fastForwardSteps;
+    long long index = (samplePeriod > 0) ? offset / samplePeriod : 0;
+    long long windowStart = fastForwardSteps + index * samplePeriod;
+    *windowIndex = (int)index;
+
+    // M이 없으면 fast-forward 뒤로는 끝까지 상세 모드다.
+    if (sampleSteps == 0)
+    {
+        *windowEnd = LLONG_MAX;
+        return true;
+    }
+    if (step < windowStart + sampleSteps)
+    {
+        *windowEnd = windowStart + sampleSteps;
+        return true;
+    }
+
+    // 상세 구간이 끝났으면 다음 구간 시작까지(주기가 없으면 끝까지) 기능 모드로 간다.
+    *windowEnd = (samplePeriod > 0) ? windowStart + samplePeriod : LLONG_MAX;
+    return false;
+}
+
+// 구간 통계를 출력한다.
+void printWindowStats(const WindowStats *stats)
+{
+    printf("[window %d] steps %lld-%lld (%lld instructions)\n", stats->index, stats->startStep,
+           stats->startStep + stats->instructions - 1, stats->instructions);
+    printf("  R: %lld  I: %lld  S: %lld  SB: %lld  J: %lld  A: %lld  CSR: %lld  EXIT: %lld\n", stats->typeCounts[R_TYPE],
+           stats->typeCounts[I_TYPE], stats->typeCounts[S_TYPE], stats->typeCounts[SB_TYPE], stats->typeCounts[J_TYPE],
+           stats->typeCounts[A_TYPE], stats->typeCounts[CSR_TYPE], stats->typeCounts[EXIT_TYPE]);
+    printf("  loads: %lld  stores: %lld  branches taken: %lld  not taken: %lld  jumps: %lld\n", stats->loads,
+           stats->stores, stats->branchesTaken, stats->branchesNotTaken, stats->jumps);
+}
+
+// 명령어를 넣으면 파일을 실행한다. 명령어 한줄씩 읽으면서 값을 정한다.
+void executeProgram()
+{
+    bool sampling = (fastForwardSteps > 0 || sampleSteps > 0);
+    long long stopStep = (maxSteps > 0) ? maxSteps : LLONG_MAX;
+    bool finished = false;
+    WindowStats stats;
+    bool windowOpen = false;
+
+    // 체크포인트에서 이어서 실행할 때는 복원한 pc에서 시작한다.
+    if (!checkpointRestored)
+    {
+        pc = 1000; // 프로그램 시작 시 PC 초기값
+    }
+
+    // --time-travel 이면 처음 상태부터 기록한다.
+    if (timeTravelInterval > 0)
+    {
+        startHistory();
+    }
+
+    while (!finished)
+    {
+        // 정해진 step 수만큼 실행했거나 SIGTERM을 받았으면 체크포인트를 남기고 멈춘다.
+        // (--max-steps 만 줬어도 멈춘 곳에서 이어갈 수 있도록 항상 남긴다)
+        if (stepCount >= stopStep || checkpointRequested)
+        {
+            writeCheckpoint(checkpointPath);
+            break;
+        }
+
+        // 이번에 어디까지, 어떤 모드로 실행할지 정한다.
+        long long limit = stopStep;
+        bool detailed = true;
+        int windowIndex = 0;
+        if (sampling)
+        {
+            long long windowEnd;
+            detailed = findWindow(stepCount, &windowEnd, &windowIndex);
+            limit = (windowEnd < limit) ? windowEnd : limit;
+        }
+        if (checkpointInterval > 0)
+        {
+            long long nextCheckpoint = (stepCount / checkpointInterval + 1) * checkpointInterval;
+            limit = (nextCheckpoint < limit) ? nextCheckpoint : limit;
+        }
+        if (historyActive)
+        {
+            long long nextSnapshot = (stepCount / timeTravelInterval + 1) * timeTravelInterval;
+            limit = (nextSnapshot < limit) ? nextSnapshot : limit;
+        }
+
+        // 새 상세 구간이 시작되면 통계를 초기화한다.
+        if (sampling && detailed && (!windowOpen || stats.index != windowIndex))
+        {
+            memset(&stats, 0, sizeof(stats));
+            stats.index = windowIndex;
+            stats.startStep = stepCount;
+            windowOpen = true;
+        }
+
+        if (detailed)
+        {
+            finished = runDetailed(limit, sampling ? &stats : NULL);
+        }
+        else
+        {
+            finished = runFunctional(limit);
+        }
+
+        // 상세 구간이 끝났으면 그 구간의 통계를 출력한다.
+        if (windowOpen && (finished || !findWindow(stepCount, &limit, &windowIndex) || windowIndex != stats.index))
+        {
+            printWindowStats(&stats);
+            windowOpen = false;
+        }
+
+        // 정해진 step 간격마다 체크포인트를 쓴다.
+        if (!finished && checkpointInterval > 0 && stepCount % checkpointInterval == 0)
+        {
+            writeCheckpoint(checkpointPath);
+        }
+
+        // 정해진 step 간격마다 시간 여행 스냅숏을 뜬다.
+        if (!finished && historyActive && stepCount % timeTravelInterval == 0)
+        {
+            takeSnapshot();
+        }
+    }
+
+    // 최대 step에서 멈춘 경우 아직 열려있는 구간도 출력한다.
+    if (windowOpen)
+    {
+        printWindowStats(&stats);
+    }
+}
+
+//
+// 데이터 구간!! 시작!! (.data/.word/.space/.align/.incbin, --load)
+//
+// .data 뒤의 레이블은 pc 대신 데이터 주소(DATA_SEGMENT_BASE 부터 주소 하나에 값 하나)를 받는다.
+// .asciz 문자열과 .incbin 파일은 주소 하나에 4바이트(리틀 엔디언)씩 채운다. (ecall 의 read/write 와 같은 방식)
+// firstPass 가 지시어마다 데이터 덩어리를 만들고, .word 의 레이블 값은 loadInstructions 에서 채운다.
+// .incbin 과 --load 파일은 mmap 해서 덩어리가 그대로 가리키고, 실행하기 전에 loadDataImage 가 페이지 단위로 복사한다.
+// (게스트 메모리 페이지에는 값과 저장 표시가 같이 있으므로 파일을 페이지로 바로 쓸 수는 없다)
+
+// 데이터 덩어리를 하나 추가한다. 배열은 아레나에서 두 배씩 늘린다.
+DataBlock *addDataBlock(int address, int count, const int *values)
+{
+    if (dataBlockCount >= dataBlockCapacity)
+    {
+        int newCapacity = (dataBlockCapacity == 0) ? 64 : dataBlockCapacity * 2;
+        dataBlocks = arenaGrow(&fileArena, dataBlocks, dataBlockCount * sizeof(DataBlock), newCapacity * sizeof(DataBlock));
+        dataBlockCapacity = newCapacity;
+    }
+
+    DataBlock *block = &dataBlocks[dataBlockCount++];
+    block->address = address;
+    block->count = count;
+    block->values = values;
+    block->sourceOffset = -1;
+    block->sourceLength = 0;
+    block->mapping = NULL;
+    block->mappingSize = 0;
+    return block;
+}
+
+// 호스트 파일을 mmap 해서 address 부터 4바이트(호스트와 같은 리틀 엔디언)씩 넣는 덩어리로 만든다.
+// 4바이트로 나눠지는 부분은 mmap 한 곳을 그대로 가리키고, 남는 1~3바이트만 0을 붙여서 따로 둔다.
+// 쓴 주소 수를 돌려주고, 열 수 없거나 메모리에 들어가지 않으면 where 를 붙여서 출력하고 -1
+long long addHostFile(const char *path, long long address, const char *where)
+{
+    struct stat info;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0 || fstat(fd, &info) != 0)
+    {
+        printf("%s: we can't open the file %s\n", where, path);
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        return -1;
+    }
+
+    size_t size = (size_t)info.st_size;
+    long long words = (long long)((size + 3) / 4);
+    if (address + words > (long long)INT_MAX + 1)
+    {
+        printf("%s: %s does not fit in guest memory\n", where, path);
+        close(fd);
+        return -1;
+    }
+
+    void *mapping = NULL;
+    if (size > 0)
+    {
+        mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED)
+        {
+            printf("%s: we can't open the file %s\n", where, path);
+            close(fd);
+            return -1;
+        }
+        madvise(mapping, size, MADV_SEQUENTIAL);
+    }
+    close(fd);
+
+    DataBlock *block = addDataBlock((int)address, (int)(size / 4), mapping);
+    block->mapping = mapping;
+    block->mappingSize = size;
+    if (size % 4 != 0)
+    {
+        int *tail = arenaAlloc(&fileArena, sizeof(int));
+        *tail = 0;
+        memcpy(tail, (const char *)mapping + size / 4 * 4, size % 4);
+        addDataBlock((int)(address + (long long)(size / 4)), 1, tail);
+    }
+    return words;
+}
+
+// --load FILE@ADDR 들을 덩어리로 만든다. 소스의 데이터보다 뒤에 두므로 주소가 겹치면 --load 가 이긴다.
+bool addHostLoads()
+{
+    for (int i = 0; i < hostLoadCount; i++)
+    {
+        char path[260];
+        char *end = NULL;
+        const char *at = strrchr(hostLoads[i], '@');
+        long long address = (at != NULL) ? strtoll(at + 1, &end, 0) : -1;
+        if (at == NULL || at == hostLoads[i] || at[1] == '\0' || *end != '\0' || address < 0 || address > INT_MAX)
+        {
+            printf("--load: expected FILE@ADDR, got '%s'\n", hostLoads[i]);
+            return false;
+        }
+        snprintf(path, sizeof(path), "%.*s", (int)(at - hostLoads[i]), hostLoads[i]);
+        if (addHostFile(path, address, "--load") < 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// 지시어 한 줄을 처리한다. 구간을 바꾸거나, 데이터 주소를 옮기고 덩어리를 추가한다. 에러면 출력하고 false
+bool addDirective(const char *line, int length, int lineNumber, bool *inData, long long *dataAddress)
+{
+    ParsedLine parsed;
+    int value = 0;
+    long long count = 0;
+
+    if (!parseLine(line, length, &parsed, NULL, 0))
+    {
+        return false; // check_file_for_errors 에서 이미 걸렀다.
+    }
+    if (parsed.directive == DIRECTIVE_TEXT || parsed.directive == DIRECTIVE_DATA)
+    {
+        *inData = (parsed.directive == DIRECTIVE_DATA);
+        return true;
+    }
+    if (parsed.directive == DIRECTIVE_GLOBL || parsed.directive == DIRECTIVE_EXTERN)
+    {
+        // 레이블이 다 모인 뒤에 처리한다. (.globl 은 레이블보다 앞에 올 수 있다)
+        if (symbolDirectiveCount >= symbolDirectiveCapacity)
+        {
+            int newCapacity = (symbolDirectiveCapacity == 0) ? 16 : symbolDirectiveCapacity * 2;
+            symbolDirectives = arenaGrow(&fileArena, symbolDirectives, symbolDirectiveCount * sizeof(SymbolDirective),
+                                         newCapacity * sizeof(SymbolDirective));
+            symbolDirectiveCapacity = newCapacity;
+        }
+        symbolDirectives[symbolDirectiveCount].sourceOffset = (int)(line - source);
+        symbolDirectives[symbolDirectiveCount].sourceLength = length;
+        symbolDirectives[symbolDirectiveCount].lineNumber = lineNumber;
+        symbolDirectiveCount++;
+        return true;
+    }
+    if (!*inData)
+    {
+        printf("line %d: '%.*s' outside .data\n", lineNumber, parsed.mnemonic.length, parsed.mnemonic.start);
+        return false;
+    }
+
+    switch (parsed.directive)
+    {
+    case DIRECTIVE_ALIGN:
+        tokenNumber(parsed.operands[0], &value);
+        *dataAddress = (*dataAddress + (1LL << value) - 1) & ~((1LL << value) - 1);
+        if (value > dataAlignLog2)
+        {
+            dataAlignLog2 = value;
+        }
+        break;
+    case DIRECTIVE_SPACE:
+        tokenNumber(parsed.operands[0], &value);
+        count = value;
+        if (*dataAddress + count <= (long long)INT_MAX + 1)
+        {
+            addDataBlock((int)*dataAddress, (int)count, NULL);
+        }
+        break;
+    case DIRECTIVE_WORD:
+    {
+        // 값은 레이블이 다 모인 뒤에 채운다.
+        count = parsed.operandCount;
+        DataBlock *block = addDataBlock((int)*dataAddress, (int)count, arenaAlloc(&fileArena, count * sizeof(int)));
+        block->sourceOffset = (int)(line - source);
+        block->sourceLength = length;
+        break;
+    }
+    case DIRECTIVE_ASCIZ:
+    {
+        // \n, \t, \0, \\, \" 만 바꾸고, 끝에 널 문자를 붙여서 주소 하나에 4글자씩 넣는다.
+        Token text = parsed.operands[0];
+        int *values = arenaAlloc(&fileArena, (size_t)(text.length / 4 + 1) * sizeof(int));
+        char *bytes = (char *)values;
+        int used = 0;
+        memset(values, 0, (size_t)(text.length / 4 + 1) * sizeof(int));
+        for (int i = 0; i < text.length; i++)
+        {
+            char c = text.start[i];
+            if (c == '\\' && i + 1 < text.length)
+            {
+                c = text.start[++i];
+                c = (c == 'n') ? '\n' : (c == 't') ? '\t' : (c == '0') ? '\0' : c;
+            }
+            bytes[used++] = c;
+        }
+        count = used / 4 + 1;
+        addDataBlock((int)*dataAddress, (int)count, values);
+        break;
+    }
+    default:
+    {
+        char path[260];
+        char where[32];
+        snprintf(path, sizeof(path), "%.*s", parsed.operands[0].length, parsed.operands[0].start);
+        snprintf(where, sizeof(where), "line %d", lineNumber);
+        count = addHostFile(path, *dataAddress, where);
+        if (count < 0)
+        {
+            return false;
+        }
+        break;
+    }
+    }
+
+    *dataAddress += count;
+    if (*dataAddress > (long long)INT_MAX + 1)
+    {
+        printf("line %d: data does not fit in guest memory\n", lineNumber);
+        return false;
+    }
+    return true;
+}
+
+// .word 의 값을 채운다. 레이블은 firstPass 에서 모두 저장했으므로 주소로 바꾼다. 없는 레이블이 있으면 false
+bool resolveDataWords()
+{
+    for (int b = 0; b < dataBlockCount; b++)
+    {
+        DataBlock *block = &dataBlocks[b];
+        Token tokens[MAX_LINE_TOKENS];
+        if (block->sourceOffset < 0)
+        {
+            continue;
+        }
+
+        int count = lexLine(source + block->sourceOffset, block->sourceLength, tokens, MAX_LINE_TOKENS);
+        int *values = (int *)block->values;
+        for (int i = 1; i < count; i += 2)
+        {
+            if (tokens[i].kind == TOKEN_NUMBER)
+            {
+                tokenNumber(tokens[i], &values[i / 2]);
+            }
+            else if ((values[i / 2] = findLabelAddress(tokens[i])) == -1)
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// 데이터 덩어리들을 memory 에 넣는다. 페이지 단위로 복사하고 저장한 주소로 표시한다.
+// 실행하기 전에 스레드 하나에서만 부른다. (덩어리 순서대로 넣으므로 겹치면 뒤의 것이 남는다)
+void loadDataImage(GuestMemory *memory)
+{
+    for (int b = 0; b < dataBlockCount; b++)
+    {
+        const DataBlock *block = &dataBlocks[b];
+        long long done = 0;
+        while (done < block->count)
+        {
+            int address = block->address + (int)done;
+            unsigned int offset = (unsigned int)address & (MEMORY_PAGE_WORDS - 1);
+            long long length = MEMORY_PAGE_WORDS - offset;
+            if (length > block->count - done)
+            {
+                length = block->count - done;
+            }
+
+            MemoryPage *page = findMemoryPage(memory, address, true);
+            if (block->values != NULL)
+            {
+                memcpy(&page->values[offset], block->values + done, (size_t)length * sizeof(int));
+            }
+            else
+            {
+                memset(&page->values[offset], 0, (size_t)length * sizeof(int));
+            }
+            for (unsigned int k = offset; k < offset + (unsigned int)length; k++)
+            {
+                page->touched[k / 64] |= 1ULL << (k % 64);
+            }
+            done += length;
+        }
+    }
+}
+
+// 파일이 끝나면 mmap 한 파일들을 닫는다. (덩어리 배열은 아레나에 있으므로 arenaReset 이 돌려준다)
+void resetDataBlocks()
+{
+    for (int b = 0; b < dataBlockCount; b++)
+    {
+        if (dataBlocks[b].mapping != NULL)
+        {
+            munmap(dataBlocks[b].mapping, dataBlocks[b].mappingSize);
+        }
+    }
+    dataBlocks = NULL;
+    dataBlockCount = 0;
+    dataBlockCapacity = 0;
+    dataAlignLog2 = 0;
+    symbolDirectives = NULL;
+    symbolDirectiveCount = 0;
+    symbolDirectiveCapacity = 0;
+}
+
+// .globl/.extern 을 레이블에 표시한다. 에러가 있으면 출력하고 false
+// .globl 은 이 파일에 있는 레이블이어야 하고, .extern 은 이 파일에 없는 레이블이어야 한다.
+// .rel 을 만들 때는 .extern 레이블을 주소 0 으로 추가해 두고, 링크할 때 쓴 곳마다 고친다. (링크 구간 참고)
+// 파일 하나만 처리할 때는 .extern 레이블이 없는 레이블 그대로 남으므로 쓰면 에러가 된다.
+bool bindSymbols()
+{
+    bool ok = true;
+    for (int d = 0; d < symbolDirectiveCount; d++)
+    {
+        const SymbolDirective *directive = &symbolDirectives[d];
+        Token tokens[MAX_LINE_TOKENS];
+        int count = lexLine(source + directive->sourceOffset, directive->sourceLength, tokens, MAX_LINE_TOKENS);
+        bool isExtern = tokenEquals(tokens[0], ".extern");
+
+        for (int i = 1; i < count; i += 2)
+        {
+            int index = findLabelIndex(tokens[i].start, tokens[i].length);
+            bool defined = (index >= 0 && labels[index].binding != LABEL_EXTERN);
+            if (!isExtern && !defined)
+            {
+                printf("line %d: '.globl' of undefined label '%.*s'\n", directive->lineNumber, tokens[i].length, tokens[i].start);
+                ok = false;
+            }
+            else if (!isExtern)
+            {
+                labels[index].binding = LABEL_GLOBAL;
+            }
+            else if (defined)
+            {
+                printf("line %d: extern label '%.*s' is defined in this file\n", directive->lineNumber, tokens[i].length,
+                       tokens[i].start);
+                ok = false;
+            }
+            else if (index < 0 && objectMode)
+            {
+                addLabel(tokens[i], 0);
+                labels[labelCount - 1].binding = LABEL_EXTERN;
+            }
+        }
+    }
+    return ok;
+}
+
+// 라벨(레이블)의 위치를 정확히 알아야 분기문하고 trace값을 처리할 수 있다. 그래서 처음에 레이블이 있는지 한번 훑는다.
+// 첫 번째 패스: 레이블 주소 저장
+// .data 뒤의 레이블은 데이터 주소를 받고, 지시어는 데이터 덩어리로 만든다. (데이터 구간 참고)
+bool firstPass()
+{
+    const char *cursor = source;
+    const char *line;
+    int length;
+    int lineNumber = 0;
+    bool inData = false;                       // .data 뒤인지 (.text 를 만나면 다시 코드)
+    long long dataAddress = DATA_SEGMENT_BASE; // 다음 데이터가 들어갈 주소
+
+    // 레이블 에러가 있을 경우.
+    bool label_Error = false;
+
+    // Program counter 초기값 (가정) . 여기서는 임의로 한번 읽는것이기 때문에 pc값을 따로 뺀다.
+    pc = 1000;
+
+    // 파일 끝까지 읽음
+    while ((line = nextLine(&cursor, source + sourceSize, &length)) != NULL)
+    {
+        Token labelToken;
+        LineKind kind = classifyLine(line, length, &labelToken);
+        lineNumber++;
+
+        // 비어있는 줄은 넘어간다.
+        if (kind == LINE_EMPTY)
+        {
+            continue;
+        }
+
+        if (kind == LINE_LABEL)
+        {
+            // 기존에 같은 이름의 라벨이 있는지 확인 (이름은 대소문자를 구분하지 않는다)
+            if (findLabelIndex(labelToken.start, labelToken.length) >= 0)
+            {
+                label_Error = true; // 중복 라벨 발견
+            }
+
+            // 라벨 배열에 추가 (중복 여부와 관계없이 라벨 추가)
+            addLabel(labelToken, inData ? (int)dataAddress : pc);
+            labels[labelCount - 1].inData = inData;
+        }
+        else if (kind == LINE_DIRECTIVE)
+        {
+            if (!addDirective(line, length, lineNumber, &inData, &dataAddress))
+            {
+                label_Error = true;
+            }
+        }
+        else if (inData)
+        {
+            printf("line %d: instruction in .data\n", lineNumber);
+            label_Error = true;
+        }
+        else
+        {
+            // 명령어 한 줄이므로 PC를 증가시킴
+            pc += 4;
+        }
+    }
+
+    // .globl/.extern 을 레이블에 표시한다.
+    if (!label_Error && !bindSymbols())
+    {
+        label_Error = true;
+    }
+
+    // --load 로 준 호스트 파일도 데이터 덩어리로 둔다. (.rel 에는 넣지 않고 링크한 뒤에 넣는다)
+    if (!label_Error && !objectMode && !addHostLoads())
+    {
+        label_Error = true;
+    }
+
+    return label_Error;
+}
+
+// 명령어 한 줄을 해석한 결과
+typedef enum
+{
+    DECODE_OK,      // 정상적으로 해석함
+    DECODE_ERROR,   // 레지스터/즉시값/레이블 에러
+    DECODE_UNKNOWN  // 모르는 명령어
+} DecodeStatus;
+
+// 명령어 한 줄을 해석해서 instr 에 레지스터 번호, 즉시값, 분기 대상을 채운다.
+// instr->address 는 미리 정해져 있어야 한다. 레이블 표는 읽기만 하므로 여러 스레드에서 동시에 불러도 된다.
+DecodeStatus decodeLine(const char *line, int length, Instruction *instr)
+{
+    ParsedLine parsed;
+
+    // 문법에 맞지 않는 assembly 코드가 하나라도 존재하는 경우
+    if (!parseLine(line, length, &parsed, NULL, 0))
+    {
+        return (parsed.infoIndex < 0) ? DECODE_UNKNOWN : DECODE_ERROR;
+    }
+    if (parsed.kind != LINE_INSTRUCTION)
+    {
+        return DECODE_UNKNOWN;
+    }
+
+    const InstructionInfo *info = &instructionTable[parsed.infoIndex];
+    OperandFormat format = operandFormat(info);
+
+    // 명령어 이름부터 마지막 토큰까지만 소스 안의 위치로 저장한다. (앞뒤 공백은 뺀다)
+    instr->sourceOffset = (int)(parsed.mnemonic.start - source);
+    instr->sourceLength = (int)(parsed.end - parsed.mnemonic.start);
+    instr->infoIndex = (short)parsed.infoIndex;
+    instr->rd = instr->rs1 = instr->rs2 = 0;
+    instr->hasLabel = false;
+    instr->imm = 0;
+    instr->target = -1;
+
+    switch (format)
+    {
+    case OPERANDS_NONE: // exit
+        break;
+    case OPERANDS_REG: // rdcycle rd
+        instr->rd = tokenRegister(parsed.operands[0]);
+        break;
+    case OPERANDS_REG_REG_REG: // add rd, rs1, rs2
+        instr->rd = tokenRegister(parsed.operands[0]);
+        instr->rs1 = tokenRegister(parsed.operands[1]);
+        instr->rs2 = tokenRegister(parsed.operands[2]);
+        break;
+    case OPERANDS_REG_REG_IMM: // addi rd, rs1, imm
+        instr->rd = tokenRegister(parsed.operands[0]);
+        instr->rs1 = tokenRegister(parsed.operands[1]);
+        tokenNumber(parsed.operands[2], &instr->imm);
+        break;
+    case OPERANDS_REG_OFFSET_BASE: // lw rd, imm(rs1) / jalr rd, imm(rs1) / sw rs2, imm(rs1)
+        if (info->type == S_TYPE)
+        {
+            instr->rs2 = tokenRegister(parsed.operands[0]);
+        }
+        else
+        {
+            instr->rd = tokenRegister(parsed.operands[0]);
+        }
+        instr->rs1 = tokenRegister(parsed.operands[2]);
+
+        // offset 자리의 레이블은 그 주소를 offset 으로 쓴다. (데이터 레이블을 x0 기준으로 읽고 쓸 때)
+        if (parsed.operands[1].kind == TOKEN_WORD)
+        {
+            instr->imm = findLabelAddress(parsed.operands[1]);
+            if (instr->imm == -1 || is_overflow(instr->imm, info->type))
+            {
+                return DECODE_ERROR;
+            }
+        }
+        else
+        {
+            tokenNumber(parsed.operands[1], &instr->imm);
+        }
+        break;
+    case OPERANDS_REG_ADDRESS: // lr.w rd, (rs1)
+        instr->rd = tokenRegister(parsed.operands[0]);
+        instr->rs1 = tokenRegister(parsed.operands[1]);
+        break;
+    case OPERANDS_REG_REG_ADDRESS: // sc.w rd, rs2, (rs1)
+        instr->rd = tokenRegister(parsed.operands[0]);
+        instr->rs2 = tokenRegister(parsed.operands[1]);
+        instr->rs1 = tokenRegister(parsed.operands[2]);
+        break;
+    case OPERANDS_REG_REG_TARGET: // beq rs1, rs2, label
+    case OPERANDS_REG_TARGET:     // jal rd, label
+    {
+        Token target = parsed.operands[parsed.operandCount - 1];
+
+        // la rd, label 은 addi rd, x0, 레이블 주소 이다. (분기 대상이 아니므로 hasLabel 은 false)
+        if (isLoadAddress(info))
+        {
+            instr->rd = tokenRegister(parsed.operands[0]);
+            if (target.kind == TOKEN_NUMBER)
+            {
+                tokenNumber(target, &instr->imm);
+            }
+            else
+            {
+                instr->imm = findLabelAddress(target);
+                if (instr->imm == -1 || is_overflow(instr->imm, I_TYPE))
+                {
+                    return DECODE_ERROR;
+                }
+            }
+            break;
+        }
+        if (format == OPERANDS_REG_REG_TARGET)
+        {
+            instr->rs1 = tokenRegister(parsed.operands[0]);
+            instr->rs2 = tokenRegister(parsed.operands[1]);
+        }
+        else
+        {
+            instr->rd = tokenRegister(parsed.operands[0]);
+        }
+
+        // 대상이 정수 값인지 레이블인지를 판단합니다.
+        if (target.kind == TOKEN_NUMBER)
+        {
+            // 정수형 즉시 값인 경우 (실행할 때는 레이블 표에 없는 대상이므로 -1 로 간다)
+            tokenNumber(target, &instr->imm);
+        }
+        else
+        {
+            // 레이블인 경우, 레이블의 주소를 찾아야 합니다.
+            instr->hasLabel = true;
+            instr->target = findLabelAddress(target);
+            if (instr->target == -1)
+            {
+                return DECODE_ERROR;
+            }
+        }
+        break;
+    }
+    }
+
+    return DECODE_OK;
+}
+
+// 해석해 둔 명령어 하나를 32비트 기계어로 바꾼다.
+unsigned int encodeInstruction(const Instruction *instr)
+{
+    const InstructionInfo *info = &instructionTable[instr->infoIndex];
+    InstructionType type = info->type;
+    unsigned int opcode = info->opcode;
+    unsigned int funct3 = info->funct3;
+    unsigned int funct7 = info->funct7;
+    unsigned int rd = instr->rd;
+    unsigned int rs1 = instr->rs1;
+    unsigned int rs2 = instr->rs2;
+    unsigned int imm;
+    unsigned int word = 0;
+
+    // R-type 명령어 처리 (A-type 도 funct5|aq|rl 을 funct7 자리에 두는 같은 형식이다)
+    if (type == R_TYPE || type == A_TYPE)
+    {
+        // R-type 형식: opcode (7 bits) | rd (5 bits) | funct3 (3 bits) | rs1 (5 bits) | rs2 (5 bits) | funct7 (7 bits)
+        word = (funct7 << 25) | (rs2 << 20) | (rs1 << 15) | (funct3 << 12) | (rd << 7) | opcode;
+    }
+    // I-type 명령어 처리
+    else if (type == I_TYPE)
+    {
+        // I-type 형식: imm(12bits) | rs1 (5 bits) | funct3 (3 bits) | rd (5 bits) | opcode (7 bits)
+        //'lw'와 'jalr' 은 명령어 명령어 형식이 조금다르지만 해석할 때 이미 나눠두었다.
+        if (operandFormat(info) != OPERANDS_REG_OFFSET_BASE && (funct3 == 0x1 || funct3 == 0x5)) // slli, srli, srai
+        {
+            imm = ((unsigned int)instr->imm & 0x1F); // sign-extension 처리
+            word = (funct7 << 25) | (imm << 20) | (rs1 << 15) | (funct3 << 12) | (rd << 7) | opcode;
+        }
+        else
+        {
+            imm = ((unsigned int)instr->imm & 0xFFFFFFFF); // sign-extension 처리
+            word = (imm << 20) | (rs1 << 15) | (funct3 << 12) | (rd << 7) | opcode;
+        }
+    }
+    // S-type 명령어 처리
+    else if (type == S_TYPE)
+    {
+        // S=type 형식: imm[11:5] (7 bits) | rs2 (5 bits) | rs1 (5 bits) | funct3 (3 bits) | imm[4-1:11] (5 bits) | opcode (7 bits)
+        imm = (unsigned int)instr->imm;
+        unsigned int imm11_5 = (imm >> 5) & 0x7F;
+        unsigned int imm4_0 = imm & 0x1F;
+        word = (imm11_5 << 25) | (rs2 << 20) | (rs1 << 15) | (funct3 << 12) | (imm4_0 << 7) | opcode;
+    }
+    // SB-type, J-type 명령어 처리
+    else if (type == SB_TYPE || type == J_TYPE)
+    {
+        // 레이블이면 현재 PC와 레이블 주소의 차이를 offset으로 사용합니다.
+        int offset = instr->hasLabel ? (instr->target - instr->address) / 2 : instr->imm;
+        offset = (offset << 1);
+
+        if (type == SB_TYPE)
+        {
+            // SB-type 형식: imm[12|10:5] (7 bits) | rs2 (5 bits) | rs1 (5 bits) | funct3 (3 bits) | imm[4:1|11] (5 bits) | opcode (7 bits)
+            // Branch 명령어의 즉시 값을 비트로 분해합니다.
+            unsigned int imm12 = (offset >> 12) & 0x1;
+            unsigned int imm10_5 = (offset >> 5) & 0x3F;
+            unsigned int imm4_1 = (offset >> 1) & 0xF;
+            unsigned int imm11 = (offset >> 11) & 0x1;
+            word = (imm12 << 31) | (imm10_5 << 25) | (rs2 << 20) | (rs1 << 15) | (funct3 << 12) | (imm4_1 << 8) | (imm11 << 7) | opcode;
+        }
+        else
+        {
+            // J - type 형식: imm[20:10-1:11:19-12] (20 bits) | rd (5 bits) | opcode (7 bits)
+            imm = offset;
+            unsigned int imm20 = imm & 0x1;
+            unsigned int imm10_1 = (imm >> 1) & 0x3FF;
+            unsigned int imm11 = (imm >> 11) & 0x1;
+            unsigned int imm19_12 = (imm >> 12) & 0xFF;
+            word = (imm20 << 31) | (imm10_1 << 21) | (imm11 << 20) | (imm19_12 << 12) | (rd << 7) | opcode;
+        }
+    }
+    // CSR 명령어 처리 (csrrs rd, csr, x0)
+    else if (type == CSR_TYPE)
+    {
+        // I-type 과 같은 형식이고 imm 자리에 CSR 번호가 들어간다.
+        word = (funct7 << 20) | (funct3 << 12) | (rd << 7) | opcode;
+    }
+    // EXIT type 명령어 처리
+    else if (type == EXIT_TYPE)
+    {
+        word = 0xFFFFFFFF;
+    }
+
+    return word;
+}
+
+// 32비트 값을 .o 한 줄로 쓴다. 높은 비트부터 '0'/'1' 32글자와 줄바꿈 하나, 모두 33글자이다.
+void formatBinary(char *out, unsigned int value)
+{
+    for (int i = 31; i >= 0; i--)
+    {
+        *out++ = (char)('0' + ((value >> i) & 1));
+    }
+    *out = '\n';
+}
+
+// 출력 파일 이름을 만든다. (파일명.o, 파일명.trace 처럼 첫 번째 '.' 앞부분에 확장자를 붙인다)
+void makeOutputName(const char *filename, const char *extension, char *out, size_t size)
+{
+    // 예전처럼 맨 앞의 '.' 은 건너뛰고 다음 '.' 까지를 이름으로 쓴다.
+    while (*filename == '.')
+    {
+        filename++;
+    }
+    int length = (int)strcspn(filename, ".");
+    snprintf(out, size, "%.*s%s", length, filename, extension);
+}
+
+// 해석/인코딩 스레드 하나가 맡는 구간
+typedef struct
+{
+    int begin;
+    int end;
+    int errorIndex;         // 구간 안에서 처음 에러가 난 명령어 (없으면 -1)
+    char *output;           // 명령어마다 33글자씩 미리 잡아둔 출력 자리 (인코딩할 때)
+} InstructionChunk;
+
+// 구간 안의 명령어를 해석한다. (스레드 함수)
+// 각 명령어의 sourceOffset/sourceLength 에는 아직 줄 전체가 들어있다.
+void *decodeChunkWorker(void *argument)
+{
+    InstructionChunk *chunk = (InstructionChunk *)argument;
+
+    for (int i = chunk->begin; i < chunk->end; i++)
+    {
+        Instruction *instr = &instructions[i];
+        if (decodeLine(source + instr->sourceOffset, instr->sourceLength, instr) != DECODE_OK)
+        {
+            chunk->errorIndex = i;
+            break;
+        }
+    }
+    return NULL;
+}
+
+// 명령어 하나를 .o 형식으로 out 에 쓴다. (binary 면 4바이트 리틀 엔디언, 아니면 33글자 줄)
+static inline void formatObjectWord(char *out, unsigned int word)
+{
+    if (objectBinary)
+    {
+        unsigned char *bytes = (unsigned char *)out;
+        bytes[0] = (unsigned char)word;
+        bytes[1] = (unsigned char)(word >> 8);
+        bytes[2] = (unsigned char)(word >> 16);
+        bytes[3] = (unsigned char)(word >> 24);
+    }
+    else
+    {
+        formatBinary(out, word);
+    }
+}
+
+// 구간 안의 명령어를 인코딩해서 각자의 출력 자리에 쓴다. (스레드 함수)
+void *encodeChunkWorker(void *argument)
+{
+    InstructionChunk *chunk = (InstructionChunk *)argument;
+    size_t recordSize = objectBinary ? 4 : BINARY_LINE_LENGTH;
+
+    for (int i = chunk->begin; i < chunk->end; i++)
+    {
+        formatObjectWord(chunk->output + (size_t)i * recordSize, encodeInstruction(&instructions[i]));
+    }
+    return NULL;
+}
+
+// 명령어 배열을 스레드 수만큼 구간으로 나눠서 worker 를 돌린다.
+int runInstructionChunks(InstructionChunk *chunks, void *(*worker)(void *), char *output)
+{
+    int chunkCount = decideThreadCount(instructionCount, ENCODE_CHUNK_MIN_LINES);
+    pthread_t threads[MAX_THREADS];
+
+    for (int i = 0; i < chunkCount; i++)
+    {
+        chunks[i].begin = (int)((long long)instructionCount * i / chunkCount);
+        chunks[i].end = (int)((long long)instructionCount * (i + 1) / chunkCount);
+        chunks[i].errorIndex = -1;
+        chunks[i].output = output;
+    }
+    if (chunkCount == 1)
+    {
+        worker(&chunks[0]);
+    }
+    else
+    {
+        for (int i = 0; i < chunkCount; i++)
+        {
+            pthread_create(&threads[i], NULL, worker, &chunks[i]);
+        }
+        for (int i = 0; i < chunkCount; i++)
+        {
+            pthread_join(threads[i], NULL);
+        }
+    }
+    return chunkCount;
+}
+
+// 두 번째 패스. 파일을 전체적으로 읽으면서 모든 명령어를 해석해서 배열에 넣는다.
+// (레이블은 firstPass 에서 이미 모두 저장했다) 명령어 배열은 개수를 먼저 센 뒤 아레나에서 한 번에 받는다.
+// firstPass 가 레이블 주소를 모두 정해두었으므로 줄마다 독립적으로, 여러 스레드가 나눠서 해석할 수 있다.
+bool loadInstructions()
+{
+    const char *cursor = source;
+    const char *line;
+    int length;
+
+    // 명령어 줄 수를 센다. (비어있는 줄과 라벨 줄은 넘어간다)
+    int count = 0;
+    while ((line = nextLine(&cursor, source + sourceSize, &length)) != NULL)
+    {
+        Token labelToken;
+        if (classifyLine(line, length, &labelToken) == LINE_INSTRUCTION)
+        {
+            count++;
+        }
+    }
+
+    // 명령어 줄마다 주소를 정하고, 해석하기 전까지는 줄 전체의 위치를 넣어둔다.
+    instructions = arenaAlloc(&fileArena, (count + 1) * sizeof(Instruction));
+    instructionCount = 0;
+    pc = 1000; // PC 초기값
+    cursor = source;
+    while ((line = nextLine(&cursor, source + sourceSize, &length)) != NULL)
+    {
+        Token labelToken;
+        if (classifyLine(line, length, &labelToken) == LINE_INSTRUCTION)
+        {
+            instructions[instructionCount].sourceOffset = (int)(line - source);
+            instructions[instructionCount].sourceLength = length;
+            instructions[instructionCount].address = pc;
+            instructionCount++;
+            pc += 4;
+        }
+    }
+
+    // 구간을 나눠서 동시에 해석하고, 앞 구간부터 보면서 처음 나온 에러로 결과를 정한다.
+    InstructionChunk chunks[MAX_THREADS];
+    int chunkCount = runInstructionChunks(chunks, decodeChunkWorker, NULL);
+    for (int i = 0; i < chunkCount; i++)
+    {
+        if (chunks[i].errorIndex >= 0)
+        {
+            return false;
+        }
+    }
+
+    // .word 에 쓴 레이블도 주소로 바꾼다.
+    return resolveDataWords();
+}
+
+// 세 번째 패스. 해석해 둔 명령어를 이진수로 바꿔서 .o 파일을 만든다.
+// 구간을 스레드들에게 나눠주고, 각 스레드는 미리 잡아둔 자리에 결과를 쓴 뒤, 마지막에 한 번에 순서대로 파일에 쓴다.
+bool processFile(const char *filename)
+{
+    char outputFilename[260];
+
+    // 파일명.o  파일을 만드는 것
+    makeOutputName(filename, ".o", outputFilename, sizeof(outputFilename));
+    fileOpenCheck = 1;
+
+    // 파이프라인 모드에서는 버퍼를 쓰기 스레드에 넘기므로 아레나가 아니라 malloc 으로 잡는다.
+    size_t outputSize = (size_t)instructionCount * (objectBinary ? 4 : BINARY_LINE_LENGTH);
+    char *output = pipelineEnabled ? malloc(outputSize + 1) : arenaAlloc(&fileArena, outputSize + 1);
+    InstructionChunk chunks[MAX_THREADS];
+    runInstructionChunks(chunks, encodeChunkWorker, output);
+    if (pipelineEnabled)
+    {
+        submitWrite(outputFilename, output, outputSize, false, false);
+        return true;
+    }
+
+    // 순서대로 한 번에 파일에 쓴다.
+    FILE *outputFile = fopen(outputFilename, "w");
+    if (outputFile == NULL)
+    {
+        printf("we can't open the file\n");
+        return false;
+    }
+    fwrite(output, 1, outputSize, outputFile);
+    fclose(outputFile);
+    return true;
+}
+
+// 하트 하나의 시작 상태
+typedef struct
+{
+    int index;                     // 하트 번호 (시작할 때 x10 에 넣어준다)
+    int entry;                     // 시작 pc
+    int registers[REGISTER_COUNT]; // 시작 레지스터
+    char traceName[300];           // 파일명.hartN.trace
+    bool opened;                   // trace 파일을 열었는지
+} HartStart;
+
+// 하트 하나를 끝까지 실행한다. (스레드 함수)
+// 실행 상태는 _Thread_local 이므로 하트가 하나일 때와 같은 runDetailed 를 그대로 쓴다.
+void *hartWorker(void *argument)
+{
+    HartStart *start = (HartStart *)argument;
+    FILE *outputFile = fopen(start->traceName, "w");
+
+    if (outputFile == NULL)
+    {
+        return NULL;
+    }
+    start->opened = true;
+
+    memcpy(registers, start->registers, sizeof(registers));
+    registers[10] = start->index;
+    pc = start->entry;
+    stepCount = 0;
+    traceHead = NULL;
+    traceTail = NULL;
+    traceLength = 0;
+    traceFileOffset = 0;
+    traceEntries = 0;
+    reservationValid = false;
+    traceOutputFile = outputFile;
+
+    runDetailed((maxSteps > 0) ? maxSteps : LLONG_MAX, NULL);
+
+    // 남아있는 trace를 파일에 기록한다.
+    flushTrace();
+    traceOutputFile = NULL;
+    fclose(outputFile);
+    return NULL;
+}
+
+// 하트 여러 개를 각자 스레드에서 같은 메모리를 쓰면서 실행한다. trace 는 하트마다 파일명.hartN.trace 에 남긴다.
+// 하트 i 는 --hart-entry 의 i 번째 레이블에서 시작하고, 목록이 짧으면 나머지 하트는 프로그램 처음에서 시작한다.
+void runHarts(const char *filename)
+{
+    HartStart *starts = arenaAlloc(&fileArena, hartCount * sizeof(HartStart));
+    pthread_t threads[MAX_HARTS];
+    char baseName[260];
+    const char *entry = (hartEntryOption != NULL) ? hartEntryOption : "";
+
+    makeOutputName(filename, "", baseName, sizeof(baseName));
+    for (int i = 0; i < hartCount; i++)
+    {
+        starts[i].index = i;
+        starts[i].entry = 1000;
+        memcpy(starts[i].registers, registers, sizeof(registers));
+        snprintf(starts[i].traceName, sizeof(starts[i].traceName), "%s.hart%d.trace", baseName, i);
+        starts[i].opened = false;
+
+        // 쉼표로 나눈 목록에서 이 하트의 시작 레이블을 꺼낸다.
+        int length = (int)strcspn(entry, ",");
+        if (length > 0)
+        {
+            Token label = {entry, length, TOKEN_WORD};
+            starts[i].entry = findLabelAddress(label);
+            if (starts[i].entry == -1)
+            {
+                printf("Unknown hart entry label '%.*s'\n", length, entry);
+                return;
+            }
+        }
+        entry += length;
+        if (*entry == ',')
+        {
+            entry++;
+        }
+    }
+
+    for (int i = 0; i < hartCount; i++)
+    {
+        pthread_create(&threads[i], NULL, hartWorker, &starts[i]);
+    }
+    for (int i = 0; i < hartCount; i++)
+    {
+        pthread_join(threads[i], NULL);
+        if (!starts[i].opened)
+        {
+            printf("we can't open the file\n");
+        }
+    }
+}
+
+//
+// lockstep 구간!! 시작!!
+//
+// 같은 프로그램을 여러 초기 레지스터 값으로 돌릴 때, LOCKSTEP_LANES 개의 인스턴스를 한 묶음으로 같은 pc 에서 같이 실행한다.
+// 레지스터는 레지스터마다 인스턴스 값들을 나란히 둔 벡터(SoA)로 저장해서, ALU 명령어 하나를 SIMD 연산 하나로 계산한다.
+// 분기 결과가 인스턴스마다 달라지면 갈라진 인스턴스는 묶음에서 빠지고, 나중에 보통(스칼라) 실행으로 끝까지 돈다.
+typedef int LaneVector __attribute__((vector_size(LOCKSTEP_LANES * sizeof(int))));
+typedef unsigned int LaneVectorUnsigned __attribute__((vector_size(LOCKSTEP_LANES * sizeof(int))));
+
+// 인스턴스 하나의 상태
+typedef struct
+{
+    int index;                      // 입력 파일에서 몇 번째 인스턴스인지
+    int registers[REGISTER_COUNT];  // 시작 레지스터 (묶음에서 빠진 뒤에는 그때의 레지스터)
+    int pc;                         // 묶음에서 빠진 뒤의 pc
+    bool diverged;                  // 묶음에서 빠져서 스칼라로 실행해야 하는지
+    long long steps;                // 실행한 명령어 수
+    uint64_t digest;                // trace 내용의 FNV-1a 해시 (.trace 파일을 해시한 값과 같다)
+    FILE *traceFile;                // 인스턴스의 .trace (digestOnly 면 NULL)
+    GuestMemory memory;             // 인스턴스마다 따로 쓰는 메모리
+    int bufferLength;
+    char buffer[LANE_TRACE_BUFFER]; // 파일로 내보내기 전의 trace
+} LaneState;
+
+// 인스턴스 하나의 결과
+typedef struct
+{
+    long long steps;
+    uint64_t digest;
+    bool opened; // trace 파일을 열었는지
+} LaneResult;
+
+int (*laneInputs)[REGISTER_COUNT] = NULL; // 인스턴스마다 시작 레지스터
+int laneInputCount = 0;
+LaneResult *laneResults = NULL;
+int nextLaneGroup = 0;         // 다음에 가져갈 묶음 번호 (스레드들이 원자적으로 가져간다)
+long long lockstepDiverged = 0; // 묶음에서 빠진 인스턴스 수
+char laneBaseName[260];        // 인스턴스 trace 파일 이름의 앞부분
+
+// 인스턴스의 trace 에 글자를 붙인다. 해시는 항상 계산하고, 파일은 버퍼가 차면 내보낸다.
+void appendLaneTrace(LaneState *lane, const char *text, int length)
+{
+    for (int i = 0; i < length; i++)
+    {
+        lane->digest ^= (unsigned char)text[i];
+        lane->digest *= 1099511628211ULL;
+    }
+    if (lane->traceFile != NULL)
+    {
+        if (lane->bufferLength + length > LANE_TRACE_BUFFER)
+        {
+            fwrite(lane->buffer, 1, lane->bufferLength, lane->traceFile);
+            lane->bufferLength = 0;
+        }
+        memcpy(lane->buffer + lane->bufferLength, text, length);
+        lane->bufferLength += length;
+    }
+}
+
+// 묶음에서 빠진 인스턴스를 보통 실행으로 끝까지 돌린다. (runDetailed 와 같은 순서로 trace 를 남긴다)
+void runLaneScalar(LaneState *lane, long long stepLimit)
+{
+    char text[16];
+
+    currentMemory = &lane->memory;
+    memcpy(registers, lane->registers, sizeof(registers));
+    pc = lane->pc;
+    reservationValid = false;
+
+    while (lane->steps < stepLimit)
+    {
+        Instruction *instr = fetchInstruction(pc);
+        if (instr == NULL)
+        {
+            break; // 더 이상 명령어가 없으면 종료
+        }
+        appendLaneTrace(lane, text, formatTraceEntry(text, pc, lane->steps == 0));
+
+        InstructionType type = instructionTable[instr->infoIndex].type;
+        int nowPc = pc;
+        stepCount = lane->steps; // 카운터 CSR 은 인스턴스의 명령어 수를 읽는다.
+        int newPc = executeInstruction(instr);
+        lane->steps++;
+
+        // 종료 명령어이거나 pc가 그대로면 끝낸다.
+        if (type == EXIT_TYPE || newPc == nowPc)
+        {
+            break;
+        }
+        pc = newPc;
+    }
+    currentMemory = &sharedMemory;
+}
+
+// R-type, I-type ALU 명령어를 모든 인스턴스에 대해 한 번에 계산해서 *result 에 넣는다. (b 는 rs2 또는 즉시값)
+// 벡터를 값으로 넘기면 AVX 없이 컴파일할 때 ABI 경고가 나므로 포인터로 주고받는다.
+static inline void laneAlu(const InstructionInfo *info, const LaneVector *a, const LaneVector *b, bool immediate, LaneVector *result)
+{
+    LaneVector shift = *b & 0x1F;
+
+    switch (info->funct3)
+    {
+    case 0x0: // add, sub, addi
+        *result = (info->funct7 == 0x20) ? *a - *b : *a + *b;
+        break;
+    case 0x7: // and, andi
+        *result = *a & *b;
+        break;
+    case 0x6: // or, ori
+        *result = *a | *b;
+        break;
+    case 0x4: // xor, xori
+        *result = *a ^ *b;
+        break;
+    case 0x1: // sll, slli
+        *result = *a << shift;
+        break;
+    default: // srl, sra, srli, srai
+        if (info->funct7 == 0x20)
+        {
+            // 스칼라 sra 는 shift 가 0 이고 음수이면 mask 계산에서 1 << 32 가 1 이 되어 -1 이 나온다. 결과를 똑같이 맞춘다.
+            LaneVector shifted = *a >> shift;
+            if (!immediate)
+            {
+                shifted |= (*a < 0) & (shift == 0);
+            }
+            *result = shifted;
+        }
+        else
+        {
+            *result = (LaneVector)((LaneVectorUnsigned)*a >> (LaneVectorUnsigned)shift);
+        }
+        break;
+    }
+}
+
+// 묶음 안의 인스턴스 하나만 스칼라로 한 step 실행한다. (원자 명령어처럼 벡터로 만들 이유가 없는 명령어)
+int stepLaneScalar(const Instruction *instr, LaneVector *laneRegisters, int groupPc, LaneState *lane, int laneIndex)
+{
+    currentMemory = &lane->memory;
+    for (int r = 0; r < REGISTER_COUNT; r++)
+    {
+        registers[r] = laneRegisters[r][laneIndex];
+    }
+    pc = groupPc;
+
+    int newPc = executeInstruction(instr);
+
+    for (int r = 0; r < REGISTER_COUNT; r++)
+    {
+        laneRegisters[r][laneIndex] = registers[r];
+    }
+    currentMemory = &sharedMemory;
+    return newPc;
+}
+
+// 묶음 하나(인스턴스 laneCount 개)를 실행한다.
+void runLaneGroup(LaneState *lanes, int laneCount, long long stepLimit)
+{
+    LaneVector laneRegisters[REGISTER_COUNT];
+    LaneVector zero = {0};
+    unsigned int active = (1u << laneCount) - 1; // 묶음에 남아있는 인스턴스
+    int groupPc = 1000;
+    long long steps = 0;
+    char text[16];
+
+    // 시작 레지스터를 SoA 로 옮긴다.
+    for (int r = 0; r < REGISTER_COUNT; r++)
+    {
+        for (int l = 0; l < LOCKSTEP_LANES; l++)
+        {
+            laneRegisters[r][l] = (l < laneCount) ? lanes[l].registers[r] : 0;
+        }
+    }
+
+    while (active != 0 && steps < stepLimit)
+    {
+        Instruction *instr = fetchInstruction(groupPc);
+        if (instr == NULL)
+        {
+            break; // 더 이상 명령어가 없으면 종료
+        }
+
+        // 현재 PC값을 남아있는 인스턴스들의 트레이스에 저장
+        int length = formatTraceEntry(text, groupPc, steps == 0);
+        for (int l = 0; l < laneCount; l++)
+        {
+            if (active & (1u << l))
+            {
+                appendLaneTrace(&lanes[l], text, length);
+            }
+        }
+        steps++;
+
+        const InstructionInfo *info = &instructionTable[instr->infoIndex];
+        LaneVector a = laneRegisters[instr->rs1];
+        LaneVector b = laneRegisters[instr->rs2];
+        LaneVector imm = zero + instr->imm;
+        int newPc = groupPc + 4;
+        int lanePcs[LOCKSTEP_LANES] = {0}; // 인스턴스마다 다음 pc 가 다를 수 있는 명령어에서 쓴다.
+        bool perLanePc = false;
+
+        switch (info->type)
+        {
+        case R_TYPE:
+            laneAlu(info, &a, &b, false, &laneRegisters[instr->rd]);
+            break;
+        case I_TYPE:
+            if (info->opcode == 0x03) // lw 는 인스턴스마다 자기 메모리에서 읽는다.
+            {
+                for (int l = 0; l < laneCount; l++)
+                {
+                    if (active & (1u << l))
+                    {
+                        laneRegisters[instr->rd][l] = loadGuestMemory(&lanes[l].memory, a[l] + instr->imm);
+                    }
+                }
+            }
+            else if (info->opcode == 0x67) // jalr 은 인스턴스마다 목표 주소가 다를 수 있다.
+            {
+                for (int l = 0; l < laneCount; l++)
+                {
+                    lanePcs[l] = (a[l] + instr->imm) & ~1;
+                }
+                perLanePc = true;
+                if (instr->rd != 0)
+                {
+                    laneRegisters[instr->rd] = zero + (groupPc + 4);
+                }
+            }
+            else
+            {
+                laneAlu(info, &a, &imm, true, &laneRegisters[instr->rd]);
+            }
+            break;
+        case S_TYPE: // sw 도 인스턴스마다 자기 메모리에 쓴다.
+            for (int l = 0; l < laneCount; l++)
+            {
+                if (active & (1u << l))
+                {
+                    *guestMemoryWord(&lanes[l].memory, a[l] + instr->imm) = b[l];
+                }
+            }
+            break;
+        case SB_TYPE:
+        {
+            LaneVector taken;
+            switch (info->funct3)
+            {
+            case 0x0: // beq
+                taken = (a == b);
+                break;
+            case 0x1: // bne
+                taken = (a != b);
+                break;
+            case 0x4: // blt
+                taken = (a < b);
+                break;
+            default: // bge
+                taken = (a >= b);
+                break;
+            }
+            for (int l = 0; l < laneCount; l++)
+            {
+                lanePcs[l] = taken[l] ? instr->target : groupPc + 4;
+            }
+            perLanePc = true;
+            break;
+        }
+        case J_TYPE:
+            laneRegisters[instr->rd] = zero + (groupPc + 4);
+            newPc = instr->target;
+            break;
+        case A_TYPE:
+            for (int l = 0; l < laneCount; l++)
+            {
+                if (active & (1u << l))
+                {
+                    stepLaneScalar(instr, laneRegisters, groupPc, &lanes[l], l);
+                }
+            }
+            break;
+        case CSR_TYPE:
+            // ecall 은 인스턴스마다 스칼라로 하고, exit 한 인스턴스는 pc 가 그대로라서 묶음에서 빠진다.
+            if (info->funct3 == 0x0)
+            {
+                for (int l = 0; l < laneCount; l++)
+                {
+                    if (active & (1u << l))
+                    {
+                        lanePcs[l] = stepLaneScalar(instr, laneRegisters, groupPc, &lanes[l], l);
+                    }
+                }
+                perLanePc = true;
+                break;
+            }
+            // 묶음 안의 인스턴스는 실행한 명령어 수가 모두 같다. (steps 는 이 명령어까지 센 값)
+            laneRegisters[instr->rd] = zero + (int)readCounter(info->funct7, steps - 1);
+            break;
+        default:
+            break;
+        }
+        laneRegisters[0] = zero;
+
+        // 다음 pc 가 인스턴스마다 다르면 남아있는 첫 번째 인스턴스를 따라가고, 나머지는 묶음에서 뺀다.
+        if (perLanePc)
+        {
+            int leader = __builtin_ctz(active);
+            newPc = lanePcs[leader];
+            for (int l = leader + 1; l < laneCount; l++)
+            {
+                if ((active & (1u << l)) && lanePcs[l] != newPc)
+                {
+                    active &= ~(1u << l);
+                    lanes[l].steps = steps;
+
+                    // pc 가 그대로인 인스턴스는 여기서 끝난다.
+                    if (lanePcs[l] != groupPc)
+                    {
+                        for (int r = 0; r < REGISTER_COUNT; r++)
+                        {
+                            lanes[l].registers[r] = laneRegisters[r][l];
+                        }
+                        lanes[l].pc = lanePcs[l];
+                        lanes[l].diverged = true;
+                    }
+                }
+            }
+        }
+
+        // 종료 명령어이거나 pc가 그대로면 끝낸다.
+        if (info->type == EXIT_TYPE || newPc == groupPc)
+        {
+            break;
+        }
+        groupPc = newPc;
+    }
+
+    // 묶음에 끝까지 남은 인스턴스의 step 수
+    for (int l = 0; l < laneCount; l++)
+    {
+        if (active & (1u << l))
+        {
+            lanes[l].steps = steps;
+        }
+    }
+
+    // 갈라진 인스턴스를 스칼라로 끝까지 실행한다.
+    for (int l = 0; l < laneCount; l++)
+    {
+        if (lanes[l].diverged)
+        {
+            runLaneScalar(&lanes[l], stepLimit);
+        }
+    }
+}
+
+// 묶음을 하나씩 가져가서 실행한다. (스레드 함수)
+void *laneGroupWorker(void *argument)
+{
+    LaneState *lanes = calloc(LOCKSTEP_LANES, sizeof(LaneState));
+    long long stepLimit = (maxSteps > 0) ? maxSteps : LLONG_MAX;
+    int groupCount = (laneInputCount + LOCKSTEP_LANES - 1) / LOCKSTEP_LANES;
+    int group;
+
+    (void)argument;
+    if (lanes == NULL)
+    {
+        printf("Memory allocation failed.\n");
+        exit(1);
+    }
+
+    while ((group = __atomic_fetch_add(&nextLaneGroup, 1, __ATOMIC_RELAXED)) < groupCount)
+    {
+        int first = group * LOCKSTEP_LANES;
+        int laneCount = (laneInputCount - first < LOCKSTEP_LANES) ? laneInputCount - first : LOCKSTEP_LANES;
+        long long diverged = 0;
+
+        for (int l = 0; l < laneCount; l++)
+        {
+            LaneState *lane = &lanes[l];
+            char traceName[300];
+
+            lane->index = first + l;
+            memcpy(lane->registers, laneInputs[first + l], sizeof(lane->registers));
+            lane->diverged = false;
+            lane->steps = 0;
+            lane->digest = 1469598103934665603ULL;
+            lane->bufferLength = 0;
+            lane->traceFile = NULL;
+            if (!digestOnly)
+            {
+                snprintf(traceName, sizeof(traceName), "%s.inst%d.trace", laneBaseName, lane->index);
+                lane->traceFile = fopen(traceName, "w");
+            }
+            laneResults[lane->index].opened = digestOnly || lane->traceFile != NULL;
+            loadDataImage(&lane->memory);
+        }
+
+        runLaneGroup(lanes, laneCount, stepLimit);
+
+        for (int l = 0; l < laneCount; l++)
+        {
+            LaneState *lane = &lanes[l];
+            if (lane->traceFile != NULL)
+            {
+                fwrite(lane->buffer, 1, lane->bufferLength, lane->traceFile);
+                fclose(lane->traceFile);
+            }
+            freeMemory(&lane->memory);
+            laneResults[lane->index].steps = lane->steps;
+            laneResults[lane->index].digest = lane->digest;
+            diverged += lane->diverged ? 1 : 0;
+        }
+        __atomic_fetch_add(&lockstepDiverged, diverged, __ATOMIC_RELAXED);
+    }
+
+    free(lanes);
+    return NULL;
+}
+
+// 입력 파일을 읽는다. 한 줄이 인스턴스 하나이고, 공백이나 쉼표로 나눈 정수들을 차례대로 x1, x2, ... 에 넣는다. ('#' 뒤는 주석)
+bool readLaneInputs(const char *path)
+{
+    size_t size;
+    char *text = readFileToArena(path, &size);
+    const char *cursor = text;
+    const char *line;
+    int length;
+    int lineNumber = 0;
+    int capacity = 0;
+
+    if (text == NULL)
+    {
+        printf("Input file does not exist!!\n");
+        return false;
+    }
+
+    laneInputs = NULL;
+    laneInputCount = 0;
+    while ((line = nextLine(&cursor, text + size, &length)) != NULL)
+    {
+        Token tokens[REGISTER_COUNT * 2];
+        int count = lexLine(line, length, tokens, REGISTER_COUNT * 2 - 1);
+        int valueCount = 0;
+        lineNumber++;
+
+        if (count == 0)
+        {
+            continue;
+        }
+        if (count > REGISTER_COUNT * 2 - 1)
+        {
+            printf("%s line %d: too many values\n", path, lineNumber);
+            return false;
+        }
+
+        if (laneInputCount >= capacity)
+        {
+            int newCapacity = (capacity == 0) ? 256 : capacity * 2;
+            laneInputs = arenaGrow(&fileArena, laneInputs, capacity * sizeof(*laneInputs), newCapacity * sizeof(*laneInputs));
+            capacity = newCapacity;
+        }
+        memset(laneInputs[laneInputCount], 0, sizeof(*laneInputs));
+        for (int i = 0; i < count; i++)
+        {
+            // 값 사이의 쉼표는 넘어간다.
+            if (tokens[i].kind == TOKEN_COMMA)
+            {
+                continue;
+            }
+            if (valueCount >= REGISTER_COUNT - 1)
+            {
+                printf("%s line %d: too many values\n", path, lineNumber);
+                return false;
+            }
+            if (!tokenNumber(tokens[i], &laneInputs[laneInputCount][++valueCount]))
+            {
+                printf("%s line %d: '%.*s' is not an integer\n", path, lineNumber, tokens[i].length, tokens[i].start);
+                return false;
+            }
+        }
+        laneInputCount++;
+    }
+    return true;
+}
+
+// 입력 파일의 레지스터 값마다 인스턴스를 만들어서 lockstep 으로 실행한다.
+// trace 는 인스턴스마다 파일명.instN.trace 에 남기고, --digest 면 대신 파일명.digest 에 인스턴스마다 trace 해시를 남긴다.
+void runLockstep(const char *filename)
+{
+    pthread_t threads[MAX_THREADS];
+
+    if (!readLaneInputs(inputsPath))
+    {
+        return;
+    }
+    laneResults = arenaAlloc(&fileArena, (laneInputCount + 1) * sizeof(LaneResult));
+    makeOutputName(filename, "", laneBaseName, sizeof(laneBaseName));
+    nextLaneGroup = 0;
+    lockstepDiverged = 0;
+
+    // 묶음들을 스레드들이 나눠서 실행한다.
+    int groupCount = (laneInputCount + LOCKSTEP_LANES - 1) / LOCKSTEP_LANES;
+    int workerCount = decideThreadCount(groupCount, 1);
+    if (workerCount == 1)
+    {
+        laneGroupWorker(NULL);
+    }
+    else
+    {
+        for (int i = 0; i < workerCount; i++)
+        {
+            pthread_create(&threads[i], NULL, laneGroupWorker, NULL);
+        }
+        for (int i = 0; i < workerCount; i++)
+        {
+            pthread_join(threads[i], NULL);
+        }
+    }
+
+    for (int i = 0; i < laneInputCount; i++)
+    {
+        if (!laneResults[i].opened)
+        {
+            printf("we can't open the file\n");
+            break;
+        }
+    }
+
+    if (digestOnly)
+    {
+        char digestName[280];
+        snprintf(digestName, sizeof(digestName), "%s.digest", laneBaseName);
+        FILE *digestFile = fopen(digestName, "w");
+        if (digestFile == NULL)
+        {
+            printf("we can't open the file\n");
+            return;
+        }
+        for (int i = 0; i < laneInputCount; i++)
+        {
+            fprintf(digestFile, "instance %d: steps %lld digest %016llx\n", i, laneResults[i].steps,
+                    (unsigned long long)laneResults[i].digest);
+        }
+        fclose(digestFile);
+    }
+
+    printf("lockstep: %d instances, %d lanes per group, %lld diverged\n", laneInputCount, LOCKSTEP_LANES, lockstepDiverged);
+}
+
+// 트레이스 파일을 만들어 보자. trace에 있는 값을 한줄씩 저장한다.
+void traceFile(const char *filename)
+{
+    // .data 와 --load 로 준 값을 메모리에 넣는다. (lockstep 인스턴스는 각자 메모리에 따로 넣는다)
+    loadDataImage(&sharedMemory);
+
+    // 입력 파일이 있으면 인스턴스마다의 레지스터 값으로 lockstep 실행을 한다.
+    if (inputsPath != NULL)
+    {
+        runLockstep(filename);
+        return;
+    }
+
+    // 하트가 여러 개면 하트마다 스레드를 만들어서 따로 trace 를 남긴다.
+    if (hartCount > 1)
+    {
+        runHarts(filename);
+        return;
+    }
+
+    // 파이프라인 모드에서는 소스를 이미 읽어두었으므로 다시 열어보지 않는다.
+    FILE *inputFile = pipelineEnabled ? NULL : fopen(filename, "r");
+    char outputFilename[260];
+
+    // 파일명.trace  파일을 만드는 것
+    makeOutputName(filename, ".trace", outputFilename, sizeof(outputFilename));
+
+    // 파일명.ckpt 가 기본 체크포인트 파일 이름이다.
+    if (checkpointOption != NULL)
+    {
+        snprintf(checkpointPath, sizeof(checkpointPath), "%s", checkpointOption);
+    }
+    else
+    {
+        makeOutputName(filename, ".ckpt", checkpointPath, sizeof(checkpointPath));
+    }
+
+    // 명령어와 라벨의 주소값은 앞의 패스에서 모두 저장했다.
+    sourceHash = (linkedObjectCount > 0) ? linkedSourceHash : hashSource(source, sourceSize);
+
+    // 체크포인트에서 이어서 실행하는 경우 상태를 되돌리고 .trace 파일도 체크포인트 위치에서 이어 쓴다.
+    checkpointRestored = false;
+    if (restorePath != NULL)
+    {
+        checkpointRestored = restoreCheckpoint(restorePath);
+        restorePath = NULL; // 복원은 다음 파일 하나에만 적용한다.
+        if (!checkpointRestored)
+        {
+            if (inputFile != NULL)
+            {
+                fclose(inputFile);
+            }
+            return;
+        }
+        if (truncate(outputFilename, traceFileOffset) != 0)
+        {
+            printf("we can't open the file\n");
+            if (inputFile != NULL)
+            {
+                fclose(inputFile);
+            }
+            return;
+        }
+    }
+
+    // --mtrace 면 메모리 trace 쓰기 스레드를 띄운다.
+    if (memoryTraceEnabled)
+    {
+        char memoryTraceFilename[260];
+        makeOutputName(filename, ".mtrace", memoryTraceFilename, sizeof(memoryTraceFilename));
+        startMemoryTrace(memoryTraceFilename);
+    }
+
+    // 파이프라인 모드에서는 .trace 를 쓰기 스레드에 넘긴다. (체크포인트 옵션과는 같이 쓰지 않는다)
+    if (pipelineEnabled)
+    {
+        traceWritePath = outputFilename;
+        traceWriteStarted = false;
+        executeProgram();
+        stopMemoryTrace();
+        flushTrace();
+        traceWritePath = NULL;
+        if (!fileOpenCheck)
+        {
+            submitWrite(outputFilename, NULL, 0, false, true);
+        }
+        return;
+    }
+
+    FILE *outputFile = fopen(outputFilename, checkpointRestored ? "a" : "w");
+
+    // 파일이 열리지 않을 때는 이렇게 처리한다.
+    if (inputFile == NULL || outputFile == NULL)
+    {
+        printf("we can't open the file\n");
+        stopMemoryTrace();
+        return;
+    }
+    traceOutputFile = outputFile;
+
+    // trace에 값을 저장!! (실행 도중에도 trace 버퍼가 커지거나 체크포인트를 쓰면 파일로 내보낸다)
+    executeProgram();
+    stopMemoryTrace();
+
+    // 남아있는 trace를 파일에 기록한다.
+    flushTrace();
+    traceOutputFile = NULL;
+
+    // Syntax error 가 떴을 때 trace파일 자체를 쓰지 않기 위해서 넣었다.
+    if (fileOpenCheck)
+    {
+        fclose(inputFile);
+        fclose(outputFile);
+    }
+    else
+    {
+        fclose(outputFile);
+        remove(outputFilename);
+        return;
+    }
+}
+
+//
+// 최적화 구간!! 시작!! (-O)
+//
+// 해석해 둔 명령어 배열을 인코딩과 실행 전에 고친다. 지운 명령어는 표시만 해두었다가 마지막에 한 번에 당기고,
+// 레이블 주소와 분기 대상을 새 주소로 옮긴다.
+// 블록이 시작할 때 레지스터 값은 모르는 것으로 본다. (하트, lockstep 인스턴스마다 시작 값이 다르기 때문)
+// 코드 주소는 jal 이 남긴 복귀 주소로만 얻는다고 가정한다. (숫자로 계산하거나 la 로 얻은 주소로 jalr 하는 코드는 -O 를 쓰면 안 된다)
+
+// 최적화 결과
+typedef struct
+{
+    int constantsFolded;   // 상수로 바꾼 명령어
+    int deadWrites;        // 아무도 읽지 않는 레지스터에 쓰는 명령어
+    int noops;             // x0 에 쓰거나 값을 바꾸지 않는 명령어
+    int redundantMoves;    // 이미 같은 값이 들어있는 레지스터로의 복사
+    int branchesRemoved;   // 다음 명령어로 가는 분기, 절대 분기하지 않는 분기
+    int branchesResolved;  // 항상 분기해서 jal 로 바꾼 분기
+} OptimizeStats;
+
+bool *optimizeRemoved = NULL; // 명령어마다 지웠는지
+
+// addi, jal 처럼 다시 쓸 명령어의 instructionTable 위치
+int instructionIndexByName(const char *name)
+{
+    Token token = {name, (int)strlen(name), TOKEN_WORD};
+    return findInstructionIndex(token);
+}
+
+// 명령어가 쓰는 레지스터 (없으면 -1)
+int instructionDefinition(const Instruction *instr)
+{
+    switch (instructionTable[instr->infoIndex].type)
+    {
+    case R_TYPE:
+    case I_TYPE:
+    case J_TYPE:
+    case A_TYPE:
+        return instr->rd;
+    case CSR_TYPE:
+        return (instructionTable[instr->infoIndex].funct3 == 0x0) ? 10 : instr->rd; // ecall 은 a0 에 결과를 쓴다.
+    default:
+        return -1;
+    }
+}
+
+// 명령어가 읽는 레지스터들 (비트마다 레지스터 하나)
+unsigned int instructionUses(const Instruction *instr)
+{
+    switch (instructionTable[instr->infoIndex].type)
+    {
+    case R_TYPE:
+    case S_TYPE:
+    case SB_TYPE:
+    case A_TYPE:
+        return (1u << instr->rs1) | (1u << instr->rs2);
+    case I_TYPE:
+        return 1u << instr->rs1;
+    case CSR_TYPE:
+        // ecall 은 a0~a3 과 a7 을 읽는다.
+        return (instructionTable[instr->infoIndex].funct3 == 0x0) ? (0xFu << 10) | (1u << 17) : 0;
+    default:
+        return 0;
+    }
+}
+
+// 레지스터에 쓰는 것 말고는 하는 일이 없는 명령어인지 (ALU, lw)
+bool isPureInstruction(const Instruction *instr)
+{
+    const InstructionInfo *info = &instructionTable[instr->infoIndex];
+    return info->type == R_TYPE || (info->type == I_TYPE && info->opcode != 0x67);
+}
+
+// 주소에 해당하는 명령어 위치. 프로그램 밖이면 instructionCount
+int instructionIndexOfAddress(int address)
+{
+    if (address < 1000 || (address - 1000) % 4 != 0 || (address - 1000) / 4 > instructionCount)
+    {
+        return instructionCount;
+    }
+    return (address - 1000) / 4;
+}
+
+// index 부터 처음으로 남아있는 명령어 위치
+int nextKeptInstruction(int index)
+{
+    while (index < instructionCount && optimizeRemoved[index])
+    {
+        index++;
+    }
+    return index;
+}
+
+// ALU 명령어를 상수로 계산한다. executeInstruction 과 결과가 다를 수 있는 경우(sra 의 shift 0)는 false
+bool foldAlu(const InstructionInfo *info, int a, int b, bool immediate, int *result)
+{
+    unsigned int ua = (unsigned int)a;
+    unsigned int ub = (unsigned int)b;
+
+    switch (info->funct3)
+    {
+    case 0x0: // add, sub, addi
+        *result = (int)((info->funct7 == 0x20 && !immediate) ? ua - ub : ua + ub);
+        return true;
+    case 0x7: // and, andi
+        *result = a & b;
+        return true;
+    case 0x6: // or, ori
+        *result = a | b;
+        return true;
+    case 0x4: // xor, xori
+        *result = a ^ b;
+        return true;
+    case 0x1: // sll, slli
+        *result = (int)(ua << (ub & 0x1F));
+        return true;
+    case 0x5: // srl, sra, srli, srai
+        if (info->funct7 == 0x20)
+        {
+            if (!immediate && (ub & 0x1F) == 0 && a < 0)
+            {
+                return false;
+            }
+            *result = a >> (ub & 0x1F);
+        }
+        else
+        {
+            *result = (int)(ua >> (ub & 0x1F));
+        }
+        return true;
+    default:
+        return false;
+    }
+}
+
+// 블록이 시작하는 명령어를 표시한다. (레이블, 분기 대상, 분기/점프/종료 다음 명령어)
+void markBlockLeaders(bool *leader)
+{
+    memset(leader, 0, (instructionCount + 1) * sizeof(bool));
+    leader[0] = true;
+    for (int i = 0; i < labelCount; i++)
+    {
+        // .data 레이블은 코드 주소가 아니다. (1000 이상이어도 블록을 나누지 않는다)
+        if (!labels[i].inData)
+        {
+            leader[instructionIndexOfAddress(labels[i].address)] = true;
+        }
+    }
+    for (int i = 0; i < instructionCount; i++)
+    {
+        const Instruction *instr = &instructions[i];
+        InstructionType type = instructionTable[instr->infoIndex].type;
+        if (instr->hasLabel)
+        {
+            leader[instructionIndexOfAddress(instr->target)] = true;
+        }
+        if (type == SB_TYPE || type == J_TYPE || type == EXIT_TYPE || instructionTable[instr->infoIndex].opcode == 0x67)
+        {
+            leader[i + 1] = true;
+        }
+    }
+}
+
+// 명령어를 "addi rd, x0, value" 로 바꾼다.
+void rewriteAsConstant(Instruction *instr, int value)
+{
+    instr->infoIndex = (short)instructionIndexByName("addi");
+    instr->rs1 = 0;
+    instr->rs2 = 0;
+    instr->imm = value;
+    instr->hasLabel = false;
+    instr->target = -1;
+}
+
+// 블록 안에서 상수와 복사를 따라가면서 명령어를 줄인다. 바뀐 것이 있으면 true
+bool propagateConstants(const bool *leader, OptimizeStats *stats)
+{
+    bool known[REGISTER_COUNT];
+    int value[REGISTER_COUNT];
+    int copyOf[REGISTER_COUNT]; // 같은 값을 가진 다른 레지스터 (없으면 -1)
+    bool changed = false;
+
+    for (int i = 0; i < instructionCount; i++)
+    {
+        Instruction *instr = &instructions[i];
+
+        // 블록이 시작하면 아무것도 모른다. (x0 는 항상 0)
+        if (leader[i])
+        {
+            for (int r = 0; r < REGISTER_COUNT; r++)
+            {
+                known[r] = (r == 0);
+                value[r] = 0;
+                copyOf[r] = -1;
+            }
+        }
+        if (optimizeRemoved[i])
+        {
+            continue;
+        }
+
+        const InstructionInfo *info = &instructionTable[instr->infoIndex];
+        int rd = instructionDefinition(instr);
+        bool remove = false;
+        int result = 0;
+        bool resultKnown = false;
+
+        if (info->type == R_TYPE || (info->type == I_TYPE && isPureInstruction(instr) && info->opcode != 0x03))
+        {
+            bool immediate = (info->type == I_TYPE);
+            int b = immediate ? instr->imm : value[instr->rs2];
+            bool bKnown = immediate || known[instr->rs2];
+
+            if (known[instr->rs1] && bKnown && foldAlu(info, value[instr->rs1], b, immediate, &result))
+            {
+                resultKnown = true;
+            }
+
+            // rd = rs (addi rd, rs, 0 / add rd, rs, x0 / add rd, x0, rs, or, xor, sub 도 같다) 인지 본다.
+            int moveSource = -1;
+            if (immediate && info->funct3 == 0x0 && instr->imm == 0)
+            {
+                moveSource = instr->rs1;
+            }
+            else if (!immediate && (info->funct3 == 0x0 || info->funct3 == 0x6 || info->funct3 == 0x4))
+            {
+                if (instr->rs2 == 0)
+                {
+                    moveSource = instr->rs1;
+                }
+                else if (instr->rs1 == 0 && info->funct7 != 0x20)
+                {
+                    moveSource = instr->rs2;
+                }
+            }
+
+            // x0 에 쓰는 명령어는 하는 일이 없다.
+            if (rd == 0)
+            {
+                remove = true;
+                stats->noops++;
+            }
+            // 이미 같은 상수가 들어있으면 쓸 필요가 없다.
+            else if (resultKnown && known[rd] && value[rd] == result)
+            {
+                remove = true;
+                stats->noops++;
+            }
+            else
+            {
+                if (moveSource == rd || (moveSource >= 0 && (copyOf[rd] == moveSource || copyOf[moveSource] == rd)))
+                {
+                    remove = true;
+                    if (moveSource == rd)
+                    {
+                        stats->noops++;
+                    }
+                    else
+                    {
+                        stats->redundantMoves++;
+                    }
+                }
+                else if (resultKnown && result >= -2048 && result <= 2047 &&
+                         !(immediate && info->funct3 == 0x0 && instr->rs1 == 0))
+                {
+                    // 결과가 상수면 "addi rd, x0, 상수" 로 바꾼다. (addi/ori 사슬이 하나로 줄어든다)
+                    rewriteAsConstant(instr, result);
+                    stats->constantsFolded++;
+                    changed = true;
+                }
+                else if (!immediate && known[instr->rs2] && !resultKnown)
+                {
+                    // rs2 만 상수면 즉시값 명령어로 바꾼다. (sub 는 addi -c, sra 는 shift 0 이 다르므로 뺀다)
+                    int c = value[instr->rs2];
+                    bool isSub = (info->funct3 == 0x0 && info->funct7 == 0x20);
+                    bool isShift = (info->funct3 == 0x1 || info->funct3 == 0x5);
+                    bool isSra = (info->funct3 == 0x5 && info->funct7 == 0x20);
+                    int immediateValue = isSub ? -c : isShift ? (c & 0x1F) : c;
+                    if (instr->rs2 != 0 && !(isSra && immediateValue == 0) && immediateValue >= -2048 && immediateValue <= 2047 &&
+                        !(isSub && c == INT_MIN))
+                    {
+                        const char *name = NULL;
+                        switch (info->funct3)
+                        {
+                        case 0x0:
+                            name = "addi";
+                            break;
+                        case 0x7:
+                            name = "andi";
+                            break;
+                        case 0x6:
+                            name = "ori";
+                            break;
+                        case 0x4:
+                            name = "xori";
+                            break;
+                        case 0x1:
+                            name = "slli";
+                            break;
+                        default:
+                            name = isSra ? "srai" : "srli";
+                            break;
+                        }
+                        instr->infoIndex = (short)instructionIndexByName(name);
+                        instr->imm = immediateValue;
+                        instr->rs2 = 0;
+                        stats->constantsFolded++;
+                        changed = true;
+                    }
+                }
+            }
+
+            if (!remove)
+            {
+                // rd 의 값을 새로 정한다.
+                known[rd] = resultKnown;
+                value[rd] = result;
+                for (int r = 0; r < REGISTER_COUNT; r++)
+                {
+                    if (copyOf[r] == rd)
+                    {
+                        copyOf[r] = -1;
+                    }
+                }
+                copyOf[rd] = (moveSource > 0) ? moveSource : -1;
+            }
+        }
+        else if (info->type == SB_TYPE && instr->hasLabel)
+        {
+            int targetIndex = instructionIndexOfAddress(instr->target);
+            bool taken = false;
+            bool decided = known[instr->rs1] && known[instr->rs2];
+            int a = value[instr->rs1];
+            int b = value[instr->rs2];
+
+            switch (info->funct3)
+            {
+            case 0x0:
+                taken = (a == b);
+                break;
+            case 0x1:
+                taken = (a != b);
+                break;
+            case 0x4:
+                taken = (a < b);
+                break;
+            default:
+                taken = (a >= b);
+                break;
+            }
+
+            // 다음 명령어로 가는 분기나 절대 분기하지 않는 분기는 지운다. 항상 분기하면 jal x0 으로 바꾼다.
+            if (nextKeptInstruction(i + 1) == nextKeptInstruction(targetIndex) || (decided && !taken))
+            {
+                remove = true;
+                stats->branchesRemoved++;
+            }
+            else if (decided && taken && targetIndex != i)
+            {
+                instr->infoIndex = (short)instructionIndexByName("jal");
+                instr->rd = 0;
+                instr->rs1 = 0;
+                instr->rs2 = 0;
+                stats->branchesResolved++;
+                changed = true;
+            }
+        }
+        else
+        {
+            // jal x0 이 다음 명령어로 가면 지운다.
+            if (info->type == J_TYPE && instr->rd == 0 && instr->hasLabel &&
+                nextKeptInstruction(i + 1) == nextKeptInstruction(instructionIndexOfAddress(instr->target)))
+            {
+                remove = true;
+                stats->branchesRemoved++;
+            }
+            else if (rd > 0)
+            {
+                // lw, jal, jalr, 원자 명령어의 결과는 모른다.
+                known[rd] = false;
+                for (int r = 0; r < REGISTER_COUNT; r++)
+                {
+                    if (copyOf[r] == rd)
+                    {
+                        copyOf[r] = -1;
+                    }
+                }
+                copyOf[rd] = -1;
+            }
+        }
+
+        if (remove)
+        {
+            optimizeRemoved[i] = true;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+// 레지스터 생존 분석으로 아무도 읽지 않는 레지스터에 쓰는 명령어를 지운다. 바뀐 것이 있으면 true
+// jalr 다음에는 어디로 갈지 모르므로 모든 레지스터가 살아있다고 본다. exit 와 프로그램 끝에서는 아무것도 살아있지 않다.
+bool removeDeadWrites(OptimizeStats *stats)
+{
+    unsigned int *liveIn = arenaAlloc(&fileArena, (instructionCount + 1) * sizeof(unsigned int));
+    bool changed = true;
+    bool removedAny = false;
+
+    memset(liveIn, 0, (instructionCount + 1) * sizeof(unsigned int));
+    while (changed)
+    {
+        changed = false;
+        for (int i = instructionCount - 1; i >= 0; i--)
+        {
+            const Instruction *instr = &instructions[i];
+            const InstructionInfo *info = &instructionTable[instr->infoIndex];
+            unsigned int liveOut = 0;
+            unsigned int in;
+
+            if (optimizeRemoved[i])
+            {
+                in = liveIn[i + 1];
+            }
+            else
+            {
+                if (info->type == SB_TYPE)
+                {
+                    liveOut = liveIn[i + 1] | (instr->hasLabel ? liveIn[instructionIndexOfAddress(instr->target)] : 0);
+                }
+                else if (info->type == J_TYPE)
+                {
+                    liveOut = liveIn[instructionIndexOfAddress(instr->target)];
+                }
+                else if (info->opcode == 0x67) // jalr
+                {
+                    liveOut = 0xFFFFFFFFu;
+                }
+                else if (info->type != EXIT_TYPE)
+                {
+                    liveOut = liveIn[i + 1];
+                }
+
+                int rd = instructionDefinition(instr);
+                unsigned int defined = (rd > 0) ? (1u << rd) : 0;
+                in = instructionUses(instr) | (liveOut & ~defined);
+            }
+
+            if (in != liveIn[i])
+            {
+                liveIn[i] = in;
+                changed = true;
+            }
+        }
+    }
+
+    // 결과를 아무도 읽지 않으면 지운다.
+    for (int i = 0; i < instructionCount; i++)
+    {
+        const Instruction *instr = &instructions[i];
+        if (optimizeRemoved[i] || !isPureInstruction(instr) || instr->rd == 0)
+        {
+            continue;
+        }
+        if ((liveIn[i + 1] & (1u << instr->rd)) == 0)
+        {
+            optimizeRemoved[i] = true;
+            stats->deadWrites++;
+            removedAny = true;
+        }
+    }
+    return removedAny;
+}
+
+// 지운 명령어를 당기면 제자리로 가는 분기가 생길 수 있다. (pc 가 그대로면 프로그램이 끝나므로 뜻이 바뀐다)
+// 그런 분기의 대상 명령어는 다시 살려둔다.
+void keepBranchTargets()
+{
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (int i = 0; i < instructionCount; i++)
+        {
+            const Instruction *instr = &instructions[i];
+            if (optimizeRemoved[i] || !instr->hasLabel)
+            {
+                continue;
+            }
+            int targetIndex = instructionIndexOfAddress(instr->target);
+            if (targetIndex < i && nextKeptInstruction(targetIndex) == i)
+            {
+                optimizeRemoved[targetIndex] = false;
+                changed = true;
+            }
+        }
+    }
+}
+
+// 지운 명령어를 빼고 배열을 당긴다. 주소는 1000 부터 다시 매기고, 레이블과 분기 대상은 새 주소로 옮긴다.
+// 지운 명령어를 가리키던 주소는 그 뒤에 처음 남아있는 명령어로 간다.
+void compactInstructions()
+{
+    int *newAddress = arenaAlloc(&fileArena, (instructionCount + 1) * sizeof(int));
+    int kept = 0;
+
+    for (int i = 0; i < instructionCount; i++)
+    {
+        newAddress[i] = 1000 + kept * 4;
+        if (!optimizeRemoved[i])
+        {
+            kept++;
+        }
+    }
+    newAddress[instructionCount] = 1000 + kept * 4;
+
+    for (int i = 0; i < labelCount; i++)
+    {
+        // .data 레이블의 주소는 명령어를 당겨도 그대로다.
+        if (labels[i].inData)
+        {
+            continue;
+        }
+        int index = instructionIndexOfAddress(labels[i].address);
+        if (index < instructionCount || labels[i].address == 1000 + instructionCount * 4)
+        {
+            labels[i].address = newAddress[index];
+        }
+    }
+
+    kept = 0;
+    for (int i = 0; i < instructionCount; i++)
+    {
+        if (optimizeRemoved[i])
+        {
+            continue;
+        }
+        Instruction instr = instructions[i];
+        instr.address = newAddress[i];
+        if (instr.hasLabel)
+        {
+            instr.target = newAddress[instructionIndexOfAddress(instr.target)];
+        }
+        instructions[kept++] = instr;
+    }
+    instructionCount = kept;
+}
+
+// 지금 명령어 배열을 기능 모드로 끝까지 돌려서 실행한 명령어 수를 센다. 레지스터, 메모리, pc 는 되돌려 놓는다.
+// ecall 은 호스트를 건드리지 않는 stubSystemCall 로 처리한다. (입출력 결과에 따라 흐름이 바뀌는 프로그램은 수가 실제와 다를 수 있다)
+long long countDynamicInstructions()
+{
+    int savedRegisters[REGISTER_COUNT];
+    memcpy(savedRegisters, registers, sizeof(savedRegisters));
+    long long savedSteps = stepCount;
+
+    pc = 1000;
+    stepCount = 0;
+    loadDataImage(&sharedMemory);
+    systemCallsStubbed = true; // 세기만 하는 실행이므로 ecall 이 호스트 입출력을 다시 하지 않게 한다.
+    runFunctional((maxSteps > 0) ? maxSteps : LLONG_MAX);
+    systemCallsStubbed = false;
+    long long steps = stepCount;
+
+    memcpy(registers, savedRegisters, sizeof(savedRegisters));
+    stepCount = savedSteps;
+    pc = 1000;
+    freeMemory(&sharedMemory);
+    return steps;
+}
+
+// -O. 명령어 배열을 최적화하고 얼마나 줄었는지 출력한다.
+void optimizeProgram()
+{
+    OptimizeStats stats = {0};
+    int originalCount = instructionCount;
+    long long dynamicBefore = compareDynamic ? countDynamicInstructions() : 0;
+    bool *leader = arenaAlloc(&fileArena, (instructionCount + 1) * sizeof(bool));
+
+    optimizeRemoved = arenaAlloc(&fileArena, (instructionCount + 1) * sizeof(bool));
+    memset(optimizeRemoved, 0, (instructionCount + 1) * sizeof(bool));
+    markBlockLeaders(leader);
+
+    // 하나를 지우면 다른 것도 지울 수 있게 되므로 더 바뀌지 않을 때까지 돌린다.
+    bool changed = true;
+    while (changed)
+    {
+        changed = propagateConstants(leader, &stats);
+        changed = removeDeadWrites(&stats) || changed;
+    }
+    keepBranchTargets();
+    compactInstructions();
+    optimizeRemoved = NULL;
+
+    printf("optimizer: %d -> %d instructions (%d removed: %d dead writes, %d no-ops, %d moves, %d branches; "
+           "%d folded, %d branches resolved)\n",
+           originalCount, instructionCount, originalCount - instructionCount, stats.deadWrites, stats.noops,
+           stats.redundantMoves, stats.branchesRemoved, stats.constantsFolded, stats.branchesResolved);
+    if (compareDynamic)
+    {
+        printf("optimizer: dynamic instructions %lld -> %lld\n", dynamicBefore, countDynamicInstructions());
+    }
+}
+
+//
+// ILP 분석 구간!! 시작!! (--ilp)
+//
+// 명령어 사이의 데이터 의존성만 남기고 스케줄하면 몇 사이클이 걸리는지 잰다. 모든 명령어는 1 사이클이 걸리고,
+// 레지스터 이름 바꾸기와 분기 예측은 완벽하다고 본다. (WAR/WAW 와 제어 의존성은 없는 것으로 본다)
+// 정적 분석은 기본 블록마다 하고, 동적 분석은 상세 모드로 실제 실행한 명령어 흐름 전체로 한다.
+
+long long registerReady[REGISTER_COUNT];  // 레지스터 값이 준비되는 사이클
+GuestMemory dataflowMemory;               // 주소마다 값이 준비되는 사이클 (2^31 사이클까지만 정확하다)
+long long dataflowInstructions = 0;       // 동적 분석에서 본 명령어 수
+long long dataflowCycles = 0;             // 동적 분석의 스케줄 길이
+
+// 실행하기 직전의 명령어 하나를 dataflow 스케줄에 넣는다. (메모리 주소를 알기 위해 실행 전에 부른다)
+void recordDataflow(const Instruction *instr)
+{
+    const InstructionInfo *info = &instructionTable[instr->infoIndex];
+    unsigned int uses = instructionUses(instr);
+    long long start = 0;
+    int address = 0;
+    bool readsMemory = (info->opcode == 0x03 || info->type == A_TYPE);
+    bool writesMemory = (info->type == S_TYPE || info->type == A_TYPE);
+
+    for (int r = 1; r < REGISTER_COUNT; r++)
+    {
+        if ((uses & (1u << r)) && registerReady[r] > start)
+        {
+            start = registerReady[r];
+        }
+    }
+    if (readsMemory || writesMemory)
+    {
+        address = registers[instr->rs1] + ((info->type == A_TYPE) ? 0 : instr->imm);
+    }
+    if (readsMemory)
+    {
+        long long ready = loadGuestMemory(&dataflowMemory, address);
+        if (ready > start)
+        {
+            start = ready;
+        }
+    }
+
+    long long finish = start + 1;
+    int rd = instructionDefinition(instr);
+    if (rd > 0)
+    {
+        registerReady[rd] = finish;
+    }
+    if (writesMemory)
+    {
+        *guestMemoryWord(&dataflowMemory, address) = (int)finish;
+    }
+    if (finish > dataflowCycles)
+    {
+        dataflowCycles = finish;
+    }
+    dataflowInstructions++;
+}
+
+// 블록 안에서 레지스터 하나의 def-use 사슬을 쓴다. ("in" 은 블록에 들어올 때의 값)
+// 예: "  x5: in -> 1000; 1000 -> 1004, 1012; 1012 -> -"
+void writeDefUseChain(FILE *report, int reg, int begin, int end)
+{
+    int def = -1; // 지금 값을 쓴 명령어 (-1 이면 블록에 들어올 때의 값)
+    int useCount = 0;
+
+    fprintf(report, "  x%d:", reg);
+    for (int i = begin; i < end; i++)
+    {
+        const Instruction *instr = &instructions[i];
+        if (instructionUses(instr) & (1u << reg))
+        {
+            if (useCount == 0)
+            {
+                if (def < 0)
+                {
+                    fprintf(report, " in ->");
+                }
+                else
+                {
+                    fprintf(report, " %d ->", instructions[def].address);
+                }
+            }
+            fprintf(report, "%s %d", (useCount > 0) ? "," : "", instr->address);
+            useCount++;
+        }
+        if (instructionDefinition(instr) == reg)
+        {
+            if (def >= 0 && useCount == 0)
+            {
+                fprintf(report, " %d -> -;", instructions[def].address);
+            }
+            else if (useCount > 0)
+            {
+                fprintf(report, ";");
+            }
+            def = i;
+            useCount = 0;
+        }
+    }
+    if (def >= 0 && useCount == 0)
+    {
+        fprintf(report, " %d -> -", instructions[def].address);
+    }
+    fprintf(report, "\n");
+}
+
+// 기본 블록 하나의 critical path 길이. 블록에 들어올 때의 값은 0 사이클에 준비되어 있다.
+// 주소를 모르므로 lw 는 블록 안의 앞선 sw 뒤에 온다고 본다.
+int blockCriticalPath(int begin, int end)
+{
+    int ready[REGISTER_COUNT] = {0};
+    int lastStore = 0;
+    int critical = 0;
+
+    for (int i = begin; i < end; i++)
+    {
+        const Instruction *instr = &instructions[i];
+        const InstructionInfo *info = &instructionTable[instr->infoIndex];
+        unsigned int uses = instructionUses(instr);
+        int start = 0;
+
+        for (int r = 1; r < REGISTER_COUNT; r++)
+        {
+            if ((uses & (1u << r)) && ready[r] > start)
+            {
+                start = ready[r];
+            }
+        }
+        if ((info->opcode == 0x03 || info->type == A_TYPE) && lastStore > start)
+        {
+            start = lastStore;
+        }
+
+        int finish = start + 1;
+        int rd = instructionDefinition(instr);
+        if (rd > 0)
+        {
+            ready[rd] = finish;
+        }
+        if (info->type == S_TYPE || info->type == A_TYPE)
+        {
+            lastStore = finish;
+        }
+        if (finish > critical)
+        {
+            critical = finish;
+        }
+    }
+    return critical;
+}
+
+// 파일명.ilp 에 블록마다 def-use 사슬, critical path, ILP 를 쓰고 마지막에 동적 분석 결과를 쓴다.
+void writeDataflowReport(const char *filename)
+{
+    char reportFilename[260];
+    makeOutputName(filename, ".ilp", reportFilename, sizeof(reportFilename));
+    FILE *report = fopen(reportFilename, "w");
+    if (report == NULL)
+    {
+        printf("we can't open the file\n");
+        return;
+    }
+
+    bool *leader = arenaAlloc(&fileArena, (instructionCount + 1) * sizeof(bool));
+    markBlockLeaders(leader);
+
+    int blockCount = 0;
+    long long criticalTotal = 0;
+    for (int begin = 0; begin < instructionCount;)
+    {
+        int end = begin + 1;
+        while (end < instructionCount && !leader[end])
+        {
+            end++;
+        }
+
+        int critical = blockCriticalPath(begin, end);
+        fprintf(report, "block %d: %d-%d, %d instructions, critical path %d, ILP %.2f\n", blockCount,
+                instructions[begin].address, instructions[end - 1].address, end - begin, critical,
+                (double)(end - begin) / critical);
+
+        // 블록에서 읽거나 쓰는 레지스터마다 사슬을 쓴다.
+        unsigned int referenced = 0;
+        for (int i = begin; i < end; i++)
+        {
+            int rd = instructionDefinition(&instructions[i]);
+            referenced |= instructionUses(&instructions[i]) | ((rd > 0) ? (1u << rd) : 0);
+        }
+        for (int r = 1; r < REGISTER_COUNT; r++)
+        {
+            if (referenced & (1u << r))
+            {
+                writeDefUseChain(report, r, begin, end);
+            }
+        }
+
+        criticalTotal += critical;
+        blockCount++;
+        begin = end;
+    }
+
+    double staticIlp = (criticalTotal > 0) ? (double)instructionCount / criticalTotal : 0.0;
+    double dynamicIlp = (dataflowCycles > 0) ? (double)dataflowInstructions / dataflowCycles : 0.0;
+    fprintf(report, "static: %d blocks, %d instructions, critical paths %lld, ILP %.2f\n", blockCount, instructionCount,
+            criticalTotal, staticIlp);
+    fprintf(report, "dynamic: %lld instructions, dataflow schedule %lld cycles, ILP %.2f\n", dataflowInstructions,
+            dataflowCycles, dynamicIlp);
+    fclose(report);
+
+    printf("ilp: static %.2f over %d blocks, dynamic %lld instructions in %lld cycles (ILP %.2f)\n", staticIlp,
+           blockCount, dataflowInstructions, dataflowCycles, dynamicIlp);
+}
+
+// 다음 파일을 위해 동적 분석 상태를 비운다.
+void resetDataflow()
+{
+    memset(registerReady, 0, sizeof(registerReady));
+    freeMemory(&dataflowMemory);
+    dataflowInstructions = 0;
+    dataflowCycles = 0;
+}
+
+//
+// 실행 통계 구간!! 시작!! (--stats)
+//
+// 실행하는 동안에는 명령어마다 실행 횟수와 분기한 횟수만 세고(executedCounts, takenCounts),
+// 명령어별/유형별 개수, load/store 수 같은 것은 끝난 뒤에 이 횟수들로 계산한다.
+// 읽거나 쓴 메모리 주소는 statsMemory 에 표시해두고 끝난 뒤에 센다.
+
+GuestMemory statsMemory; // lw/sw/원자 명령어가 건드린 주소 표시 (값은 쓰지 않는다)
+
+// 메모리 주소 하나를 건드렸다고 표시한다.
+void recordStatsAccess(int address)
+{
+    guestMemoryWord(&statsMemory, address);
+}
+
+// 파일 하나의 실행을 세기 시작한다. (명령어 배열이 정해진 뒤에 부른다)
+void startStats()
+{
+    size_t size = (instructionCount + 1) * sizeof(long long);
+    executedCounts = arenaAlloc(&fileArena, size);
+    takenCounts = arenaAlloc(&fileArena, size);
+    memset(executedCounts, 0, size);
+    memset(takenCounts, 0, size);
+}
+
+// 메모리에 표시된 주소 수와, 페이지 표가 차지하는 바이트 수를 센다.
+void measureMemory(GuestMemory *memory, long long *words, long long *bytes)
+{
+    *words = 0;
+    *bytes = 0;
+    for (int i = 0; i < MEMORY_ROOT_SIZE; i++)
+    {
+        if (memory->root[i] == NULL)
+        {
+            continue;
+        }
+        *bytes += sizeof(MemoryDirectory);
+        for (int j = 0; j < MEMORY_DIRECTORY_SIZE; j++)
+        {
+            MemoryPage *page = memory->root[i]->pages[j];
+            if (page == NULL)
+            {
+                continue;
+            }
+            *bytes += sizeof(MemoryPage);
+            for (int k = 0; k < MEMORY_PAGE_WORDS / 64; k++)
+            {
+                *words += __builtin_popcountll(page->touched[k]);
+            }
+        }
+    }
+}
+
+// 통계를 파일명.stats (사람이 읽는 글) 와 파일명.stats.json 에 쓴다.
+// 게스트 메모리는 파일이 끝날 때까지 줄지 않으므로 지금 크기가 가장 컸을 때의 크기이다.
+void writeStatsReport(const char *filename)
+{
+    static const char *const typeNames[] = {"R", "I", "S", "SB", "J", "A", "CSR", "EXIT", "UNKNOWN"};
+    char textFilename[260];
+    char jsonFilename[260];
+    makeOutputName(filename, ".stats", textFilename, sizeof(textFilename));
+    makeOutputName(filename, ".stats.json", jsonFilename, sizeof(jsonFilename));
+    FILE *text = fopen(textFilename, "w");
+    FILE *json = (text != NULL) ? fopen(jsonFilename, "w") : NULL;
+    if (json == NULL)
+    {
+        if (text != NULL)
+        {
+            fclose(text);
+        }
+        printf("we can't open the file\n");
+        return;
+    }
+
+    // 명령어 횟수를 명령어 이름별, 유형별로 모은다.
+    int tableSize = 0;
+    while (instructionTable[tableSize].instName != NULL)
+    {
+        tableSize++;
+    }
+    long long *mnemonicCounts = arenaAlloc(&fileArena, tableSize * sizeof(long long));
+    memset(mnemonicCounts, 0, tableSize * sizeof(long long));
+    long long typeCounts[UNKNOWN_TYPE + 1] = {0};
+    long long total = 0, loads = 0, stores = 0, atomics = 0, taken = 0, notTaken = 0;
+    for (int i = 0; i < instructionCount; i++)
+    {
+        const InstructionInfo *info = &instructionTable[instructions[i].infoIndex];
+        long long count = executedCounts[i];
+        mnemonicCounts[instructions[i].infoIndex] += count;
+        typeCounts[info->type] += count;
+        total += count;
+        if (info->opcode == 0x03)
+        {
+            loads += count;
+        }
+        else if (info->type == S_TYPE)
+        {
+            stores += count;
+        }
+        else if (info->type == A_TYPE)
+        {
+            atomics += count;
+        }
+        else if (info->type == SB_TYPE)
+        {
+            taken += takenCounts[i];
+            notTaken += count - takenCounts[i];
+        }
+    }
+
+    long long touchedWords, statsBytes, storedWords, memoryBytes;
+    measureMemory(&statsMemory, &touchedWords, &statsBytes);
+    measureMemory(&sharedMemory, &storedWords, &memoryBytes);
+
+    // 글 형식
+    fprintf(text, "instructions: %lld\n", total);
+    for (int t = 0; t <= UNKNOWN_TYPE; t++)
+    {
+        if (typeCounts[t] > 0)
+        {
+            fprintf(text, "type %s: %lld\n", typeNames[t], typeCounts[t]);
+        }
+    }
+    for (int m = 0; m < tableSize; m++)
+    {
+        if (mnemonicCounts[m] > 0)
+        {
+            fprintf(text, "mnemonic %s: %lld\n", instructionTable[m].instName, mnemonicCounts[m]);
+        }
+    }
+    fprintf(text, "loads: %lld  stores: %lld  atomics: %lld\n", loads, stores, atomics);
+    fprintf(text, "branches taken: %lld  not taken: %lld\n", taken, notTaken);
+    for (int i = 0; i < instructionCount; i++)
+    {
+        if (instructionTable[instructions[i].infoIndex].type == SB_TYPE && executedCounts[i] > 0)
+        {
+            fprintf(text, "branch %d: taken %lld  not taken %lld\n", instructions[i].address, takenCounts[i],
+                    executedCounts[i] - takenCounts[i]);
+        }
+    }
+    fprintf(text, "memory: %lld words touched, %lld words stored, peak guest memory %lld bytes\n", touchedWords,
+            storedWords, memoryBytes);
+
+    // JSON 형식 (같은 내용)
+    fprintf(json, "{\"instructions\": %lld, \"types\": {", total);
+    bool first = true;
+    for (int t = 0; t <= UNKNOWN_TYPE; t++)
+    {
+        if (typeCounts[t] > 0)
+        {
+            fprintf(json, "%s\"%s\": %lld", first ? "" : ", ", typeNames[t], typeCounts[t]);
+            first = false;
+        }
+    }
+    fprintf(json, "}, \"mnemonics\": {");
+    first = true;
+    for (int m = 0; m < tableSize; m++)
+    {
+        if (mnemonicCounts[m] > 0)
+        {
+            fprintf(json, "%s\"%s\": %lld", first ? "" : ", ", instructionTable[m].instName, mnemonicCounts[m]);
+            first = false;
+        }
+    }
+    fprintf(json, "}, \"loads\": %lld, \"stores\": %lld, \"atomics\": %lld, \"branchesTaken\": %lld, \"branchesNotTaken\": %lld, \"branches\": [",
+            loads, stores, atomics, taken, notTaken);
+    first = true;
+    for (int i = 0; i < instructionCount; i++)
+    {
+        if (instructionTable[instructions[i].infoIndex].type == SB_TYPE && executedCounts[i] > 0)
+        {
+            fprintf(json, "%s{\"pc\": %d, \"taken\": %lld, \"notTaken\": %lld}", first ? "" : ", ",
+                    instructions[i].address, takenCounts[i], executedCounts[i] - takenCounts[i]);
+            first = false;
+        }
+    }
+    fprintf(json, "], \"wordsTouched\": %lld, \"wordsStored\": %lld, \"peakMemoryBytes\": %lld}\n", touchedWords,
+            storedWords, memoryBytes);
+    fclose(text);
+    fclose(json);
+
+    printf("stats: %lld instructions, %lld loads, %lld stores, %lld words touched, peak memory %lld bytes\n", total,
+           loads, stores, touchedWords, memoryBytes);
+}
+
+//
+// 메모리 덤프 구간!! 시작!! (--dump)
+//
+// 프로그램이 끝났을 때의 레지스터와 한 번이라도 저장한 메모리를 파일명.dump 에 쓴다. mmap 해서 바로 쓸 수 있는 형식이다.
+// (리틀 엔디언, memdump_tool 로 읽는다)
+//   머리        : MemoryDumpHeader (160 바이트)
+//   페이지 목록 : 페이지마다 첫 주소(uint32), 주소 순서. 8바이트에 맞춰 채운다.
+//   페이지      : MemoryPage 그대로 (값 1024개 + 저장한 주소 표시 비트 1024개 = 4224 바이트)
+
+typedef struct
+{
+    char magic[4];        // "RVMD"
+    uint32_t version;     // 1
+    uint32_t pageWords;   // 페이지 하나의 주소 수 (MEMORY_PAGE_WORDS)
+    uint32_t pageCount;
+    int32_t pc;
+    uint32_t reserved;
+    int64_t steps;        // 실행한 명령어 수
+    int32_t registers[REGISTER_COUNT];
+} MemoryDumpHeader;
+
+// 덤프할 페이지들을 주소 순서대로 모은다.
+int collectMemoryPages(GuestMemory *memory, MemoryPage **pages, uint32_t *addresses, int capacity)
+{
+    int count = 0;
+    for (int i = 0; i < MEMORY_ROOT_SIZE; i++)
+    {
+        if (memory->root[i] == NULL)
+        {
+            continue;
+        }
+        for (int j = 0; j < MEMORY_DIRECTORY_SIZE; j++)
+        {
+            MemoryPage *page = memory->root[i]->pages[j];
+            if (page == NULL)
+            {
+                continue;
+            }
+            if (pages != NULL && count < capacity)
+            {
+                pages[count] = page;
+                addresses[count] = ((uint32_t)i << 22) | ((uint32_t)j << 10);
+            }
+            count++;
+        }
+    }
+    return count;
+}
+
+void writeMemoryDump(const char *filename)
+{
+    char dumpFilename[260];
+    makeOutputName(filename, ".dump", dumpFilename, sizeof(dumpFilename));
+    FILE *dump = fopen(dumpFilename, "wb");
+    if (dump == NULL)
+    {
+        printf("we can't open the file\n");
+        return;
+    }
+
+    int pageCount = collectMemoryPages(&sharedMemory, NULL, NULL, 0);
+    MemoryPage **pages = arenaAlloc(&fileArena, (pageCount + 1) * sizeof(MemoryPage *));
+    uint32_t *addresses = arenaAlloc(&fileArena, (pageCount + 2) * sizeof(uint32_t));
+    collectMemoryPages(&sharedMemory, pages, addresses, pageCount);
+
+    MemoryDumpHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "RVMD", 4);
+    header.version = 1;
+    header.pageWords = MEMORY_PAGE_WORDS;
+    header.pageCount = (uint32_t)pageCount;
+    header.pc = pc;
+    header.steps = stepCount;
+    memcpy(header.registers, registers, sizeof(header.registers));
+
+    // 페이지 목록은 8바이트에 맞춰 끝낸다. (페이지 안의 비트 표가 8바이트 단위이므로)
+    int indexWords = pageCount + (pageCount & 1);
+    addresses[pageCount] = 0;
+    fwrite(&header, sizeof(header), 1, dump);
+    fwrite(addresses, sizeof(uint32_t), indexWords, dump);
+
+    long long storedWords = 0;
+    for (int i = 0; i < pageCount; i++)
+    {
+        fwrite(pages[i], sizeof(MemoryPage), 1, dump);
+        for (int k = 0; k < MEMORY_PAGE_WORDS / 64; k++)
+        {
+            storedWords += __builtin_popcountll(pages[i]->touched[k]);
+        }
+    }
+    fclose(dump);
+
+    printf("dump: %d pages, %lld words -> %s\n", pageCount, storedWords, dumpFilename);
+}
+
+// 다음 파일을 위해 통계 상태를 비운다. (횟수 배열은 파일 아레나에 있다)
+void resetStats()
+{
+    executedCounts = NULL;
+    takenCounts = NULL;
+    freeMemory(&statsMemory);
+}
+
+//
+// 프로파일 구간!! 시작!! (--profile)
+//
+// 상세 모드에서 실행한 명령어를 함수별로 센다. rd 가 x1 인 jal(jalr) 을 호출로, jalr x0, 0(x1) 을 반환으로 보고
+// 그림자 호출 스택을 따라간다. 함수는 호출 대상 주소에 있는 레이블이다. (레이블이 없으면 pc_주소)
+// 호출 문맥마다 노드를 하나 두고(같은 부모에서 같은 함수를 부르면 같은 노드), 명령어마다 스택 맨 위 노드의 횟수만 올린다.
+// 포함/자기 횟수와 스택별 횟수는 끝난 뒤에 노드들로 계산해서 파일명.prof 와 파일명.folded 에 쓴다.
+// 파일명.folded 는 "main;f;g 횟수" 줄들이라 flamegraph.pl 같은 도구에 그대로 넣을 수 있다.
+// 반환 주소가 스택에 없는 jalr 은 반환으로 보지 않는다. (fast-forward 구간의 호출은 보지 못한다)
+
+// 호출 문맥 하나
+typedef struct
+{
+    int function;     // 레이블 번호 (레이블이 없는 주소면 -2 - 주소)
+    int parent;       // 부르는 쪽 노드 (뿌리는 -1)
+    long long self;   // 이 노드가 스택 맨 위일 때 실행한 명령어 수
+    long long calls;  // 이 노드로 들어온 횟수
+    bool nested;      // 조상 중에 같은 함수가 있는지 (재귀면 포함 횟수를 한 번만 센다)
+} ProfileNode;
+
+// 그림자 호출 스택의 한 칸
+typedef struct
+{
+    int node;
+    int returnAddress; // 호출한 jal 의 다음 주소
+} ProfileFrame;
+
+ProfileNode *profileNodes = NULL;
+int profileNodeCount = 0;
+int profileNodeCapacity = 0;
+int *profileTable = NULL;   // (부모, 함수) -> 노드 해시표 (노드 번호 + 1, 0이면 빈칸)
+int profileTableSize = 0;   // 2의 거듭제곱
+ProfileFrame *profileStack = NULL;
+int profileDepth = 0;
+int profileStackCapacity = 0;
+int *profileLabels = NULL;  // 명령어마다 그 주소에 있는 첫 레이블 (없으면 -1)
+
+// 프로파일을 시작한다. (명령어 배열과 레이블이 정해진 뒤에 부른다)
+void startProfile()
+{
+    profileLabels = arenaAlloc(&fileArena, (instructionCount + 1) * sizeof(int));
+    for (int i = 0; i < instructionCount; i++)
+    {
+        profileLabels[i] = -1;
+    }
+    for (int l = 0; l < labelCount; l++)
+    {
+        Instruction *instr = labels[l].inData ? NULL : fetchInstruction(labels[l].address);
+        if (instr != NULL && profileLabels[instr - instructions] < 0)
+        {
+            profileLabels[instr - instructions] = l;
+        }
+    }
+    profileActive = true;
+}
+
+// 주소에 있는 함수 번호
+int profileFunctionAt(int address)
+{
+    Instruction *instr = fetchInstruction(address);
+    int label = (instr != NULL) ? profileLabels[instr - instructions] : -1;
+    return (label >= 0) ? label : -2 - address;
+}
+
+static inline unsigned int profileHash(int parent, int function)
+{
+    return ((unsigned int)parent * 2654435761u) ^ ((unsigned int)function * 40503u);
+}
+
+// parent 에서 function 을 부른 노드. 없으면 만든다.
+int profileChild(int parent, int function)
+{
+    if (profileTableSize > 0)
+    {
+        unsigned int slot = profileHash(parent, function) & (profileTableSize - 1);
+        while (profileTable[slot] != 0)
+        {
+            const ProfileNode *node = &profileNodes[profileTable[slot] - 1];
+            if (node->parent == parent && node->function == function)
+            {
+                return profileTable[slot] - 1;
+            }
+            slot = (slot + 1) & (profileTableSize - 1);
+        }
+    }
+
+    // 노드 배열과 해시표는 아레나에서 두 배씩 늘린다. (해시표는 반 이상 차지 않게 둔다)
+    if (profileNodeCount >= profileNodeCapacity)
+    {
+        int newCapacity = (profileNodeCapacity == 0) ? 256 : profileNodeCapacity * 2;
+        profileNodes = arenaGrow(&fileArena, profileNodes, profileNodeCount * sizeof(ProfileNode), newCapacity * sizeof(ProfileNode));
+        profileNodeCapacity = newCapacity;
+        profileTableSize = newCapacity * 2;
+        profileTable = arenaAlloc(&fileArena, profileTableSize * sizeof(int));
+        memset(profileTable, 0, profileTableSize * sizeof(int));
+        for (int i = 0; i < profileNodeCount; i++)
+        {
+            unsigned int slot = profileHash(profileNodes[i].parent, profileNodes[i].function) & (profileTableSize - 1);
+            while (profileTable[slot] != 0)
+            {
+                slot = (slot + 1) & (profileTableSize - 1);
+            }
+            profileTable[slot] = i + 1;
+        }
+    }
+
+    int index = profileNodeCount++;
+    ProfileNode *node = &profileNodes[index];
+    node->function = function;
+    node->parent = parent;
+    node->self = 0;
+    node->calls = 0;
+    node->nested = false;
+    for (int ancestor = parent; ancestor >= 0 && !node->nested; ancestor = profileNodes[ancestor].parent)
+    {
+        node->nested = (profileNodes[ancestor].function == function);
+    }
+
+    unsigned int slot = profileHash(parent, function) & (profileTableSize - 1);
+    while (profileTable[slot] != 0)
+    {
+        slot = (slot + 1) & (profileTableSize - 1);
+    }
+    profileTable[slot] = index + 1;
+    return index;
+}
+
+// 그림자 스택에 노드를 쌓는다.
+void pushProfileFrame(int node, int returnAddress)
+{
+    if (profileDepth >= profileStackCapacity)
+    {
+        int newCapacity = (profileStackCapacity == 0) ? 256 : profileStackCapacity * 2;
+        profileStack = arenaGrow(&fileArena, profileStack, profileDepth * sizeof(ProfileFrame), newCapacity * sizeof(ProfileFrame));
+        profileStackCapacity = newCapacity;
+    }
+    profileStack[profileDepth].node = node;
+    profileStack[profileDepth].returnAddress = returnAddress;
+    profileDepth++;
+}
+
+// 실행한 명령어 하나를 센다. newPc 는 실행한 뒤의 pc 이다. (runDetailed 에서 부른다)
+void recordProfile(const Instruction *instr, int newPc)
+{
+    // 처음 실행한 명령어의 함수가 뿌리이다.
+    if (profileDepth == 0)
+    {
+        int root = profileChild(-1, profileFunctionAt(instr->address));
+        profileNodes[root].calls++;
+        pushProfileFrame(root, -1);
+    }
+    int top = profileStack[profileDepth - 1].node;
+    profileNodes[top].self++;
+
+    const InstructionInfo *info = &instructionTable[instr->infoIndex];
+    if (info->type != J_TYPE && info->opcode != 0x67)
+    {
+        return;
+    }
+    if (instr->rd == 1)
+    {
+        int node = profileChild(top, profileFunctionAt(newPc));
+        profileNodes[node].calls++;
+        pushProfileFrame(node, instr->address + 4);
+    }
+    else if (instr->rd == 0 && info->opcode == 0x67 && instr->rs1 == 1 && instr->imm == 0)
+    {
+        // 반환 주소가 맞는 칸까지 꺼낸다. (뿌리는 꺼내지 않는다)
+        for (int d = profileDepth - 1; d > 0; d--)
+        {
+            if (profileStack[d].returnAddress == newPc)
+            {
+                profileDepth = d;
+                break;
+            }
+        }
+    }
+}
+
+void writeFunctionName(FILE *file, int function)
+{
+    if (function >= 0)
+    {
+        fprintf(file, "%.*s", labels[function].nameLength, source + labels[function].nameOffset);
+    }
+    else
+    {
+        fprintf(file, "pc_%d", -2 - function);
+    }
+}
+
+// 함수 하나의 합계
+typedef struct
+{
+    int function;
+    long long inclusive; // 스택 어디에든 있을 때 실행한 명령어 수
+    long long exclusive; // 스택 맨 위일 때 실행한 명령어 수
+    long long calls;
+} FunctionProfile;
+
+int compareNodeFunction(const void *a, const void *b)
+{
+    int x = profileNodes[*(const int *)a].function;
+    int y = profileNodes[*(const int *)b].function;
+    return (x > y) - (x < y);
+}
+
+int compareInclusive(const void *a, const void *b)
+{
+    const FunctionProfile *x = a;
+    const FunctionProfile *y = b;
+    if (x->inclusive != y->inclusive)
+    {
+        return (x->inclusive < y->inclusive) ? 1 : -1;
+    }
+    return (x->function > y->function) - (x->function < y->function);
+}
+
+// 함수별 포함/자기 횟수를 파일명.prof 에, 스택별 횟수를 파일명.folded 에 쓴다.
+void writeProfileReport(const char *filename)
+{
+    char textFilename[260];
+    char foldedFilename[260];
+    makeOutputName(filename, ".prof", textFilename, sizeof(textFilename));
+    makeOutputName(filename, ".folded", foldedFilename, sizeof(foldedFilename));
+    FILE *text = fopen(textFilename, "w");
+    FILE *folded = (text != NULL) ? fopen(foldedFilename, "w") : NULL;
+    if (folded == NULL)
+    {
+        if (text != NULL)
+        {
+            fclose(text);
+        }
+        printf("we can't open the file\n");
+        return;
+    }
+
+    // 노드의 하위 합계. 자식은 항상 부모보다 뒤에 만들어지므로 뒤에서부터 부모에 더한다.
+    long long *totals = arenaAlloc(&fileArena, (profileNodeCount + 1) * sizeof(long long));
+    for (int n = 0; n < profileNodeCount; n++)
+    {
+        totals[n] = profileNodes[n].self;
+    }
+    for (int n = profileNodeCount - 1; n > 0; n--)
+    {
+        if (profileNodes[n].parent >= 0)
+        {
+            totals[profileNodes[n].parent] += totals[n];
+        }
+    }
+
+    // 노드를 함수 순서로 모아서 함수마다 더한다.
+    int *order = arenaAlloc(&fileArena, (profileNodeCount + 1) * sizeof(int));
+    FunctionProfile *functions = arenaAlloc(&fileArena, (profileNodeCount + 1) * sizeof(FunctionProfile));
+    int functionCount = 0;
+    long long total = 0;
+    for (int n = 0; n < profileNodeCount; n++)
+    {
+        order[n] = n;
+        total += profileNodes[n].self;
+    }
+    qsort(order, profileNodeCount, sizeof(int), compareNodeFunction);
+    for (int i = 0; i < profileNodeCount; i++)
+    {
+        const ProfileNode *node = &profileNodes[order[i]];
+        if (functionCount == 0 || functions[functionCount - 1].function != node->function)
+        {
+            memset(&functions[functionCount], 0, sizeof(FunctionProfile));
+            functions[functionCount++].function = node->function;
+        }
+        FunctionProfile *function = &functions[functionCount - 1];
+        function->exclusive += node->self;
+        function->calls += node->calls;
+        if (!node->nested)
+        {
+            function->inclusive += totals[order[i]];
+        }
+    }
+    qsort(functions, functionCount, sizeof(FunctionProfile), compareInclusive);
+
+    fprintf(text, "profile: %lld instructions, %d functions, %d call contexts\n", total, functionCount, profileNodeCount);
+    fprintf(text, "%14s %7s %14s %7s %12s  %s\n", "inclusive", "%", "exclusive", "%", "calls", "function");
+    for (int i = 0; i < functionCount; i++)
+    {
+        const FunctionProfile *function = &functions[i];
+        fprintf(text, "%14lld %6.2f%% %14lld %6.2f%% %12lld  ", function->inclusive,
+                (total > 0) ? 100.0 * function->inclusive / total : 0.0, function->exclusive,
+                (total > 0) ? 100.0 * function->exclusive / total : 0.0, function->calls);
+        writeFunctionName(text, function->function);
+        fputc('\n', text);
+    }
+
+    // 스택마다 "뿌리;...;맨 위 횟수" 한 줄 (부모를 따라 올라가서 거꾸로 쓴다)
+    int *path = arenaAlloc(&fileArena, (profileNodeCount + 1) * sizeof(int));
+    for (int n = 0; n < profileNodeCount; n++)
+    {
+        if (profileNodes[n].self == 0)
+        {
+            continue;
+        }
+        int depth = 0;
+        for (int node = n; node >= 0; node = profileNodes[node].parent)
+        {
+            path[depth++] = node;
+        }
+        for (int d = depth - 1; d >= 0; d--)
+        {
+            writeFunctionName(folded, profileNodes[path[d]].function);
+            fputc((d > 0) ? ';' : ' ', folded);
+        }
+        fprintf(folded, "%lld\n", profileNodes[n].self);
+    }
+
+    fclose(text);
+    fclose(folded);
+    printf("profile: %lld instructions in %d functions -> %s, %s\n", total, functionCount, textFilename, foldedFilename);
+}
+
+void resetProfile()
+{
+    profileActive = false;
+    profileNodes = NULL;
+    profileNodeCount = 0;
+    profileNodeCapacity = 0;
+    profileTable = NULL;
+    profileTableSize = 0;
+    profileStack = NULL;
+    profileDepth = 0;
+    profileStackCapacity = 0;
+    profileLabels = NULL;
+}
+
+//
+// 시간 여행 구간!! 시작!! (--time-travel)
+//
+// 상세 모드에서 실행을 기록해 두고, 끝난 뒤 명령어로 지난 step 의 레지스터, pc, 메모리를 다시 만든다.
+// timeTravelInterval step 마다 스냅숏을 뜬다. 레지스터와 pc 는 복사하고, 메모리는 페이지 목록만 남겨서 실행과 같이 쓴다.
+// (같이 쓰는 페이지는 디렉터리에 표시해 두고, 실행이 고치기 전에 findMemoryPage 가 복사한다)
+// 스냅숏 사이에는 step 마다 바뀐 pc, 레지스터, 메모리의 전/후 값을 기록한다.
+// step T 로 갈 때는 지금 위치, T 앞의 스냅숏, T 뒤의 스냅숏 중 가장 가까운 곳에서 기록을 되돌리거나 다시 적용하므로
+// 스냅숏 간격의 절반만큼만 걸으면 된다. 다시 실행하지 않으므로 ecall 이 호스트 파일을 다시 읽고 쓰지 않는다.
+// (호스트 파일 위치와 brk 는 되돌리지 않는다)
+
+typedef enum
+{
+    HISTORY_PC,          // step 의 시작 (where 는 쓰지 않는다)
+    HISTORY_REGISTER,    // where 는 레지스터 번호
+    HISTORY_MEMORY,      // where 는 주소
+    HISTORY_FRESH_MEMORY // 처음 저장한 주소 (되돌리면 저장하지 않은 주소로 표시한다)
+} HistoryKind;
+
+typedef struct
+{
+    int where;
+    int oldValue;
+    int newValue;
+    int kind; // HistoryKind
+} HistoryEntry;
+
+// 스냅숏 하나와, 그 뒤 다음 스냅숏까지의 기록
+typedef struct
+{
+    long long step;
+    int pc;
+    int registers[REGISTER_COUNT];
+    int pageCount;
+    uint32_t *addresses; // 페이지마다 첫 주소 (주소 순서)
+    MemoryPage **pages;  // 실행 메모리와 같이 쓰는 페이지
+    HistoryEntry *log;
+    long long logCount;
+    long long logCapacity;
+} HistorySnapshot;
+
+HistorySnapshot *historySnapshots = NULL; // timeTravelKeep 개짜리 링 (가장 오래된 것이 historyFirst)
+int historyFirst = 0;
+int historyCount = 0;
+long long historyStepEntry = 0; // 지금 기록하는 step 의 첫 항목 (finishHistoryStep 에서 새 값을 채운다)
+int historyCursor = 0;          // 오갈 때 지금 위치가 들어있는 구간 (오래된 것부터의 순서)
+long long historyEntry = 0;     // 그 구간의 기록에서 적용한 항목 수
+
+// 오래된 것부터 i 번째 스냅숏
+HistorySnapshot *historySnapshot(int i)
+{
+    return &historySnapshots[(historyFirst + i) % timeTravelKeep];
+}
+
+// 실행 메모리의 address 페이지를 page 로 바꾼다. (NULL 이면 뺀다)
+// 원래 페이지는 스냅숏과 같이 쓰지 않을 때만 돌려준다. 새 페이지는 스냅숏의 것이므로 같이 쓰는 페이지로 표시한다.
+void replaceLivePage(uint32_t address, MemoryPage *page)
+{
+    void **directorySlot = (void **)&sharedMemory.root[address >> 22];
+    if (page == NULL && *directorySlot == NULL)
+    {
+        return;
+    }
+
+    MemoryDirectory *directory = installMemoryTable(directorySlot, sizeof(MemoryDirectory));
+    unsigned int index = (address >> 10) & (MEMORY_DIRECTORY_SIZE - 1);
+    unsigned long long bit = 1ULL << (index % 64);
+    MemoryPage *old = directory->pages[index];
+    if (old == page)
+    {
+        return;
+    }
+    if (old != NULL && (directory->shared[index / 64] & bit) == 0)
+    {
+        free(old);
+    }
+    directory->pages[index] = page;
+    if (page != NULL)
+    {
+        directory->shared[index / 64] |= bit;
+    }
+    else
+    {
+        directory->shared[index / 64] &= ~bit;
+    }
+}
+
+// 가장 오래된 스냅숏을 버린다. 그 스냅숏이 마지막으로 같이 쓰던 페이지는 돌려준다.
+// (기록하는 동안 페이지 하나를 같이 쓰는 스냅숏들은 이어져 있으므로 바로 다음 스냅숏만 보면 된다)
+void releaseOldestSnapshot()
+{
+    HistorySnapshot *oldest = historySnapshot(0);
+    HistorySnapshot *next = (historyCount > 1) ? historySnapshot(1) : NULL;
+    int n = 0;
+
+    for (int i = 0; i < oldest->pageCount; i++)
+    {
+        uint32_t address = oldest->addresses[i];
+        while (next != NULL && n < next->pageCount && next->addresses[n] < address)
+        {
+            n++;
+        }
+        if (next != NULL && n < next->pageCount && next->pages[n] == oldest->pages[i])
+        {
+            continue;
+        }
+
+        // 실행 메모리가 아직 쓰고 있으면 표시만 지운다.
+        MemoryDirectory *directory = sharedMemory.root[address >> 22];
+        unsigned int index = (address >> 10) & (MEMORY_DIRECTORY_SIZE - 1);
+        if (directory != NULL && directory->pages[index] == oldest->pages[i])
+        {
+            directory->shared[index / 64] &= ~(1ULL << (index % 64));
+        }
+        else
+        {
+            free(oldest->pages[i]);
+        }
+    }
+
+    free(oldest->addresses);
+    free(oldest->pages);
+    free(oldest->log);
+    historyFirst = (historyFirst + 1) % timeTravelKeep;
+    historyCount--;
+}
+
+// 지금 상태의 스냅숏을 뜬다. 링이 가득 찼으면 가장 오래된 것을 버린다.
+void takeSnapshot()
+{
+    if (historyCount > 0 && historySnapshot(historyCount - 1)->step == stepCount)
+    {
+        return;
+    }
+    if (historyCount == timeTravelKeep)
+    {
+        releaseOldestSnapshot();
+    }
+
+    HistorySnapshot *snapshot = historySnapshot(historyCount++);
+    memset(snapshot, 0, sizeof(HistorySnapshot));
+    snapshot->step = stepCount;
+    snapshot->pc = pc;
+    memcpy(snapshot->registers, registers, sizeof(snapshot->registers));
+
+    // 페이지는 복사하지 않고 목록만 남긴 뒤 같이 쓰는 페이지로 표시한다.
+    int count = collectMemoryPages(&sharedMemory, NULL, NULL, 0);
+    snapshot->addresses = malloc((count + 1) * sizeof(uint32_t));
+    snapshot->pages = malloc((count + 1) * sizeof(MemoryPage *));
+    snapshot->pageCount = collectMemoryPages(&sharedMemory, snapshot->pages, snapshot->addresses, count);
+    for (int i = 0; i < snapshot->pageCount; i++)
+    {
+        unsigned int index = (snapshot->addresses[i] >> 10) & (MEMORY_DIRECTORY_SIZE - 1);
+        sharedMemory.root[snapshot->addresses[i] >> 22]->shared[index / 64] |= 1ULL << (index % 64);
+    }
+}
+
+// 실행을 기록하기 시작한다. 처음 상태를 첫 스냅숏으로 남긴다.
+void startHistory()
+{
+    historySnapshots = calloc(timeTravelKeep, sizeof(HistorySnapshot));
+    historyFirst = 0;
+    historyCount = 0;
+    historyActive = true;
+    takeSnapshot();
+}
+
+static inline void appendHistory(int kind, int where, int oldValue)
+{
+    HistorySnapshot *snapshot = historySnapshot(historyCount - 1);
+    if (snapshot->logCount == snapshot->logCapacity)
+    {
+        snapshot->logCapacity = (snapshot->logCapacity == 0) ? 4096 : snapshot->logCapacity * 2;
+        snapshot->log = realloc(snapshot->log, snapshot->logCapacity * sizeof(HistoryEntry));
+        if (snapshot->log == NULL)
+        {
+            printf("Memory allocation failed.\n");
+            exit(1);
+        }
+    }
+    HistoryEntry *entry = &snapshot->log[snapshot->logCount++];
+    entry->kind = kind;
+    entry->where = where;
+    entry->oldValue = oldValue;
+}
+
+void appendMemoryHistory(int address)
+{
+    MemoryPage *page = findMemoryPage(&sharedMemory, address, false);
+    unsigned int index = (unsigned int)address & (MEMORY_PAGE_WORDS - 1);
+    bool stored = page != NULL && (page->touched[index / 64] & (1ULL << (index % 64)));
+    appendHistory(stored ? HISTORY_MEMORY : HISTORY_FRESH_MEMORY, address, stored ? page->values[index] : 0);
+}
+
+// 명령어를 실행하기 전에 바뀔 수 있는 pc, 레지스터, 메모리의 지금 값을 기록한다.
+void recordHistory(const Instruction *instr)
+{
+    const InstructionInfo *info = &instructionTable[instr->infoIndex];
+
+    historyStepEntry = historySnapshot(historyCount - 1)->logCount;
+    appendHistory(HISTORY_PC, 0, pc);
+    if (instr->rd != 0)
+    {
+        appendHistory(HISTORY_REGISTER, instr->rd, registers[instr->rd]);
+    }
+
+    if (info->type == S_TYPE)
+    {
+        appendMemoryHistory(registers[instr->rs1] + instr->imm);
+    }
+    else if (info->type == A_TYPE)
+    {
+        appendMemoryHistory(registers[instr->rs1]);
+    }
+    else if (info->type == CSR_TYPE && info->funct3 == 0x0)
+    {
+        // ecall 은 x10 에 결과를 넣고, read 는 게스트 버퍼를 채운다. (주소 하나에 4바이트)
+        appendHistory(HISTORY_REGISTER, 10, registers[10]);
+        if (registers[17] == 63 && registers[12] > 0)
+        {
+            for (long long word = 0; word < ((long long)registers[12] + 3) / 4; word++)
+            {
+                appendMemoryHistory(registers[11] + (int)word);
+            }
+        }
+    }
+}
+
+// 명령어를 실행한 뒤 이번 step 의 기록에 새 값을 채운다.
+void finishHistoryStep()
+{
+    HistorySnapshot *snapshot = historySnapshot(historyCount - 1);
+    for (long long i = historyStepEntry; i < snapshot->logCount; i++)
+    {
+        HistoryEntry *entry = &snapshot->log[i];
+        if (entry->kind == HISTORY_PC)
+        {
+            entry->newValue = pc;
+        }
+        else if (entry->kind == HISTORY_REGISTER)
+        {
+            entry->newValue = registers[entry->where];
+        }
+        else
+        {
+            entry->newValue = loadGuestMemory(&sharedMemory, entry->where);
+        }
+    }
+}
+
+// 기록 하나를 되돌리거나(undo) 다시 적용한다.
+void applyHistoryEntry(const HistoryEntry *entry, bool undo)
+{
+    int value = undo ? entry->oldValue : entry->newValue;
+
+    if (entry->kind == HISTORY_PC)
+    {
+        pc = value;
+    }
+    else if (entry->kind == HISTORY_REGISTER)
+    {
+        registers[entry->where] = value;
+    }
+    else
+    {
+        MemoryPage *page = findMemoryPage(&sharedMemory, entry->where, true);
+        unsigned int index = (unsigned int)entry->where & (MEMORY_PAGE_WORDS - 1);
+        page->values[index] = value;
+        if (undo && entry->kind == HISTORY_FRESH_MEMORY)
+        {
+            page->touched[index / 64] &= ~(1ULL << (index % 64));
+        }
+        else
+        {
+            page->touched[index / 64] |= 1ULL << (index % 64);
+        }
+    }
+}
+
+// step 하나를 되돌린다. (구간 처음이면 앞 구간의 끝으로 넘어간다. 두 상태는 같다)
+void undoHistoryStep()
+{
+    if (historyEntry == 0)
+    {
+        historyCursor--;
+        historyEntry = historySnapshot(historyCursor)->logCount;
+    }
+
+    HistorySnapshot *snapshot = historySnapshot(historyCursor);
+    while (historyEntry > 0)
+    {
+        const HistoryEntry *entry = &snapshot->log[--historyEntry];
+        applyHistoryEntry(entry, true);
+        if (entry->kind == HISTORY_PC)
+        {
+            break;
+        }
+    }
+    stepCount--;
+}
+
+// step 하나를 다시 적용한다.
+void redoHistoryStep()
+{
+    if (historyEntry == historySnapshot(historyCursor)->logCount)
+    {
+        historyCursor++;
+        historyEntry = 0;
+    }
+
+    HistorySnapshot *snapshot = historySnapshot(historyCursor);
+    do
+    {
+        applyHistoryEntry(&snapshot->log[historyEntry++], false);
+    } while (historyEntry < snapshot->logCount && snapshot->log[historyEntry].kind != HISTORY_PC);
+    stepCount++;
+}
+
+// 스냅숏에서 address 페이지를 찾는다. (없으면 NULL)
+MemoryPage *findSnapshotPage(const HistorySnapshot *snapshot, uint32_t address)
+{
+    int low = 0;
+    int high = snapshot->pageCount - 1;
+    while (low <= high)
+    {
+        int middle = (low + high) / 2;
+        if (snapshot->addresses[middle] == address)
+        {
+            return snapshot->pages[middle];
+        }
+        if (snapshot->addresses[middle] < address)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle - 1;
+        }
+    }
+    return NULL;
+}
+
+// 오래된 것부터 i 번째 스냅숏의 상태로 돌아간다. 메모리는 페이지를 바꿔 끼우기만 한다.
+void restoreSnapshot(int i)
+{
+    HistorySnapshot *snapshot = historySnapshot(i);
+
+    // 스냅숏 뒤에 생긴 페이지를 빼고, 나머지는 스냅숏의 페이지로 바꾼다.
+    for (int r = 0; r < MEMORY_ROOT_SIZE; r++)
+    {
+        MemoryDirectory *directory = sharedMemory.root[r];
+        if (directory == NULL)
+        {
+            continue;
+        }
+        for (int j = 0; j < MEMORY_DIRECTORY_SIZE; j++)
+        {
+            uint32_t address = ((uint32_t)r << 22) | ((uint32_t)j << 10);
+            if (directory->pages[j] != NULL && findSnapshotPage(snapshot, address) == NULL)
+            {
+                replaceLivePage(address, NULL);
+            }
+        }
+    }
+    for (int k = 0; k < snapshot->pageCount; k++)
+    {
+        replaceLivePage(snapshot->addresses[k], snapshot->pages[k]);
+    }
+
+    pc = snapshot->pc;
+    memcpy(registers, snapshot->registers, sizeof(snapshot->registers));
+    stepCount = snapshot->step;
+}
+
+// step target 의 상태를 만든다. 지금 위치, target 앞의 스냅숏, 뒤의 스냅숏 중 가장 가까운 곳에서 걷는다.
+void moveHistory(long long target)
+{
+    int k = 0;
+    while (k + 1 < historyCount && historySnapshot(k + 1)->step <= target)
+    {
+        k++;
+    }
+
+    long long walk = (target > stepCount) ? target - stepCount : stepCount - target;
+    long long fromBefore = target - historySnapshot(k)->step;
+    long long fromAfter = (k + 1 < historyCount) ? historySnapshot(k + 1)->step - target : LLONG_MAX;
+    if (fromBefore < walk && fromBefore <= fromAfter)
+    {
+        restoreSnapshot(k);
+        historyCursor = k;
+        historyEntry = 0;
+    }
+    else if (fromAfter < walk)
+    {
+        restoreSnapshot(k + 1);
+        historyCursor = k;
+        historyEntry = historySnapshot(k)->logCount;
+    }
+
+    while (stepCount > target)
+    {
+        undoHistoryStep();
+    }
+    while (stepCount < target)
+    {
+        redoHistoryStep();
+    }
+}
+
+// 지금 위치에서 뒤로(또는 앞으로) 가면서 pc 가 target 인 가장 가까운 step 을 찾는다. 없으면 -1
+// (기록만 훑어보고 상태는 바꾸지 않는다)
+long long findHistoryPc(int target, bool backward)
+{
+    long long step = stepCount;
+    int cursor = historyCursor;
+    long long entry = historyEntry;
+
+    while (1)
+    {
+        const HistorySnapshot *snapshot = historySnapshot(cursor);
+        if (backward)
+        {
+            // step S 의 PC 기록의 전 값이 step S 의 pc 이다.
+            if (entry == 0)
+            {
+                if (cursor == 0)
+                {
+                    return -1;
+                }
+                cursor--;
+                entry = historySnapshot(cursor)->logCount;
+                continue;
+            }
+            const HistoryEntry *record = &snapshot->log[--entry];
+            if (record->kind == HISTORY_PC && (--step, record->oldValue == target))
+            {
+                return step;
+            }
+        }
+        else
+        {
+            // step S 의 PC 기록의 새 값이 step S + 1 의 pc 이다.
+            if (entry == snapshot->logCount)
+            {
+                if (cursor == historyCount - 1)
+                {
+                    return -1;
+                }
+                cursor++;
+                entry = 0;
+                continue;
+            }
+            const HistoryEntry *record = &snapshot->log[entry++];
+            if (record->kind == HISTORY_PC && (++step, record->newValue == target))
+            {
+                return step;
+            }
+        }
+    }
+}
+
+// 지금 step 과 pc 의 명령어를 출력한다.
+void printHistoryPosition()
+{
+    Instruction *instr = fetchInstruction(pc);
+    if (instr == NULL)
+    {
+        printf("step %lld pc %d\n", stepCount, pc);
+    }
+    else if (linkedObjectCount > 0 || optimizeEnabled)
+    {
+        // 링크했거나 -O 로 고친 명령어는 소스 줄과 맞지 않으므로 이름만 쓴다.
+        printf("step %lld pc %d: %s\n", stepCount, pc, instructionTable[instr->infoIndex].instName);
+    }
+    else
+    {
+        printf("step %lld pc %d: %.*s\n", stepCount, pc, instr->sourceLength, source + instr->sourceOffset);
+    }
+}
+
+// 명령어의 주소 인자를 읽는다. 숫자가 아니면 레이블 이름으로 본다.
+bool parseHistoryAddress(const char *text, int *address)
+{
+    char *end;
+    long long value = strtoll(text, &end, 0);
+    if (end != text && *end == '\0')
+    {
+        *address = (int)value;
+        return true;
+    }
+
+    int index = findLabelIndex(text, (int)strlen(text));
+    if (index < 0)
+    {
+        printf("unknown address '%s'\n", text);
+        return false;
+    }
+    *address = labels[index].address;
+    return true;
+}
+
+void printHistoryHelp()
+{
+    printf("  step [N]              N step 앞으로 (기본값 1)\n");
+    printf("  step-back [N]         N step 뒤로 (기본값 1)\n");
+    printf("  goto STEP             STEP 번째 step 으로\n");
+    printf("  run-back-to-pc PC     뒤로 가면서 pc 가 PC(숫자 또는 레이블)인 가장 가까운 step 으로\n");
+    printf("  run-to-pc PC          앞으로 가면서 pc 가 PC 인 가장 가까운 step 으로\n");
+    printf("  regs                  pc 와 레지스터\n");
+    printf("  mem ADDR [COUNT]      ADDR 부터 COUNT 개 주소의 값\n");
+    printf("  info                  기록한 step 범위와 스냅숏\n");
+    printf("  quit                  끝난 상태로 돌아가서 보고서를 쓴다.\n");
+}
+
+// 기록한 실행을 표준 입력의 명령어로 오간다. 끝나면 마지막 상태로 돌아간다. (보고서는 그 상태로 쓴다)
+void travelHistory()
+{
+    // 끝난 상태도 스냅숏으로 남긴다.
+    takeSnapshot();
+    historyActive = false;
+    historyCursor = historyCount - 1;
+    historyEntry = 0;
+
+    long long firstStep = historySnapshot(0)->step;
+    long long lastStep = stepCount;
+    printf("time travel: steps %lld..%lld, %d snapshots (type help for commands)\n", firstStep, lastStep, historyCount);
+    printHistoryPosition();
+
+    char line[256];
+    while (printf(">>time travel: "), fflush(stdout), fgets(line, sizeof(line), stdin) != NULL)
+    {
+        char command[32];
+        char first[128];
+        char second[64];
+        int fields = sscanf(line, "%31s %127s %63s", command, first, second);
+        if (fields < 1)
+        {
+            continue;
+        }
+
+        long long count = (fields >= 2) ? atoll(first) : 1;
+        long long target = -1;
+        int address;
+        if (strcmp(command, "quit") == 0)
+        {
+            break;
+        }
+        else if (strcmp(command, "step") == 0)
+        {
+            target = stepCount + count;
+        }
+        else if (strcmp(command, "step-back") == 0)
+        {
+            target = stepCount - count;
+        }
+        else if (strcmp(command, "goto") == 0 && fields >= 2)
+        {
+            target = count;
+        }
+        else if ((strcmp(command, "run-back-to-pc") == 0 || strcmp(command, "run-to-pc") == 0) && fields >= 2)
+        {
+            if (!parseHistoryAddress(first, &address))
+            {
+                continue;
+            }
+            target = findHistoryPc(address, command[4] == 'b');
+            if (target < 0)
+            {
+                printf("pc %d is not in the recorded steps\n", address);
+                continue;
+            }
+        }
+        else if (strcmp(command, "regs") == 0)
+        {
+            printf("pc: %d\n", pc);
+            for (int r = 0; r < REGISTER_COUNT; r++)
+            {
+                printf("x%d: %d\n", r, registers[r]);
+            }
+            continue;
+        }
+        else if (strcmp(command, "mem") == 0 && fields >= 2)
+        {
+            if (!parseHistoryAddress(first, &address))
+            {
+                continue;
+            }
+            long long words = (fields >= 3) ? atoll(second) : 1;
+            for (long long i = 0; i < words; i++)
+            {
+                printf("%d %d\n", address + (int)i, loadGuestMemory(&sharedMemory, address + (int)i));
+            }
+            continue;
+        }
+        else if (strcmp(command, "info") == 0)
+        {
+            printf("steps %lld..%lld, every %lld steps\n", historySnapshot(0)->step, lastStep, timeTravelInterval);
+            for (int i = 0; i < historyCount; i++)
+            {
+                printf("  snapshot %d: step %lld, %d pages, %lld log entries\n", i, historySnapshot(i)->step,
+                       historySnapshot(i)->pageCount, historySnapshot(i)->logCount);
+            }
+            continue;
+        }
+        else
+        {
+            printHistoryHelp();
+            continue;
+        }
+
+        // 기록한 범위 밖이면 끝까지만 간다.
+        if (target < firstStep || target > lastStep)
+        {
+            printf("step %lld is outside the recorded steps %lld..%lld\n", target, firstStep, lastStep);
+            target = (target < firstStep) ? firstStep : lastStep;
+        }
+        moveHistory(target);
+        printHistoryPosition();
+    }
+
+    // 끝난 상태로 돌아간다.
+    restoreSnapshot(historyCount - 1);
+}
+
+// 기록을 모두 버린다. (페이지를 돌려준 뒤에 실행 메모리를 비워야 한다)
+void resetHistory()
+{
+    while (historyCount > 0)
+    {
+        releaseOldestSnapshot();
+    }
+    free(historySnapshots);
+    historySnapshots = NULL;
+    historyFirst = 0;
+    historyActive = false;
+}
+
+//
+// 에러 체크 구간!! 시작!!
+//
+// 에러가 있는지 확인하기 위한 변수.
+bool has_error;
+
+// 문법 에러 하나 (몇 번째 줄에서 어떤 에러가 났는지)
+typedef struct
+{
+    int lineNumber;
+    char message[128];
+} SyntaxError;
+
+// 에러 체크를 나눠서 할 때 스레드 하나가 맡는 구간
+typedef struct
+{
+    const char *begin;     // 구간 시작 (줄의 시작)
+    const char *end;       // 구간 끝 (다음 구간의 시작)
+    int lineCount;         // 구간 안의 줄 수
+    SyntaxError *errors;   // 구간 안에서 나온 에러들 (줄 순서대로)
+    int errorCount;
+    int errorCapacity;
+    bool errorsDropped;    // 메모리가 없어서 저장하지 못한 에러가 있는지
+} CheckChunk;
+
+// 한 줄을 검사한다. 에러가 있으면 message에 내용을 쓰고 true를 돌려준다.
+// 전역 변수를 건드리지 않으므로 여러 스레드에서 동시에 불러도 된다.
+bool check_line_for_errors(const char *line, int length, char *message, size_t messageSize)
+{
+    ParsedLine parsed;
+
+    // 명령어 배열에 넣을 수 있는 길이인지 확인
+    if (length >= MAX_LINE_LENGTH)
+    {
+        snprintf(message, messageSize, "line is longer than %d characters", MAX_LINE_LENGTH - 1);
+        return true;
+    }
+
+    // 괄호, 쉼표, 피연산자 개수, 레지스터, 즉시값은 parseLine 이 한 번에 확인한다.
+    return !parseLine(line, length, &parsed, message, messageSize);
+}
+
+// 구간 하나의 줄들을 차례대로 검사한다. (스레드 함수)
+void *checkChunkWorker(void *argument)
+{
+    CheckChunk *chunk = (CheckChunk *)argument;
+    char message[128];
+    const char *cursor = chunk->begin;
+    const char *line;
+    int length;
+
+    while ((line = nextLine(&cursor, chunk->end, &length)) != NULL)
+    {
+        chunk->lineCount++;
+
+        // 에러는 구간 안에서의 줄 번호로 저장하고, 나중에 앞 구간들의 줄 수를 더한다.
+        if (check_line_for_errors(line, length, message, sizeof(message)))
+        {
+            if (chunk->errorCount >= chunk->errorCapacity)
+            {
+                int capacity = (chunk->errorCapacity == 0) ? 16 : chunk->errorCapacity * 2;
+                SyntaxError *grown = realloc(chunk->errors, capacity * sizeof(SyntaxError));
+                if (grown == NULL)
+                {
+                    // 앞의 에러는 그대로 두고, 이 구간에 에러가 더 있다는 것만 남긴다.
+                    chunk->errorsDropped = true;
+                    continue;
+                }
+                chunk->errors = grown;
+                chunk->errorCapacity = capacity;
+            }
+            chunk->errors[chunk->errorCount].lineNumber = chunk->lineCount;
+            snprintf(chunk->errors[chunk->errorCount].message, sizeof(message), "%s", message);
+            chunk->errorCount++;
+        }
+    }
+    return NULL;
+}
+
+// 에러 체킹 함수. 파일을 스레드 수만큼 줄 단위 구간으로 나눠서 동시에 검사하고,
+// 모든 에러를 줄 번호 순서대로 출력한다.
+bool check_file_for_errors()
+{
+    size_t size = sourceSize;
+    has_error = false;
+
+    int chunkCount = decideThreadCount(size, CHECK_CHUNK_MIN_BYTES);
+    CheckChunk chunks[MAX_THREADS];
+    pthread_t threads[MAX_THREADS];
+
+    // 구간 경계는 줄바꿈 바로 뒤로 맞춘다.
+    const char *cursor = source;
+    for (int i = 0; i < chunkCount; i++)
+    {
+        const char *chunkEnd = source + size * (i + 1) / chunkCount;
+        if (chunkEnd < cursor)
+        {
+            chunkEnd = cursor;
+        }
+        if (i == chunkCount - 1)
+        {
+            chunkEnd = source + size;
+        }
+        else
+        {
+            const char *newline = memchr(chunkEnd, '\n', source + size - chunkEnd);
+            chunkEnd = (newline != NULL) ? newline + 1 : source + size;
+        }
+
+        memset(&chunks[i], 0, sizeof(CheckChunk));
+        chunks[i].begin = cursor;
+        chunks[i].end = chunkEnd;
+        cursor = chunkEnd;
+    }
+
+    if (chunkCount == 1)
+    {
+        checkChunkWorker(&chunks[0]);
+    }
+    else
+    {
+        for (int i = 0; i < chunkCount; i++)
+        {
+            pthread_create(&threads[i], NULL, checkChunkWorker, &chunks[i]);
+        }
+        for (int i = 0; i < chunkCount; i++)
+        {
+            pthread_join(threads[i], NULL);
+        }
+    }
+
+    // 구간 순서대로 줄 번호를 맞춰서 에러를 출력한다.
+    int lineBase = 0;
+    for (int i = 0; i < chunkCount; i++)
+    {
+        for (int j = 0; j < chunks[i].errorCount; j++)
+        {
+            printf("line %d: %s\n", lineBase + chunks[i].errors[j].lineNumber, chunks[i].errors[j].message);
+            has_error = true;
+        }
+        if (chunks[i].errorsDropped)
+        {
+            printf("line %d..%d: more errors not shown (Memory allocation failed.)\n", lineBase + 1,
+                   lineBase + chunks[i].lineCount);
+            has_error = true;
+        }
+        lineBase += chunks[i].lineCount;
+        free(chunks[i].errors);
+    }
+
+    // 에러가 있는지 없는지를 리턴한다.
+    return has_error;
+}
+
+void resetLinkedObjects();
+
+// 실행해서 생긴 상태(게스트 메모리, 시스템 호출, 통계)만 비운다. 어셈블한 명령어, 레이블, 데이터는 그대로 둔다.
+// (trace 조각은 아레나에 남겨두고 다음 실행에서 다시 쓴다)
+void resetExecution()
+{
+    finishSystemCalls();
+    traceTail = NULL;
+    traceLength = 0;
+
+    resetHistory();
+    freeMemory(&sharedMemory);
+    resetDataflow();
+    resetStats();
+    resetProfile();
+    memset(stageTimings, 0, sizeof(stageTimings));
+}
+
+// 파일 하나가 끝나면 파일마다 쓰던 상태를 비운다. 아레나에서 받은 것은 arenaReset 한 번으로 모두 돌려준다.
+void endFile()
+{
+    resetExecution();
+    resetDataBlocks();
+    resetLinkedObjects();
+    arenaReset(&fileArena);
+    source = NULL;
+    sourceSize = 0;
+    labels = NULL;
+    labelCount = 0;
+    labelCapacity = 0;
+    labelTable = NULL;
+    labelTableSize = 0;
+    instructions = NULL;
+    instructionCount = 0;
+    traceHead = NULL;
+}
+
+// 실행하기 전의 pc, 레지스터, trace 위치를 처음 값으로 둔다.
+void resetRunState()
+{
+    // 파일을 여러번 읽을 수도 있기 때문에 초기화를 시켜준다.
+    traceFileOffset = 0;
+    traceEntries = 0;
+    stepCount = 0;
+    pc = 1000;
+
+    // register 값을 초기화 한다.
+    for (int i = 0; i < 32; i++)
+    {
+        registers[i] = 0;
+    }
+
+    // register 값을 선언하고 들어간다.
+    registers[1] = 1;
+    registers[2] = 2;
+    registers[3] = 3;
+    registers[4] = 4;
+    registers[5] = 5;
+    registers[6] = 6;
+}
+
+void simulateProgram(const char *filename);
+
+// 명령어 배열이 준비된 프로그램을 최적화하고, .o 파일을 만들고, 실행해서 .trace 와 보고서를 쓴다.
+// (runFile 과 링크한 프로그램이 같이 쓴다. 출력 파일 이름은 filename 으로 만든다)
+void runProgram(const char *filename)
+{
+    StageClock clock;
+
+    // -O 면 인코딩과 실행 전에 명령어를 최적화한다.
+    if (optimizeEnabled)
+    {
+        beginStage(&clock);
+        optimizeProgram();
+        endStage(STAGE_OPTIMIZE, &clock);
+    }
+
+    // 이진수 값을 .o파일에 만든다.
+    beginStage(&clock);
+    bool processed = processFile(filename);
+    endStage(STAGE_PROCESS, &clock);
+    if (!processed)
+    {
+        printf("Syntax Error!!\n");
+        return;
+    }
+    simulateProgram(filename);
+}
+
+// .o 파일까지 만든 프로그램을 실행해서 .trace 와 보고서를 쓴다.
+void simulateProgram(const char *filename)
+{
+    StageClock clock;
+
+    // --stats 면 실행하면서 명령어를 센다.
+    if (statsEnabled)
+    {
+        startStats();
+    }
+    if (profileEnabled)
+    {
+        startProfile();
+    }
+
+    // 트레이스 파일을 만들자.
+    beginStage(&clock);
+    traceFile(filename);
+    finishSystemCalls();
+    endStage(STAGE_EXECUTE, &clock);
+
+    // --time-travel 이면 기록한 실행을 오간다. 보고서는 끝난 상태로 돌아와서 쓴다.
+    if (historyActive)
+    {
+        travelHistory();
+    }
+
+    // ILP 분석 결과를 쓴다.
+    beginStage(&clock);
+    if (dataflowEnabled)
+    {
+        writeDataflowReport(filename);
+    }
+
+    // 실행 통계를 쓴다.
+    if (statsEnabled)
+    {
+        writeStatsReport(filename);
+    }
+
+    // 함수별 프로파일을 쓴다.
+    if (profileEnabled)
+    {
+        writeProfileReport(filename);
+    }
+
+    // 끝난 상태를 덤프한다.
+    if (dumpEnabled)
+    {
+        writeMemoryDump(filename);
+    }
+    if (dataflowEnabled || statsEnabled || profileEnabled || dumpEnabled)
+    {
+        endStage(STAGE_REPORTS, &clock);
+    }
+}
+
+// 읽어둔 소스를 어셈블한다. (에러 체크 -> 레이블 -> 명령어 해석) 에러가 있으면 출력하고 false
+bool assembleSource(const char *filename)
+{
+    char objectFilename[260];
+
+    // 일단 파일을 읽으면서 에러가 있는지 부터 확인한다. (사실상 이게 첫 번째 읽기)
+    if (runStage(STAGE_CHECK, check_file_for_errors))
+    {
+        printf("Syntax Error!!\n");
+        return false;
+    }
+    // 첫번째 읽기. 레이블 값을 추출한다.
+    if (runStage(STAGE_FIRST_PASS, firstPass))
+    {
+        printf("Syntax Error!!\n");
+        return false;
+    }
+    // 두 번째 읽기. 명령어를 해석해서 배열에 넣는다. (없는 레이블이 있으면 예전 .o 파일도 지운다)
+    if (!runStage(STAGE_LOAD_INSTRUCTIONS, loadInstructions))
+    {
+        printf("Syntax Error!!\n");
+        makeOutputName(filename, ".o", objectFilename, sizeof(objectFilename));
+        if (pipelineEnabled)
+        {
+            submitWrite(objectFilename, NULL, 0, false, true); // 앞에서 넘긴 쓰기보다 먼저 지우지 않도록
+        }
+        else
+        {
+            remove(objectFilename);
+        }
+        return false;
+    }
+    return true;
+}
+
+// 파일 하나를 처음부터 끝까지 처리한다. (에러 체크 -> 레이블 -> 명령어 해석 -> .o 파일 -> .trace 파일)
+void runFile(const char *filename)
+{
+    resetRunState();
+
+    // 파일 존재 여부 확인. 파일은 아레나에 한 번만 읽고 모든 패스가 같이 쓴다.
+    // (--timing 이면 단계마다 beginStage/endStage 나 runStage 로 잰다)
+    StageClock clock;
+    beginStage(&clock);
+    bool loaded = loadSource(filename);
+    endStage(STAGE_LOAD, &clock);
+    if (!loaded)
+    {
+        printf("Input file does not exist!!\n");
+        endFile();
+        return;
+    }
+
+    if (assembleSource(filename))
+    {
+        runProgram(filename);
+    }
+
+    // 단계별 시간을 출력한다.
+    printStageTimings(filename);
+
+    // 파일이 끝났으니까 초기화를 해준다.
+    endFile();
+}
+
+//
+// 링크 구간!! 시작!! (--link)
+//
+// 입력 파일들을 프로그램 하나로 만든다. 파일마다 자식 프로세스에서 재배치 오브젝트(파일명.rel)로 어셈블하고
+// (전역 상태를 쓰므로 데몬처럼 스레드가 아니라 프로세스로 나눈다), 부모가 .rel 들을 mmap 해서 구간을 이어 붙이고 재배치를 고친다.
+// 소스 해시가 같은 .rel 이 이미 있으면 다시 어셈블하지 않으므로, 여러 프로그램이 같이 쓰는 라이브러리 파일은 한 번만 어셈블된다.
+//
+// 코드는 입력 파일 순서대로 1000 부터 이어 붙이고, 데이터는 DATA_SEGMENT_BASE 부터 파일마다 그 파일의 가장 큰 .align 에 맞춰 놓는다.
+// 레이블은 파일 안에서만 보이고, .globl 레이블만 다른 파일에서 .extern 으로 쓸 수 있다.
+// 파일 안의 레이블로 가는 분기/jal 은 코드 구간 기준 위치로 저장해서 구간과 같이 옮기고, 다음 세 가지만 재배치로 남긴다.
+//   RELOCATION_TARGET  .extern 레이블로 가는 분기/jal
+//   RELOCATION_IMM     la, lw/sw/jalr 의 offset 자리에 쓴 레이블 (절대 주소이므로 파일 안의 레이블도)
+//   RELOCATION_WORD    .word 에 쓴 레이블
+// --load 는 .rel 에 넣지 않고 링크한 뒤에 넣는다.
+//
+// .rel 형식 (호스트와 같은 리틀 엔디언, 모두 4바이트 단위)
+//   머리     : ObjectHeader
+//   명령어   : ObjectInstruction * textCount
+//   데이터   : ObjectBlock * blockCount
+//   심볼     : ObjectSymbol * symbolCount (레이블 순서)
+//   재배치   : ObjectRelocation * relocationCount
+//   값       : int32 * valueCount (데이터 덩어리의 값을 이어 붙인 것)
+//   이름     : 심볼 이름들을 이어 붙인 것 (nameBytes)
+
+#define OBJECT_VERSION 1
+
+typedef struct
+{
+    char magic[4];          // "RVRO"
+    uint32_t version;       // OBJECT_VERSION
+    uint64_t sourceHash;    // 어셈블한 소스의 해시 (같으면 다시 어셈블하지 않는다)
+    uint32_t tableSize;     // instructionTable 항목 수 (명령어 번호를 그대로 쓰므로 다르면 다시 어셈블한다)
+    uint32_t reusable;      // 0 이면 .incbin 이 있어서 소스가 같아도 다시 어셈블한다
+    uint32_t textCount;     // 명령어 수
+    uint32_t dataWords;     // 데이터 구간 크기 (주소 수)
+    uint32_t dataAlignLog2; // 데이터 구간을 2^dataAlignLog2 에 맞춘다
+    uint32_t blockCount;
+    uint32_t valueCount;
+    uint32_t symbolCount;
+    uint32_t relocationCount;
+    uint32_t nameBytes;
+} ObjectHeader;
+
+// 해석해 둔 명령어 하나 (Instruction 에서 소스 위치와 주소를 뺀 것)
+typedef struct
+{
+    int16_t infoIndex;
+    uint8_t rd;
+    uint8_t rs1;
+    uint8_t rs2;
+    uint8_t hasLabel;
+    uint16_t reserved;
+    int32_t imm;
+    int32_t target; // 분기/점프 대상의 코드 구간 기준 위치 (레이블이 아니거나 .extern 이면 -1)
+} ObjectInstruction;
+
+typedef struct
+{
+    int32_t offset;     // 데이터 구간 기준 위치
+    int32_t count;
+    int32_t valueIndex; // 값 배열 안의 위치 (-1 이면 0으로 채운다)
+} ObjectBlock;
+
+typedef struct
+{
+    uint32_t nameOffset;
+    uint32_t nameLength;
+    int32_t value;    // 구간 기준 위치 (.extern 이면 0)
+    uint8_t binding;  // LabelBinding
+    uint8_t inData;
+    uint16_t reserved;
+} ObjectSymbol;
+
+typedef enum
+{
+    RELOCATION_TARGET,
+    RELOCATION_IMM,
+    RELOCATION_WORD
+} RelocationKind;
+
+typedef struct
+{
+    uint32_t kind;   // RelocationKind
+    int32_t where;   // 명령어 번호 (RELOCATION_WORD 면 값 배열 안의 위치)
+    uint32_t symbol; // 심볼 번호
+} ObjectRelocation;
+
+// 링크하려고 연 .rel 하나
+typedef struct
+{
+    const char *filename;
+    unsigned char *mapping;
+    size_t size;
+    const ObjectHeader *header;
+    const ObjectInstruction *text;
+    const ObjectBlock *blocks;
+    const ObjectSymbol *symbols;
+    const ObjectRelocation *relocations;
+    int32_t *values;      // .word 재배치를 고치므로 MAP_PRIVATE 로 쓸 수 있게 연다
+    int textBase;         // 첫 명령어가 instructions 안에서 들어갈 위치
+    long long dataBase;   // 데이터 구간 시작 주소
+    int nameBase;         // 이름이 source 안에서 시작하는 위치
+    int *symbolAddresses; // 심볼마다 링크한 주소 (.extern 은 찾은 .globl 레이블의 주소)
+} LinkedObject;
+
+LinkedObject *linkedObjects = NULL; // 아레나에 있고, mmap 은 endFile 에서 닫는다
+
+uint32_t instructionTableSize()
+{
+    uint32_t size = 0;
+    while (instructionTable[size].instName != NULL)
+    {
+        size++;
+    }
+    return size;
+}
+
+// 어셈블한 지금 파일을 path 에 .rel 로 쓴다. (임시 파일에 다 쓴 뒤에 이름을 바꾼다)
+bool writeRelocatableObject(const char *path, uint64_t sourceHash)
+{
+    ObjectHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "RVRO", 4);
+    header.version = OBJECT_VERSION;
+    header.sourceHash = sourceHash;
+    header.tableSize = instructionTableSize();
+    header.reusable = 1;
+    header.textCount = (uint32_t)instructionCount;
+    header.dataAlignLog2 = (uint32_t)dataAlignLog2;
+    header.blockCount = (uint32_t)dataBlockCount;
+    header.symbolCount = (uint32_t)labelCount;
+
+    long long dataEnd = DATA_SEGMENT_BASE;
+    for (int b = 0; b < dataBlockCount; b++)
+    {
+        if (dataBlocks[b].values != NULL)
+        {
+            header.valueCount += (uint32_t)dataBlocks[b].count;
+        }
+        if ((long long)dataBlocks[b].address + dataBlocks[b].count > dataEnd)
+        {
+            dataEnd = (long long)dataBlocks[b].address + dataBlocks[b].count;
+        }
+        if (dataBlocks[b].mapping != NULL)
+        {
+            header.reusable = 0;
+        }
+    }
+    header.dataWords = (uint32_t)(dataEnd - DATA_SEGMENT_BASE);
+
+    ObjectInstruction *text = arenaAlloc(&fileArena, (instructionCount + 1) * sizeof(ObjectInstruction));
+    ObjectBlock *blocks = arenaAlloc(&fileArena, (dataBlockCount + 1) * sizeof(ObjectBlock));
+    ObjectSymbol *symbols = arenaAlloc(&fileArena, (labelCount + 1) * sizeof(ObjectSymbol));
+    ObjectRelocation *relocations = arenaAlloc(&fileArena, (instructionCount + header.valueCount + 1) * sizeof(ObjectRelocation));
+    int32_t *values = arenaAlloc(&fileArena, (header.valueCount + 1) * sizeof(int32_t));
+
+    // 명령어마다 레이블을 쓴 자리를 다시 찾는다. (decodeLine 과 같은 피연산자 자리)
+    for (int i = 0; i < instructionCount; i++)
+    {
+        const Instruction *instr = &instructions[i];
+        const InstructionInfo *info = &instructionTable[instr->infoIndex];
+        OperandFormat format = operandFormat(info);
+        ObjectInstruction *out = &text[i];
+        ParsedLine parsed;
+        Token label;
+
+        out->infoIndex = instr->infoIndex;
+        out->rd = instr->rd;
+        out->rs1 = instr->rs1;
+        out->rs2 = instr->rs2;
+        out->hasLabel = instr->hasLabel;
+        out->reserved = 0;
+        out->imm = instr->imm;
+        out->target = (instr->hasLabel && instr->target >= 1000) ? instr->target - 1000 : -1;
+
+        if (format != OPERANDS_REG_OFFSET_BASE && format != OPERANDS_REG_TARGET && format != OPERANDS_REG_REG_TARGET)
+        {
+            continue;
+        }
+        parseLine(source + instr->sourceOffset, instr->sourceLength, &parsed, NULL, 0);
+        label = (format == OPERANDS_REG_OFFSET_BASE) ? parsed.operands[1] : parsed.operands[parsed.operandCount - 1];
+        if (label.kind != TOKEN_WORD)
+        {
+            continue;
+        }
+
+        int symbol = findLabelIndex(label.start, label.length);
+        bool absolute = (format == OPERANDS_REG_OFFSET_BASE || isLoadAddress(info));
+        if (!absolute && labels[symbol].binding != LABEL_EXTERN)
+        {
+            continue; // 파일 안의 분기 대상은 구간과 같이 옮긴다.
+        }
+        ObjectRelocation *relocation = &relocations[header.relocationCount++];
+        relocation->kind = absolute ? RELOCATION_IMM : RELOCATION_TARGET;
+        relocation->where = i;
+        relocation->symbol = (uint32_t)symbol;
+    }
+
+    // 데이터 덩어리의 값을 이어 붙이고, .word 의 레이블은 재배치로 남긴다.
+    uint32_t used = 0;
+    for (int b = 0; b < dataBlockCount; b++)
+    {
+        const DataBlock *block = &dataBlocks[b];
+        blocks[b].offset = block->address - DATA_SEGMENT_BASE;
+        blocks[b].count = block->count;
+        blocks[b].valueIndex = (block->values != NULL) ? (int32_t)used : -1;
+        if (block->values == NULL)
+        {
+            continue;
+        }
+        memcpy(values + used, block->values, (size_t)block->count * sizeof(int32_t));
+
+        if (block->sourceOffset >= 0)
+        {
+            Token tokens[MAX_LINE_TOKENS];
+            int count = lexLine(source + block->sourceOffset, block->sourceLength, tokens, MAX_LINE_TOKENS);
+            for (int k = 1; k < count; k += 2)
+            {
+                if (tokens[k].kind == TOKEN_WORD)
+                {
+                    ObjectRelocation *relocation = &relocations[header.relocationCount++];
+                    relocation->kind = RELOCATION_WORD;
+                    relocation->where = (int32_t)(used + k / 2);
+                    relocation->symbol = (uint32_t)findLabelIndex(tokens[k].start, tokens[k].length);
+                }
+            }
+        }
+        used += (uint32_t)block->count;
+    }
+
+    // 심볼은 레이블 순서 그대로 두고, 값은 구간 기준 위치로 바꾼다.
+    for (int l = 0; l < labelCount; l++)
+    {
+        symbols[l].nameOffset = header.nameBytes;
+        symbols[l].nameLength = (uint32_t)labels[l].nameLength;
+        symbols[l].value = (labels[l].binding == LABEL_EXTERN) ? 0
+                           : labels[l].inData                  ? labels[l].address - DATA_SEGMENT_BASE
+                                                               : labels[l].address - 1000;
+        symbols[l].binding = labels[l].binding;
+        symbols[l].inData = labels[l].inData;
+        symbols[l].reserved = 0;
+        header.nameBytes += (uint32_t)labels[l].nameLength;
+    }
+    char *names = arenaAlloc(&fileArena, header.nameBytes + 1);
+    for (int l = 0; l < labelCount; l++)
+    {
+        memcpy(names + symbols[l].nameOffset, source + labels[l].nameOffset, labels[l].nameLength);
+    }
+
+    char temporaryPath[300];
+    snprintf(temporaryPath, sizeof(temporaryPath), "%s.tmp", path);
+    FILE *file = fopen(temporaryPath, "wb");
+    if (file == NULL)
+    {
+        printf("we can't open the file %s\n", temporaryPath);
+        return false;
+    }
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(text, sizeof(ObjectInstruction), header.textCount, file);
+    fwrite(blocks, sizeof(ObjectBlock), header.blockCount, file);
+    fwrite(symbols, sizeof(ObjectSymbol), header.symbolCount, file);
+    fwrite(relocations, sizeof(ObjectRelocation), header.relocationCount, file);
+    fwrite(values, sizeof(int32_t), header.valueCount, file);
+    fwrite(names, 1, header.nameBytes, file);
+    bool written = (ferror(file) == 0);
+    if (fclose(file) != 0 || !written || rename(temporaryPath, path) != 0)
+    {
+        printf("we can't write the file %s\n", path);
+        remove(temporaryPath);
+        return false;
+    }
+    return true;
+}
+
+// 파일 하나를 .rel 로 어셈블한다. (자식 프로세스에서 부른다) 소스 해시가 같은 .rel 이 있으면 그대로 쓴다.
+bool assembleObject(const char *filename)
+{
+    char objectPath[260];
+    ObjectHeader existing;
+
+    makeOutputName(filename, ".rel", objectPath, sizeof(objectPath));
+    objectMode = true;
+    if (!loadSource(filename))
+    {
+        printf("%s: Input file does not exist!!\n", filename);
+        return false;
+    }
+
+    uint64_t hash = hashSource(source, sourceSize);
+    FILE *file = fopen(objectPath, "rb");
+    if (file != NULL)
+    {
+        bool same = (fread(&existing, sizeof(existing), 1, file) == 1 && memcmp(existing.magic, "RVRO", 4) == 0 &&
+                     existing.version == OBJECT_VERSION && existing.sourceHash == hash &&
+                     existing.tableSize == instructionTableSize() && existing.reusable);
+        fclose(file);
+        if (same)
+        {
+            return true;
+        }
+    }
+
+    if (check_file_for_errors() || firstPass() || !loadInstructions())
+    {
+        printf("%s: Syntax Error!!\n", filename);
+        remove(objectPath);
+        return false;
+    }
+    return writeRelocatableObject(objectPath, hash);
+}
+
+// 파일마다 자식 프로세스를 띄워서 .rel 을 만든다. 한 번에 스레드 수만큼만 띄운다. 하나라도 실패하면 false
+// (자식의 출력은 끝날 때 한 번에 나가므로 파일끼리 섞이지 않는다)
+bool assembleObjects(char **files, int count)
+{
+    int limit = decideThreadCount(count, 1);
+    int running = 0;
+    int next = 0;
+    bool ok = true;
+
+    fflush(stdout);
+    while (next < count || running > 0)
+    {
+        if (next < count && running < limit && ok)
+        {
+            pid_t pid = fork();
+            if (pid == 0)
+            {
+                bool assembled = assembleObject(files[next]);
+                fflush(stdout);
+                _exit(assembled ? 0 : 1);
+            }
+            if (pid < 0)
+            {
+                printf("we can't start a process for %s\n", files[next]);
+                ok = false;
+            }
+            else
+            {
+                running++;
+            }
+            next++;
+            continue;
+        }
+        if (running == 0)
+        {
+            break; // 실패해서 더 띄우지 않는다.
+        }
+
+        int status;
+        if (waitpid(-1, &status, 0) < 0)
+        {
+            return false;
+        }
+        running--;
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        {
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+// .rel 하나를 열고 구간 위치를 확인한다. 형식이 맞지 않으면 출력하고 false
+bool openObject(LinkedObject *object, const char *filename)
+{
+    char path[260];
+    struct stat info;
+
+    makeOutputName(filename, ".rel", path, sizeof(path));
+    object->filename = filename;
+    object->mapping = NULL;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0 || fstat(fd, &info) != 0)
+    {
+        printf("we can't open the file %s\n", path);
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        return false;
+    }
+
+    object->size = (size_t)info.st_size;
+    unsigned char *data = (object->size >= sizeof(ObjectHeader))
+                              ? mmap(NULL, object->size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0)
+                              : MAP_FAILED;
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        printf("%s is not a relocatable object\n", path);
+        return false;
+    }
+    object->mapping = data;
+
+    const ObjectHeader *header = (const ObjectHeader *)data;
+    size_t offset = sizeof(ObjectHeader);
+    object->header = header;
+    object->text = (const ObjectInstruction *)(data + offset);
+    offset += (size_t)header->textCount * sizeof(ObjectInstruction);
+    object->blocks = (const ObjectBlock *)(data + offset);
+    offset += (size_t)header->blockCount * sizeof(ObjectBlock);
+    object->symbols = (const ObjectSymbol *)(data + offset);
+    offset += (size_t)header->symbolCount * sizeof(ObjectSymbol);
+    object->relocations = (const ObjectRelocation *)(data + offset);
+    offset += (size_t)header->relocationCount * sizeof(ObjectRelocation);
+    object->values = (int32_t *)(data + offset);
+    offset += (size_t)header->valueCount * sizeof(int32_t);
+    if (memcmp(header->magic, "RVRO", 4) != 0 || header->version != OBJECT_VERSION ||
+        header->tableSize != instructionTableSize() || offset + header->nameBytes != object->size)
+    {
+        printf("%s is not a relocatable object\n", path);
+        return false;
+    }
+
+    // 번호들이 범위 안에 있는지 본다.
+    bool valid = true;
+    for (uint32_t i = 0; i < header->textCount; i++)
+    {
+        valid = valid && object->text[i].infoIndex >= 0 && (uint32_t)object->text[i].infoIndex < header->tableSize;
+    }
+    for (uint32_t b = 0; b < header->blockCount; b++)
+    {
+        const ObjectBlock *block = &object->blocks[b];
+        valid = valid && block->offset >= 0 && block->count >= 0 &&
+                (long long)block->offset + block->count <= header->dataWords &&
+                (block->valueIndex < 0 || (long long)block->valueIndex + block->count <= header->valueCount);
+    }
+    for (uint32_t s = 0; s < header->symbolCount; s++)
+    {
+        valid = valid && (long long)object->symbols[s].nameOffset + object->symbols[s].nameLength <= header->nameBytes;
+    }
+    for (uint32_t r = 0; r < header->relocationCount; r++)
+    {
+        const ObjectRelocation *relocation = &object->relocations[r];
+        uint32_t limit = (relocation->kind == RELOCATION_WORD) ? header->valueCount : header->textCount;
+        valid = valid && relocation->kind <= RELOCATION_WORD && relocation->symbol < header->symbolCount &&
+                relocation->where >= 0 && (uint32_t)relocation->where < limit;
+    }
+    if (!valid)
+    {
+        printf("%s is not a relocatable object\n", path);
+    }
+    return valid;
+}
+
+// 심볼 이름 (source 에 이어 붙여둔 이름들 안의 위치)
+Token objectSymbolName(const LinkedObject *object, int symbol)
+{
+    Token name;
+    name.start = source + object->nameBase + object->symbols[symbol].nameOffset;
+    name.length = (int)object->symbols[symbol].nameLength;
+    name.kind = TOKEN_WORD;
+    return name;
+}
+
+// .rel 들을 열어서 구간을 놓고, 명령어 배열, 레이블 표, 데이터 덩어리를 만든다. 에러가 있으면 출력하고 false
+// 링크한 프로그램의 source 는 레이블 이름들을 이어 붙인 것이다. (명령어 줄은 남지 않는다)
+bool linkObjects(char **files, int count)
+{
+    long long textCount = 0;
+    long long dataAddress = DATA_SEGMENT_BASE;
+    long long nameBytes = 0;
+    bool ok = true;
+
+    linkedObjects = arenaAlloc(&fileArena, count * sizeof(LinkedObject));
+    memset(linkedObjects, 0, count * sizeof(LinkedObject));
+    linkedObjectCount = count;
+    linkedSourceHash = 14695981039346656037ULL;
+    for (int i = 0; i < count; i++)
+    {
+        LinkedObject *object = &linkedObjects[i];
+        if (!openObject(object, files[i]))
+        {
+            return false;
+        }
+        long long align = 1LL << object->header->dataAlignLog2;
+        object->textBase = (int)textCount;
+        object->dataBase = (dataAddress + align - 1) & ~(align - 1);
+        object->nameBase = (int)nameBytes;
+        textCount += object->header->textCount;
+        dataAddress = object->dataBase + object->header->dataWords;
+        nameBytes += object->header->nameBytes;
+        linkedSourceHash = (linkedSourceHash ^ object->header->sourceHash) * 1099511628211ULL;
+        if (1000 + textCount * 4 > INT_MAX || dataAddress > (long long)INT_MAX + 1 || nameBytes > INT_MAX)
+        {
+            printf("linked program does not fit in guest memory\n");
+            return false;
+        }
+    }
+
+    source = arenaAlloc(&fileArena, nameBytes + 1);
+    sourceSize = (size_t)nameBytes;
+    for (int i = 0; i < count; i++)
+    {
+        memcpy(source + linkedObjects[i].nameBase, (const char *)linkedObjects[i].mapping + linkedObjects[i].size -
+                                                       linkedObjects[i].header->nameBytes,
+               linkedObjects[i].header->nameBytes);
+    }
+    source[nameBytes] = '\0';
+
+    // 심볼마다 주소를 정하고, .globl 레이블을 먼저 레이블 표에 넣는다. (같은 이름을 찾으면 파일 안의 레이블보다 이쪽이 나온다)
+    for (int i = 0; i < count; i++)
+    {
+        LinkedObject *object = &linkedObjects[i];
+        object->symbolAddresses = arenaAlloc(&fileArena, (object->header->symbolCount + 1) * sizeof(int));
+        for (int s = 0; s < (int)object->header->symbolCount; s++)
+        {
+            const ObjectSymbol *symbol = &object->symbols[s];
+            long long address = symbol->inData ? object->dataBase + symbol->value : 1000 + 4LL * object->textBase + symbol->value;
+            object->symbolAddresses[s] = (symbol->binding == LABEL_EXTERN) ? -1 : (int)address;
+            if (symbol->binding != LABEL_GLOBAL)
+            {
+                continue;
+            }
+
+            Token name = objectSymbolName(object, s);
+            if (findLabelIndex(name.start, name.length) >= 0)
+            {
+                printf("%s: '.globl' label '%.*s' is already defined in another file\n", object->filename, name.length, name.start);
+                ok = false;
+                continue;
+            }
+            addLabel(name, (int)address);
+            labels[labelCount - 1].binding = LABEL_GLOBAL;
+            labels[labelCount - 1].inData = symbol->inData;
+        }
+    }
+    int globalCount = labelCount;
+
+    // .extern 을 .globl 레이블로 채우고, 파일 안의 레이블도 레이블 표에 넣는다. (--hart-entry 나 보고서에서 찾을 수 있도록)
+    for (int i = 0; i < count; i++)
+    {
+        LinkedObject *object = &linkedObjects[i];
+        for (int s = 0; s < (int)object->header->symbolCount; s++)
+        {
+            const ObjectSymbol *symbol = &object->symbols[s];
+            Token name = objectSymbolName(object, s);
+            if (symbol->binding == LABEL_EXTERN)
+            {
+                int index = findLabelIndex(name.start, name.length);
+                if (index < 0 || index >= globalCount)
+                {
+                    printf("%s: undefined label '%.*s'\n", object->filename, name.length, name.start);
+                    ok = false;
+                }
+                else
+                {
+                    object->symbolAddresses[s] = labels[index].address;
+                }
+            }
+            else if (symbol->binding == LABEL_LOCAL)
+            {
+                addLabel(name, object->symbolAddresses[s]);
+                labels[labelCount - 1].inData = symbol->inData;
+            }
+        }
+    }
+    if (!ok)
+    {
+        return false;
+    }
+
+    // 명령어를 옮기고 재배치를 고친다.
+    instructions = arenaAlloc(&fileArena, (textCount + 1) * sizeof(Instruction));
+    instructionCount = (int)textCount;
+    for (int i = 0; i < count; i++)
+    {
+        LinkedObject *object = &linkedObjects[i];
+        int base = 1000 + 4 * object->textBase;
+        for (int k = 0; k < (int)object->header->textCount; k++)
+        {
+            const ObjectInstruction *in = &object->text[k];
+            Instruction *instr = &instructions[object->textBase + k];
+            instr->sourceOffset = 0;
+            instr->sourceLength = 0;
+            instr->address = base + 4 * k;
+            instr->infoIndex = in->infoIndex;
+            instr->rd = in->rd;
+            instr->rs1 = in->rs1;
+            instr->rs2 = in->rs2;
+            instr->hasLabel = in->hasLabel;
+            instr->imm = in->imm;
+            instr->target = (in->target < 0) ? -1 : base + in->target;
+        }
+
+        for (int r = 0; r < (int)object->header->relocationCount; r++)
+        {
+            const ObjectRelocation *relocation = &object->relocations[r];
+            int address = object->symbolAddresses[relocation->symbol];
+            Token name = objectSymbolName(object, (int)relocation->symbol);
+            if (relocation->kind == RELOCATION_WORD)
+            {
+                object->values[relocation->where] = address;
+                continue;
+            }
+
+            Instruction *instr = &instructions[object->textBase + relocation->where];
+            InstructionType type = instructionTable[instr->infoIndex].type;
+            if (relocation->kind == RELOCATION_TARGET)
+            {
+                // encodeInstruction 과 같은 offset 이 범위에 들어가는지 본다.
+                instr->hasLabel = true;
+                instr->target = address;
+                if (is_overflow((address - instr->address) / 2, type))
+                {
+                    printf("%s: branch to '%.*s' is out of range\n", object->filename, name.length, name.start);
+                    ok = false;
+                }
+            }
+            else
+            {
+                instr->imm = address;
+                if (is_overflow(address, (type == S_TYPE) ? S_TYPE : I_TYPE))
+                {
+                    printf("%s: address of '%.*s' (%d) does not fit in a 12-bit immediate\n", object->filename, name.length,
+                           name.start, address);
+                    ok = false;
+                }
+            }
+        }
+
+        for (int b = 0; b < (int)object->header->blockCount; b++)
+        {
+            const ObjectBlock *block = &object->blocks[b];
+            addDataBlock((int)(object->dataBase + block->offset), block->count,
+                         (block->valueIndex < 0) ? NULL : object->values + block->valueIndex);
+        }
+    }
+
+    // --load 로 준 호스트 파일은 링크한 데이터 뒤에 넣는다.
+    return ok && addHostLoads();
+}
+
+// 링크할 때 연 .rel 들을 닫는다. (endFile 에서 부른다)
+void resetLinkedObjects()
+{
+    for (int i = 0; i < linkedObjectCount; i++)
+    {
+        if (linkedObjects[i].mapping != NULL)
+        {
+            munmap(linkedObjects[i].mapping, linkedObjects[i].size);
+        }
+    }
+    linkedObjects = NULL;
+    linkedObjectCount = 0;
+    linkedSourceHash = 0;
+}
+
+// 파일들을 링크해서 프로그램 하나로 실행한다. 출력 파일 이름은 첫 번째 파일로 만든다.
+// 입력 파일마다 만든 .rel 을 지운다. (어셈블이나 링크에 실패하면 소스 옆에 남기지 않는다)
+void removeObjects(char **files, int count)
+{
+    char path[260];
+    for (int i = 0; i < count; i++)
+    {
+        makeOutputName(files[i], ".rel", path, sizeof(path));
+        unlink(path);
+    }
+}
+
+void runLinkedFiles(char **files, int count)
+{
+    StageClock clock;
+
+    resetRunState();
+    beginStage(&clock);
+    bool assembled = assembleObjects(files, count);
+    endStage(STAGE_ASSEMBLE_OBJECTS, &clock);
+
+    if (!assembled)
+    {
+        removeObjects(files, count);
+    }
+    else
+    {
+        beginStage(&clock);
+        bool linked = linkObjects(files, count);
+        endStage(STAGE_LINK, &clock);
+        if (!linked)
+        {
+            printf("Link Error!!\n");
+            removeObjects(files, count);
+        }
+        else
+        {
+            runProgram(files[0]);
+        }
+    }
+
+    printStageTimings(files[0]);
+    endFile();
+}
+
+//
+// 감시 구간!! 시작!! (--watch)
+//
+// 파일 하나를 처리한 뒤 inotify 로 저장될 때마다 다시 처리하고 실행한다. 지난번 소스와 줄 단위로 비교해서
+// 바뀐 줄이 명령어 줄(과 빈 줄)뿐이고 명령어 수가 그대로면, 레이블 주소가 그대로이므로 바뀐 줄만 다시 검사하고
+// 해석하고 인코딩해서 .o 의 그 자리에만 쓴다. (뒤쪽 줄들은 소스 안의 위치만 옮긴다)
+// 레이블, 지시어 줄이 바뀌었거나 명령어 수가 달라졌으면 처음부터 다시 어셈블한다.
+
+#define WATCH_SETTLE_MS 20                   // 마지막 이벤트 뒤 이만큼 조용하면 저장이 끝난 것으로 본다.
+#define WATCH_ARENA_LIMIT (256 * 1024 * 1024) // 바뀐 부분만 고치는 동안 아레나가 이만큼 늘면 처음부터 다시 어셈블한다.
+
+// 지난번 소스의 줄 하나
+typedef struct
+{
+    uint64_t hash;      // 줄 내용의 해시 (줄바꿈 제외)
+    int offset;         // 소스 안의 위치
+    int length;
+    int before;         // 이 줄 앞에 있는 명령어 수 (명령어 줄이면 자기 명령어 번호)
+    unsigned char kind; // LineKind
+} WatchLine;
+
+char *watchSource = NULL;     // 지금 source 가 가리키는 버퍼 (아레나가 아니라 malloc. 다음 소스와 비교해야 하므로)
+WatchLine *watchLines = NULL; // watchSource 의 줄들
+int watchLineCount = 0;
+bool watchAssembled = false;  // 지금 명령어 배열과 .o 가 watchSource 와 맞는지
+size_t watchArenaMark = 0;    // 마지막으로 처음부터 어셈블한 뒤의 아레나 사용량
+
+// 파일 전체를 malloc 한 버퍼로 읽는다. 끝에 널 문자를 붙인다.
+// 열 수 없거나 크기를 모르거나 메모리가 없으면 NULL (편집기가 파일을 지우거나 바꾸는 중일 수 있다)
+char *readWatchedFile(const char *filename, size_t *size)
+{
+    FILE *file = fopen(filename, "rb");
+    if (file == NULL)
+    {
+        return NULL;
+    }
+
+    long length = -1;
+    if (fseek(file, 0, SEEK_END) == 0)
+    {
+        length = ftell(file);
+    }
+    char *buffer = (length >= 0 && fseek(file, 0, SEEK_SET) == 0) ? malloc((size_t)length + 1) : NULL;
+    if (buffer == NULL)
+    {
+        fclose(file);
+        return NULL;
+    }
+
+    *size = fread(buffer, 1, (size_t)length, file);
+    buffer[*size] = '\0';
+    fclose(file);
+    return buffer;
+}
+
+// text 를 줄로 나눠서 줄마다 위치와 해시를 *lines 에 넣는다. 줄 수를 돌려준다. (kind, before 는 아직 채우지 않는다)
+// 메모리가 없으면 -1 (*lines 는 NULL)
+int splitWatchLines(const char *text, size_t size, WatchLine **lines)
+{
+    int capacity = 1024;
+    int count = 0;
+    *lines = malloc(capacity * sizeof(WatchLine));
+    if (*lines == NULL)
+    {
+        return -1;
+    }
+
+    const char *cursor = text;
+    const char *line;
+    int length;
+    while ((line = nextLine(&cursor, text + size, &length)) != NULL)
+    {
+        if (count >= capacity)
+        {
+            WatchLine *grown = realloc(*lines, capacity * 2 * sizeof(WatchLine));
+            if (grown == NULL)
+            {
+                free(*lines);
+                *lines = NULL;
+                return -1;
+            }
+            *lines = grown;
+            capacity *= 2;
+        }
+        (*lines)[count].hash = hashSource(line, length);
+        (*lines)[count].offset = (int)(line - text);
+        (*lines)[count].length = length;
+        count++;
+    }
+    return count;
+}
+
+static inline bool watchLinesEqual(const char *a, const WatchLine *lineA, const char *b, const WatchLine *lineB)
+{
+    return lineA->hash == lineB->hash && lineA->length == lineB->length &&
+           memcmp(a + lineA->offset, b + lineB->offset, lineA->length) == 0;
+}
+
+// 줄마다 종류와 앞에 있는 명령어 수를 채운다. (begin 줄 앞에 명령어가 before 개 있다)
+int classifyWatchLines(const char *text, WatchLine *lines, int begin, int end, int before)
+{
+    for (int i = begin; i < end; i++)
+    {
+        Token labelToken;
+        lines[i].kind = (unsigned char)classifyLine(text + lines[i].offset, lines[i].length, &labelToken);
+        lines[i].before = before;
+        if (lines[i].kind == LINE_INSTRUCTION)
+        {
+            before++;
+        }
+    }
+    return before;
+}
+
+// 명령어 [begin, end) 를 다시 인코딩해서 .o 파일의 그 자리에 쓴다. (.o 를 열 수 없으면 false)
+bool patchObjectFile(const char *filename, int begin, int end)
+{
+    char objectFilename[260];
+    size_t recordSize = objectBinary ? 4 : BINARY_LINE_LENGTH;
+    size_t size = (size_t)(end - begin) * recordSize;
+    char *output = malloc(size + 1);
+
+    for (int i = begin; i < end; i++)
+    {
+        formatObjectWord(output + (size_t)(i - begin) * recordSize, encodeInstruction(&instructions[i]));
+    }
+
+    makeOutputName(filename, ".o", objectFilename, sizeof(objectFilename));
+    int fd = open(objectFilename, O_WRONLY | O_CLOEXEC);
+    bool written = fd >= 0 && pwrite(fd, output, size, (off_t)begin * recordSize) == (ssize_t)size;
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+    free(output);
+    return written;
+}
+
+// 바뀐 줄 [prefix, 뒤에서 suffix 줄 전) 만 고친다. 바뀐 줄이 명령어 줄과 빈 줄뿐이고 명령어 수가 같을 때만 부른다.
+// 다시 인코딩한 명령어 수를 *reencoded 에 넣는다. 에러가 있으면 출력하고 false
+bool patchWatchedSource(const char *filename, char *text, size_t size, WatchLine *lines, int lineCount, int prefix,
+                        int suffix, int *reencoded)
+{
+    int oldEnd = watchLineCount - suffix;
+    int newEnd = lineCount - suffix;
+    int first = (prefix < watchLineCount) ? watchLines[prefix].before : instructionCount;
+    int oldTail = (suffix > 0) ? watchLines[oldEnd].offset : (int)sourceSize;
+    int newTail = (suffix > 0) ? lines[newEnd].offset : (int)size;
+    int delta = newTail - oldTail;
+
+    // 바뀐 줄들을 다시 검사한다.
+    bool ok = true;
+    char message[128];
+    for (int i = prefix; i < newEnd; i++)
+    {
+        if (check_line_for_errors(text + lines[i].offset, lines[i].length, message, sizeof(message)))
+        {
+            printf("line %d: %s\n", i + 1, message);
+            ok = false;
+        }
+    }
+
+    // 뒤쪽 줄들은 내용이 그대로이므로 소스 안의 위치만 옮긴다.
+    int count = classifyWatchLines(text, lines, prefix, newEnd, first) - first;
+    if (delta != 0)
+    {
+        for (int i = first + count; i < instructionCount; i++)
+        {
+            instructions[i].sourceOffset += delta;
+        }
+        for (int i = 0; i < labelCount; i++)
+        {
+            if (labels[i].nameOffset >= oldTail)
+            {
+                labels[i].nameOffset += delta;
+            }
+        }
+        for (int i = 0; i < dataBlockCount; i++)
+        {
+            if (dataBlocks[i].sourceOffset >= oldTail)
+            {
+                dataBlocks[i].sourceOffset += delta;
+            }
+        }
+        for (int i = 0; i < symbolDirectiveCount; i++)
+        {
+            if (symbolDirectives[i].sourceOffset >= oldTail)
+            {
+                symbolDirectives[i].sourceOffset += delta;
+            }
+        }
+    }
+    for (int i = 0; i < suffix; i++)
+    {
+        lines[newEnd + i].kind = watchLines[oldEnd + i].kind;
+        lines[newEnd + i].before = watchLines[oldEnd + i].before;
+    }
+    for (int i = 0; i < prefix; i++)
+    {
+        lines[i].kind = watchLines[i].kind;
+        lines[i].before = watchLines[i].before;
+    }
+
+    // 새 소스로 바꾸고 바뀐 명령어 줄만 다시 해석한다. (주소는 그대로다)
+    source = text;
+    sourceSize = size;
+    for (int i = prefix; ok && i < newEnd; i++)
+    {
+        if (lines[i].kind == LINE_INSTRUCTION &&
+            decodeLine(text + lines[i].offset, lines[i].length, &instructions[lines[i].before]) != DECODE_OK)
+        {
+            ok = false;
+        }
+    }
+    if (!ok)
+    {
+        printf("Syntax Error!!\n");
+        return false;
+    }
+
+    *reencoded = count;
+    if (count > 0 && !patchObjectFile(filename, first, first + count))
+    {
+        return processFile(filename);
+    }
+    return true;
+}
+
+// 파일을 다시 읽어서 바뀐 부분을 어셈블하고 실행한다. 처음 부를 때는 처음부터 어셈블한다.
+// 메모리가 없어서 더 감시할 수 없으면 false (파일을 읽지 못한 것은 다음 저장을 기다리면 되므로 true)
+bool watchFile(const char *filename)
+{
+    long long start = clockNanos(CLOCK_MONOTONIC);
+    size_t size;
+    char *text = readWatchedFile(filename, &size);
+    if (text == NULL)
+    {
+        printf("Input file does not exist!!\n");
+        return true;
+    }
+
+    WatchLine *lines;
+    int lineCount = splitWatchLines(text, size, &lines);
+    if (lineCount < 0)
+    {
+        printf("Memory allocation failed.\n");
+        free(text);
+        return false;
+    }
+
+    // 앞뒤로 같은 줄들을 뺀다.
+    int prefix = 0;
+    int suffix = 0;
+    if (watchSource != NULL)
+    {
+        if (size == sourceSize && memcmp(text, watchSource, size) == 0)
+        {
+            free(text);
+            free(lines);
+            return true;
+        }
+        while (prefix < lineCount && prefix < watchLineCount &&
+               watchLinesEqual(text, &lines[prefix], watchSource, &watchLines[prefix]))
+        {
+            prefix++;
+        }
+        while (suffix < lineCount - prefix && suffix < watchLineCount - prefix &&
+               watchLinesEqual(text, &lines[lineCount - 1 - suffix], watchSource, &watchLines[watchLineCount - 1 - suffix]))
+        {
+            suffix++;
+        }
+    }
+
+    // 바뀐 줄이 명령어 줄과 빈 줄뿐이고 명령어 수가 같아야 바뀐 부분만 고칠 수 있다.
+    bool incremental = watchAssembled && fileArena.used - watchArenaMark < WATCH_ARENA_LIMIT;
+    int oldInstructions = 0;
+    int newInstructions = 0;
+    for (int i = prefix; incremental && i < watchLineCount - suffix; i++)
+    {
+        incremental = watchLines[i].kind == LINE_INSTRUCTION || watchLines[i].kind == LINE_EMPTY;
+        oldInstructions += (watchLines[i].kind == LINE_INSTRUCTION);
+    }
+    for (int i = prefix; incremental && i < lineCount - suffix; i++)
+    {
+        Token labelToken;
+        LineKind kind = classifyLine(text + lines[i].offset, lines[i].length, &labelToken);
+        incremental = kind == LINE_INSTRUCTION || kind == LINE_EMPTY;
+        newInstructions += (kind == LINE_INSTRUCTION);
+    }
+    incremental = incremental && oldInstructions == newInstructions;
+
+    int reencoded = 0;
+    if (incremental)
+    {
+        watchAssembled = patchWatchedSource(filename, text, size, lines, lineCount, prefix, suffix, &reencoded);
+    }
+    else
+    {
+        endFile();
+        source = text;
+        sourceSize = size;
+        resetRunState();
+        watchAssembled = assembleSource(filename) && processFile(filename);
+        reencoded = watchAssembled ? instructionCount : 0;
+        classifyWatchLines(text, lines, 0, lineCount, 0);
+        watchArenaMark = fileArena.used;
+    }
+    free(watchSource);
+    free(watchLines);
+    watchSource = text;
+    watchLines = lines;
+    watchLineCount = lineCount;
+    double assembleMs = (clockNanos(CLOCK_MONOTONIC) - start) / 1e6;
+
+    if (watchAssembled)
+    {
+        resetExecution();
+        resetRunState();
+        simulateProgram(filename);
+        printStageTimings(filename);
+    }
+    printf("watch: %s, %d lines changed, %d instructions re-encoded, assemble %.3f ms, total %.3f ms\n",
+           incremental ? "incremental" : "full", lineCount - prefix - suffix, reencoded, assembleMs,
+           (clockNanos(CLOCK_MONOTONIC) - start) / 1e6);
+    fflush(stdout);
+    return true;
+}
+
+// filename 을 처리한 뒤 저장될 때마다 다시 처리한다. (끝내려면 Ctrl+C)
+// 편집기는 파일을 바로 쓰기도 하고 임시 파일에 쓴 뒤 rename 하기도 하므로, 파일이 아니라 디렉터리를 지켜본다.
+int runWatch(const char *filename)
+{
+    char directory[260];
+    const char *slash = strrchr(filename, '/');
+    const char *base = (slash != NULL) ? slash + 1 : filename;
+    if (slash == NULL)
+    {
+        snprintf(directory, sizeof(directory), ".");
+    }
+    else
+    {
+        snprintf(directory, sizeof(directory), "%.*s", (slash == filename) ? 1 : (int)(slash - filename), filename);
+    }
+
+    int fd = inotify_init1(IN_CLOEXEC);
+    if (fd < 0 || inotify_add_watch(fd, directory, IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+    {
+        printf("we can't watch %s\n", filename);
+        return 1;
+    }
+
+    if (!watchFile(filename))
+    {
+        close(fd);
+        return 1;
+    }
+    char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    while (1)
+    {
+        // 이 파일의 이벤트가 오면, 이벤트가 WATCH_SETTLE_MS 동안 더 오지 않을 때까지 기다렸다가 한 번만 처리한다.
+        bool changed = false;
+        while (1)
+        {
+            struct pollfd waitFd = {fd, POLLIN, 0};
+            int ready = poll(&waitFd, 1, changed ? WATCH_SETTLE_MS : -1);
+            if (ready < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (ready <= 0)
+            {
+                break;
+            }
+
+            ssize_t length = read(fd, events, sizeof(events));
+            if (length <= 0)
+            {
+                close(fd);
+                return 1;
+            }
+            for (char *p = events; p < events + length;)
+            {
+                const struct inotify_event *event = (const struct inotify_event *)p;
+                if (event->len > 0 && strcmp(event->name, base) == 0)
+                {
+                    changed = true;
+                }
+                p += sizeof(struct inotify_event) + event->len;
+            }
+        }
+        if (changed && !watchFile(filename))
+        {
+            close(fd);
+            return 1;
+        }
+    }
+}
+
+//
+// 파이프라인 구간!! 시작!! (--pipeline)
+//
+// 파일 여러 개를 처리할 때 읽기, 계산, 쓰기를 겹친다. 읽기 스레드가 다음 파일들을 미리 읽어두고,
+// 메인 스레드가 지금 파일을 계산하는 동안 쓰기 스레드가 앞 파일의 .o/.trace 를 쓴다.
+// 단계 사이에는 크기가 정해진 큐를 둬서, 앞 단계가 너무 앞서가면 기다리게 한다. (메모리를 일정하게 쓰기 위해)
+// 계산 단계는 전역 상태를 쓰므로 파일 하나씩만 한다.
+
+// 크기가 정해진 큐. 가득 차면 넣는 쪽이, 비어있으면 빼는 쪽이 기다린다.
+typedef struct
+{
+    void *items[PIPELINE_QUEUE_SIZE];
+    int head;
+    int count;
+    bool closed; // 더 넣을 것이 없다
+    pthread_mutex_t lock;
+    pthread_cond_t notEmpty;
+    pthread_cond_t notFull;
+} BoundedQueue;
+
+// 쓰기 스레드가 할 일. data 는 malloc 으로 잡은 것이고 쓰기 스레드가 free 한다.
+typedef struct
+{
+    char path[300];
+    char *data;
+    size_t size;
+    bool append;     // true 면 이어 쓴다. (긴 trace 를 나눠서 넘길 때)
+    bool removeFile; // true 면 파일을 지운다.
+} WriteJob;
+
+BoundedQueue readQueue;
+BoundedQueue writeQueue;
+
+void queueInit(BoundedQueue *queue)
+{
+    queue->head = 0;
+    queue->count = 0;
+    queue->closed = false;
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->notEmpty, NULL);
+    pthread_cond_init(&queue->notFull, NULL);
+}
+
+void queueDestroy(BoundedQueue *queue)
+{
+    pthread_mutex_destroy(&queue->lock);
+    pthread_cond_destroy(&queue->notEmpty);
+    pthread_cond_destroy(&queue->notFull);
+}
+
+void queuePush(BoundedQueue *queue, void *item)
+{
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == PIPELINE_QUEUE_SIZE)
+    {
+        pthread_cond_wait(&queue->notFull, &queue->lock);
+    }
+    queue->items[(queue->head + queue->count) % PIPELINE_QUEUE_SIZE] = item;
+    queue->count++;
+    pthread_cond_signal(&queue->notEmpty);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+// 하나 뺀다. 닫혔고 비어있으면 NULL
+void *queuePop(BoundedQueue *queue)
+{
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == 0 && !queue->closed)
+    {
+        pthread_cond_wait(&queue->notEmpty, &queue->lock);
+    }
+    void *item = NULL;
+    if (queue->count > 0)
+    {
+        item = queue->items[queue->head];
+        queue->head = (queue->head + 1) % PIPELINE_QUEUE_SIZE;
+        queue->count--;
+        pthread_cond_signal(&queue->notFull);
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return item;
+}
+
+void queueClose(BoundedQueue *queue)
+{
+    pthread_mutex_lock(&queue->lock);
+    queue->closed = true;
+    pthread_cond_broadcast(&queue->notEmpty);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+// 쓰기 스레드에 일을 넘긴다. 큐가 가득 차 있으면 기다린다.
+void submitWrite(const char *path, char *data, size_t size, bool append, bool removeFile)
+{
+    WriteJob *job = malloc(sizeof(WriteJob));
+    snprintf(job->path, sizeof(job->path), "%s", path);
+    job->data = data;
+    job->size = size;
+    job->append = append;
+    job->removeFile = removeFile;
+    queuePush(&writeQueue, job);
+}
+
+// 쓰기 스레드. 넘겨받은 순서대로 쓰므로 같은 파일에 이어 쓰는 것도 순서가 지켜진다.
+void *writerThread(void *argument)
+{
+    (void)argument;
+    WriteJob *job;
+    while ((job = queuePop(&writeQueue)) != NULL)
+    {
+        if (job->removeFile)
+        {
+            remove(job->path);
+        }
+        else
+        {
+            FILE *file = fopen(job->path, job->append ? "a" : "w");
+            if (file == NULL)
+            {
+                printf("we can't open the file\n");
+            }
+            else
+            {
+                fwrite(job->data, 1, job->size, file);
+                fclose(file);
+            }
+        }
+        free(job->data);
+        free(job);
+    }
+    return NULL;
+}
+
+// 읽기 스레드가 읽을 파일 목록
+typedef struct
+{
+    char **files;
+    int count;
+} ReadList;
+
+// 읽기 스레드. 파일을 차례대로 통째로 읽어서 큐에 넣는다.
+void *readerThread(void *argument)
+{
+    ReadList *list = (ReadList *)argument;
+    for (int i = 0; i < list->count; i++)
+    {
+        ReadItem *item = malloc(sizeof(ReadItem));
+        item->filename = list->files[i];
+        item->buffer = NULL;
+        item->size = 0;
+
+        int file = open(list->files[i], O_RDONLY);
+        struct stat info;
+        if (file >= 0 && fstat(file, &info) == 0 && S_ISREG(info.st_mode))
+        {
+            item->buffer = malloc((size_t)info.st_size + 1);
+            size_t received = 0;
+            ssize_t readSize;
+            while (received < (size_t)info.st_size &&
+                   (readSize = read(file, item->buffer + received, (size_t)info.st_size - received)) > 0)
+            {
+                received += (size_t)readSize;
+            }
+            item->buffer[received] = '\0';
+            item->size = received;
+        }
+        if (file >= 0)
+        {
+            close(file);
+        }
+        queuePush(&readQueue, item);
+    }
+    queueClose(&readQueue);
+    return NULL;
+}
+
+// --pipeline. 읽기/쓰기 스레드를 띄우고 메인 스레드는 계산만 한다.
+void runPipeline(char **files, int count)
+{
+    pthread_t reader;
+    pthread_t writer;
+    ReadList list = {files, count};
+
+    queueInit(&readQueue);
+    queueInit(&writeQueue);
+    pthread_create(&reader, NULL, readerThread, &list);
+    pthread_create(&writer, NULL, writerThread, NULL);
+
+    ReadItem *item;
+    while ((item = queuePop(&readQueue)) != NULL)
+    {
+        prefetchedSource = item;
+        runFile(item->filename);
+        prefetchedSource = NULL;
+        free(item->buffer);
+        free(item);
+    }
+
+    // 남은 쓰기가 다 끝날 때까지 기다린다.
+    queueClose(&writeQueue);
+    pthread_join(reader, NULL);
+    pthread_join(writer, NULL);
+    queueDestroy(&readQueue);
+    queueDestroy(&writeQueue);
+}
+
+//
+// 디스어셈블러 구간!! 시작!! (--disassemble)
+//
+// processFile 이 만든 .o (33글자 이진수 줄 형식과 --object-format binary 의 4바이트 형식)를 다시 어셈블리로 바꾼다.
+// 파일은 mmap 으로 읽고, 두 번 훑는다. 처음에는 분기 대상에 레이블 표시만 하고, 다음에는 구간마다 스레드가 글자를 만든다.
+// 큰 파일에서도 메모리를 일정하게 쓰도록 두 번째는 DISASSEMBLE_WINDOW 씩 끊어서 쓴다.
+
+// (opcode 번호, funct3, funct7) -> instructionTable 위치 + 1. opcode 번호는 opcodeIds 로 0x7F 를 작은 수로 줄인 것
+unsigned char opcodeIds[128];
+short decodeLookup[16][8][128];
+int opcodeIdCount = 0;
+int exitInstructionIndex = -1;
+
+// instructionTable 로 해석표를 만든다. 형식에 없는 필드(funct3, funct7)는 모든 값을 같은 명령어로 채운다.
+void initDecodeLookup()
+{
+    if (opcodeIdCount > 0)
+    {
+        return;
+    }
+    for (int i = 0; instructionTable[i].instName != NULL; i++)
+    {
+        const InstructionInfo *info = &instructionTable[i];
+        if (info->type == EXIT_TYPE)
+        {
+            exitInstructionIndex = i;
+            continue;
+        }
+        if (info->type == CSR_TYPE)
+        {
+            continue; // CSR 번호는 funct7 보다 넓으므로 decodeWord 에서 따로 찾는다.
+        }
+        if (isLoadAddress(info))
+        {
+            continue; // la 는 addi 와 같은 기계어이므로 addi 로 되돌린다.
+        }
+        if (opcodeIds[info->opcode] == 0)
+        {
+            opcodeIds[info->opcode] = (unsigned char)++opcodeIdCount;
+        }
+
+        bool isShift = (info->type == I_TYPE && operandFormat(info) != OPERANDS_REG_OFFSET_BASE &&
+                        (info->funct3 == 0x1 || info->funct3 == 0x5));
+        bool useFunct3 = (info->type != J_TYPE);
+        bool useFunct7 = (info->type == R_TYPE || info->type == A_TYPE || isShift);
+        for (int funct3 = 0; funct3 < 8; funct3++)
+        {
+            for (int funct7 = 0; funct7 < 128; funct7++)
+            {
+                if ((!useFunct3 || funct3 == (int)info->funct3) && (!useFunct7 || funct7 == (int)info->funct7))
+                {
+                    decodeLookup[opcodeIds[info->opcode]][funct3][funct7] = (short)(i + 1);
+                }
+            }
+        }
+    }
+}
+
+// 32비트 값을 address 에 있던 명령어로 되돌린다. 해석표에 없는 값이면 false
+// 분기/점프는 target 에 대상 주소를 넣는다. (jal 은 encodeInstruction 처럼 offset 의 비트 1~19 만 들어있다)
+bool decodeWord(unsigned int word, int address, Instruction *instr)
+{
+    memset(instr, 0, sizeof(*instr));
+    instr->address = address;
+    instr->target = -1;
+    if (word == 0xFFFFFFFF)
+    {
+        instr->infoIndex = (short)exitInstructionIndex;
+        return true;
+    }
+    if ((word & 0x7F) == 0x73)
+    {
+        // 카운터 CSR 읽기는 rs1 이 x0 이고 CSR 번호가 표에 있어야 한다. (ecall 은 0x00000073 하나뿐이다)
+        for (int i = 0; instructionTable[i].instName != NULL; i++)
+        {
+            const InstructionInfo *info = &instructionTable[i];
+            if (info->type == CSR_TYPE && info->funct3 == ((word >> 12) & 0x7) && info->funct7 == (word >> 20) &&
+                ((word >> 15) & 0x1F) == 0 && (info->funct3 != 0x0 || word == 0x73))
+            {
+                instr->infoIndex = (short)i;
+                instr->rd = (word >> 7) & 0x1F;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    int id = opcodeIds[word & 0x7F];
+    int index = (id == 0) ? 0 : decodeLookup[id][(word >> 12) & 0x7][word >> 25];
+    if (index == 0)
+    {
+        return false;
+    }
+
+    const InstructionInfo *info = &instructionTable[index - 1];
+    instr->infoIndex = (short)(index - 1);
+    instr->rd = (word >> 7) & 0x1F;
+    instr->rs1 = (word >> 15) & 0x1F;
+    instr->rs2 = (word >> 20) & 0x1F;
+    switch (info->type)
+    {
+    case I_TYPE:
+        if (operandFormat(info) != OPERANDS_REG_OFFSET_BASE && (info->funct3 == 0x1 || info->funct3 == 0x5))
+        {
+            instr->imm = (int)((word >> 20) & 0x1F);
+        }
+        else
+        {
+            instr->imm = (int)word >> 20;
+        }
+        break;
+    case S_TYPE:
+        instr->imm = (((int)word >> 25) << 5) | (int)((word >> 7) & 0x1F);
+        break;
+    case SB_TYPE:
+        instr->target = address + ((((int)word >> 31) << 12) | (int)(((word >> 7) & 0x1) << 11) |
+                                   (int)(((word >> 25) & 0x3F) << 5) | (int)(((word >> 8) & 0xF) << 1));
+        break;
+    case J_TYPE:
+    {
+        unsigned int offset = (((word >> 21) & 0x3FF) << 1) | (((word >> 20) & 0x1) << 11) | (((word >> 12) & 0xFF) << 12);
+        instr->target = address + ((int)(offset << 12) >> 12);
+        break;
+    }
+    default:
+        break;
+    }
+    return true;
+}
+
+// 열어둔 .o 파일
+typedef struct
+{
+    const unsigned char *data;
+    long long count; // 명령어 수
+    bool text;       // true 면 33글자 줄 형식, false 면 4바이트(리틀 엔디언) 형식
+    unsigned char *isTarget; // 명령어마다 분기 대상인지
+} ObjectImage;
+
+// i 번째 명령어의 32비트 값. 줄 형식에서 0/1 이 아닌 글자가 있으면 valid 를 false 로 둔다.
+static inline unsigned int objectWord(const ObjectImage *image, long long i, bool *valid)
+{
+    if (!image->text)
+    {
+        const unsigned char *p = image->data + i * 4;
+        return (unsigned int)p[0] | ((unsigned int)p[1] << 8) | ((unsigned int)p[2] << 16) | ((unsigned int)p[3] << 24);
+    }
+
+    const unsigned char *p = image->data + i * BINARY_LINE_LENGTH;
+    unsigned int word = 0;
+    unsigned int bad = (p[32] != '\n');
+    for (int b = 0; b < 32; b++)
+    {
+        unsigned int bit = (unsigned int)(p[b] - '0');
+        bad |= bit >> 1;
+        word = (word << 1) | (bit & 1);
+    }
+    if (bad)
+    {
+        *valid = false;
+    }
+    return word;
+}
+
+// 디스어셈블 스레드 하나가 맡는 구간
+typedef struct
+{
+    const ObjectImage *image;
+    long long begin;
+    long long end;
+    bool valid;        // 첫 번째 훑기에서 이상한 줄이 없었는지
+    char *text;        // 두 번째 훑기에서 만든 글자
+    size_t length;
+    long long unknown; // 해석표에 없는 값의 수
+} DisassembleChunk;
+
+// 첫 번째 훑기. 분기/점프 대상에 표시만 한다. (같은 칸에 1을 쓰는 것뿐이라 relaxed 로 충분하다)
+void *markTargetsWorker(void *argument)
+{
+    DisassembleChunk *chunk = (DisassembleChunk *)argument;
+    const ObjectImage *image = chunk->image;
+    chunk->valid = true;
+
+    for (long long i = chunk->begin; i < chunk->end; i++)
+    {
+        Instruction instr;
+        unsigned int word = objectWord(image, i, &chunk->valid);
+        if (decodeWord(word, (int)(1000 + i * 4), &instr) && instr.target >= 1000 && (instr.target - 1000) % 4 == 0 &&
+            (instr.target - 1000) / 4 < image->count)
+        {
+            __atomic_store_n(&image->isTarget[(instr.target - 1000) / 4], 1, __ATOMIC_RELAXED);
+        }
+    }
+    return NULL;
+}
+
+// 글자를 붙이는 작은 함수들. snprintf 보다 훨씬 빠르다.
+static inline char *putText(char *out, const char *text)
+{
+    while (*text != '\0')
+    {
+        *out++ = *text++;
+    }
+    return out;
+}
+
+static inline char *putNumber(char *out, long long value)
+{
+    char digits[24];
+    int count = 0;
+    unsigned long long magnitude = (value < 0) ? 0ULL - (unsigned long long)value : (unsigned long long)value;
+    if (value < 0)
+    {
+        *out++ = '-';
+    }
+    do
+    {
+        digits[count++] = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude > 0);
+    while (count > 0)
+    {
+        *out++ = digits[--count];
+    }
+    return out;
+}
+
+static inline char *putRegister(char *out, int reg)
+{
+    *out++ = 'x';
+    return putNumber(out, reg);
+}
+
+// 분기 대상. 프로그램 안이면 레이블, 밖이면 어셈블러가 같은 값으로 인코딩하는 숫자(offset / 2)로 쓴다.
+static inline char *putTarget(char *out, const ObjectImage *image, const Instruction *instr)
+{
+    long long index = (instr->target - 1000) / 4;
+    if (instr->target >= 1000 && (instr->target - 1000) % 4 == 0 && index < image->count)
+    {
+        *out++ = 'L';
+        return putNumber(out, instr->target);
+    }
+    return putNumber(out, (instr->target - instr->address) / 2);
+}
+
+// 명령어 한 줄을 쓴다. 어셈블러가 그대로 받아들이는 형식이다.
+char *formatDisassembly(char *out, const ObjectImage *image, const Instruction *instr)
+{
+    const InstructionInfo *info = &instructionTable[instr->infoIndex];
+    out = putText(out, "    ");
+    out = putText(out, info->instName);
+    switch (operandFormat(info))
+    {
+    case OPERANDS_NONE:
+        break;
+    case OPERANDS_REG:
+        out = putRegister(putText(out, " "), instr->rd);
+        break;
+    case OPERANDS_REG_REG_REG:
+        out = putRegister(putText(out, " "), instr->rd);
+        out = putRegister(putText(out, ", "), instr->rs1);
+        out = putRegister(putText(out, ", "), instr->rs2);
+        break;
+    case OPERANDS_REG_REG_IMM:
+        out = putRegister(putText(out, " "), instr->rd);
+        out = putRegister(putText(out, ", "), instr->rs1);
+        out = putNumber(putText(out, ", "), instr->imm);
+        break;
+    case OPERANDS_REG_OFFSET_BASE:
+        out = putRegister(putText(out, " "), (info->type == S_TYPE) ? instr->rs2 : instr->rd);
+        out = putNumber(putText(out, ", "), instr->imm);
+        out = putText(putRegister(putText(out, "("), instr->rs1), ")");
+        break;
+    case OPERANDS_REG_REG_TARGET:
+        out = putRegister(putText(out, " "), instr->rs1);
+        out = putRegister(putText(out, ", "), instr->rs2);
+        out = putTarget(putText(out, ", "), image, instr);
+        break;
+    case OPERANDS_REG_TARGET:
+        out = putRegister(putText(out, " "), instr->rd);
+        out = putTarget(putText(out, ", "), image, instr);
+        break;
+    case OPERANDS_REG_ADDRESS:
+        out = putRegister(putText(out, " "), instr->rd);
+        out = putText(putRegister(putText(out, ", ("), instr->rs1), ")");
+        break;
+    case OPERANDS_REG_REG_ADDRESS:
+        out = putRegister(putText(out, " "), instr->rd);
+        out = putRegister(putText(out, ", "), instr->rs2);
+        out = putText(putRegister(putText(out, ", ("), instr->rs1), ")");
+        break;
+    }
+    *out++ = '\n';
+    return out;
+}
+
+// 두 번째 훑기. 구간의 명령어를 글자로 만든다. 분기 대상이면 앞에 "L주소:" 줄을 둔다.
+void *formatChunkWorker(void *argument)
+{
+    DisassembleChunk *chunk = (DisassembleChunk *)argument;
+    const ObjectImage *image = chunk->image;
+    char *out = chunk->text;
+    bool valid = true;
+
+    for (long long i = chunk->begin; i < chunk->end; i++)
+    {
+        Instruction instr;
+        int address = (int)(1000 + i * 4);
+        unsigned int word = objectWord(image, i, &valid);
+
+        if (image->isTarget[i])
+        {
+            *out++ = 'L';
+            out = putText(putNumber(out, address), ":\n");
+        }
+        if (decodeWord(word, address, &instr))
+        {
+            out = formatDisassembly(out, image, &instr);
+        }
+        else
+        {
+            // 해석할 수 없는 값은 '#' 줄로 남긴다. (다시 어셈블하면 에러가 나므로 round-trip 에서 드러난다)
+            static const char hex[] = "0123456789abcdef";
+            out = putText(out, "    # unknown 0x");
+            for (int shift = 28; shift >= 0; shift -= 4)
+            {
+                *out++ = hex[(word >> shift) & 0xF];
+            }
+            *out++ = '\n';
+            chunk->unknown++;
+        }
+    }
+    chunk->length = (size_t)(out - chunk->text);
+    return NULL;
+}
+
+// chunkCount 개의 구간을 스레드로 돌린다.
+void runDisassembleChunks(DisassembleChunk *chunks, int chunkCount, void *(*worker)(void *))
+{
+    pthread_t threads[MAX_THREADS];
+    if (chunkCount == 1)
+    {
+        worker(&chunks[0]);
+        return;
+    }
+    for (int i = 0; i < chunkCount; i++)
+    {
+        pthread_create(&threads[i], NULL, worker, &chunks[i]);
+    }
+    for (int i = 0; i < chunkCount; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+}
+
+// 소스 파일 하나를 어셈블해서 명령어마다 32비트 값을 malloc 한 배열로 돌려준다. (-O 면 최적화한 결과)
+// 에러가 있으면 NULL. 전역 상태를 쓰므로 끝나면 endFile 로 비운다.
+unsigned int *assembleWords(const char *filename, long long *count)
+{
+    unsigned int *words = NULL;
+    pc = 1000;
+    if (!loadSource(filename))
+    {
+        printf("round-trip: %s does not exist\n", filename);
+    }
+    else if (check_file_for_errors() || firstPass() || !loadInstructions())
+    {
+        printf("round-trip: %s has syntax errors\n", filename);
+    }
+    else
+    {
+        if (optimizeEnabled)
+        {
+            optimizeProgram();
+        }
+        words = malloc(((size_t)instructionCount + 1) * sizeof(unsigned int));
+        for (int i = 0; i < instructionCount; i++)
+        {
+            words[i] = encodeInstruction(&instructions[i]);
+        }
+        *count = instructionCount;
+    }
+    endFile();
+    return words;
+}
+
+// 두 결과를 비교해서 처음 다른 곳을 출력한다.
+bool compareWords(const char *objectName, const char *otherName, const ObjectImage *image, const unsigned int *words,
+                  long long count)
+{
+    bool valid = true;
+    long long limit = (count < image->count) ? count : image->count;
+    for (long long i = 0; i < limit; i++)
+    {
+        unsigned int expected = objectWord(image, i, &valid);
+        if (words[i] != expected)
+        {
+            printf("round-trip: %s differs from %s at %lld (%08x vs %08x)\n", otherName, objectName, 1000 + i * 4,
+                   words[i], expected);
+            return false;
+        }
+    }
+    if (count != image->count)
+    {
+        printf("round-trip: %s has %lld instructions, %s has %lld\n", otherName, count, objectName, image->count);
+        return false;
+    }
+    return true;
+}
+
+// .o 파일 하나를 파일명.dis 로 디스어셈블한다. roundTripCheck 면 파일명.s 와 파일명.dis 를 다시 어셈블해서 .o 와 비교한다.
+bool disassembleFile(const char *filename)
+{
+    initDecodeLookup();
+
+    int file = open(filename, O_RDONLY);
+    struct stat info;
+    if (file < 0 || fstat(file, &info) != 0)
+    {
+        printf("Input file does not exist!!\n");
+        if (file >= 0)
+        {
+            close(file);
+        }
+        return false;
+    }
+
+    size_t size = (size_t)info.st_size;
+    const unsigned char *data = (size > 0) ? mmap(NULL, size, PROT_READ, MAP_PRIVATE, file, 0) : NULL;
+    close(file);
+    if (size > 0 && data == MAP_FAILED)
+    {
+        printf("we can't open the file\n");
+        return false;
+    }
+    if (size > 0)
+    {
+        madvise((void *)data, size, MADV_SEQUENTIAL);
+    }
+
+    // 처음 줄이 "0/1 32글자 + 줄바꿈" 이면 줄 형식, 아니면 4바이트 형식으로 본다.
+    ObjectImage image;
+    image.data = data;
+    image.text = (size == 0) || (size >= BINARY_LINE_LENGTH && data[BINARY_LINE_LENGTH - 1] == '\n' &&
+                                 strspn((const char *)data, "01") >= BINARY_LINE_LENGTH - 1);
+    size_t unit = image.text ? BINARY_LINE_LENGTH : 4;
+    if (size % unit != 0)
+    {
+        printf("%s is not a valid object file\n", filename);
+        munmap((void *)data, size);
+        return false;
+    }
+    image.count = (long long)(size / unit);
+    image.isTarget = calloc((size_t)image.count + 1, 1);
+
+    // 첫 번째 훑기: 레이블 자리 표시
+    DisassembleChunk chunks[MAX_THREADS];
+    int chunkCount = decideThreadCount(image.count, DISASSEMBLE_CHUNK_MIN_WORDS);
+    bool valid = true;
+    for (int i = 0; i < chunkCount; i++)
+    {
+        chunks[i].image = &image;
+        chunks[i].begin = image.count * i / chunkCount;
+        chunks[i].end = image.count * (i + 1) / chunkCount;
+    }
+    runDisassembleChunks(chunks, chunkCount, markTargetsWorker);
+    for (int i = 0; i < chunkCount; i++)
+    {
+        valid = valid && chunks[i].valid;
+    }
+    if (!valid)
+    {
+        printf("%s is not a valid object file\n", filename);
+        free(image.isTarget);
+        munmap((void *)data, size);
+        return false;
+    }
+
+    // 두 번째 훑기: DISASSEMBLE_WINDOW 개씩 스레드들이 나눠서 글자를 만들고 순서대로 쓴다.
+    char outputFilename[260];
+    makeOutputName(filename, ".dis", outputFilename, sizeof(outputFilename));
+    FILE *output = fopen(outputFilename, "w");
+    if (output == NULL)
+    {
+        printf("we can't open the file\n");
+        free(image.isTarget);
+        munmap((void *)data, size);
+        return false;
+    }
+
+    long long windowWords = (long long)chunkCount * DISASSEMBLE_WINDOW;
+    long long perChunk = DISASSEMBLE_WINDOW;
+    long long unknown = 0;
+    long long labelCountFound = 0;
+    for (int i = 0; i < chunkCount; i++)
+    {
+        chunks[i].text = malloc((size_t)perChunk * DISASSEMBLE_MAX_LINE);
+        chunks[i].unknown = 0;
+    }
+    for (long long start = 0; start < image.count; start += windowWords)
+    {
+        long long end = (start + windowWords < image.count) ? start + windowWords : image.count;
+        for (int i = 0; i < chunkCount; i++)
+        {
+            chunks[i].begin = start + (end - start) * i / chunkCount;
+            chunks[i].end = start + (end - start) * (i + 1) / chunkCount;
+        }
+        runDisassembleChunks(chunks, chunkCount, formatChunkWorker);
+        for (int i = 0; i < chunkCount; i++)
+        {
+            fwrite(chunks[i].text, 1, chunks[i].length, output);
+        }
+    }
+    fclose(output);
+    for (int i = 0; i < chunkCount; i++)
+    {
+        unknown += chunks[i].unknown;
+        free(chunks[i].text);
+    }
+    for (long long i = 0; i < image.count; i++)
+    {
+        labelCountFound += image.isTarget[i];
+    }
+    printf("disassemble: %s -> %s (%lld instructions, %s format, %lld labels, %lld unknown)\n", filename, outputFilename,
+           image.count, image.text ? "text" : "binary", labelCountFound, unknown);
+
+    // round-trip: 원래 소스와 디스어셈블 결과를 다시 어셈블해서 .o 와 같은지 본다.
+    bool ok = true;
+    if (roundTripCheck)
+    {
+        char sourceFilename[260];
+        makeOutputName(filename, ".s", sourceFilename, sizeof(sourceFilename));
+        const char *names[2] = {sourceFilename, outputFilename};
+        for (int i = 0; i < 2; i++)
+        {
+            long long count = 0;
+            unsigned int *words = assembleWords(names[i], &count);
+            ok = ok && words != NULL && compareWords(filename, names[i], &image, words, count);
+            free(words);
+        }
+        printf("round-trip: %s %s\n", filename, ok ? "ok" : "FAILED");
+    }
+
+    free(image.isTarget);
+    if (size > 0)
+    {
+        munmap((void *)data, size);
+    }
+    return ok;
+}
+
+// 사용법을 출력한다.
+void printUsage(const char *programName)
+{
+    printf("usage: %s [options] [file.s ...]\n", programName);
+    printf("  file.s 를 주면 차례대로 처리하고 끝난다. 주지 않으면 파일 이름을 입력받는다.\n");
+    printf("  --checkpoint-interval N   N step 마다 체크포인트를 쓴다.\n");
+    printf("  --checkpoint-file PATH    체크포인트 파일 이름 (기본값: 파일명.ckpt)\n");
+    printf("  --max-steps N             N step 까지만 실행하고 체크포인트를 남긴다.\n");
+    printf("  --restore PATH            체크포인트에서 이어서 실행한다.\n");
+    printf("  --threads N               에러 체크/인코딩에 쓸 스레드 수 (기본값: CPU 개수)\n");
+    printf("  --fast-forward N          처음 N step은 trace/통계 없이 기능 모드로만 실행한다.\n");
+    printf("  --sample M                fast-forward 뒤 M step을 상세 모드로 실행하고 구간 통계를 출력한다.\n");
+    printf("  --sample-period P         P step 마다 상세 구간을 반복한다. (P >= M)\n");
+    printf("  --harts N                 N 개의 하트를 각자 스레드에서 같은 메모리로 실행한다. (하트마다 파일명.hartN.trace)\n");
+    printf("  --hart-entry L0,L1,...    하트마다 시작할 레이블 (없으면 프로그램 처음에서 시작, x10 = 하트 번호)\n");
+    printf("  --inputs FILE             FILE 의 줄마다(x1 x2 ... 값) 인스턴스를 만들어 lockstep 으로 실행한다. (파일명.instN.trace)\n");
+    printf("  --digest                  --inputs 에서 trace 대신 인스턴스마다 trace 해시를 파일명.digest 에 남긴다.\n");
+    printf("  -O, --optimize            인코딩과 실행 전에 상수 전파, 죽은 쓰기/빈 명령어/다음으로 가는 분기 제거를 한다.\n");
+    printf("  --compare-dynamic         -O 전후로 실행한 명령어 수를 비교해서 출력한다.\n");
+    printf("  --ilp                     블록마다 def-use 사슬, critical path, ILP 와 실행 흐름의 dataflow 한계를 파일명.ilp 에 쓴다.\n");
+    printf("  --daemon PATH             유닉스 소켓 PATH 에서 'file PATH [옵션]' / 'source NAME SIZE [옵션]' 요청을 받는다.\n");
+    printf("  --workers N               데몬이 미리 띄워둘 워커 프로세스 수 (기본값: CPU 개수)\n");
+    printf("  --pipeline                파일 여러 개를 줄 때 다음 파일 읽기, 계산, 앞 파일 쓰기를 각자 스레드에서 겹쳐서 한다.\n");
+    printf("  --link                    입력 파일마다 파일명.rel 로 어셈블해서(.globl/.extern) 프로그램 하나로 링크한다. (출력은 첫 파일 이름)\n");
+    printf("                            .rel 은 소스 옆에 만들어서 남겨두고, 어셈블이나 링크에 실패하면 지운다.\n");
+    printf("  --watch                   입력 파일 하나를 처리한 뒤 저장될 때마다 바뀐 줄만 다시 어셈블해서 .o 를 고치고 다시 실행한다.\n");
+    printf("  --time-travel N           상세 모드 실행을 기록하고(N step 마다 스냅숏), 끝난 뒤 step-back, run-back-to-pc 같은 명령어로 지난 step 을 오간다.\n");
+    printf("  --snapshot-keep K         --time-travel 에서 남겨둘 스냅숏 수 (기본값: 64, 넘으면 오래된 기록부터 버린다)\n");
+    printf("  --mtrace                  상세 모드에서 실행한 lw/sw 를 파일명.mtrace 에 이진 레코드(step, pc, 주소, 값, r/w)로 남긴다.\n");
+    printf("  --stats                   상세 모드의 명령어별/유형별 실행 횟수, 분기 결과, load/store, 메모리를 파일명.stats(.json) 에 쓴다.\n");
+    printf("  --load FILE@ADDR          FILE 을 mmap 해서 메모리 ADDR 부터 4바이트씩 넣는다. (여러 번 쓸 수 있다)\n");
+    printf("  --io-dir DIR              ecall 의 open 으로 DIR 안의 파일을 열 수 있게 한다. (read/write/close/exit/brk 는 항상 된다)\n");
+    printf("  --profile                 jal x1 을 호출, jalr x0, 0(x1) 을 반환으로 보고 함수별 포함/자기 명령어 수를 파일명.prof 에, 스택별 횟수를 파일명.folded 에 쓴다.\n");
+    printf("  --dump                    끝났을 때 레지스터와 저장한 메모리를 파일명.dump 에 쓴다. (memdump_tool 로 읽는다)\n");
+    printf("  --timing                  파일마다 단계별 wall/CPU 시간, 할당한 바이트 수, 최대 RSS 를 출력한다.\n");
+    printf("  --timing-json PATH        --timing 결과를 단계마다 JSON 한 줄씩 PATH 에 붙여 쓴다.\n");
+    printf("  --object-format F         .o 형식. text (기본값, 33글자 줄) 또는 binary (명령어마다 4바이트)\n");
+    printf("  --trace-format F          .trace 형식. text (기본값, 줄마다 pc) 또는 binary (머리 + pc 마다 4바이트)\n");
+    printf("  --disassemble             입력 파일을 .o 로 보고 파일명.dis 에 어셈블리를 쓴다.\n");
+    printf("  --round-trip              --disassemble 에서 파일명.s 와 파일명.dis 를 다시 어셈블해서 .o 와 비교한다.\n");
+}
+
+// 실행 옵션 하나를 읽는다. 읽었으면 마지막으로 쓴 인자 위치를, 실행 옵션이 아니면 -1 을 돌려준다.
+// 명령줄과 데몬 요청이 같이 쓴다.
+int parseOption(int argc, char *argv[], int i)
+{
+    if (strcmp(argv[i], "--checkpoint-interval") == 0 && i + 1 < argc)
+    {
+        checkpointInterval = atoll(argv[++i]);
+    }
+    else if (strcmp(argv[i], "--checkpoint-file") == 0 && i + 1 < argc)
+    {
+        checkpointOption = argv[++i];
+    }
+    else if (strcmp(argv[i], "--max-steps") == 0 && i + 1 < argc)
+    {
+        maxSteps = atoll(argv[++i]);
+    }
+    else if (strcmp(argv[i], "--restore") == 0 && i + 1 < argc)
+    {
+        restorePath = argv[++i];
+    }
+    else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+    {
+        threadCount = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "--fast-forward") == 0 && i + 1 < argc)
+    {
+        fastForwardSteps = atoll(argv[++i]);
+    }
+    else if (strcmp(argv[i], "--sample") == 0 && i + 1 < argc)
+    {
+        sampleSteps = atoll(argv[++i]);
+    }
+    else if (strcmp(argv[i], "--sample-period") == 0 && i + 1 < argc)
+    {
+        samplePeriod = atoll(argv[++i]);
+    }
+    else if (strcmp(argv[i], "--harts") == 0 && i + 1 < argc)
+    {
+        hartCount = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "--hart-entry") == 0 && i + 1 < argc)
+    {
+        hartEntryOption = argv[++i];
+    }
+    else if (strcmp(argv[i], "--inputs") == 0 && i + 1 < argc)
+    {
+        inputsPath = argv[++i];
+    }
+    else if (strcmp(argv[i], "--digest") == 0)
+    {
+        digestOnly = true;
+    }
+    else if (strcmp(argv[i], "-O") == 0 || strcmp(argv[i], "--optimize") == 0)
+    {
+        optimizeEnabled = true;
+    }
+    else if (strcmp(argv[i], "--compare-dynamic") == 0)
+    {
+        compareDynamic = true;
+    }
+    else if (strcmp(argv[i], "--ilp") == 0)
+    {
+        dataflowEnabled = true;
+    }
+    else if (strcmp(argv[i], "--mtrace") == 0)
+    {
+        memoryTraceEnabled = true;
+    }
+    else if (strcmp(argv[i], "--stats") == 0)
+    {
+        statsEnabled = true;
+    }
+    else if (strcmp(argv[i], "--profile") == 0)
+    {
+        profileEnabled = true;
+    }
+    else if (strcmp(argv[i], "--dump") == 0)
+    {
+        dumpEnabled = true;
+    }
+    else if (strcmp(argv[i], "--io-dir") == 0 && i + 1 < argc)
+    {
+        ioDirectory = argv[++i];
+    }
+    else if (strcmp(argv[i], "--load") == 0 && i + 1 < argc && strchr(argv[i + 1], '@') != NULL &&
+             hostLoadCount < MAX_HOST_LOADS)
+    {
+        hostLoads[hostLoadCount++] = argv[++i];
+    }
+    else if (strcmp(argv[i], "--timing") == 0)
+    {
+        timingEnabled = true;
+    }
+    else if (strcmp(argv[i], "--timing-json") == 0 && i + 1 < argc)
+    {
+        timingEnabled = true;
+        timingJsonPath = argv[++i];
+    }
+    else if (strcmp(argv[i], "--object-format") == 0 && i + 1 < argc &&
+             (strcmp(argv[i + 1], "text") == 0 || strcmp(argv[i + 1], "binary") == 0))
+    {
+        objectBinary = (strcmp(argv[++i], "binary") == 0);
+    }
+    else if (strcmp(argv[i], "--trace-format") == 0 && i + 1 < argc &&
+             (strcmp(argv[i + 1], "text") == 0 || strcmp(argv[i + 1], "binary") == 0))
+    {
+        traceBinary = (strcmp(argv[++i], "binary") == 0);
+    }
+    else
+    {
+        return -1;
+    }
+    return i;
+}
+
+// 옵션끼리 같이 쓸 수 있는지 확인한다. 안 되면 이유를 출력하고 false 를 돌려준다.
+bool validateOptions()
+{
+    // 주기가 상세 구간보다 짧으면 구간이 겹치므로 받지 않는다.
+    if (samplePeriod > 0 && samplePeriod < sampleSteps)
+    {
+        printf("--sample-period must be at least --sample\n");
+        return false;
+    }
+
+    // 하트 수를 확인한다. 체크포인트와 샘플링은 하트 하나일 때만 쓸 수 있다.
+    if (hartCount < 1 || hartCount > MAX_HARTS)
+    {
+        printf("--harts must be between 1 and %d\n", MAX_HARTS);
+        return false;
+    }
+    if (hartCount > 1 && (checkpointInterval > 0 || restorePath != NULL || fastForwardSteps > 0 || sampleSteps > 0))
+    {
+        printf("--harts can't be used with checkpoint or sampling options\n");
+        return false;
+    }
+    if (inputsPath != NULL && (hartCount > 1 || checkpointInterval > 0 || restorePath != NULL || fastForwardSteps > 0 || sampleSteps > 0))
+    {
+        printf("--inputs can't be used with --harts, checkpoint or sampling options\n");
+        return false;
+    }
+    if (dataflowEnabled && (hartCount > 1 || inputsPath != NULL))
+    {
+        printf("--ilp can't be used with --harts or --inputs\n");
+        return false;
+    }
+    if (memoryTraceEnabled && (hartCount > 1 || inputsPath != NULL))
+    {
+        printf("--mtrace can't be used with --harts or --inputs\n");
+        return false;
+    }
+    if (statsEnabled && (hartCount > 1 || inputsPath != NULL))
+    {
+        printf("--stats can't be used with --harts or --inputs\n");
+        return false;
+    }
+    if (profileEnabled && (hartCount > 1 || inputsPath != NULL))
+    {
+        printf("--profile can't be used with --harts or --inputs\n");
+        return false;
+    }
+    if (dumpEnabled && (hartCount > 1 || inputsPath != NULL))
+    {
+        printf("--dump can't be used with --harts or --inputs\n");
+        return false;
+    }
+    return true;
+}
+
+//
+// 데몬 구간!! 시작!! (--daemon)
+//
+// 유닉스 도메인 소켓에서 요청을 받아 처리한다. 명령어 해시표를 만든 뒤에 워커 프로세스를 미리 fork 해두고,
+// 워커들이 같은 소켓에서 각자 accept 해서 요청을 하나씩 처리한다. (전역 상태를 쓰므로 스레드가 아니라 프로세스로 나눈다)
+//
+// 요청은 헤더 한 줄로 시작한다.
+//   file PATH [옵션...]            PATH 를 명령줄에서처럼 처리한다. 결과 파일은 PATH 옆에 생긴다.
+//   source NAME SIZE [옵션...]     헤더 뒤의 SIZE 바이트를 NAME 이라는 소스로 처리하고 생긴 결과 파일 내용을 모두 돌려준다.
+// 옵션은 명령줄 옵션과 같고 요청 하나에만 적용된다.
+// 응답은 명령줄에서 출력하던 내용, 결과 파일마다 "--- 이름 크기" 줄과 내용, "stats: ..." 줄, "end" 줄 순서다.
+
+// 요청마다 되돌려 놓을 옵션들
+typedef struct
+{
+    long long checkpointInterval;
+    long long maxSteps;
+    char *checkpointOption;
+    char *restorePath;
+    int threadCount;
+    long long fastForwardSteps;
+    long long sampleSteps;
+    long long samplePeriod;
+    int hartCount;
+    char *hartEntryOption;
+    char *inputsPath;
+    bool digestOnly;
+    bool optimizeEnabled;
+    bool compareDynamic;
+    bool dataflowEnabled;
+    bool memoryTraceEnabled;
+    bool statsEnabled;
+    bool timingEnabled;
+    char *timingJsonPath;
+    bool objectBinary;
+    bool traceBinary;
+    bool dumpEnabled;
+    bool profileEnabled;
+    int hostLoadCount;
+    char *ioDirectory;
+} DaemonOptions;
+
+volatile sig_atomic_t daemonStopping = 0; // SIGTERM/SIGINT 를 받으면 1이 된다.
+
+void saveOptions(DaemonOptions *options)
+{
+    options->checkpointInterval = checkpointInterval;
+    options->maxSteps = maxSteps;
+    options->checkpointOption = checkpointOption;
+    options->restorePath = restorePath;
+    options->threadCount = threadCount;
+    options->fastForwardSteps = fastForwardSteps;
+    options->sampleSteps = sampleSteps;
+    options->samplePeriod = samplePeriod;
+    options->hartCount = hartCount;
+    options->hartEntryOption = hartEntryOption;
+    options->inputsPath = inputsPath;
+    options->digestOnly = digestOnly;
+    options->optimizeEnabled = optimizeEnabled;
+    options->compareDynamic = compareDynamic;
+    options->dataflowEnabled = dataflowEnabled;
+    options->memoryTraceEnabled = memoryTraceEnabled;
+    options->statsEnabled = statsEnabled;
+    options->timingEnabled = timingEnabled;
+    options->timingJsonPath = timingJsonPath;
+    options->objectBinary = objectBinary;
+    options->traceBinary = traceBinary;
+    options->dumpEnabled = dumpEnabled;
+    options->profileEnabled = profileEnabled;
+    options->hostLoadCount = hostLoadCount;
+    options->ioDirectory = ioDirectory;
+}
+
+void restoreOptions(const DaemonOptions *options)
+{
+    checkpointInterval = options->checkpointInterval;
+    maxSteps = options->maxSteps;
+    checkpointOption = options->checkpointOption;
+    restorePath = options->restorePath;
+    threadCount = options->threadCount;
+    fastForwardSteps = options->fastForwardSteps;
+    sampleSteps = options->sampleSteps;
+    samplePeriod = options->samplePeriod;
+    hartCount = options->hartCount;
+    hartEntryOption = options->hartEntryOption;
+    inputsPath = options->inputsPath;
+    digestOnly = options->digestOnly;
+    optimizeEnabled = options->optimizeEnabled;
+    compareDynamic = options->compareDynamic;
+    dataflowEnabled = options->dataflowEnabled;
+    memoryTraceEnabled = options->memoryTraceEnabled;
+    statsEnabled = options->statsEnabled;
+    timingEnabled = options->timingEnabled;
+    timingJsonPath = options->timingJsonPath;
+    objectBinary = options->objectBinary;
+    traceBinary = options->traceBinary;
+    dumpEnabled = options->dumpEnabled;
+    profileEnabled = options->profileEnabled;
+    hostLoadCount = options->hostLoadCount;
+    ioDirectory = options->ioDirectory;
+}
+
+// 끝까지 다 보낸다. 상대가 끊었으면 false
+bool sendAll(int fd, const void *data, size_t length)
+{
+    const char *cursor = data;
+    while (length > 0)
+    {
+        ssize_t sent = write(fd, cursor, length);
+        if (sent <= 0)
+        {
+            return false;
+        }
+        cursor += sent;
+        length -= (size_t)sent;
+    }
+    return true;
+}
+
+// 결과 파일 하나를 "--- 이름 크기" 줄과 함께 보낸다. 파일이 없으면 보내지 않는다.
+void sendOutputFile(int fd, const char *path, const char *name)
+{
+    int file = open(path, O_RDONLY);
+    if (file < 0)
+    {
+        return;
+    }
+
+    struct stat info;
+    if (fstat(file, &info) == 0)
+    {
+        char header[300];
+        int length = snprintf(header, sizeof(header), "--- %s %lld\n", name, (long long)info.st_size);
+        sendAll(fd, header, (size_t)length);
+
+        char buffer[65536];
+        ssize_t readSize;
+        while ((readSize = read(file, buffer, sizeof(buffer))) > 0)
+        {
+            if (!sendAll(fd, buffer, (size_t)readSize))
+            {
+                break;
+            }
+        }
+    }
+    close(file);
+}
+
+// 요청 헤더 한 줄을 읽는다. 헤더 뒤에 같이 읽힌 바이트 수를 extra 에 넣는다. 줄이 너무 길거나 끊기면 -1
+int readRequestHeader(int fd, char *buffer, int size, int *extra)
+{
+    int received = 0;
+    while (received < size - 1)
+    {
+        ssize_t readSize = read(fd, buffer + received, (size_t)(size - 1 - received));
+        if (readSize <= 0)
+        {
+            return -1;
+        }
+        received += (int)readSize;
+
+        char *newline = memchr(buffer, '\n', (size_t)received);
+        if (newline != NULL)
+        {
+            *newline = '\0';
+            int headerLength = (int)(newline - buffer);
+            *extra = received - headerLength - 1;
+            return headerLength;
+        }
+    }
+    return -1;
+}
+
+// source 요청의 본문을 워커 임시 디렉터리의 파일로 받는다.
+bool receiveSource(int fd, const char *path, const char *already, int alreadyLength, long long size)
+{
+    int file = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (file < 0)
+    {
+        return false;
+    }
+
+    bool ok = true;
+    long long remaining = size;
+    int first = (alreadyLength < remaining) ? alreadyLength : (int)remaining;
+    if (first > 0)
+    {
+        ok = sendAll(file, already, (size_t)first);
+        remaining -= first;
+    }
+
+    char buffer[65536];
+    while (ok && remaining > 0)
+    {
+        ssize_t readSize = read(fd, buffer, (size_t)((remaining < (long long)sizeof(buffer)) ? remaining : (long long)sizeof(buffer)));
+        if (readSize <= 0)
+        {
+            ok = false;
+            break;
+        }
+        ok = sendAll(file, buffer, (size_t)readSize);
+        remaining -= readSize;
     }
+    close(file);
+    return ok;
 }
 
-// 세 번째 패스. 파일을 전체적으로 읽으면서 모든 명령어와 주소를 배열에 넣는다
-void loadInstructions(const char *filename)
+// 요청 하나를 처리한다. 처리하는 동안 stdout 을 연결로 돌려서 명령줄에서와 같은 출력이 그대로 간다.
+void handleRequest(int fd, const char *tempDirectory)
 {
-    FILE *inputFile = fopen(filename, "r");
-
-    // printf("loadInstructions file open success!"); 여기까지는 잘됨
+    char header[4096];
+    int extra = 0;
+    int headerLength = readRequestHeader(fd, header, sizeof(header), &extra);
+    if (headerLength < 0)
+    {
+        return;
+    }
 
-    char line[MAX_LINE_LENGTH];
-    pc = 1000; // PC 초기값
+    // 헤더를 공백으로 나눈다.
+    char *words[64];
+    int wordCount = 0;
+    char *save = NULL;
+    for (char *word = strtok_r(header, " \t\r", &save); word != NULL && wordCount < 64; word = strtok_r(NULL, " \t\r", &save))
+    {
+        words[wordCount++] = word;
+    }
 
-    if (inputFile == NULL)
+    char reply[600];
+    bool isSource = (wordCount >= 3 && strcmp(words[0], "source") == 0);
+    bool isFile = (wordCount >= 2 && strcmp(words[0], "file") == 0);
+    if (!isSource && !isFile)
     {
-        printf("we can't open the file\n");
+        int length = snprintf(reply, sizeof(reply), "error: expected 'file PATH' or 'source NAME SIZE'\nend\n");
+        sendAll(fd, reply, (size_t)length);
         return;
     }
 
-    while (fgets(line, sizeof(line), inputFile) != NULL)
+    // 요청의 옵션을 적용한다. 끝나면 데몬을 시작할 때의 옵션으로 되돌린다.
+    DaemonOptions saved;
+    saveOptions(&saved);
+    int firstOption = isSource ? 3 : 2;
+    for (int i = firstOption; i < wordCount; i++)
     {
-        // 줄 끝의 개행 문자 제거
-        line[strcspn(line, "\n")] = '\0';
+        int next = parseOption(wordCount, words, i);
+        if (next < 0)
+        {
+            int length = snprintf(reply, sizeof(reply), "error: unknown option '%s'\nend\n", words[i]);
+            sendAll(fd, reply, (size_t)length);
+            restoreOptions(&saved);
+            return;
+        }
+        i = next;
+    }
 
-        // 비어있는 줄은 넘어간다.
-        if (strlen(line) == 0)
+    // source 요청은 본문을 임시 디렉터리에 받는다. 이름은 디렉터리 부분을 떼고 쓴다.
+    char sourcePath[400];
+    const char *name = NULL;
+    if (isSource)
+    {
+        name = strrchr(words[1], '/') ? strrchr(words[1], '/') + 1 : words[1];
+        while (*name == '.')
         {
-            continue;
+            name++;
         }
+        long long size = atoll(words[2]);
+        snprintf(sourcePath, sizeof(sourcePath), "%s/%s", tempDirectory, (*name != '\0') ? name : "input.s");
+        if (size < 0 || !receiveSource(fd, sourcePath, header + headerLength + 1, extra, size))
+        {
+            int length = snprintf(reply, sizeof(reply), "error: can't receive source\nend\n");
+            sendAll(fd, reply, (size_t)length);
+            restoreOptions(&saved);
+            return;
+        }
+    }
+    else
+    {
+        snprintf(sourcePath, sizeof(sourcePath), "%s", words[1]);
+    }
 
-        // // 줄 끝의 개행 문자 제거
-        // line[strcspn(line, "\n")] = '\0';
+    // stdout 을 연결로 돌리고 명령줄에서처럼 처리한다.
+    struct timespec started;
+    struct timespec finished;
+    clock_gettime(CLOCK_MONOTONIC, &started);
+    fflush(stdout);
+    int savedStdout = dup(STDOUT_FILENO);
+    dup2(fd, STDOUT_FILENO);
+    if (validateOptions())
+    {
+        runFile(sourcePath);
+    }
+    fflush(stdout);
+    dup2(savedStdout, STDOUT_FILENO);
+    close(savedStdout);
+    clock_gettime(CLOCK_MONOTONIC, &finished);
 
-        // 라벨 확인. 현재 :문자가 있는 위치를 찾는다.
-        char *labelPos = strchr(line, ':');
-        if (labelPos != NULL)
+    // 결과 파일. source 요청은 임시 디렉터리에 생긴 파일을 모두 보내고 지운다.
+    if (isSource)
+    {
+        unlink(sourcePath);
+        struct dirent **entries;
+        int entryCount = scandir(tempDirectory, &entries, NULL, alphasort);
+        for (int i = 0; i < entryCount; i++)
         {
-            *labelPos = '\0'; // ':'를 '\0'로 대체하여 레이블 이름만 추출
-            Label newLabel;
-            strcpy(newLabel.label, line);
-            newLabel.address = pc;
-
-            // 라벨 배열에 추가
-            if (labelCount >= labelCapacity)
+            if (entries[i]->d_name[0] != '.')
             {
-                labelCapacity += 10;
-                labels = realloc(labels, labelCapacity * sizeof(Label));
+                char outputPath[700];
+                snprintf(outputPath, sizeof(outputPath), "%s/%s", tempDirectory, entries[i]->d_name);
+                sendOutputFile(fd, outputPath, entries[i]->d_name);
+                unlink(outputPath);
             }
-            labels[labelCount++] = newLabel;
-
-            // 명령어 부분 추출
-            char *instructionPart = labelPos + 1;
-            while (isspace(*instructionPart))
-                instructionPart++;
-
-            if (*instructionPart == '\0')
+            free(entries[i]);
+        }
+        if (entryCount >= 0)
+        {
+            free(entries);
+        }
+    }
+    // file 요청은 경로만 알려준다. 예전에 만든 파일을 결과로 착각하지 않도록 이번 옵션으로 생기는 파일만 본다.
+    else
+    {
+        const char *extensions[] = {".o", ".trace", ".ilp", ".digest", ".mtrace", ".stats", ".stats.json", ".dump"};
+        bool wanted[] = {true, inputsPath == NULL && hartCount == 1, dataflowEnabled, inputsPath != NULL && digestOnly,
+                         memoryTraceEnabled, statsEnabled, statsEnabled, dumpEnabled};
+        int extensionCount = (int)(sizeof(extensions) / sizeof(extensions[0]));
+        for (int i = 0; i < extensionCount + hartCount; i++)
+        {
+            char extension[32];
+            if (i < extensionCount && !wanted[i])
             {
-                // 명령어가 없으면 다음 줄로 이동
                 continue;
             }
-            else
+            if (i < extensionCount)
             {
-                // 명령어 배열에 추가
-                if (instructionCount >= instructionCapacity)
-                {
-                    instructionCapacity += 100;
-                    instructions = realloc(instructions, instructionCapacity * sizeof(Instruction));
-                }
-
-                strcpy(instructions[instructionCount].line, instructionPart);
-                instructions[instructionCount].address = pc;
-                instructionCount++;
-
-                pc += 4;
+                snprintf(extension, sizeof(extension), "%s", extensions[i]);
             }
-        }
-        else
-        {
-            // 공백 또는 주석 라인 처리
-            char *trimmedLine = line;
-            while (isspace(*trimmedLine))
-                trimmedLine++;
-            if (*trimmedLine == '\0' || *trimmedLine == '#')
+            else if (hartCount > 1)
             {
-                continue;
+                snprintf(extension, sizeof(extension), ".hart%d.trace", i - extensionCount);
             }
-
-            // 명령어 배열에 추가
-            if (instructionCount >= instructionCapacity)
+            else
             {
-                instructionCapacity += 10000;
-                instructions = realloc(instructions, instructionCapacity * sizeof(Instruction));
+                break;
             }
 
-            strcpy(instructions[instructionCount].line, line);
-            instructions[instructionCount].address = pc;
-            instructionCount++;
-
-            pc += 4;
+            char outputPath[400];
+            makeOutputName(sourcePath, extension, outputPath, sizeof(outputPath));
+            if (access(outputPath, F_OK) == 0)
+            {
+                int length = snprintf(reply, sizeof(reply), "file: %s\n", outputPath);
+                sendAll(fd, reply, (size_t)length);
+            }
         }
     }
 
-    fclose(inputFile);
+    double elapsed = (finished.tv_sec - started.tv_sec) * 1000.0 + (finished.tv_nsec - started.tv_nsec) / 1e6;
+    int length = snprintf(reply, sizeof(reply), "stats: steps %lld time %.3f ms pid %d\nend\n", stepCount, elapsed,
+                          (int)getpid());
+    sendAll(fd, reply, (size_t)length);
+    restoreOptions(&saved);
 }
 
-// 트레이스 파일을 만들어 보자. trace에 있는 값을 한줄씩 저장한다.
-void traceFile(const char *filename)
+// 워커 프로세스. 부모가 만들어준 임시 디렉터리를 쓰면서 요청을 계속 받는다.
+void daemonWorker(int listenFd, const char *tempDirectory)
 {
-    FILE *inputFile = fopen(filename, "r");
-    char outputFilename[260];
-
-    // 파일명.trace  파일을 만드는 것
-    snprintf(outputFilename, sizeof(outputFilename), "%s.trace", strtok(strdup(filename), "."));
-    FILE *outputFile = fopen(outputFilename, "w");
-    char line[MAX_LINE_LENGTH];
+    signal(SIGTERM, SIG_DFL);
+    signal(SIGINT, SIG_DFL);
+    signal(SIGPIPE, SIG_IGN); // 클라이언트가 먼저 끊어도 워커는 살아있어야 한다.
 
-    // 파일이 열리지 않을 때는 이렇게 처리한다.
-    if (inputFile == NULL || outputFile == NULL)
+    while (1)
     {
-        printf("we can't open the file\n");
-        return;
+        int fd = accept(listenFd, NULL, NULL);
+        if (fd < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            break;
+        }
+        handleRequest(fd, tempDirectory);
+        close(fd);
     }
+    _exit(0);
+}
 
-    // 일단 파일을 한번 싹 읽고 모든명령어와 라벨의 주소값을 저장한다.!!!
-    loadInstructions(filename);
-
-    // trace에 값을 저장!!
-    executeProgram();
+void handleDaemonSignal(int signalNumber)
+{
+    (void)signalNumber;
+    daemonStopping = 1;
+}
 
-    char *token = strtok(trace, " "); // 공백을 기준으로 첫 번째 토큰 추출
+// 워커 하나를 fork 한다.
+pid_t startDaemonWorker(int listenFd, const char *tempDirectory)
+{
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        daemonWorker(listenFd, tempDirectory);
+    }
+    return pid;
+}
 
-    while (token != NULL)
+// --daemon. 소켓을 열고 워커들을 띄운 뒤, 죽은 워커는 다시 띄우면서 SIGTERM/SIGINT 를 받을 때까지 기다린다.
+int runDaemon(const char *socketPath)
+{
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(socketPath) >= sizeof(address.sun_path))
     {
-        int value;
-        if (sscanf(token, "%d", &value) == 1) // 숫자 변환 확인
-        {
-            fprintf(outputFile, "%d\n", value); // 파일에 숫자 기록
-        }
-        else
-        {
-            // 숫자가 아닌 경우 로그를 출력하거나 무시할 수 있습니다.
-        }
+        printf("socket path is too long\n");
+        return 1;
+    }
+    strcpy(address.sun_path, socketPath);
 
-        // 다음 공백을 기준으로 토큰 추출
-        token = strtok(NULL, " ");
+    int listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(socketPath);
+    if (listenFd < 0 || bind(listenFd, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(listenFd, 1024) != 0)
+    {
+        printf("we can't open the socket %s\n", socketPath);
+        return 1;
     }
-    // 파일에 빈줄이 하나생기는데 그정도는 상관없는지 교수님께 물어보자.
 
-    // Syntax error 가 떴을 때 trace파일 자체를 쓰지 않기 위해서 넣었다.
-    if (fileOpenCheck)
+    int workers = (daemonWorkers > 0) ? daemonWorkers : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (workers < 1)
     {
-        fclose(inputFile);
-        fclose(outputFile);
+        workers = 1;
     }
-    else
+    if (workers > MAX_DAEMON_WORKERS)
     {
-        remove(outputFilename);
-        return;
+        workers = MAX_DAEMON_WORKERS;
     }
-}
 
-//
-// 에러 체크 구간!! 시작!!
-//
-// 괄호에러를 확인하는 함수이다.
-bool check_bracket_balance(char *line)
-{
-    // 괄호 개수 체크를 위한 변수 초기화
-    int bracket_count = 0;
-    for (int i = 0; i < strlen(line); i++)
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handleDaemonSignal; // SA_RESTART 를 주지 않아서 waitpid 가 깨어난다.
+    sigaction(SIGTERM, &action, NULL);
+    sigaction(SIGINT, &action, NULL);
+
+    // 워커마다 임시 디렉터리를 만들어 둔다. 다시 띄운 워커도 같은 디렉터리를 쓰고, 끝날 때 부모가 지운다.
+    fflush(stdout);
+    pid_t children[MAX_DAEMON_WORKERS];
+    char tempDirectories[MAX_DAEMON_WORKERS][32];
+    for (int i = 0; i < workers; i++)
     {
-        if (line[i] == '(')
+        snprintf(tempDirectories[i], sizeof(tempDirectories[i]), "/tmp/rvdaemon-XXXXXX");
+        if (mkdtemp(tempDirectories[i]) == NULL)
         {
-            bracket_count++;
+            printf("we can't make a temporary directory\n");
+            workers = i;
+            break;
         }
-        else if (line[i] == ')')
+        children[i] = startDaemonWorker(listenFd, tempDirectories[i]);
+    }
+    printf("daemon: listening on %s with %d workers\n", socketPath, workers);
+    fflush(stdout);
+
+    while (!daemonStopping)
+    {
+        int status;
+        pid_t pid = waitpid(-1, &status, 0);
+        if (pid < 0 || daemonStopping)
+        {
+            continue;
+        }
+        for (int i = 0; i < workers; i++)
         {
-            bracket_count--;
-            if (bracket_count < 0)
+            if (children[i] == pid)
             {
-                return false; // 닫는 괄호가 여는 괄호보다 먼저 나오는 경우
+                children[i] = startDaemonWorker(listenFd, tempDirectories[i]);
             }
         }
     }
 
-    // 추가: 라인에 괄호가 없거나 잘못된 경우에 대한 체크
-    if (bracket_count != 0)
+    for (int i = 0; i < workers; i++)
     {
-        return false; // 여는 괄호가 남아있는 경우
+        kill(children[i], SIGTERM);
     }
-
-    return true; // 괄호가 균형을 이루는 경우
-}
-
-// 명령어 에러를 확인하는 함수이다.
-bool check_instruction_validity(char *check_instruction_validity_line)
-{
-
-    char instruction_name[MAX_LINE_LENGTH];
-    sscanf(check_instruction_validity_line, "%s", instruction_name);
-
-    // 대소문자는 상관없으니 모든 문자를 소문자로 내린다.
-    for (int i = 0; instruction_name[i]; i++)
+    while (wait(NULL) > 0)
     {
-        instruction_name[i] = tolower(check_instruction_validity_line[i]);
     }
-
-    for (int i = 0; instructionTable[i].instName != NULL; i++)
+    for (int i = 0; i < workers; i++)
     {
-        if (strcmp(instruction_name, instructionTable[i].instName) == 0)
-        {
-            return true; // 유효한 명령어인 경우
-        }
+        rmdir(tempDirectories[i]);
     }
-
-    return false; // 유효하지 않은 명령어인 경우
+    close(listenFd);
+    unlink(socketPath);
+    return 0;
 }
 
-// 에러가 있는지 확인하기 위한 변수.
-bool has_error;
-
-// 에러 체킹 함수
-bool check_file_for_errors(const char *filename)
+int main(int argc, char *argv[])
 {
-    FILE *file = fopen(filename, "r");
-
-    char check_error_line[MAX_LINE_LENGTH];
-    int line_number = 0;
-    has_error = false;
 
-    while (fgets(check_error_line, sizeof(check_error_line), file) != NULL)
-    {
-        line_number++;
+    char filename[256]; // 입력 파일 이름을 저장할 배열
+    int fileArgCount = 0;
 
-        // 줄 끝의 개행 문자 제거
-    check_error_line[strcspn(check_error_line, "\n")] = '\0';
+    // 명령어 이름 해시표를 만든다.
+    initInstructionLookup();
 
-        //비어있으면 건너 뜀.
-        if (strlen(check_error_line) == 0)
+    // 옵션을 읽는다. 옵션이 아닌 인자는 입력 파일 이름으로 본다.
+    for (int i = 1; i < argc; i++)
+    {
+        int next = parseOption(argc, argv, i);
+        if (next >= 0)
         {
-            continue;
+            i = next;
         }
-
-        // 공백 제거 로직을 직접 여기에 포함
-        // 문자열 시작 부분의 공백 제거
-        char *start = check_error_line;
-        while (isspace((unsigned char)*start))
+        else if (strcmp(argv[i], "--daemon") == 0 && i + 1 < argc)
         {
-            start++;
+            daemonPath = argv[++i];
         }
-
-        // 문자열 끝 부분의 공백 제거
-        char *end = start + strlen(start) - 1;
-        while (end > start && isspace((unsigned char)*end))
+        else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc)
         {
-            end--;
+            daemonWorkers = atoi(argv[++i]);
         }
-
-        // 공백이 제거된 문자열의 끝에 널 문자 추가
-        *(end + 1) = '\0';
-
-        // 공백이 제거된 문자열을 check_error_line에 복사
-        strcpy(check_error_line, start);
-
-        // 공백이 제거된 문자열을 소문자로 변환
-        for (int i = 0; check_error_line[i]; i++)
+        else if (strcmp(argv[i], "--pipeline") == 0)
         {
-            check_error_line[i] = tolower((unsigned char)check_error_line[i]);
+            pipelineEnabled = true;
         }
-
-        char line_copy[MAX_LINE_LENGTH];
-        strcpy(line_copy, check_error_line);
-
-        // 라벨 값은 그냥 넘어간다. 하지만 ':' 뒤에 잘못된 내용이 있는지 확인한다.
-        char *colon_pos = strchr(check_error_line, ':');
-        // 라벨 값은 그냥 넘어간다.
-        if (colon_pos != NULL)
+        else if (strcmp(argv[i], "--link") == 0)
         {
-            // ':' 이후에 공백 문자들만 있으면 올바른 라벨로 간주
-            colon_pos++; // ':' 다음 위치로 이동
-            while (*colon_pos != '\0')
-            {
-                if (!isspace((unsigned char)*colon_pos)) // 공백이 아닌 문자가 있다면 에러 처리
-                {
-                    has_error = true;
-                    break;
-                }
-                colon_pos++;
-            }
-
-            // 라벨이 있는 라인은 명령어 처리 없이 건너뜀
-            if (!has_error)
-            {
-                continue;
-            }
+            linkMode = true;
         }
-
-        if (identifyInstructionType(check_error_line) != EXIT_TYPE)
+        else if (strcmp(argv[i], "--watch") == 0)
         {
-            // 쉼표가 두 개 연속으로 나오는지 확인
-            int comma_error = 0;
-            for (int i = 0; check_error_line[i] != '\0'; i++)
-            {
-                if (check_error_line[i] == ',' && (check_error_line[i + 1] == ',' || check_error_line[i + 1] == '\0'))
-                {
-                    comma_error = 1;
-                    break;
-                }
-            }
-
-            if (comma_error)
-            {
-                has_error = true;
-                break;
-            }
-            else
-            {
-
-                // 토큰 개수가 3개인지 확인한다.
-                char *token = strtok(check_error_line, ",()");
-                int token_count = 0;
-                char *tokens[3]; // 최대 3개의 토큰 저장
-                while (token != NULL)
-                {
-                    if (token != NULL) // 빈 문자열이 아닌 경우만 처리
-                    {
-                        if (token_count < 4)
-                        {
-                            tokens[token_count] = token; // 토큰 저장
-                        }
-                        token_count++;
-                    }
-                    token = strtok(NULL, ",()");
-                }
-
-                if (identifyInstructionType(check_error_line) == J_TYPE && token_count != 2)
-                {
-
-                    has_error = true;
-                    break;
-                }
-                else if (identifyInstructionType(check_error_line) != J_TYPE && token_count != 3 && identifyInstructionType(check_error_line) != EXIT_TYPE)
-                {
-                    // printf("error identify instruction type\n");
-                    has_error = true;
-                    break;
-                }
-
-                // 맨 앞 문자열만 가져오기
-                char first_token[MAX_LINE_LENGTH];
-                sscanf(check_error_line, "%s", first_token);
-
-                // I-타입 명령어의 세 번째 토큰이 정수인지 확인
-                if (identifyInstructionType(check_error_line) == I_TYPE && strcmp(first_token, "jalr") != 0 && strcmp(first_token, "lw") != 0)
-                {
-                    char *last_operand = tokens[2]; // 세 번째 토큰
-                    char *endptr;
-                    long immediate = strtol(last_operand, &endptr, 10);
-
-                    if (*endptr != '\0')
-                    {
-                        // 변환되지 않은 문자가 남아있음 -> 정수가 아님
-                        has_error = true;
-                        break;
-                    }
-                }
-            }
+            watchMode = true;
         }
-
-        bool bracket_check = check_bracket_balance(line_copy);
-
-        // 괄호 균형 확인
-        if (bracket_check == false)
+        else if (strcmp(argv[i], "--time-travel") == 0 && i + 1 < argc)
         {
-            has_error = true;
-            break;
+            timeTravelInterval = atoll(argv[++i]);
         }
-
-        bool instruction_check = check_instruction_validity(line_copy);
-        // 명령어 유효성 확인
-        if (instruction_check == false)
+        else if (strcmp(argv[i], "--snapshot-keep") == 0 && i + 1 < argc)
         {
-            has_error = true;
-            break;
+            timeTravelKeep = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--disassemble") == 0)
+        {
+            disassembleMode = true;
+        }
+        else if (strcmp(argv[i], "--round-trip") == 0)
+        {
+            roundTripCheck = true;
+        }
+        else if (strcmp(argv[i], "--help") == 0 || argv[i][0] == '-')
+        {
+            printUsage(argv[0]);
+            return (strcmp(argv[i], "--help") == 0) ? 0 : 1;
+        }
+        else
+        {
+            argv[1 + fileArgCount++] = argv[i]; // 파일 이름은 앞쪽으로 모아둔다.
         }
     }
 
-    fclose(file);
-
-    // 에러가 있는지 없는지를 리턴한다.
-    return has_error;
-}
-
-int main()
-{
+    if (!validateOptions())
+    {
+        return 1;
+    }
 
-    char filename[256]; // 입력 파일 이름을 저장할 배열
-    FILE *inputFile;
+    if (pipelineEnabled && (checkpointInterval > 0 || restorePath != NULL || daemonPath != NULL))
+    {
+        printf("--pipeline can't be used with checkpoint options or --daemon\n");
+        return 1;
+    }
 
-    while (1)
+    if (linkMode && (pipelineEnabled || daemonPath != NULL || disassembleMode || fileArgCount == 0))
     {
-        // 파일을 여러번 읽을 수도 있기 때문에 초기화를 시켜준다. (아직 부족한게 있을 수도)
-        labels = NULL;
-        labelCount = 0;
-        labelCapacity = 0;
-        instructions = NULL;
-        trace = NULL;
-        // trace값을 다시 초기화한다.
-        trace = (char *)calloc(traceSize, sizeof(char));
-        traceSize = 0;
-        pc = 1000;
-        instructionCapacity = 0;
-        instructionCount = 0;
-        register_error = false;
-
-        // register 값을 초기화 한다.
-        for (int i = 0; i < 32; i++)
-        {
-            registers[i] = 0;
-        }
-
-        // register 값을 선언하고 들어간다.
-        registers[1] = 1;
-        registers[2] = 2;
-        registers[3] = 3;
-        registers[4] = 4;
-        registers[5] = 5;
-        registers[6] = 6;
+        printf("--link needs input files and can't be used with --pipeline, --daemon or --disassemble\n");
+        return 1;
+    }
 
-        printf(">>Enter Input File Name: ");
-        scanf("%s", filename);
+    // -O 는 명령어 배열을 고쳐 쓰므로 소스 줄과 명령어가 맞지 않게 된다.
+    if (watchMode && (fileArgCount != 1 || optimizeEnabled || linkMode || pipelineEnabled || daemonPath != NULL ||
+                      disassembleMode || checkpointInterval > 0 || restorePath != NULL))
+    {
+        printf("--watch needs one input file and can't be used with -O, --link, --pipeline, --daemon, --disassemble or checkpoint options\n");
+        return 1;
+    }
 
-        // "terminate"가 입력되면 프로그램 종료
-        if (strcmp(filename, "terminate") == 0)
-        {
-            break;
-        }
+    // 시간 여행은 하트 하나를 상세 모드로 처음부터 끝까지 실행할 때만 기록할 수 있고, 명령어를 표준 입력에서 읽는다.
+    if (timeTravelInterval < 0 || timeTravelKeep < 2)
+    {
+        printf("--time-travel needs a positive interval and --snapshot-keep at least 2\n");
+        return 1;
+    }
+    if (timeTravelInterval > 0 && (hartCount > 1 || inputsPath != NULL || fastForwardSteps > 0 || sampleSteps > 0 ||
+                                   restorePath != NULL || pipelineEnabled || daemonPath != NULL || watchMode))
+    {
+        printf("--time-travel can't be used with --harts, --inputs, --fast-forward, --sample, --restore, --pipeline, --daemon or --watch\n");
+        return 1;
+    }
 
-        // 파일 존재 여부 확인
-        inputFile = fopen(filename, "r");
-        if (inputFile == NULL)
+    // 디스어셈블 모드면 입력 파일들을 .o 로 보고 디스어셈블만 한다.
+    if (disassembleMode)
+    {
+        bool ok = true;
+        for (int i = 0; i < fileArgCount; i++)
         {
-            printf("Input file does not exist!!\n");
-            continue;
+            ok = disassembleFile(argv[1 + i]) && ok;
         }
+        return ok ? 0 : 1;
+    }
 
-        // 파일 닫기
-        fclose(inputFile);
+    // 데몬 모드면 소켓에서 요청을 받는다.
+    if (daemonPath != NULL)
+    {
+        return runDaemon(daemonPath);
+    }
 
-        // 일단 파일을 읽으면서 에러가 있는지 부터 확인한다. (사실상 이게 첫 번째 읽기)
-        bool check = check_file_for_errors(filename);
+    // 선점형 클러스터에서 SIGTERM을 받으면 체크포인트를 남기고 끝낸다.
+    if (checkpointInterval > 0 || maxSteps > 0)
+    {
+        signal(SIGTERM, handleCheckpointSignal);
+    }
 
-        if (check == true)
+    // 파일 이름을 인자로 받았으면 차례대로 처리하고 끝낸다.
+    if (linkMode)
+    {
+        runLinkedFiles(argv + 1, fileArgCount);
+        return 0;
+    }
+    if (watchMode)
+    {
+        return runWatch(argv[1]);
+    }
+    if (fileArgCount > 0 && pipelineEnabled)
+    {
+        runPipeline(argv + 1, fileArgCount);
+        return 0;
+    }
+    if (fileArgCount > 0)
+    {
+        for (int i = 0; i < fileArgCount; i++)
         {
-            printf("Syntax Error!!\n");
-            continue;
+            runFile(argv[1 + i]);
         }
+        return 0;
+    }
 
-        // 첫번째 읽기. 레이블 값을 추출한다.
-        bool first_pass_check = firstPass(filename);
-        if (first_pass_check == true)
+    while (1)
+    {
+        printf(">>Enter Input File Name: ");
+        if (scanf("%255s", filename) != 1)
         {
-            printf("Syntax Error!!\n");
-            continue;
+            break;
         }
 
-        // 두 번째 읽기. 이진수 값을 .o파일에 만든다.
-        check = processFile(filename);
-        if (check == false)
+        // "terminate"가 입력되면 프로그램 종료
+        if (strcmp(filename, "terminate") == 0)
         {
-            printf("Syntax Error!!\n");
-            continue;
+            break;
         }
 
-        // 트레이스 파일을 만들자.
-        traceFile(filename);
-
-        // 파일이 끝났으니까 초기화를 해준다.
-        free(labels);
-        labels = NULL;
-        free(instructions);
-        instructions = NULL;
-        free(trace);
-        trace = NULL;
-
-        freeMemory();
+        runFile(filename);
     }
 
     return 0;
 }
-
@@ -0,0 +1,35 @@
+.data
+shared:
+.word 7
+ready:
+.word 0
+done:
+.word 0
+.text
+first:
+la x5, shared
+la x6, ready
+la x7, done
+lr.w x8, (x5)
+addi x9, x0, 1
+sw x9, 0(x6)
+wait_done:
+lw x9, 0(x7)
+beq x9, x0, wait_done
+sc.w x10, x8, (x5)
+addi x17, x0, 93
+ecall
+second:
+la x5, shared
+la x6, ready
+la x7, done
+wait_ready:
+lw x9, 0(x6)
+beq x9, x0, wait_ready
+addi x9, x0, 8
+sw x9, 0(x5)
+addi x9, x0, 7
+sw x9, 0(x5)
+addi x9, x0, 1
+sw x9, 0(x7)
+exit
@@ -0,0 +1,11 @@
+.extern square
+.data
+result:
+.word 0
+.text
+addi x10, x0, 7
+jal x1, square
+la x11, result
+sw x10, 0(x11)
+addi x17, x0, 93
+ecall
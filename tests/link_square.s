@@ -0,0 +1,11 @@
+.globl square
+.text
+square:
+addi x5, x10, 0
+addi x6, x0, 0
+mul:
+add x6, x6, x10
+addi x5, x5, -1
+bne x5, x0, mul
+addi x10, x6, 0
+jalr x0, 0(x1)
@@ -0,0 +1,3 @@
+.extern missing
+jal x1, missing
+exit
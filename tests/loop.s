@@ -0,0 +1,29 @@
+addi x10, x0, 0
+addi x11, x0, 20
+loop:
+add x10, x10, x1
+sw x10, 0(x12)
+lw x13, 0(x12)
+addi x12, x12, 4
+addi x11, x11, -1
+bne x11, x0, loop
+jal x1, func
+exit
+func:
+slli x14, x10, 3
+srai x15, x14, 2
+sub x16, x0, x15
+sra x17, x16, x2
+srl x18, x16, x2
+xori x19, x17, 255
+andi x20, x19, 15
+ori x21, x20, 1024
+and x22, x21, x19
+or x23, x22, x3
+xor x24, x23, x4
+sll x25, x24, x1
+srli x26, x25, 1
+blt x26, x0, neg
+bge x26, x0, neg
+neg:
+jalr x0, 0(x1)
@@ -0,0 +1,28 @@
+.data
+values:
+.word 3, 5, 7, 11, 13
+total:
+.word 0
+msg:
+.asciz "sum\n"
+.text
+addi x5, x0, 0
+addi x6, x0, 5
+la x7, values
+addi x8, x0, 0
+sum:
+lw x9, 0(x7)
+add x8, x8, x9
+addi x7, x7, 1
+addi x6, x6, -1
+bne x6, x0, sum
+la x7, total
+sw x8, 0(x7)
+addi x10, x0, 1
+la x11, msg
+addi x12, x0, 4
+addi x17, x0, 64
+ecall
+addi x10, x8, 0
+addi x17, x0, 93
+ecall
@@ -0,0 +1,103 @@
+#!/bin/sh
+# 회귀 테스트. 컴파일러와 memdump_tool 을 임시 디렉터리에 빌드하고, 같은 결과가 나와야 하는 두 실행을 비교한다.
+# 사용법: tests/run_tests.sh   (실패한 항목이 있으면 1 로 끝난다)
+#   checkpoint   한 번에 끝까지 실행한 것과 --max-steps 로 멈춘 뒤 --restore 로 이어서 실행한 것
+#   sc-aba       lr.w 와 sc.w 사이에 다른 하트가 값을 A->B->A 로 바꾸면 sc.w 가 실패하는지 (exit code 로 본다)
+#   optimize     .data 레이블과 ecall 이 있는 프로그램을 -O 없이/있이 실행한 출력과 메모리
+#   link         --link 로 링크한 것과 두 파일을 한 파일로 이어 붙여서 어셈블한 것
+#   link-error   링크에 실패하면 .rel 을 남기지 않는지
+#   time-travel  --time-travel 의 goto 로 간 상태와 --max-steps N --dump 로 남긴 상태
+
+TESTS=$(cd "$(dirname "$0")" && pwd)
+ROOT=$(dirname "$TESTS")
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+CC=${CC:-gcc}
+$CC -O2 -pthread -o "$WORK/risc_v_compiler" "$ROOT/risc_v_compiler.c" || exit 1
+$CC -O2 -o "$WORK/memdump_tool" "$ROOT/memdump_tool.c" || exit 1
+RV="$WORK/risc_v_compiler"
+MDT="$WORK/memdump_tool"
+
+failures=0
+
+# 결과를 출력하고 실패 수를 센다.
+report()
+{
+    if [ "$2" -eq 0 ]
+    then
+        echo "ok    $1"
+    else
+        echo "FAIL  $1"
+        failures=$((failures + 1))
+    fi
+}
+
+# 테스트마다 빈 디렉터리에서 실행한다.
+fresh()
+{
+    rm -rf "$WORK/run"
+    mkdir "$WORK/run"
+    cd "$WORK/run" || exit 1
+    for file in "$@"
+    do
+        cp "$TESTS/$file" .
+    done
+}
+
+# 덤프 두 개의 레지스터와 메모리가 같은지 확인한다.
+same_dump()
+{
+    "$MDT" regs "$1" > a.txt && "$MDT" regs "$2" > b.txt && cmp -s a.txt b.txt &&
+        "$MDT" text "$1" > a.txt && "$MDT" text "$2" > b.txt && cmp -s a.txt b.txt
+}
+
+# checkpoint: 50 step 에서 멈추고 이어서 실행해도 trace 와 끝난 상태가 같아야 한다.
+fresh loop.s
+"$RV" --dump loop.s > /dev/null && mv loop.trace full.trace && mv loop.dump full.dump &&
+    "$RV" --max-steps 50 loop.s > /dev/null && [ -f loop.ckpt ] &&
+    "$RV" --restore loop.ckpt --dump loop.s > /dev/null &&
+    cmp -s loop.trace full.trace && same_dump loop.dump full.dump
+report checkpoint $?
+
+# sc-aba: 첫 하트가 lr.w 한 뒤 두 번째 하트가 7->8->7 로 쓰면 sc.w 는 1 을 돌려줘야 한다. (--harts 는 --dump 를 못 쓴다)
+fresh aba.s
+"$RV" --harts 2 --hart-entry first,second aba.s > out.txt && grep -qx 'exit code 1' out.txt
+report sc-aba $?
+
+# optimize: ecall 출력과 메모리가 같아야 한다. (죽은 쓰기를 지우므로 레지스터는 다를 수 있다)
+fresh opt_data.s
+"$RV" --dump opt_data.s | grep -v '^optimizer:' > plain.txt && "$MDT" text opt_data.dump > plain.mem &&
+    "$RV" -O --dump opt_data.s | grep -v '^optimizer:' > optimized.txt && "$MDT" text opt_data.dump > optimized.mem &&
+    grep -q '^sum$' plain.txt && cmp -s plain.txt optimized.txt && cmp -s plain.mem optimized.mem
+report optimize $?
+
+# link: 링크한 .o/trace/덤프가 .globl/.extern 을 빼고 이어 붙인 파일과 같아야 한다.
+fresh link_main.s link_square.s
+grep -hv '^\.\(globl\|extern\)' link_main.s link_square.s > combined.s &&
+    "$RV" --link --dump link_main.s link_square.s > /dev/null && [ -f link_square.rel ] &&
+    "$RV" --dump combined.s > /dev/null &&
+    cmp -s link_main.o combined.o && cmp -s link_main.trace combined.trace && same_dump link_main.dump combined.dump
+report link $?
+
+# link-error: 정의되지 않은 .extern 이 있으면 링크에 실패하고, 만든 .rel 은 모두 지워야 한다.
+fresh link_undefined.s link_square.s
+"$RV" --link link_undefined.s link_square.s > out.txt; grep -q 'Link Error!!' out.txt &&
+    [ ! -e link_undefined.rel ] && [ ! -e link_square.rel ]
+report link-error $?
+
+# time-travel: 앞뒤로 오가며 간 step 의 pc, 레지스터, 메모리가 그 step 에서 멈춘 덤프와 같아야 한다.
+fresh loop.s
+status=0
+for step in 1 97 40 140
+do
+    printf 'goto 140\ngoto %s\nregs\nmem 0 100\nquit\n' "$step" | "$RV" --time-travel 16 loop.s |
+        sed 's/^\(>>time travel: \)*//' > travel.txt &&
+        "$RV" --max-steps "$step" --dump loop.s > /dev/null &&
+        grep -E '^(pc|x[0-9]+):' travel.txt > a.txt && "$MDT" regs loop.dump > b.txt && cmp -s a.txt b.txt &&
+        grep -E '^[0-9]+ -?[0-9]+$' travel.txt > a.txt && "$MDT" read loop.dump 0 100 > b.txt && cmp -s a.txt b.txt ||
+        status=1
+done
+report time-travel $status
+
+[ "$failures" -eq 0 ]
@@ -0,0 +1,468 @@
+#include <stdio.h>    // 표준 입출력 함수를 사용하기 위해 포함.
+#include <string.h>   // memcmp, memchr 를 쓰기 위해 포함.
+#include <stdlib.h>   // 표준 라이브러리 함수를 사용하기 위해 포함.
+#include <stdbool.h>  // boolean형을 쓰기 위해서 부른다.
+#include <stdint.h>   // 이진 trace 의 머리를 읽기 위해 포함.
+#include <fcntl.h>    // open 함수를 쓰기 위해 포함.
+#include <unistd.h>   // close, sysconf 를 쓰기 위해 포함.
+#include <sys/mman.h> // trace 파일을 mmap 으로 읽기 위해 포함.
+#include <sys/stat.h> // 파일 크기를 알아내기 위해 포함.
+#include <pthread.h>  // 큰 trace 를 여러 스레드로 나눠서 비교하기 위해 포함. (컴파일할 때 -pthread 필요)
+
+// .trace 두 개를 비교해서 처음으로 달라지는 step 과 pc, 그 주변을 보여준다.
+// 사용법: trace_diff [--threads N] [--context N] [--tolerance N] a.trace b.trace
+// 끝나는 코드: 0 = 같음 (또는 차이가 허용한 꼬리 안에만 있음), 1 = 다름, 2 = 에러
+//
+// trace 형식은 두 가지이다. (risc_v_compiler 의 --trace-format)
+//   text   : 줄마다 pc 하나 ("%d\n")
+//   binary : 머리("RVTR" + uint32 버전 1 + uint32 레코드 크기 4) 뒤에 pc 마다 4바이트 (리틀 엔디언)
+// 두 파일의 형식이 같으면 바이트를 그대로 비교하면 되므로, 파일을 조각으로 나눠 스레드마다 memcmp 로 비교한다.
+// (glibc 의 memcmp 는 SIMD 로 비교한다) 형식이 다르면 레코드를 하나씩 읽어서 비교한다.
+
+#define COMPARE_CHUNK_SIZE (4 * 1024 * 1024) // 비교 스레드가 한 번에 가져가는 크기
+#define COUNT_CHUNK_MIN_SIZE (1024 * 1024)   // 줄 세기 스레드 하나가 맡는 최소 크기
+#define MAX_THREADS 64                       // 한 번에 쓰는 최대 스레드 수
+#define BINARY_HEADER_SIZE 12
+
+// mmap 으로 연 trace 파일 하나
+typedef struct
+{
+    const char *name;
+    const unsigned char *data;
+    size_t size;
+    size_t start; // 첫 레코드 위치 (이진 형식이면 머리 다음)
+    bool binary;
+} TraceFile;
+
+int threadCount = 0;     // 0 이면 CPU 개수
+long long contextSteps = 5; // 달라진 곳 앞뒤로 보여줄 step 수
+long long tolerance = 0;    // 두 trace 모두 끝에서 이만큼 안쪽에서만 다르면 같은 것으로 본다.
+
+// 파일을 mmap 으로 연다. 실패하면 false
+bool openTrace(const char *name, TraceFile *trace)
+{
+    struct stat info;
+    int fd = open(name, O_RDONLY);
+    if (fd < 0 || fstat(fd, &info) != 0)
+    {
+        printf("we can't open the file %s\n", name);
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        return false;
+    }
+
+    trace->name = name;
+    trace->size = (size_t)info.st_size;
+    trace->data = NULL;
+    if (trace->size > 0)
+    {
+        void *data = mmap(NULL, trace->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED)
+        {
+            printf("we can't open the file %s\n", name);
+            close(fd);
+            return false;
+        }
+        madvise(data, trace->size, MADV_SEQUENTIAL);
+        trace->data = data;
+    }
+    close(fd);
+
+    // 머리가 있으면 이진 형식이다.
+    trace->binary = (trace->size >= BINARY_HEADER_SIZE && memcmp(trace->data, "RVTR", 4) == 0);
+    trace->start = 0;
+    if (trace->binary)
+    {
+        uint32_t header[2];
+        memcpy(header, trace->data + 4, sizeof(header));
+        if (header[0] != 1 || header[1] != 4)
+        {
+            printf("%s: unsupported binary trace version\n", name);
+            return false;
+        }
+        trace->start = BINARY_HEADER_SIZE;
+    }
+    return true;
+}
+
+// offset 에 있는 레코드를 읽고 offset 을 다음 레코드로 옮긴다. 더 없으면 false
+bool readRecord(const TraceFile *trace, size_t *offset, int *pc)
+{
+    if (trace->binary)
+    {
+        if (*offset + 4 > trace->size)
+        {
+            return false;
+        }
+        memcpy(pc, trace->data + *offset, 4);
+        *offset += 4;
+        return true;
+    }
+
+    if (*offset >= trace->size)
+    {
+        return false;
+    }
+    const unsigned char *cursor = trace->data + *offset;
+    const unsigned char *end = trace->data + trace->size;
+    bool negative = (*cursor == '-');
+    long long value = 0;
+    if (negative)
+    {
+        cursor++;
+    }
+    while (cursor < end && *cursor != '\n')
+    {
+        value = value * 10 + (*cursor - '0');
+        cursor++;
+    }
+    *pc = (int)(negative ? -value : value);
+    *offset = (size_t)(cursor - trace->data) + ((cursor < end) ? 1 : 0);
+    return true;
+}
+
+// offset 에서 count 개 앞의 레코드 위치 (처음보다 앞으로는 가지 않는다)
+size_t recordsBack(const TraceFile *trace, size_t offset, long long count)
+{
+    if (trace->binary)
+    {
+        long long available = (long long)(offset - trace->start) / 4;
+        return offset - (size_t)((count < available) ? count : available) * 4;
+    }
+    for (long long i = 0; i < count && offset > 0; i++)
+    {
+        offset--; // 앞 레코드의 줄바꿈
+        while (offset > 0 && trace->data[offset - 1] != '\n')
+        {
+            offset--;
+        }
+    }
+    return offset;
+}
+
+// 비교 스레드들이 같이 쓰는 상태
+typedef struct
+{
+    const unsigned char *a;
+    const unsigned char *b;
+    size_t length;             // 두 파일에서 같이 있는 길이
+    size_t nextChunk;          // 다음에 가져갈 조각 번호 (원자적으로 가져간다)
+    size_t firstDifference;    // 지금까지 찾은 가장 앞의 다른 바이트 위치 (원자적으로 줄인다)
+} CompareJob;
+
+void *compareWorker(void *argument)
+{
+    CompareJob *job = argument;
+    size_t chunkCount = (job->length + COMPARE_CHUNK_SIZE - 1) / COMPARE_CHUNK_SIZE;
+    size_t chunk;
+
+    while ((chunk = __atomic_fetch_add(&job->nextChunk, 1, __ATOMIC_RELAXED)) < chunkCount)
+    {
+        size_t begin = chunk * COMPARE_CHUNK_SIZE;
+        size_t end = (begin + COMPARE_CHUNK_SIZE < job->length) ? begin + COMPARE_CHUNK_SIZE : job->length;
+
+        // 앞쪽 조각에서 이미 다른 곳을 찾았으면 뒤 조각은 볼 필요가 없다.
+        if (begin >= __atomic_load_n(&job->firstDifference, __ATOMIC_RELAXED))
+        {
+            break;
+        }
+        if (memcmp(job->a + begin, job->b + begin, end - begin) == 0)
+        {
+            continue;
+        }
+
+        // 조각 안에서 다른 바이트를 좁혀 찾는다.
+        size_t position = begin;
+        while (end - position > 64 && memcmp(job->a + position, job->b + position, 64) == 0)
+        {
+            position += 64;
+        }
+        while (job->a[position] == job->b[position])
+        {
+            position++;
+        }
+
+        size_t current = __atomic_load_n(&job->firstDifference, __ATOMIC_RELAXED);
+        while (position < current &&
+               !__atomic_compare_exchange_n(&job->firstDifference, &current, position, false, __ATOMIC_RELAXED,
+                                            __ATOMIC_RELAXED))
+        {
+        }
+    }
+    return NULL;
+}
+
+// 줄 세기 스레드 하나가 맡는 구간
+typedef struct
+{
+    const unsigned char *begin;
+    const unsigned char *end;
+    long long lines;
+} CountChunk;
+
+void *countWorker(void *argument)
+{
+    CountChunk *chunk = argument;
+    long long lines = 0;
+    for (const unsigned char *cursor = chunk->begin;
+         (cursor = memchr(cursor, '\n', (size_t)(chunk->end - cursor))) != NULL; cursor++)
+    {
+        lines++;
+    }
+    chunk->lines = lines;
+    return NULL;
+}
+
+int decideThreadCount(size_t work, size_t minWorkPerThread)
+{
+    int count = (threadCount > 0) ? threadCount : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (count > MAX_THREADS)
+    {
+        count = MAX_THREADS;
+    }
+    if (work / minWorkPerThread < (size_t)count)
+    {
+        count = (int)(work / minWorkPerThread);
+    }
+    return (count < 1) ? 1 : count;
+}
+
+// [start, end) 안의 레코드 수. 글 형식은 줄바꿈을 스레드로 나눠서 센다.
+long long countRecords(const TraceFile *trace, size_t start, size_t end)
+{
+    if (trace->binary)
+    {
+        return (long long)(end - start) / 4;
+    }
+
+    size_t size = end - start;
+    int count = decideThreadCount(size, COUNT_CHUNK_MIN_SIZE);
+    pthread_t threads[MAX_THREADS];
+    CountChunk chunks[MAX_THREADS];
+    long long lines = 0;
+    for (int i = 0; i < count; i++)
+    {
+        chunks[i].begin = trace->data + start + size / count * i;
+        chunks[i].end = (i == count - 1) ? trace->data + end : trace->data + start + size / count * (i + 1);
+        pthread_create(&threads[i], NULL, countWorker, &chunks[i]);
+    }
+    for (int i = 0; i < count; i++)
+    {
+        pthread_join(threads[i], NULL);
+        lines += chunks[i].lines;
+    }
+    return lines;
+}
+
+// 전체 레코드 수 (마지막 줄에 줄바꿈이 없어도 한 레코드로 센다)
+long long totalRecords(const TraceFile *trace)
+{
+    long long records = countRecords(trace, trace->start, trace->size);
+    if (!trace->binary && trace->size > 0 && trace->data[trace->size - 1] != '\n')
+    {
+        records++;
+    }
+    return records;
+}
+
+// 형식이 같은 두 trace 를 바이트로 비교한다. 같으면 false, 다르면 처음으로 다른 레코드의 step 과 위치를 넣고 true
+bool findDivergenceSameFormat(const TraceFile *a, const TraceFile *b, long long *step, size_t *offsetA, size_t *offsetB)
+{
+    CompareJob job;
+    job.a = a->data;
+    job.b = b->data;
+    job.length = (a->size < b->size) ? a->size : b->size;
+    job.nextChunk = 0;
+    job.firstDifference = job.length;
+
+    int count = decideThreadCount(job.length, COMPARE_CHUNK_SIZE);
+    pthread_t threads[MAX_THREADS];
+    for (int i = 0; i < count; i++)
+    {
+        pthread_create(&threads[i], NULL, compareWorker, &job);
+    }
+    for (int i = 0; i < count; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+
+    size_t difference = job.firstDifference;
+    if (difference == job.length && a->size == b->size)
+    {
+        return false;
+    }
+
+    // 다른 바이트가 들어있는 레코드의 시작. 그 앞은 두 파일이 똑같으므로 두 파일에서 위치가 같다.
+    size_t recordStart;
+    if (a->binary)
+    {
+        recordStart = a->start + (difference - a->start) / 4 * 4;
+        *step = (long long)(recordStart - a->start) / 4;
+    }
+    else
+    {
+        recordStart = difference;
+        while (recordStart > 0 && a->data[recordStart - 1] != '\n')
+        {
+            recordStart--;
+        }
+        *step = countRecords(a, 0, recordStart);
+    }
+    *offsetA = recordStart;
+    *offsetB = recordStart;
+    return true;
+}
+
+// 형식이 다른 두 trace 를 레코드 하나씩 비교한다.
+bool findDivergenceMixed(const TraceFile *a, const TraceFile *b, long long *step, size_t *offsetA, size_t *offsetB)
+{
+    size_t cursorA = a->start;
+    size_t cursorB = b->start;
+    long long index = 0;
+
+    while (true)
+    {
+        size_t beforeA = cursorA;
+        size_t beforeB = cursorB;
+        int pcA, pcB;
+        bool hasA = readRecord(a, &cursorA, &pcA);
+        bool hasB = readRecord(b, &cursorB, &pcB);
+        if (!hasA && !hasB)
+        {
+            return false;
+        }
+        if (hasA != hasB || pcA != pcB)
+        {
+            *step = index;
+            *offsetA = beforeA;
+            *offsetB = beforeB;
+            return true;
+        }
+        index++;
+    }
+}
+
+// 달라진 step 앞뒤로 두 trace 를 나란히 보여준다.
+void printContext(const TraceFile *a, const TraceFile *b, long long step, size_t offsetA, size_t offsetB)
+{
+    long long back = (step < contextSteps) ? step : contextSteps;
+    size_t cursorA = recordsBack(a, offsetA, back);
+    size_t cursorB = recordsBack(b, offsetB, back);
+
+    printf("%12s  %12s  %12s\n", "step", "a", "b");
+    for (long long i = step - back; i <= step + contextSteps; i++)
+    {
+        int pcA, pcB;
+        bool hasA = readRecord(a, &cursorA, &pcA);
+        bool hasB = readRecord(b, &cursorB, &pcB);
+        if (!hasA && !hasB)
+        {
+            break;
+        }
+
+        char textA[16] = "-";
+        char textB[16] = "-";
+        if (hasA)
+        {
+            snprintf(textA, sizeof(textA), "%d", pcA);
+        }
+        if (hasB)
+        {
+            snprintf(textB, sizeof(textB), "%d", pcB);
+        }
+        printf("%c%11lld  %12s  %12s\n", (i == step) ? '>' : ' ', i, textA, textB);
+    }
+}
+
+void printUsage(const char *program)
+{
+    printf("usage: %s [options] a.trace b.trace\n", program);
+    printf("  --threads N     비교에 쓸 스레드 수 (기본값: CPU 개수)\n");
+    printf("  --context N     달라진 곳 앞뒤로 보여줄 step 수 (기본값: 5)\n");
+    printf("  --tolerance N   두 trace 모두 끝에서 N step 안쪽에서만 다르면 같은 것으로 본다.\n");
+}
+
+int main(int argc, char *argv[])
+{
+    const char *names[2];
+    int nameCount = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+        {
+            threadCount = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--context") == 0 && i + 1 < argc)
+        {
+            contextSteps = atoll(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc)
+        {
+            tolerance = atoll(argv[++i]);
+        }
+        else if (argv[i][0] != '-' && nameCount < 2)
+        {
+            names[nameCount++] = argv[i];
+        }
+        else
+        {
+            printUsage(argv[0]);
+            return 2;
+        }
+    }
+    if (nameCount != 2 || contextSteps < 0 || tolerance < 0)
+    {
+        printUsage(argv[0]);
+        return 2;
+    }
+
+    TraceFile a, b;
+    if (!openTrace(names[0], &a) || !openTrace(names[1], &b))
+    {
+        return 2;
+    }
+
+    long long step;
+    size_t offsetA, offsetB;
+    bool differ = (a.binary == b.binary) ? findDivergenceSameFormat(&a, &b, &step, &offsetA, &offsetB)
+                                         : findDivergenceMixed(&a, &b, &step, &offsetA, &offsetB);
+    if (!differ)
+    {
+        printf("traces identical: %lld steps\n", totalRecords(&a));
+        return 0;
+    }
+
+    // 달라진 곳의 pc (trace 가 먼저 끝났으면 end)
+    size_t cursorA = offsetA;
+    size_t cursorB = offsetB;
+    int pcA, pcB;
+    char textA[16] = "end";
+    char textB[16] = "end";
+    if (readRecord(&a, &cursorA, &pcA))
+    {
+        snprintf(textA, sizeof(textA), "%d", pcA);
+    }
+    if (readRecord(&b, &cursorB, &pcB))
+    {
+        snprintf(textB, sizeof(textB), "%d", pcB);
+    }
+    printf("first divergence at step %lld: %s pc %s, %s pc %s\n", step, a.name, textA, b.name, textB);
+    printContext(&a, &b, step, offsetA, offsetB);
+
+    // 끝부분에서만 다르면 허용한다.
+    if (tolerance > 0)
+    {
+        long long remainingA = totalRecords(&a) - step;
+        long long remainingB = totalRecords(&b) - step;
+        if (remainingA <= tolerance && remainingB <= tolerance)
+        {
+            printf("difference is within the last %lld steps (a: %lld, b: %lld), tolerated\n", tolerance, remainingA,
+                   remainingB);
+            return 0;
+        }
+    }
+    return 1;
+}